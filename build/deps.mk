@@ -0,0 +1,651 @@
+/root/repo/build/Server/KeyLock.o: Server/KeyLock.cpp Server/KeyLock.hpp
+/root/repo/build/Server/Uring.o: Server/Uring.cpp Server/Uring.hpp \
+ Server/IOBackend.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/MemoryPool.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../Common/MyString.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Protocol/../Crypto/CryptoDefinitions.hpp \
+ Server/../Common/Exception.hpp Server/../Common/MyString.hpp
+/root/repo/build/Server/Server.o: Server/Server.cpp Server/Server.hpp \
+ Server/UserDB.hpp Server/../Crypto/CryptoDefinitions.hpp \
+ Server/../Common/BinaryFile.hpp Server/../Common/MyString.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/MemoryPool.hpp \
+ Server/../Common/Exception.hpp Server/../Common/CowBuffer.hpp \
+ Server/../Common/RwLock.hpp Server/../Crypto/Crypto.hpp \
+ Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../Common/MyString.hpp \
+ Server/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Crypto/CryptoDefinitions.hpp Server/MessagePipe.hpp \
+ Server/Mailbox.hpp Server/FailBan.hpp Server/KeyLock.hpp \
+ Server/MessageJournal.hpp Server/../Message/StorageEngine.hpp \
+ Server/../Message/Message.hpp Server/../Message/../Common/CowBuffer.hpp \
+ Server/../Message/../Crypto/CryptoDefinitions.hpp \
+ Server/../Message/../Common/MyString.hpp \
+ Server/../Message/../Common/BinaryFile.hpp Server/ConnectionLimits.hpp \
+ Server/MemoryBudget.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp Server/Worker.hpp \
+ Server/IOBackend.hpp Server/../Common/TimerWheel.hpp \
+ Server/../Common/IniFile.hpp Server/../Common/File.hpp \
+ Server/../Common/../Common/MyString.hpp \
+ Server/../Common/../Common/CowBuffer.hpp \
+ Server/../Common/SignalHandling.hpp Server/../Common/Log.hpp \
+ Server/../Common/UnixTime.hpp Server/../Common/Debug.hpp \
+ Server/../Common/UnixTime.hpp Server/../Message/StorageConverter.hpp
+/root/repo/build/Server/ConnectionLimits.o: Server/ConnectionLimits.cpp \
+ Server/ConnectionLimits.hpp
+/root/repo/build/Server/Mailbox.o: Server/Mailbox.cpp Server/Mailbox.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/MemoryPool.hpp \
+ Server/../Crypto/CryptoDefinitions.hpp Server/../Common/Exception.hpp \
+ Server/../Common/MyString.hpp Server/../Common/CowBuffer.hpp
+/root/repo/build/Server/Worker.o: Server/Worker.cpp Server/Worker.hpp \
+ Server/UserDB.hpp Server/../Crypto/CryptoDefinitions.hpp \
+ Server/../Common/BinaryFile.hpp Server/../Common/MyString.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/MemoryPool.hpp \
+ Server/../Common/Exception.hpp Server/../Common/CowBuffer.hpp \
+ Server/../Common/RwLock.hpp Server/../Crypto/Crypto.hpp \
+ Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../Common/MyString.hpp \
+ Server/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Crypto/CryptoDefinitions.hpp Server/MessagePipe.hpp \
+ Server/Mailbox.hpp Server/FailBan.hpp Server/KeyLock.hpp \
+ Server/MessageJournal.hpp Server/../Message/StorageEngine.hpp \
+ Server/../Message/Message.hpp Server/../Message/../Common/CowBuffer.hpp \
+ Server/../Message/../Crypto/CryptoDefinitions.hpp \
+ Server/../Message/../Common/MyString.hpp \
+ Server/../Message/../Common/BinaryFile.hpp Server/ConnectionLimits.hpp \
+ Server/MemoryBudget.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp Server/IOBackend.hpp \
+ Server/../Common/TimerWheel.hpp Server/../Protocol/ServerSession.hpp \
+ Server/../Protocol/Session.hpp Server/../Protocol/../Server/UserDB.hpp \
+ Server/../Protocol/../Server/MessagePipe.hpp \
+ Server/../Protocol/../Server/FailBan.hpp \
+ Server/../Protocol/../Server/KeyLock.hpp \
+ Server/../Protocol/../Server/MessageJournal.hpp \
+ Server/../Protocol/../Server/ConnectionLimits.hpp \
+ Server/../Protocol/../Message/StorageEngine.hpp \
+ Server/../Protocol/ControlSession.hpp \
+ Server/../Protocol/../Server/MemoryBudget.hpp \
+ Server/../ServerCtl/SocketName.hpp Server/../Common/UnixTime.hpp \
+ Server/../Common/Log.hpp Server/../Common/UnixTime.hpp
+/root/repo/build/Server/ServerMain.o: Server/ServerMain.cpp \
+ Server/Server.hpp Server/UserDB.hpp \
+ Server/../Crypto/CryptoDefinitions.hpp Server/../Common/BinaryFile.hpp \
+ Server/../Common/MyString.hpp Server/../Common/CowBuffer.hpp \
+ Server/../Common/MemoryPool.hpp Server/../Common/Exception.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/RwLock.hpp \
+ Server/../Crypto/Crypto.hpp Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../Common/MyString.hpp \
+ Server/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Crypto/CryptoDefinitions.hpp Server/MessagePipe.hpp \
+ Server/Mailbox.hpp Server/FailBan.hpp Server/KeyLock.hpp \
+ Server/MessageJournal.hpp Server/../Message/StorageEngine.hpp \
+ Server/../Message/Message.hpp Server/../Message/../Common/CowBuffer.hpp \
+ Server/../Message/../Crypto/CryptoDefinitions.hpp \
+ Server/../Message/../Common/MyString.hpp \
+ Server/../Message/../Common/BinaryFile.hpp Server/ConnectionLimits.hpp \
+ Server/MemoryBudget.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp Server/Worker.hpp \
+ Server/IOBackend.hpp Server/../Common/TimerWheel.hpp \
+ Server/../Common/IniFile.hpp Server/../Common/UnixTime.hpp \
+ Server/../Common/File.hpp Server/../Common/../Common/MyString.hpp \
+ Server/../Common/../Common/CowBuffer.hpp Server/../Common/Version.hpp
+/root/repo/build/Server/IOBackend.o: Server/IOBackend.cpp \
+ Server/IOBackend.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/MemoryPool.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../Common/MyString.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Protocol/../Crypto/CryptoDefinitions.hpp Server/Poller.hpp \
+ Server/Uring.hpp Server/../Common/Exception.hpp \
+ Server/../Common/MyString.hpp Server/../Common/Log.hpp \
+ Server/../Common/UnixTime.hpp
+/root/repo/build/Server/MessagePipe.o: Server/MessagePipe.cpp \
+ Server/MessagePipe.hpp Server/Mailbox.hpp Server/../Common/CowBuffer.hpp \
+ Server/../Common/MemoryPool.hpp Server/../Crypto/CryptoDefinitions.hpp \
+ Server/../Common/RwLock.hpp Server/../Crypto/Crypto.hpp \
+ Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../Common/MyString.hpp \
+ Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Crypto/CryptoDefinitions.hpp Server/../Common/Exception.hpp \
+ Server/../Common/MyString.hpp Server/../Message/Message.hpp \
+ Server/../Message/../Common/CowBuffer.hpp \
+ Server/../Message/../Crypto/CryptoDefinitions.hpp \
+ Server/../ThirdParty/monocypher.h
+/root/repo/build/Server/FailBan.o: Server/FailBan.cpp Server/FailBan.hpp \
+ Server/../Common/BinaryFile.hpp Server/../Common/MyString.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/MemoryPool.hpp \
+ Server/../Common/Exception.hpp Server/../Common/CowBuffer.hpp \
+ Server/../Common/RwLock.hpp Server/../Common/Log.hpp \
+ Server/../Common/UnixTime.hpp Server/../Common/Debug.hpp
+/root/repo/build/Server/MemoryBudget.o: Server/MemoryBudget.cpp \
+ Server/MemoryBudget.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/MemoryPool.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../Common/MyString.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Protocol/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/Server/Poller.o: Server/Poller.cpp Server/Poller.hpp \
+ Server/IOBackend.hpp Server/../Protocol/Session.hpp \
+ Server/../Protocol/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Common/MemoryPool.hpp \
+ Server/../Protocol/../Common/TimerWheel.hpp \
+ Server/../Protocol/../Crypto/Crypto.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../Common/MyString.hpp \
+ Server/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Protocol/../Crypto/CryptoDefinitions.hpp \
+ Server/../Common/Exception.hpp Server/../Common/MyString.hpp
+/root/repo/build/Server/MessageJournal.o: Server/MessageJournal.cpp \
+ Server/MessageJournal.hpp Server/MessagePipe.hpp Server/Mailbox.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/MemoryPool.hpp \
+ Server/../Crypto/CryptoDefinitions.hpp Server/../Common/RwLock.hpp \
+ Server/../Crypto/Crypto.hpp Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../Common/MyString.hpp \
+ Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Crypto/CryptoDefinitions.hpp Server/KeyLock.hpp \
+ Server/../Message/StorageEngine.hpp Server/../Message/Message.hpp \
+ Server/../Message/../Common/CowBuffer.hpp \
+ Server/../Message/../Crypto/CryptoDefinitions.hpp \
+ Server/../Message/../Common/MyString.hpp \
+ Server/../Message/../Common/BinaryFile.hpp \
+ Server/../Message/../Common/MyString.hpp \
+ Server/../Message/../Common/CowBuffer.hpp \
+ Server/../Message/../Common/Exception.hpp \
+ Server/../Common/BinaryFile.hpp Server/../Message/MessageStorage.hpp \
+ Server/../Message/StorageEngine.hpp Server/../Message/Message.hpp \
+ Server/../Common/UnixTime.hpp Server/../Common/Log.hpp \
+ Server/../Common/MyString.hpp Server/../Common/UnixTime.hpp
+/root/repo/build/Server/UserDB.o: Server/UserDB.cpp Server/UserDB.hpp \
+ Server/../Crypto/CryptoDefinitions.hpp Server/../Common/BinaryFile.hpp \
+ Server/../Common/MyString.hpp Server/../Common/CowBuffer.hpp \
+ Server/../Common/MemoryPool.hpp Server/../Common/Exception.hpp \
+ Server/../Common/CowBuffer.hpp Server/../Common/RwLock.hpp \
+ Server/../Crypto/Crypto.hpp Server/../Crypto/../Common/CowBuffer.hpp \
+ Server/../Crypto/../Common/MyString.hpp \
+ Server/../Crypto/../ThirdParty/monocypher.h \
+ Server/../Crypto/CryptoDefinitions.hpp Server/../ThirdParty/monocypher.h \
+ Server/../Common/Debug.hpp
+/root/repo/build/Protocol/Session.o: Protocol/Session.cpp \
+ Protocol/Session.hpp Protocol/../Common/CowBuffer.hpp \
+ Protocol/../Common/MemoryPool.hpp Protocol/../Common/TimerWheel.hpp \
+ Protocol/../Crypto/Crypto.hpp Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../Common/MyString.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Protocol/../Crypto/CryptoDefinitions.hpp \
+ Protocol/../Common/Exception.hpp Protocol/../Common/MyString.hpp
+/root/repo/build/Protocol/Handshake.o: Protocol/Handshake.cpp \
+ Protocol/Handshake.hpp Protocol/../Common/CowBuffer.hpp \
+ Protocol/../Common/MemoryPool.hpp Protocol/Session.hpp \
+ Protocol/../Common/TimerWheel.hpp Protocol/../Crypto/Crypto.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../Common/MyString.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Protocol/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/Protocol/ActiveSession.o: Protocol/ActiveSession.cpp \
+ Protocol/ActiveSession.hpp Protocol/../Common/CowBuffer.hpp \
+ Protocol/../Common/MemoryPool.hpp Protocol/../Common/MyString.hpp \
+ Protocol/../Common/CowBuffer.hpp Protocol/../Message/Message.hpp \
+ Protocol/../Message/../Common/CowBuffer.hpp \
+ Protocol/../Message/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/Protocol/ControlSession.o: Protocol/ControlSession.cpp \
+ Protocol/ControlSession.hpp Protocol/Session.hpp \
+ Protocol/../Common/CowBuffer.hpp Protocol/../Common/MemoryPool.hpp \
+ Protocol/../Common/TimerWheel.hpp Protocol/../Crypto/Crypto.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../Common/MyString.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Protocol/../Crypto/CryptoDefinitions.hpp Protocol/../Server/UserDB.hpp \
+ Protocol/../Server/../Crypto/CryptoDefinitions.hpp \
+ Protocol/../Server/../Common/BinaryFile.hpp \
+ Protocol/../Server/../Common/MyString.hpp \
+ Protocol/../Server/../Common/CowBuffer.hpp \
+ Protocol/../Server/../Common/Exception.hpp \
+ Protocol/../Server/../Common/CowBuffer.hpp \
+ Protocol/../Server/../Common/RwLock.hpp \
+ Protocol/../Server/../Crypto/Crypto.hpp Protocol/../Server/FailBan.hpp \
+ Protocol/../Server/MemoryBudget.hpp \
+ Protocol/../Server/../Protocol/Session.hpp \
+ Protocol/../ServerCtl/SocketName.hpp Protocol/../Common/UnixTime.hpp \
+ Protocol/../Common/Hex.hpp Protocol/../Common/MyString.hpp \
+ Protocol/../Common/Exception.hpp Protocol/../Common/Log.hpp \
+ Protocol/../Common/UnixTime.hpp
+/root/repo/build/Protocol/ServerSession.o: Protocol/ServerSession.cpp \
+ Protocol/ServerSession.hpp Protocol/Session.hpp \
+ Protocol/../Common/CowBuffer.hpp Protocol/../Common/MemoryPool.hpp \
+ Protocol/../Common/TimerWheel.hpp Protocol/../Crypto/Crypto.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../Common/MyString.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Protocol/../Crypto/CryptoDefinitions.hpp Protocol/../Server/UserDB.hpp \
+ Protocol/../Server/../Crypto/CryptoDefinitions.hpp \
+ Protocol/../Server/../Common/BinaryFile.hpp \
+ Protocol/../Server/../Common/MyString.hpp \
+ Protocol/../Server/../Common/CowBuffer.hpp \
+ Protocol/../Server/../Common/Exception.hpp \
+ Protocol/../Server/../Common/CowBuffer.hpp \
+ Protocol/../Server/../Common/RwLock.hpp \
+ Protocol/../Server/../Crypto/Crypto.hpp \
+ Protocol/../Server/MessagePipe.hpp Protocol/../Server/Mailbox.hpp \
+ Protocol/../Server/FailBan.hpp Protocol/../Server/KeyLock.hpp \
+ Protocol/../Server/MessageJournal.hpp Protocol/../Server/MessagePipe.hpp \
+ Protocol/../Server/KeyLock.hpp \
+ Protocol/../Server/../Message/StorageEngine.hpp \
+ Protocol/../Server/../Message/Message.hpp \
+ Protocol/../Server/../Message/../Common/CowBuffer.hpp \
+ Protocol/../Server/../Message/../Crypto/CryptoDefinitions.hpp \
+ Protocol/../Server/../Message/../Common/MyString.hpp \
+ Protocol/../Server/../Message/../Common/BinaryFile.hpp \
+ Protocol/../Server/ConnectionLimits.hpp \
+ Protocol/../Message/StorageEngine.hpp Protocol/ActiveSession.hpp \
+ Protocol/../Common/MyString.hpp Protocol/Handshake.hpp \
+ Protocol/../Common/UnixTime.hpp Protocol/../Message/MessageStorage.hpp \
+ Protocol/../Message/StorageEngine.hpp Protocol/../Message/Message.hpp \
+ Protocol/../Common/Debug.hpp
+/root/repo/build/Protocol/ClientSession.o: Protocol/ClientSession.cpp \
+ Protocol/ClientSession.hpp Protocol/Session.hpp \
+ Protocol/../Common/CowBuffer.hpp Protocol/../Common/MemoryPool.hpp \
+ Protocol/../Common/TimerWheel.hpp Protocol/../Crypto/Crypto.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../Common/MyString.hpp \
+ Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Protocol/../Crypto/CryptoDefinitions.hpp Protocol/ActiveSession.hpp \
+ Protocol/../Common/MyString.hpp Protocol/Handshake.hpp \
+ Protocol/../Message/Message.hpp \
+ Protocol/../Message/../Common/CowBuffer.hpp \
+ Protocol/../Message/../Crypto/CryptoDefinitions.hpp \
+ Protocol/../Common/UnixTime.hpp Protocol/../Common/Exception.hpp \
+ Protocol/../Common/MyString.hpp
+/root/repo/build/Client/Client.o: Client/Client.cpp Client/Client.hpp \
+ Client/UI.hpp Client/Screen.hpp Client/../Protocol/ClientSession.hpp \
+ Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/MemoryPool.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp Client/VoiceChat.hpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Audio/Audio.hpp \
+ Client/../Audio/../Common/CowBuffer.hpp Client/../Crypto/Crypto.hpp \
+ Client/../Common/Exception.hpp Client/../Common/UnixTime.hpp \
+ Client/../Common/SignalHandling.hpp
+/root/repo/build/Client/AttachmentScreen.o: Client/AttachmentScreen.cpp \
+ Client/AttachmentScreen.hpp Client/Screen.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/MemoryPool.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp Client/Chat.hpp \
+ Client/NotificationSystem.hpp Client/ControlStorage.hpp \
+ Client/../Common/IniFile.hpp Client/../Common/MyString.hpp \
+ Client/../Common/MyString.hpp Client/../Message/MessageStorage.hpp \
+ Client/../Message/StorageEngine.hpp Client/../Message/Message.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/BinaryFile.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Common/Exception.hpp \
+ Client/../Message/AttributeStorage.hpp
+/root/repo/build/Client/ClientMain.o: Client/ClientMain.cpp \
+ Client/Client.hpp Client/UI.hpp Client/Screen.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/MemoryPool.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp Client/VoiceChat.hpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Audio/Audio.hpp \
+ Client/../Audio/../Common/CowBuffer.hpp Client/../Crypto/Crypto.hpp \
+ Client/../Common/Exception.hpp Client/../Common/Version.hpp
+/root/repo/build/Client/ControlStorage.o: Client/ControlStorage.cpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Common/CowBuffer.hpp \
+ Client/../Common/MemoryPool.hpp Client/../Common/File.hpp \
+ Client/../Common/../Common/MyString.hpp \
+ Client/../Common/../Common/CowBuffer.hpp Client/../Common/Hex.hpp \
+ Client/../Common/Exception.hpp Client/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/Client/ChatList.o: Client/ChatList.cpp \
+ Client/ChatList.hpp Client/Chat.hpp Client/NotificationSystem.hpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Common/CowBuffer.hpp \
+ Client/../Common/MemoryPool.hpp Client/../Common/MyString.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/MessageStorage.hpp Client/../Message/StorageEngine.hpp \
+ Client/../Message/Message.hpp Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/BinaryFile.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Common/Exception.hpp \
+ Client/../Message/AttributeStorage.hpp \
+ Client/../Message/ContactStorage.hpp Client/TextColor.hpp \
+ Client/../Common/Hex.hpp Client/../Common/Exception.hpp \
+ Client/../Message/Message.hpp
+/root/repo/build/Client/NotificationSystem.o: \
+ Client/NotificationSystem.cpp Client/NotificationSystem.hpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Common/CowBuffer.hpp \
+ Client/../Common/MemoryPool.hpp Client/../Common/MyString.hpp \
+ Client/TextColor.hpp
+/root/repo/build/Client/UI.o: Client/UI.cpp Client/UI.hpp \
+ Client/Screen.hpp Client/../Protocol/ClientSession.hpp \
+ Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/MemoryPool.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp Client/VoiceChat.hpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Audio/Audio.hpp \
+ Client/../Audio/../Common/CowBuffer.hpp Client/../Crypto/Crypto.hpp \
+ Client/TextColor.hpp Client/PasswordScreen.hpp
+/root/repo/build/Client/WorkScreen.o: Client/WorkScreen.cpp \
+ Client/WorkScreen.hpp Client/VoiceChat.hpp Client/ControlStorage.hpp \
+ Client/../Common/IniFile.hpp Client/../Common/MyString.hpp \
+ Client/../Common/CowBuffer.hpp Client/../Common/MemoryPool.hpp \
+ Client/../Audio/Audio.hpp Client/../Audio/../Common/CowBuffer.hpp \
+ Client/../Crypto/Crypto.hpp Client/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Crypto/../Common/MyString.hpp \
+ Client/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Crypto/CryptoDefinitions.hpp Client/NotificationSystem.hpp \
+ Client/../Common/MyString.hpp Client/ChatList.hpp Client/Chat.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Message/MessageStorage.hpp Client/../Message/StorageEngine.hpp \
+ Client/../Message/Message.hpp Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/BinaryFile.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Common/Exception.hpp \
+ Client/../Message/AttributeStorage.hpp \
+ Client/../Message/ContactStorage.hpp Client/Screen.hpp \
+ Client/LoginScreen.hpp Client/AttachmentScreen.hpp Client/TextColor.hpp \
+ Client/../Protocol/ActiveSession.hpp \
+ Client/../Protocol/../Common/MyString.hpp Client/../Common/UnixTime.hpp \
+ Client/../Common/Hex.hpp Client/../Common/Exception.hpp \
+ Client/../Common/File.hpp Client/../Common/../Common/MyString.hpp \
+ Client/../Common/../Common/CowBuffer.hpp
+/root/repo/build/Client/VoiceChat.o: Client/VoiceChat.cpp \
+ Client/VoiceChat.hpp Client/ControlStorage.hpp \
+ Client/../Common/IniFile.hpp Client/../Common/MyString.hpp \
+ Client/../Common/CowBuffer.hpp Client/../Common/MemoryPool.hpp \
+ Client/../Audio/Audio.hpp Client/../Audio/../Common/CowBuffer.hpp \
+ Client/../Crypto/Crypto.hpp Client/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Crypto/../Common/MyString.hpp \
+ Client/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Crypto/CryptoDefinitions.hpp Client/../Common/Hex.hpp \
+ Client/../Common/Exception.hpp Client/TextColor.hpp
+/root/repo/build/Client/Chat.o: Client/Chat.cpp Client/Chat.hpp \
+ Client/NotificationSystem.hpp Client/ControlStorage.hpp \
+ Client/../Common/IniFile.hpp Client/../Common/MyString.hpp \
+ Client/../Common/CowBuffer.hpp Client/../Common/MemoryPool.hpp \
+ Client/../Common/MyString.hpp Client/../Protocol/ClientSession.hpp \
+ Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/MessageStorage.hpp Client/../Message/StorageEngine.hpp \
+ Client/../Message/Message.hpp Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/BinaryFile.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Common/Exception.hpp \
+ Client/../Message/AttributeStorage.hpp Client/TextColor.hpp \
+ Client/../Common/UnixTime.hpp Client/../Common/Exception.hpp \
+ Client/../Message/Message.hpp
+/root/repo/build/Client/Screen.o: Client/Screen.cpp Client/Screen.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/MemoryPool.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/Client/PasswordScreen.o: Client/PasswordScreen.cpp \
+ Client/PasswordScreen.hpp Client/VoiceChat.hpp Client/ControlStorage.hpp \
+ Client/../Common/IniFile.hpp Client/../Common/MyString.hpp \
+ Client/../Common/CowBuffer.hpp Client/../Common/MemoryPool.hpp \
+ Client/../Audio/Audio.hpp Client/../Audio/../Common/CowBuffer.hpp \
+ Client/../Crypto/Crypto.hpp Client/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Crypto/../Common/MyString.hpp \
+ Client/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Crypto/CryptoDefinitions.hpp Client/Screen.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp Client/WorkScreen.hpp \
+ Client/NotificationSystem.hpp Client/../Common/MyString.hpp \
+ Client/ChatList.hpp Client/Chat.hpp Client/../Message/MessageStorage.hpp \
+ Client/../Message/StorageEngine.hpp Client/../Message/Message.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Crypto/CryptoDefinitions.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/BinaryFile.hpp \
+ Client/../Message/../Common/MyString.hpp \
+ Client/../Message/../Common/CowBuffer.hpp \
+ Client/../Message/../Common/Exception.hpp \
+ Client/../Message/AttributeStorage.hpp \
+ Client/../Message/ContactStorage.hpp
+/root/repo/build/Client/LoginScreen.o: Client/LoginScreen.cpp \
+ Client/LoginScreen.hpp Client/Screen.hpp \
+ Client/../Protocol/ClientSession.hpp Client/../Protocol/Session.hpp \
+ Client/../Protocol/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Common/MemoryPool.hpp \
+ Client/../Protocol/../Common/TimerWheel.hpp \
+ Client/../Protocol/../Crypto/Crypto.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../Common/MyString.hpp \
+ Client/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ Client/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ Client/../Protocol/../Crypto/CryptoDefinitions.hpp \
+ Client/ControlStorage.hpp Client/../Common/IniFile.hpp \
+ Client/../Common/MyString.hpp Client/../Common/Hex.hpp \
+ Client/../Common/Exception.hpp
+/root/repo/build/Message/ContactStorage.o: Message/ContactStorage.cpp \
+ Message/ContactStorage.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/Hex.hpp \
+ Message/../Common/MyString.hpp Message/../Common/Exception.hpp \
+ Message/../Common/BinaryFile.hpp Message/../Common/File.hpp \
+ Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp \
+ Message/../ThirdParty/monocypher.h
+/root/repo/build/Message/MessageStorage.o: Message/MessageStorage.cpp \
+ Message/MessageStorage.hpp Message/StorageEngine.hpp Message/Message.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/BinaryFile.hpp \
+ Message/../Common/MyString.hpp Message/../Common/Exception.hpp \
+ Message/MessageStorageIndex.hpp Message/../Common/Hex.hpp \
+ Message/../Common/File.hpp Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp \
+ Message/../ThirdParty/monocypher.h
+/root/repo/build/Message/AttributeStorage.o: Message/AttributeStorage.cpp \
+ Message/AttributeStorage.hpp Message/../Common/CowBuffer.hpp \
+ Message/../Common/MemoryPool.hpp Message/Message.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/Hex.hpp \
+ Message/../Common/MyString.hpp Message/../Common/CowBuffer.hpp \
+ Message/../Common/Exception.hpp Message/../Common/BinaryFile.hpp \
+ Message/../Common/File.hpp Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp Message/../Common/UnixTime.hpp \
+ Message/../ThirdParty/monocypher.h
+/root/repo/build/Message/StorageConverter.o: Message/StorageConverter.cpp \
+ Message/StorageConverter.hpp Message/FileStorageEngine.hpp \
+ Message/StorageEngine.hpp Message/Message.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/BinaryFile.hpp \
+ Message/../Common/MyString.hpp Message/../Common/Exception.hpp \
+ Message/SegmentStorageEngine.hpp Message/../Common/Hex.hpp \
+ Message/../Common/File.hpp Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp
+/root/repo/build/Message/FileStorageEngine.o: \
+ Message/FileStorageEngine.cpp Message/FileStorageEngine.hpp \
+ Message/StorageEngine.hpp Message/Message.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/BinaryFile.hpp \
+ Message/../Common/MyString.hpp Message/../Common/Exception.hpp \
+ Message/MessageStorageIndex.hpp Message/../Common/UnixTime.hpp \
+ Message/../Common/File.hpp Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp Message/../Common/Hex.hpp
+/root/repo/build/Message/Message.o: Message/Message.cpp \
+ Message/Message.hpp Message/../Common/CowBuffer.hpp \
+ Message/../Common/MemoryPool.hpp Message/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/Message/MessageStorageIndex.o: \
+ Message/MessageStorageIndex.cpp Message/MessageStorageIndex.hpp \
+ Message/../Common/BinaryFile.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Common/Exception.hpp Message/../Common/File.hpp \
+ Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp
+/root/repo/build/Message/StorageEngine.o: Message/StorageEngine.cpp \
+ Message/StorageEngine.hpp Message/Message.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/BinaryFile.hpp \
+ Message/../Common/MyString.hpp Message/../Common/Exception.hpp \
+ Message/FileStorageEngine.hpp Message/SegmentStorageEngine.hpp \
+ Message/MessageStorageIndex.hpp Message/../Common/File.hpp \
+ Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp \
+ Message/../ThirdParty/monocypher.h
+/root/repo/build/Message/SegmentStorageEngine.o: \
+ Message/SegmentStorageEngine.cpp Message/SegmentStorageEngine.hpp \
+ Message/StorageEngine.hpp Message/Message.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/MemoryPool.hpp \
+ Message/../Crypto/CryptoDefinitions.hpp Message/../Common/MyString.hpp \
+ Message/../Common/CowBuffer.hpp Message/../Common/BinaryFile.hpp \
+ Message/../Common/MyString.hpp Message/../Common/Exception.hpp \
+ Message/MessageStorageIndex.hpp Message/../Common/File.hpp \
+ Message/../Common/../Common/MyString.hpp \
+ Message/../Common/../Common/CowBuffer.hpp
+/root/repo/build/Audio/Audio.o: Audio/Audio.cpp Audio/Audio.hpp \
+ Audio/../Common/CowBuffer.hpp Audio/../Common/MemoryPool.hpp \
+ Audio/../Common/Exception.hpp Audio/../Common/MyString.hpp \
+ Audio/../Common/CowBuffer.hpp
+/root/repo/build/ServerCtl/ResponseProcessor.o: \
+ ServerCtl/ResponseProcessor.cpp ServerCtl/ResponseProcessor.hpp \
+ ServerCtl/../Common/CowBuffer.hpp ServerCtl/../Common/MemoryPool.hpp \
+ ServerCtl/SocketName.hpp ServerCtl/../Common/MyString.hpp \
+ ServerCtl/../Common/CowBuffer.hpp ServerCtl/../Common/Hex.hpp \
+ ServerCtl/../Common/MyString.hpp ServerCtl/../Common/Exception.hpp \
+ ServerCtl/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/ServerCtl/RequestBuilder.o: ServerCtl/RequestBuilder.cpp \
+ ServerCtl/RequestBuilder.hpp ServerCtl/../Common/CowBuffer.hpp \
+ ServerCtl/../Common/MemoryPool.hpp ServerCtl/SocketName.hpp \
+ ServerCtl/../Common/Exception.hpp ServerCtl/../Common/MyString.hpp \
+ ServerCtl/../Common/CowBuffer.hpp ServerCtl/../Common/Hex.hpp \
+ ServerCtl/../Common/Exception.hpp \
+ ServerCtl/../Crypto/CryptoDefinitions.hpp
+/root/repo/build/ServerCtl/ServerCtlMain.o: ServerCtl/ServerCtlMain.cpp \
+ ServerCtl/SocketName.hpp ServerCtl/RequestBuilder.hpp \
+ ServerCtl/../Common/CowBuffer.hpp ServerCtl/../Common/MemoryPool.hpp \
+ ServerCtl/ResponseProcessor.hpp ServerCtl/../Protocol/Session.hpp \
+ ServerCtl/../Protocol/../Common/CowBuffer.hpp \
+ ServerCtl/../Protocol/../Common/TimerWheel.hpp \
+ ServerCtl/../Protocol/../Crypto/Crypto.hpp \
+ ServerCtl/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ ServerCtl/../Protocol/../Crypto/../Common/MyString.hpp \
+ ServerCtl/../Protocol/../Crypto/../Common/CowBuffer.hpp \
+ ServerCtl/../Protocol/../Crypto/../ThirdParty/monocypher.h \
+ ServerCtl/../Protocol/../Crypto/CryptoDefinitions.hpp \
+ ServerCtl/../Common/Version.hpp ServerCtl/../Common/Exception.hpp \
+ ServerCtl/../Common/MyString.hpp
+/root/repo/build/Common/MyString.o: Common/MyString.cpp \
+ Common/MyString.hpp Common/CowBuffer.hpp Common/MemoryPool.hpp
+/root/repo/build/Common/File.o: Common/File.cpp Common/File.hpp \
+ Common/../Common/MyString.hpp Common/../Common/CowBuffer.hpp \
+ Common/../Common/MemoryPool.hpp Common/../Common/CowBuffer.hpp \
+ Common/../Common/Exception.hpp Common/../Common/MyString.hpp
+/root/repo/build/Common/BinaryFile.o: Common/BinaryFile.cpp \
+ Common/BinaryFile.hpp Common/MyString.hpp Common/CowBuffer.hpp \
+ Common/MemoryPool.hpp Common/Exception.hpp
+/root/repo/build/Common/Version.o: Common/Version.cpp Common/Version.hpp \
+ Common/../Version.hpp
+/root/repo/build/Common/TimerWheel.o: Common/TimerWheel.cpp \
+ Common/TimerWheel.hpp
+/root/repo/build/Common/IniFile.o: Common/IniFile.cpp Common/IniFile.hpp \
+ Common/MyString.hpp Common/CowBuffer.hpp Common/MemoryPool.hpp \
+ Common/Exception.hpp
+/root/repo/build/Common/MemoryPool.o: Common/MemoryPool.cpp \
+ Common/MemoryPool.hpp
+/root/repo/build/Common/UnixTime.o: Common/UnixTime.cpp \
+ Common/UnixTime.hpp Common/Exception.hpp Common/MyString.hpp \
+ Common/CowBuffer.hpp Common/MemoryPool.hpp
+/root/repo/build/Common/SignalHandling.o: Common/SignalHandling.cpp \
+ Common/SignalHandling.hpp Common/Exception.hpp Common/MyString.hpp \
+ Common/CowBuffer.hpp Common/MemoryPool.hpp
+/root/repo/build/Crypto/Crypto.o: Crypto/Crypto.cpp Crypto/Crypto.hpp \
+ Crypto/../Common/CowBuffer.hpp Crypto/../Common/MemoryPool.hpp \
+ Crypto/../Common/MyString.hpp Crypto/../Common/CowBuffer.hpp \
+ Crypto/../ThirdParty/monocypher.h Crypto/CryptoDefinitions.hpp \
+ Crypto/../Common/UnixTime.hpp Crypto/../Common/Exception.hpp \
+ Crypto/../Common/MyString.hpp
@@ -5,6 +5,7 @@
 
 #include "TextColor.hpp"
 #include "../Common/UnixTime.hpp"
+#include "../Common/Exception.hpp"
 #include "../Message/Message.hpp"
 
 static bool IsSpace(char c)
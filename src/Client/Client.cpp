@@ -84,12 +84,17 @@ int Client::Run()
 				endSession = !_session.Write();
 			}
 
-			if (!endSession && (fds[2].revents & POLLIN)) {
+			// Received data can hold several messages.
+			bool input = fds[2].revents & POLLIN;
+
+			while (!endSession && input) {
 				endSession = !_session.Read();
-			}
 
-			if (!endSession && _session.CanReceive()) {
-				endSession = !_session.Process();
+				while (!endSession && _session.CanReceive()) {
+					endSession = !_session.Process();
+				}
+
+				input = _session.Input.HasInput();
 			}
 
 			if (!endSession && updateTime) {
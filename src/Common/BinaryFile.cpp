@@ -3,6 +3,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
 
 BinaryFile::BinaryFile(String path, bool create)
 {
@@ -46,6 +48,88 @@ uint64_t BinaryFile::Size()
 	return size;
 }
 
+CowBuffer<uint8_t> BinaryFile::Map()
+{
+	return CowBuffer<uint8_t>::MapFile(_fd, Size());
+}
+
+CowBuffer<uint8_t> BinaryFile::Map(uint64_t offset, uint64_t size)
+{
+	return CowBuffer<uint8_t>::MapFile(_fd, offset, size);
+}
+
+uint8_t *BinaryFile::MapShared(uint64_t size)
+{
+	void *data = mmap(
+		nullptr,
+		size,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED,
+		_fd,
+		0);
+
+	if (data == MAP_FAILED) {
+		THROW("Failed to map file.");
+	}
+
+	return (uint8_t*)data;
+}
+
+void BinaryFile::Unmap(uint8_t *data, uint64_t size)
+{
+	if (data) {
+		munmap(data, size);
+	}
+}
+
+void BinaryFile::WriteVector(
+	struct iovec *vector,
+	int count,
+	uint64_t offsetInBytes)
+{
+	while (count) {
+		int64_t res = pwritev(
+			_fd,
+			vector,
+			count < IOV_MAX ? count : IOV_MAX,
+			offsetInBytes);
+
+		if (res == -1 && errno == EINTR) {
+			continue;
+		}
+
+		if (res <= 0) {
+			THROW("Failed to write data to file.");
+		}
+
+		offsetInBytes += res;
+
+		while (count && (uint64_t)res >= vector->iov_len) {
+			res -= vector->iov_len;
+			vector++;
+			count--;
+		}
+
+		if (count) {
+			vector->iov_base = (uint8_t*)vector->iov_base + res;
+			vector->iov_len -= res;
+		}
+	}
+}
+
+void BinaryFile::Resize(uint64_t size)
+{
+	int res;
+
+	do {
+		res = ftruncate(_fd, size);
+	} while (res == -1 && errno == EINTR);
+
+	if (res == -1) {
+		THROW("Failed to resize file.");
+	}
+}
+
 void BinaryFile::Clear()
 {
 	bool intr;
@@ -66,6 +150,20 @@ void BinaryFile::Clear()
 	Seek(0);
 }
 
+void BinaryFile::Sync()
+{
+	if (fdatasync(_fd) == -1) {
+		THROW("Failed to sync file.");
+	}
+}
+
+void BinaryFile::SyncFileSystem()
+{
+	if (syncfs(_fd) == -1) {
+		THROW("Failed to sync file system.");
+	}
+}
+
 void BinaryFile::Seek(uint64_t offset)
 {
 	int64_t res = lseek(_fd, offset, SEEK_SET);
@@ -3,8 +3,10 @@
 
 #include <cstdint>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "MyString.hpp"
+#include "CowBuffer.hpp"
 #include "Exception.hpp"
 
 class BinaryFile
@@ -45,7 +47,30 @@ public:
 		}
 	}
 
+	// Writes buffers of the vector one after another starting at the
+	// offset. Vector is changed by partial writes.
+	void WriteVector(
+		struct iovec *vector,
+		int count,
+		uint64_t offsetInBytes);
+
 	void Clear();
+	void Resize(uint64_t size);
+
+	// Waits until written data reaches the disk.
+	void Sync();
+	// Same for all files of the file system that holds the file.
+	void SyncFileSystem();
+
+	// Private mapping of the whole file, empty buffer on failure.
+	CowBuffer<uint8_t> Map();
+	CowBuffer<uint8_t> Map(uint64_t offset, uint64_t size);
+
+	// Writable mapping of the first size bytes, changes go to the file.
+	// Size can exceed the file, only pages within the file can be
+	// accessed.
+	uint8_t *MapShared(uint64_t size);
+	static void Unmap(uint8_t *data, uint64_t size);
 
 private:
 	int _fd;
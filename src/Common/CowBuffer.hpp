@@ -2,35 +2,36 @@
 #define _COW_BUFFER_HPP
 
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
-
+#include <new>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "MemoryPool.hpp"
+
+// Reference counted array with copy on write.
+// Counter and elements are placed in one allocation from the memory
+// pool, empty buffer does not allocate. Reference counter is not atomic
+// until Share is called, see Share for passing buffers between threads.
 template <typename T>
 class CowBuffer
 {
 public:
 	CowBuffer()
 	{
-		_data = new Data;
-		_data->RefCount = 1;
-		_data->Data = nullptr;
-
-		_size = 0;
+		_data = nullptr;
 		_offset = 0;
+		_size = 0;
 	}
 
 	CowBuffer(uint64_t size)
 	{
-		_data = new Data;
-		_data->RefCount = 1;
-
-		_size = size;
+		_data = size ? NewData(size) : nullptr;
 		_offset = 0;
-
-		if (size) {
-			_data->Data = new T[size];
-		} else {
-			_data->Data = nullptr;
-		}
+		_size = size;
 	}
 
 	CowBuffer(const CowBuffer &cb)
@@ -41,11 +42,99 @@ public:
 		IncRef();
 	}
 
+	CowBuffer(CowBuffer &&cb)
+	{
+		_data = cb._data;
+		_size = cb._size;
+		_offset = cb._offset;
+
+		cb._data = nullptr;
+		cb._size = 0;
+		cb._offset = 0;
+	}
+
 	~CowBuffer()
 	{
 		DecRef();
 	}
 
+	// Buffer in shared mapping of unnamed temporary file in working
+	// directory. Its pages are written back to the file instead of
+	// being held in memory. Returns empty buffer on failure.
+	static CowBuffer MapTemporary(uint64_t size)
+	{
+		int fd = open(".", O_TMPFILE | O_RDWR, 0600);
+
+		if (fd == -1) {
+			char name[] = "spill.XXXXXX";
+			fd = mkstemp(name);
+
+			if (fd != -1) {
+				unlink(name);
+			}
+		}
+
+		if (fd == -1) {
+			return CowBuffer();
+		}
+
+		// Blocks are allocated in advance, so lack of disk space is
+		// reported here and not by a signal on write.
+		CowBuffer result;
+
+		if (!posix_fallocate(fd, 0, size * sizeof(T))) {
+			result = Map(fd, size, MAP_SHARED);
+		}
+
+		close(fd);
+		return result;
+	}
+
+	// Private writable mapping of the file. Changes are not written
+	// back. Returns empty buffer on failure.
+	static CowBuffer MapFile(int fd, uint64_t size)
+	{
+		return Map(fd, size, MAP_PRIVATE);
+	}
+
+	// Same for the part of the file at offset in bytes, which is
+	// a multiple of element size. Buffer is a slice of the pages
+	// containing the part.
+	static CowBuffer MapFile(int fd, uint64_t offset, uint64_t size)
+	{
+		uint64_t skip = offset % sysconf(_SC_PAGESIZE);
+
+		CowBuffer result = Map(
+			fd,
+			skip / sizeof(T) + size,
+			MAP_PRIVATE,
+			offset - skip);
+
+		if (!result.Size()) {
+			return result;
+		}
+
+		return result.Slice(skip / sizeof(T), size);
+	}
+
+	bool IsMapped() const
+	{
+		return _data && _data->MappedSize;
+	}
+
+	// Makes reference counter of the data atomic and returns new
+	// reference, which can be passed to other thread. Counter stays
+	// atomic for all references to the data. Elements that are buffers
+	// themselves are not affected.
+	CowBuffer Share() const
+	{
+		if (_data) {
+			_data->Atomic = true;
+		}
+
+		return *this;
+	}
+
 	CowBuffer &operator=(const CowBuffer &cb)
 	{
 		if (_data != cb._data) {
@@ -60,15 +149,37 @@ public:
 		return *this;
 	}
 
+	CowBuffer &operator=(CowBuffer &&cb)
+	{
+		if (this != &cb) {
+			DecRef();
+
+			_data = cb._data;
+			_size = cb._size;
+			_offset = cb._offset;
+
+			cb._data = nullptr;
+			cb._size = 0;
+			cb._offset = 0;
+		}
+
+		return *this;
+	}
+
+	// Clears the data if it is not referenced elsewhere and releases
+	// the buffer.
 	void Wipe()
 	{
-		if (_data->RefCount > 1 || !_size) {
-			Resize(0);
-			return;
+		if (_size && IsExclusive()) {
+			memset(
+				(void*)(_data->Data + _offset),
+				0,
+				_size * sizeof(T));
 		}
 
-		memset(_data->Data + _offset, 0, _size * sizeof(T));
-		Resize(0);
+		DecRef();
+		_size = 0;
+		_offset = 0;
 	}
 
 	T operator[](uint64_t index) const
@@ -85,11 +196,20 @@ public:
 	T *Pointer(int offset = 0)
 	{
 		MakeExclusive();
+
+		if (!_data) {
+			return nullptr;
+		}
+
 		return _data->Data + _offset + offset;
 	}
 
 	const T *Pointer(int offset = 0) const
 	{
+		if (!_data) {
+			return nullptr;
+		}
+
 		return _data->Data + _offset + offset;
 	}
 
@@ -98,6 +218,8 @@ public:
 		return _size;
 	}
 
+	// Exclusive buffer of plain elements grows in place if allocated
+	// space allows it.
 	void Resize(uint64_t size)
 	{
 		if (_size >= size) {
@@ -105,25 +227,25 @@ public:
 			return;
 		}
 
-		MakeExclusive();
-
-		T *newBuffer = nullptr;
-
-		if (size) {
-			newBuffer = new T[size];
+		if (std::is_trivially_copyable<T>::value &&
+			IsExclusive() &&
+			_offset + size <= _data->Capacity)
+		{
+			_size = size;
+			return;
 		}
 
-		if (_size && size) {
-			CopyData(newBuffer, _data->Data + _offset, _size);
-		}
+		Data *data = NewData(size);
 
-		if (_size || _offset) {
-			delete[] _data->Data;
+		if (_size) {
+			CopyData(data->Data, _data->Data + _offset, _size);
 		}
 
+		DecRef();
+
+		_data = data;
 		_size = size;
 		_offset = 0;
-		_data->Data = newBuffer;
 	}
 
 	CowBuffer Slice(uint64_t start, uint64_t length) const
@@ -134,21 +256,25 @@ public:
 		return result;
 	}
 
-	CowBuffer Concat(const CowBuffer buffer) const
+	// Concatenation with mapped buffer is mapped as well, so large
+	// data stays out of memory.
+	CowBuffer Concat(const CowBuffer &buffer) const
 	{
 		uint64_t size = _size + buffer._size;
 
-		CowBuffer result(size);
+		CowBuffer result = NewBuffer(
+			size,
+			IsMapped() || buffer.IsMapped());
 
 		if (_size) {
-			CopyData(result.Pointer(), Pointer(), _size);
+			CopyData(result._data->Data, Pointer(), _size);
 		}
 
-		if (buffer.Size()) {
+		if (buffer._size) {
 			CopyData(
-				result.Pointer() + _size,
+				result._data->Data + _size,
 				buffer.Pointer(),
-				buffer.Size());
+				buffer._size);
 		}
 
 		return result;
@@ -167,63 +293,190 @@ public:
 	}
 
 private:
-	static void CopyData(T *dest, const T *src, uint64_t size)
-	{
-		for (uint64_t i = 0; i < size; i++) {
-			dest[i] = src[i];
-		}
-	}
-
-	struct Data
+	// Elements follow the header in the same allocation unless they
+	// are mapped. Mapped size is 0 for elements in memory.
+	struct alignas(16) Data
 	{
-		int RefCount;
+		int64_t RefCount;
+		uint64_t Capacity;
+		uint64_t MappedSize;
 		T *Data;
+		bool Atomic;
 	};
 
 	Data *_data;
 	uint64_t _offset;
 	uint64_t _size;
 
+	static void CopyData(T *dest, const T *src, uint64_t size)
+	{
+		if constexpr (std::is_trivially_copyable<T>::value) {
+			memcpy(dest, src, size * sizeof(T));
+		} else {
+			for (uint64_t i = 0; i < size; i++) {
+				dest[i] = src[i];
+			}
+		}
+	}
+
+	static Data *NewData(uint64_t capacity)
+	{
+		Data *data = (Data*)MemoryPool::Allocate(
+			sizeof(Data) + capacity * sizeof(T));
+
+		data->RefCount = 1;
+		data->Capacity = capacity;
+		data->MappedSize = 0;
+		data->Data = (T*)(data + 1);
+		data->Atomic = false;
+
+		if (!std::is_trivially_default_constructible<T>::value) {
+			for (uint64_t i = 0; i < capacity; i++) {
+				new (data->Data + i) T;
+			}
+		}
+
+		return data;
+	}
+
+	static void DeleteData(Data *data)
+	{
+		if (data->MappedSize) {
+			munmap(data->Data, data->MappedSize);
+			MemoryPool::Free(data, sizeof(Data));
+			return;
+		}
+
+		if (!std::is_trivially_destructible<T>::value) {
+			for (uint64_t i = 0; i < data->Capacity; i++) {
+				data->Data[i].~T();
+			}
+		}
+
+		MemoryPool::Free(
+			data,
+			sizeof(Data) + data->Capacity * sizeof(T));
+	}
+
+	static CowBuffer Map(
+		int fd,
+		uint64_t size,
+		int flags,
+		uint64_t offset = 0)
+	{
+		CowBuffer result;
+
+		if (!size) {
+			return result;
+		}
+
+		void *address = mmap(
+			nullptr,
+			size * sizeof(T),
+			PROT_READ | PROT_WRITE,
+			flags,
+			fd,
+			offset);
+
+		if (address == MAP_FAILED) {
+			return result;
+		}
+
+		Data *data = (Data*)MemoryPool::Allocate(sizeof(Data));
+		data->RefCount = 1;
+		data->Capacity = size;
+		data->MappedSize = size * sizeof(T);
+		data->Data = (T*)address;
+		data->Atomic = false;
+
+		result._data = data;
+		result._size = size;
+		return result;
+	}
+
+	// Falls back to memory if file can not be mapped.
+	static CowBuffer NewBuffer(uint64_t size, bool mapped)
+	{
+		if (mapped && size) {
+			CowBuffer result = MapTemporary(size);
+
+			if (result.Size()) {
+				return result;
+			}
+		}
+
+		return CowBuffer(size);
+	}
+
+	bool IsExclusive() const
+	{
+		if (!_data) {
+			return false;
+		}
+
+		if (_data->Atomic) {
+			return __atomic_load_n(
+				&_data->RefCount,
+				__ATOMIC_ACQUIRE) == 1;
+		}
+
+		return _data->RefCount == 1;
+	}
+
 	void IncRef()
 	{
-		_data->RefCount += 1;
+		if (!_data) {
+			return;
+		}
+
+		if (_data->Atomic) {
+			__atomic_add_fetch(&_data->RefCount, 1, __ATOMIC_RELAXED);
+		} else {
+			_data->RefCount += 1;
+		}
 	}
 
 	void DecRef()
 	{
-		_data->RefCount -= 1;
+		if (!_data) {
+			return;
+		}
 
-		if (_data->RefCount <= 0) {
-			if (_size || _offset) {
-				delete[] _data->Data;
-				_data->Data = nullptr;
-			}
+		int64_t refCount;
 
-			delete _data;
-			_data = nullptr;
+		if (_data->Atomic) {
+			refCount = __atomic_sub_fetch(
+				&_data->RefCount,
+				1,
+				__ATOMIC_ACQ_REL);
+		} else {
+			refCount = --_data->RefCount;
 		}
+
+		if (refCount <= 0) {
+			DeleteData(_data);
+		}
+
+		_data = nullptr;
 	}
 
 	void MakeExclusive()
 	{
-		if (_data->RefCount == 1) {
+		if (!_data || IsExclusive()) {
 			return;
 		}
 
-		Data *data = new Data;
-		data->RefCount = 1;
+		Data *data = nullptr;
 
 		if (_size) {
-			data->Data = new T[_size];
+			data = NewData(_size);
 			CopyData(data->Data, _data->Data + _offset, _size);
-		} else {
-			data->Data = nullptr;
 		}
 
-		_offset = 0;
-
 		DecRef();
+
 		_data = data;
+		_offset = 0;
 	}
 };
 
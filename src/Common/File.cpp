@@ -1,5 +1,6 @@
 #include "File.hpp"
 
+#include <cstdio>
 #include <cstdlib>
 #include <unistd.h>
 #include <fcntl.h>
@@ -21,7 +22,8 @@ void CreateDirectory(String path)
 
 		fd = mkdir(path.CStr(), 0700);
 
-		if (fd == -1) {
+		// Directory may be created concurrently.
+		if (fd == -1 && errno != EEXIST) {
 			THROW("Failed to create directory.");
 		}
 	} else {
@@ -76,6 +78,8 @@ CowBuffer<String> ListDirectory(String path)
 		last = &((*last)->Next);
 	}
 
+	closedir(dir);
+
 	if (!entryCount) {
 		return CowBuffer<String>();
 	}
@@ -90,7 +94,31 @@ CowBuffer<String> ListDirectory(String path)
 		delete tmp;
 	}
 
-	closedir(dir);
-
 	return result;
 }
+
+void RemoveFile(String path)
+{
+	if (unlink(path.CStr()) == -1 && errno != ENOENT) {
+		THROW("Failed to remove file " + path + ".");
+	}
+}
+
+bool LinkFile(String target, String path)
+{
+	return link(target.CStr(), path.CStr()) == 0;
+}
+
+void RenameFile(String path, String newPath)
+{
+	if (rename(path.CStr(), newPath.CStr()) == -1) {
+		THROW("Failed to rename file " + path + ".");
+	}
+}
+
+void RemoveDirectory(String path)
+{
+	if (rmdir(path.CStr()) == -1 && errno != ENOENT) {
+		THROW("Failed to remove directory " + path + ".");
+	}
+}
@@ -8,4 +8,13 @@ void CreateDirectory(String path);
 bool FileExists(String path);
 CowBuffer<String> ListDirectory(String path);
 
+void RemoveFile(String path);
+// Adds another name to the file. Returns false if the file system
+// can not link it, for example across devices.
+bool LinkFile(String target, String path);
+// Replaces the file at the new path.
+void RenameFile(String path, String newPath);
+// Directory must be empty.
+void RemoveDirectory(String path);
+
 #endif
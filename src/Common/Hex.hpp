@@ -4,7 +4,7 @@
 #include "MyString.hpp"
 #include "Exception.hpp"
 
-inline void HexToData(String hex, uint8_t *data)
+inline void HexToData(const String &hex, uint8_t *data)
 {
 	if (hex.Length() % 2 != 0) {
 		THROW("Hex string has odd length.");
@@ -45,40 +45,21 @@ inline void HexToData(String hex, uint8_t *data)
 
 inline String DataToHex(const uint8_t *data, uint64_t size)
 {
-	String res;
-
-	for (uint64_t i = 0; i < size; i++) {
-		uint8_t hex[2];
-
-		hex[0] = data[i] >> 4;
-		hex[1] = data[i] & 0b1111;
-
-		for (int c = 0; c < 2; c++) {
-			if (hex[c] < 10) {
-				res += '0' + hex[c];
-			} else {
-				res += 'a' + hex[c] - 10;
-			}
-		}
-	}
-
-	return res;
+	StringBuilder builder(size * 2);
+	builder.AppendHex(data, size);
+	return builder.Build();
 }
 
 template <typename T>
 String ToHex(T value)
 {
-	uint8_t data[sizeof(T)];
-
-	for (uint32_t i = 0; i < sizeof(T); i++) {
-		data[i] = ((const uint8_t*)&value)[sizeof(T) - 1 - i];
-	}
-
-	return DataToHex(data, sizeof(T));
+	StringBuilder builder;
+	builder.AppendHex(value);
+	return builder.Build();
 }
 
 template <typename T>
-T HexToInt(String string)
+T HexToInt(const String &string)
 {
 	uint8_t data[sizeof(T)];
 	HexToData(string, data);
@@ -10,7 +10,10 @@
 inline void Log(String message)
 {
 	int64_t timestamp = GetUnixTime();
-	String timeStr = ctime(&timestamp);
+
+	// Called from worker threads.
+	char timeBuffer[32];
+	String timeStr = ctime_r(&timestamp, timeBuffer);
 	timeStr = timeStr.Substring(0, timeStr.Length() - 1);
 
 	printf("[%s]: %s\n", timeStr.CStr(), message.CStr());
@@ -0,0 +1,202 @@
+#include "MemoryPool.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <pthread.h>
+
+struct FreeBlock
+{
+	FreeBlock *Next;
+};
+
+struct ThreadCache
+{
+	ThreadCache *Next;
+	ThreadCache *Prev;
+
+	FreeBlock *Blocks[MemoryPool::ClassCount];
+	int64_t Counts[MemoryPool::ClassCount];
+
+	// Written only by the owning thread, read by statistics.
+	int64_t Hits;
+	int64_t Misses;
+	int64_t Large;
+	int64_t Cached;
+};
+
+static thread_local ThreadCache *Cache = nullptr;
+
+// Live caches and statistics of finished threads.
+static pthread_mutex_t CacheLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadCache *Caches = nullptr;
+static MemoryPool::Statistics Retired = {0, 0, 0, 0};
+
+static pthread_key_t CacheKey;
+static pthread_once_t CacheKeyOnce = PTHREAD_ONCE_INIT;
+
+static void Add(int64_t &counter, int64_t value)
+{
+	__atomic_store_n(&counter, counter + value, __ATOMIC_RELAXED);
+}
+
+static int GetClass(uint64_t size)
+{
+	if (size <= ((uint64_t)1 << MemoryPool::MinClassShift)) {
+		return 0;
+	}
+
+	return 64 - __builtin_clzll(size - 1) - MemoryPool::MinClassShift;
+}
+
+// Called on thread exit.
+static void ReleaseCache(void *arg)
+{
+	ThreadCache *cache = (ThreadCache*)arg;
+
+	pthread_mutex_lock(&CacheLock);
+
+	if (cache->Prev) {
+		cache->Prev->Next = cache->Next;
+	} else {
+		Caches = cache->Next;
+	}
+
+	if (cache->Next) {
+		cache->Next->Prev = cache->Prev;
+	}
+
+	Retired.Hits += cache->Hits;
+	Retired.Misses += cache->Misses;
+	Retired.Large += cache->Large;
+
+	pthread_mutex_unlock(&CacheLock);
+
+	for (int i = 0; i < MemoryPool::ClassCount; i++) {
+		while (cache->Blocks[i]) {
+			FreeBlock *block = cache->Blocks[i];
+			cache->Blocks[i] = block->Next;
+			free(block);
+		}
+	}
+
+	if (Cache == cache) {
+		Cache = nullptr;
+	}
+
+	free(cache);
+}
+
+static void CreateCacheKey()
+{
+	pthread_key_create(&CacheKey, ReleaseCache);
+}
+
+static ThreadCache *GetCache()
+{
+	if (Cache) {
+		return Cache;
+	}
+
+	ThreadCache *cache = (ThreadCache*)calloc(1, sizeof(ThreadCache));
+
+	if (!cache) {
+		throw std::bad_alloc();
+	}
+
+	pthread_once(&CacheKeyOnce, CreateCacheKey);
+	pthread_setspecific(CacheKey, cache);
+
+	pthread_mutex_lock(&CacheLock);
+
+	cache->Next = Caches;
+
+	if (Caches) {
+		Caches->Prev = cache;
+	}
+
+	Caches = cache;
+
+	pthread_mutex_unlock(&CacheLock);
+
+	Cache = cache;
+	return cache;
+}
+
+void *MemoryPool::Allocate(uint64_t size)
+{
+	ThreadCache *cache = GetCache();
+	void *pointer;
+
+	if (size > ((uint64_t)1 << MaxClassShift)) {
+		Add(cache->Large, 1);
+		pointer = malloc(size);
+	} else {
+		int index = GetClass(size);
+		FreeBlock *block = cache->Blocks[index];
+
+		if (block) {
+			cache->Blocks[index] = block->Next;
+			cache->Counts[index]--;
+			Add(cache->Hits, 1);
+			Add(cache->Cached, -((int64_t)1 << (index + MinClassShift)));
+			return block;
+		}
+
+		Add(cache->Misses, 1);
+		pointer = malloc((uint64_t)1 << (index + MinClassShift));
+	}
+
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+
+	return pointer;
+}
+
+void MemoryPool::Free(void *pointer, uint64_t size)
+{
+	if (!pointer) {
+		return;
+	}
+
+	if (size > ((uint64_t)1 << MaxClassShift)) {
+		free(pointer);
+		return;
+	}
+
+	ThreadCache *cache = GetCache();
+	int index = GetClass(size);
+	int64_t blockSize = (int64_t)1 << (index + MinClassShift);
+
+	if (cache->Counts[index] >= MinCachedBlocks &&
+		cache->Counts[index] * blockSize >= CacheLimit)
+	{
+		free(pointer);
+		return;
+	}
+
+	FreeBlock *block = (FreeBlock*)pointer;
+	block->Next = cache->Blocks[index];
+	cache->Blocks[index] = block;
+	cache->Counts[index]++;
+	Add(cache->Cached, blockSize);
+}
+
+void MemoryPool::GetStatistics(Statistics &statistics)
+{
+	pthread_mutex_lock(&CacheLock);
+
+	statistics = Retired;
+
+	for (ThreadCache *cache = Caches; cache; cache = cache->Next) {
+		statistics.Hits += __atomic_load_n(&cache->Hits, __ATOMIC_RELAXED);
+		statistics.Misses +=
+			__atomic_load_n(&cache->Misses, __ATOMIC_RELAXED);
+		statistics.Large +=
+			__atomic_load_n(&cache->Large, __ATOMIC_RELAXED);
+		statistics.Cached +=
+			__atomic_load_n(&cache->Cached, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&CacheLock);
+}
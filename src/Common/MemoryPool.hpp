@@ -0,0 +1,57 @@
+#ifndef _MEMORY_POOL_HPP
+#define _MEMORY_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+// Per-thread caches of freed memory blocks in power of two size classes.
+// Buffers, queue nodes, output batches, sessions and pipe events are
+// allocated here, so steady message relay reuses blocks instead of
+// calling the general-purpose heap. Block can be freed by any thread,
+// it joins the cache of the freeing thread. Blocks larger than the
+// largest class are allocated from the heap directly.
+class MemoryPool
+{
+public:
+	enum
+	{
+		MinClassShift = 5,
+		MaxClassShift = 17,
+		ClassCount = MaxClassShift - MinClassShift + 1,
+
+		// Bytes kept in one size class of a thread cache, at least
+		// MinCachedBlocks blocks are kept.
+		CacheLimit = 1024 * 1024,
+		MinCachedBlocks = 16
+	};
+
+	// Hits are allocations served from cache, misses and large
+	// allocations go to the heap. Cached is size of free blocks held
+	// by caches.
+	struct Statistics
+	{
+		int64_t Hits;
+		int64_t Misses;
+		int64_t Large;
+		int64_t Cached;
+	};
+
+	// Size of freed block must match allocated size.
+	static void *Allocate(uint64_t size);
+	static void Free(void *pointer, uint64_t size);
+
+	static void GetStatistics(Statistics &statistics);
+};
+
+// Routes allocations of the class to the pool.
+#define POOL_ALLOCATED \
+	static void *operator new(size_t size) \
+	{ \
+		return MemoryPool::Allocate(size); \
+	} \
+	static void operator delete(void *pointer, size_t size) \
+	{ \
+		MemoryPool::Free(pointer, size); \
+	}
+
+#endif
@@ -1,6 +1,7 @@
 #include "MyString.hpp"
 
 #include <cstring>
+#include <utility>
 
 static bool IsSpace(char c)
 {
@@ -9,40 +10,35 @@ static bool IsSpace(char c)
 
 String::String()
 {
-	_data = 0;
-	Clear();
+	_data = nullptr;
+	_length = 0;
+	_local[0] = 0;
 }
 
 String::String(const String &s)
 {
-	_data = s._data;
-	IncRef();
+	_data = nullptr;
+	_length = 0;
+	*this = s;
 }
 
-String::String(const char *s)
+String::String(String &&s)
 {
-	if (!s) {
-		_data = 0;
-		Clear();
-		return;
-	}
-
-	int length = strlen(s);
-
-	if (length == 0) {
-		_data = 0;
-		Clear();
-		return;
-	}
+	_data = nullptr;
+	_length = 0;
+	*this = std::move(s);
+}
 
-	_data = new Data;
-	_data->RefCount = 1;
-	_data->Length = length;
-	_data->Reserved = length + 1;
-	_data->Data = new char[length + 1];
+String::String(const char *s)
+{
+	_data = nullptr;
+	Assign(s, s ? strlen(s) : 0);
+}
 
-	memcpy(_data->Data, s, length);
-	_data->Data[length] = 0;
+String::String(const char *s, int length)
+{
+	_data = nullptr;
+	Assign(s, length);
 }
 
 String::~String()
@@ -53,133 +49,151 @@ String::~String()
 void String::Clear()
 {
 	FreeRef();
+	_length = 0;
+	_local[0] = 0;
+}
 
-	_data = new Data;
-	_data->RefCount = 1;
-	_data->Length = 0;
-	_data->Reserved = 1;
-	_data->Data = new char[1];
-	_data->Data[0] = 0;
+void String::Reserve(int length)
+{
+	bool exclusive = !_data || _data->RefCount == 1;
+
+	if (exclusive && length <= Capacity()) {
+		return;
+	}
+
+	if (length < _length) {
+		length = _length;
+	}
+
+	Data *data = (Data*)MemoryPool::Allocate(sizeof(Data) + length + 1);
+	data->RefCount = 1;
+	data->Reserved = length + 1;
+	memcpy(data + 1, CStr(), _length + 1);
+
+	FreeRef();
+	_data = data;
 }
 
 String &String::operator=(const String &s)
 {
-	if (_data == s._data) {
+	if (this == &s) {
 		return *this;
 	}
 
-	FreeRef();
-	_data = s._data;
-	IncRef();
+	if (s._data) {
+		if (_data != s._data) {
+			FreeRef();
+			_data = s._data;
+			IncRef();
+		}
+	} else {
+		FreeRef();
+		memcpy(_local, s._local, s._length + 1);
+	}
+
+	_length = s._length;
 
 	return *this;
 }
 
-String String::operator+(const String &s) const
+String &String::operator=(String &&s)
 {
-	int l1 = _data->Length;
-	int l2 = s._data->Length;
-
-	int length = l1 + l2;
-
-	if (length == 0) {
-		return String();
+	if (this == &s) {
+		return *this;
 	}
 
-	Data *data = new Data;
-	data->RefCount = 0;
-	data->Length = length;
-	data->Reserved = length + 1;
-	data->Data = new char[length + 1];
+	FreeRef();
 
-	if (l1) {
-		memcpy(data->Data, _data->Data, l1);
-	}
+	_data = s._data;
+	_length = s._length;
 
-	if (l2) {
-		memcpy(data->Data + l1, s._data->Data, l2);
+	if (!_data) {
+		memcpy(_local, s._local, _length + 1);
 	}
 
-	data->Data[length] = 0;
+	s._data = nullptr;
+	s._length = 0;
+	s._local[0] = 0;
 
-	return String(data);
+	return *this;
 }
 
-void String::operator+=(const String &s)
+String String::operator+(const String &s) const
 {
-	*this = *this + s;
+	String result;
+	result.Reserve(_length + s._length);
+	result.Append(CStr(), _length);
+	result.Append(s.CStr(), s._length);
+	return result;
 }
 
-void String::operator+=(char c)
+void String::operator+=(const String &s)
 {
-	MakeExclusive();
-
-	if (_data->Length >= _data->Reserved - 1) {
-		char *buffer = _data->Data;
-		_data->Reserved = _data->Reserved * 2;
-		_data->Data = new char[_data->Reserved];
-		memcpy(_data->Data, buffer, _data->Length + 1);
-		delete[] buffer;
+	if (this == &s) {
+		String copy = s;
+		Append(copy.CStr(), copy._length);
+		return;
 	}
 
-	_data->Data[_data->Length] = c;
-	_data->Length += 1;
-	_data->Data[_data->Length] = 0;
+	Append(s.CStr(), s._length);
 }
 
-const char *String::CStr() const
+void String::operator+=(const char *s)
 {
-	return _data->Data;
+	Append(s, strlen(s));
 }
 
-int String::Length() const
+void String::operator+=(char c)
 {
-	return _data->Length;
+	Append(&c, 1);
 }
 
-bool String::operator==(const String &s) const
+// Appended characters must not belong to this string.
+void String::Append(const char *s, int length)
 {
-	if (_data->Length != s._data->Length) {
-		return false;
+	if (length) {
+		memcpy(Extend(length), s, length);
 	}
+}
 
-	for (int i = 0; i < _data->Length; i++) {
-		if (_data->Data[i] != s._data->Data[i]) {
-			return false;
-		}
+bool String::operator==(const String &s) const
+{
+	if (_length != s._length) {
+		return false;
 	}
 
-	return true;
+	return !memcmp(CStr(), s.CStr(), _length);
 }
 
 bool String::operator<(const String &s) const
 {
-	int length =
-		_data->Length < s._data->Length ?
-		_data->Length :
-		s._data->Length;
+	int length = _length < s._length ? _length : s._length;
+
+	const char *chars1 = CStr();
+	const char *chars2 = s.CStr();
 
 	for (int i = 0; i < length; i++) {
-		if (_data->Data[i] != s._data->Data[i]) {
-			return _data->Data[i] < s._data->Data[i];
+		if (chars1[i] != chars2[i]) {
+			return chars1[i] < chars2[i];
 		}
 	}
 
-	return _data->Length < s._data->Length;
+	return _length < s._length;
 }
 
 CowBuffer<String> String::Split(char delim, bool removeEmpty) const
 {
-	if (_data->Length == 0) {
+	if (_length == 0) {
 		return CowBuffer<String>();
 	}
 
+	const char *chars = CStr();
 	int partCount = 1;
 
-	for (int i = 0; i < _data->Length; i++) {
-		if (_data->Data[i] == delim) {
+	for (int i = 0; i < _length; i++) {
+		if (chars[i] == delim) {
 			bool newPart = !removeEmpty ||
-				(i > 0 && _data->Data[i - 1] != delim);
+				(i > 0 && chars[i - 1] != delim);
 
 			if (newPart) {
 				++partCount;
@@ -192,8 +206,8 @@ CowBuffer<String> String::Split(char delim, bool removeEmpty) const
 	int startIndex = 0;
 	int partIndex = 0;
 
-	for (int currIndex = 0; currIndex < _data->Length; currIndex++) {
-		if (_data->Data[currIndex] != delim) {
+	for (int currIndex = 0; currIndex < _length; currIndex++) {
+		if (chars[currIndex] != delim) {
 			continue;
 		}
 
@@ -211,8 +225,10 @@ CowBuffer<String> String::Split(char delim, bool removeEmpty) const
 		startIndex = currIndex + 1;
 	}
 
-	if (startIndex < _data->Length) {
-		result[partIndex] = String(_data->Data + startIndex);
+	if (startIndex < _length) {
+		result[partIndex] = String(
+			chars + startIndex,
+			_length - startIndex);
 		++partIndex;
 	} else if (!removeEmpty) {
 		result[partIndex] = String();
@@ -223,18 +239,19 @@ CowBuffer<String> String::Split(char delim, bool removeEmpty) const
 
 String String::Trim() const
 {
+	const char *chars = CStr();
 	int startIndex = 0;
-	int endIndex = _data->Length - 1;
+	int endIndex = _length - 1;
 
-	while (IsSpace(_data->Data[startIndex]) && startIndex < _data->Length) {
+	while (IsSpace(chars[startIndex]) && startIndex < _length) {
 		++startIndex;
 	}
 
-	if (startIndex >= _data->Length) {
+	if (startIndex >= _length) {
 		return String();
 	}
 
-	while (IsSpace(_data->Data[endIndex]) && endIndex >= startIndex) {
+	while (IsSpace(chars[endIndex]) && endIndex >= startIndex) {
 		--endIndex;
 	}
 
@@ -243,19 +260,7 @@ String String::Trim() const
 
 String String::Substring(int start, int length) const
 {
-	Data *data = new Data;
-	data->RefCount = 0;
-	data->Length = length;
-	data->Reserved = length + 1;
-	data->Data = new char[data->Reserved];
-
-	if (length) {
-		memcpy(data->Data, _data->Data + start, length);
-	}
-
-	data->Data[length] = 0;
-
-	return String(data);
+	return String(CStr() + start, length);
 }
 
 String String::Replace(char from, char to) const
@@ -263,11 +268,11 @@ String String::Replace(char from, char to) const
 	String res = *this;
 	res.MakeExclusive();
 
-	for (int i = 0; i < res.Length(); i++) {
-		char c = res._data->Data[i];
+	char *chars = res.Chars();
 
-		if (c == from) {
-			res._data->Data[i] = to;
+	for (int i = 0; i < res._length; i++) {
+		if (chars[i] == from) {
+			chars[i] = to;
 		}
 	}
 
@@ -277,18 +282,45 @@ String String::Replace(char from, char to) const
 void String::Wipe()
 {
 	MakeExclusive();
+	memset(Chars(), 0, _length);
+	Clear();
+}
 
-	for (int i = 0; i < _data->Length; i++) {
-		_data->Data[i] = 0;
+void String::Assign(const char *s, int length)
+{
+	_length = length;
+
+	if (length > LocalCapacity) {
+		_data = (Data*)MemoryPool::Allocate(sizeof(Data) + length + 1);
+		_data->RefCount = 1;
+		_data->Reserved = length + 1;
 	}
 
-	Clear();
+	char *chars = Chars();
+
+	if (length) {
+		memcpy(chars, s, length);
+	}
+
+	chars[length] = 0;
 }
 
-String::String(Data *data)
+// Buffer grows at least twice, so appending in a loop takes linear
+// time.
+char *String::Extend(int length)
 {
-	_data = data;
-	IncRef();
+	int required = _length + length;
+	bool exclusive = !_data || _data->RefCount == 1;
+
+	if (!exclusive || required > Capacity()) {
+		Reserve(required < _length * 2 ? _length * 2 : required);
+	}
+
+	char *chars = Chars() + _length;
+	_length = required;
+	chars[length] = 0;
+
+	return chars;
 }
 
 void String::IncRef()
@@ -307,26 +339,111 @@ void String::FreeRef()
 	}
 
 	_data->RefCount -= 1;
-	
+
 	if (_data->RefCount == 0) {
-		delete[] _data->Data;
-		delete _data;
-	};
+		MemoryPool::Free(_data, sizeof(Data) + _data->Reserved);
+	}
 
-	_data = 0;
+	_data = nullptr;
 }
 
 void String::MakeExclusive()
 {
-	if (_data->RefCount > 1) {
-		Data *data = new Data;
-		data->RefCount = 1;
-		data->Length = _data->Length;
-		data->Reserved = _data->Reserved;
-		data->Data = new char[_data->Reserved];
-		memcpy(data->Data, _data->Data, _data->Length + 1);
+	if (_data && _data->RefCount > 1) {
+		Reserve(_data->Reserved - 1);
+	}
+}
 
-		FreeRef();
-		_data = data;
+// StringBuilder.
+static const char DigitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// Digits are written from the end, two at a time.
+void StringBuilder::AppendInt(int64_t value)
+{
+	char buffer[20];
+	int position = sizeof(buffer);
+
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : value;
+
+	while (magnitude >= 100) {
+		int pair = magnitude % 100 * 2;
+		magnitude /= 100;
+
+		position -= 2;
+		buffer[position] = DigitPairs[pair];
+		buffer[position + 1] = DigitPairs[pair + 1];
+	}
+
+	if (magnitude >= 10) {
+		position -= 2;
+		buffer[position] = DigitPairs[magnitude * 2];
+		buffer[position + 1] = DigitPairs[magnitude * 2 + 1];
+	} else {
+		buffer[--position] = '0' + magnitude;
+	}
+
+	if (value < 0) {
+		buffer[--position] = '-';
+	}
+
+	int length = sizeof(buffer) - position;
+	memcpy(_string.Extend(length), buffer + position, length);
+}
+
+// Four bytes are converted at once in a 64 bit word: nibbles are
+// spread one per byte in output order, then mapped to characters
+// without branches.
+static void WriteHex(const uint8_t *data, uint64_t size, char *result)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	uint64_t i = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; i + 4 <= size; i += 4) {
+		uint32_t bytes;
+		memcpy(&bytes, data + i, sizeof(bytes));
+
+		uint64_t word = bytes;
+		word = (word | word << 16) & 0x0000ffff0000ffff;
+		word = (word | word << 8) & 0x00ff00ff00ff00ff;
+
+		uint64_t nibbles =
+			(word >> 4 & 0x000f000f000f000f) |
+			(word & 0x000f000f000f000f) << 8;
+
+		uint64_t letters =
+			(nibbles + 0x0606060606060606) >> 4 & 0x0101010101010101;
+
+		uint64_t chars = nibbles + 0x3030303030303030 + letters * 39;
+		memcpy(result + i * 2, &chars, sizeof(chars));
+	}
+#endif
+
+	for (; i < size; i++) {
+		result[i * 2] = digits[data[i] >> 4];
+		result[i * 2 + 1] = digits[data[i] & 0xf];
 	}
 }
+
+void StringBuilder::AppendHex(const uint8_t *data, uint64_t size)
+{
+	if (size) {
+		WriteHex(data, size, _string.Extend(size * 2));
+	}
+}
+
+String StringBuilder::Build()
+{
+	return std::move(_string);
+}
@@ -3,24 +3,49 @@
 
 #include "CowBuffer.hpp"
 
+// Strings up to LocalCapacity characters, which covers hex form of
+// keys, are stored in the object. Longer strings are reference counted
+// with copy on write.
 class String
 {
 public:
+	enum
+	{
+		LocalCapacity = 83
+	};
+
 	String();
 	String(const String &s);
+	String(String &&s);
 	String(const char *s);
+	String(const char *s, int length);
 	~String();
 
 	void Clear();
 
+	// Makes room for length characters, so appending up to that
+	// length does not reallocate.
+	void Reserve(int length);
+
 	String &operator=(const String &s);
+	String &operator=(String &&s);
 
 	String operator+(const String &s) const;
 	void operator+=(const String &s);
+	void operator+=(const char *s);
 	void operator+=(char c);
 
-	const char *CStr() const;
-	int Length() const;
+	void Append(const char *s, int length);
+
+	const char *CStr() const
+	{
+		return _data ? (const char*)(_data + 1) : _local;
+	}
+
+	int Length() const
+	{
+		return _length;
+	}
 
 	bool operator==(const String &s) const;
 	bool operator<(const String &s) const;
@@ -33,70 +58,124 @@ public:
 	void Wipe();
 
 private:
+	// Characters follow the header in the same allocation.
 	struct Data
 	{
 		int RefCount;
-		int Length;
 		int Reserved;
-		char *Data;
 	};
 
 	Data *_data;
+	int _length;
+	char _local[LocalCapacity + 1];
+
+	char *Chars()
+	{
+		return _data ? (char*)(_data + 1) : _local;
+	}
+
+	int Capacity() const
+	{
+		return _data ? _data->Reserved - 1 : LocalCapacity;
+	}
+
+	void Assign(const char *s, int length);
 
-	String(Data *data);
+	// Grows string by length characters and returns them for writing.
+	char *Extend(int length);
 
 	void IncRef();
 	void FreeRef();
 
 	void MakeExclusive();
-};
 
-inline String operator+(const char *str1, const String str2)
-{
-	return String(str1) + str2;
-}
+	friend class StringBuilder;
+};
 
-inline String ToString(int value)
+// Collects string in one buffer. Reserved space is used without
+// reallocation, numbers and binary data are formatted in place.
+class StringBuilder
 {
-	if (value == 0) {
-		return "0";
+public:
+	StringBuilder(int reserve = 0)
+	{
+		_string.Reserve(reserve);
 	}
 
-	String res;
-	int digits = 0;
+	void Reserve(int length)
+	{
+		_string.Reserve(length);
+	}
 
-	int val = value;
+	int Length() const
+	{
+		return _string.Length();
+	}
 
-	if (val < 0) {
-		res += '-';
-		val = -val;
+	void Append(const String &s)
+	{
+		_string += s;
 	}
 
-	while (val) {
-		++digits;
-		val /= 10;
+	void Append(const char *s)
+	{
+		_string += s;
 	}
 
-	val = value;
+	void Append(const char *s, int length)
+	{
+		_string.Append(s, length);
+	}
 
-	if (val < 0) {
-		val = -val;
+	void Append(char c)
+	{
+		_string += c;
 	}
 
-	while (digits) {
-		int digit = val;
+	void AppendInt(int64_t value);
+
+	// Two lower case hex digits per byte.
+	void AppendHex(const uint8_t *data, uint64_t size);
+
+	// Most significant byte first, as ToHex.
+	template <typename T>
+	void AppendHex(T value)
+	{
+		uint8_t data[sizeof(T)];
 
-		for (int i = 1; i < digits; i++) {
-			digit /= 10;
+		for (uint32_t i = 0; i < sizeof(T); i++) {
+			data[i] = ((const uint8_t*)&value)[sizeof(T) - 1 - i];
 		}
 
-		digit = digit % 10;
+		AppendHex(data, sizeof(T));
+	}
 
-		res += '0' + digit;
-		--digits;
+	// Current content, builder can be appended to afterwards.
+	const String &GetString() const
+	{
+		return _string;
 	}
 
-	return res;
+	// Returns the string and leaves builder empty.
+	String Build();
+
+private:
+	String _string;
+};
+
+inline String operator+(const char *str1, const String &str2)
+{
+	StringBuilder builder(strlen(str1) + str2.Length());
+	builder.Append(str1);
+	builder.Append(str2);
+	return builder.Build();
+}
+
+inline String ToString(int value)
+{
+	StringBuilder builder;
+	builder.AppendInt(value);
+	return builder.Build();
 }
 
 #endif
@@ -0,0 +1,74 @@
+#ifndef _RW_LOCK_HPP
+#define _RW_LOCK_HPP
+
+#include <pthread.h>
+
+class RwLock
+{
+public:
+	RwLock()
+	{
+		pthread_rwlock_init(&_lock, nullptr);
+	}
+
+	~RwLock()
+	{
+		pthread_rwlock_destroy(&_lock);
+	}
+
+	void ReadLock()
+	{
+		pthread_rwlock_rdlock(&_lock);
+	}
+
+	void WriteLock()
+	{
+		pthread_rwlock_wrlock(&_lock);
+	}
+
+	void Unlock()
+	{
+		pthread_rwlock_unlock(&_lock);
+	}
+
+private:
+	pthread_rwlock_t _lock;
+};
+
+// Holds shared lock until the end of the scope.
+class ReadGuard
+{
+public:
+	ReadGuard(RwLock &lock) : _lock(lock)
+	{
+		_lock.ReadLock();
+	}
+
+	~ReadGuard()
+	{
+		_lock.Unlock();
+	}
+
+private:
+	RwLock &_lock;
+};
+
+// Holds exclusive lock until the end of the scope.
+class WriteGuard
+{
+public:
+	WriteGuard(RwLock &lock) : _lock(lock)
+	{
+		_lock.WriteLock();
+	}
+
+	~WriteGuard()
+	{
+		_lock.Unlock();
+	}
+
+private:
+	RwLock &_lock;
+};
+
+#endif
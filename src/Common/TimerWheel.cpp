@@ -0,0 +1,216 @@
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel(int64_t now)
+{
+	for (int i = 0; i < ListCount; i++) {
+		_lists[i] = nullptr;
+	}
+
+	for (int i = 0; i < LevelCount; i++) {
+		_occupied[i] = 0;
+	}
+
+	_current = now;
+}
+
+void TimerWheel::Add(Timer *timer, int64_t expiry)
+{
+	if (timer->Armed()) {
+		Unlink(timer);
+	}
+
+	timer->Expiry = expiry;
+	Insert(timer);
+}
+
+void TimerWheel::Remove(Timer *timer)
+{
+	if (timer->Armed()) {
+		Unlink(timer);
+	}
+}
+
+void TimerWheel::Advance(int64_t now)
+{
+	while (true) {
+		int64_t tick = NextTick();
+
+		if (tick == -1 || tick > now) {
+			break;
+		}
+
+		_current = tick;
+
+		// Higher levels go first, their timers can land in
+		// the lower level slots that are processed at this tick.
+		for (int level = LevelCount - 1; level > 0; level--) {
+			int64_t mask = ((int64_t)1 << (SlotBits * level)) - 1;
+
+			if (tick & mask) {
+				continue;
+			}
+
+			int slot = (tick >> (SlotBits * level)) & (SlotCount - 1);
+			ProcessSlot(level, slot);
+		}
+
+		ProcessSlot(0, tick & (SlotCount - 1));
+	}
+
+	if (now > _current) {
+		_current = now;
+	}
+}
+
+Timer *TimerWheel::GetExpired()
+{
+	Timer *timer = _lists[ExpiredList];
+
+	if (timer) {
+		Unlink(timer);
+	}
+
+	return timer;
+}
+
+int TimerWheel::GetTimeout(int64_t now)
+{
+	if (_lists[ExpiredList]) {
+		return 0;
+	}
+
+	int64_t tick = NextTick();
+
+	if (tick == -1) {
+		return -1;
+	}
+
+	int64_t timeout = tick - now;
+
+	if (timeout < 0) {
+		return 0;
+	}
+
+	if (timeout > 0x7fffffff) {
+		return 0x7fffffff;
+	}
+
+	return timeout;
+}
+
+void TimerWheel::Insert(Timer *timer)
+{
+	int64_t expiry = timer->Expiry;
+
+	if (expiry <= _current) {
+		Link(timer, ExpiredList);
+		return;
+	}
+
+	int64_t delta = expiry - _current;
+	int level = 0;
+
+	while (
+		level < LevelCount - 1 &&
+		delta >= (int64_t)1 << (SlotBits * (level + 1)))
+	{
+		++level;
+	}
+
+	int64_t range = (int64_t)1 << (SlotBits * LevelCount);
+
+	if (delta >= range) {
+		expiry = _current + range - 1;
+	}
+
+	int slot = (expiry >> (SlotBits * level)) & (SlotCount - 1);
+	Link(timer, level * SlotCount + slot);
+}
+
+void TimerWheel::Link(Timer *timer, int list)
+{
+	timer->List = list;
+	timer->Prev = nullptr;
+	timer->Next = _lists[list];
+
+	if (_lists[list]) {
+		_lists[list]->Prev = timer;
+	}
+
+	_lists[list] = timer;
+
+	if (list != ExpiredList) {
+		_occupied[list / SlotCount] |= (uint64_t)1 << (list % SlotCount);
+	}
+}
+
+void TimerWheel::Unlink(Timer *timer)
+{
+	int list = timer->List;
+
+	if (timer->Prev) {
+		timer->Prev->Next = timer->Next;
+	} else {
+		_lists[list] = timer->Next;
+	}
+
+	if (timer->Next) {
+		timer->Next->Prev = timer->Prev;
+	}
+
+	if (!_lists[list] && list != ExpiredList) {
+		_occupied[list / SlotCount] &=
+			~((uint64_t)1 << (list % SlotCount));
+	}
+
+	timer->Prev = nullptr;
+	timer->Next = nullptr;
+	timer->List = -1;
+}
+
+int64_t TimerWheel::NextTick()
+{
+	int64_t result = -1;
+
+	for (int level = 0; level < LevelCount; level++) {
+		uint64_t occupied = _occupied[level];
+
+		if (!occupied) {
+			continue;
+		}
+
+		int shift = SlotBits * level;
+		int64_t position = _current >> shift;
+		int start = (position + 1) & (SlotCount - 1);
+
+		// Bit N corresponds to the slot reached after N + 1 steps.
+		if (start) {
+			occupied = (occupied >> start) |
+				(occupied << (SlotCount - start));
+		}
+
+		int64_t steps = __builtin_ctzll(occupied) + 1;
+		int64_t tick = (position + steps) << shift;
+
+		if (result == -1 || tick < result) {
+			result = tick;
+		}
+	}
+
+	return result;
+}
+
+void TimerWheel::ProcessSlot(int level, int slot)
+{
+	int list = level * SlotCount + slot;
+
+	Timer *timer = _lists[list];
+	_lists[list] = nullptr;
+	_occupied[level] &= ~((uint64_t)1 << slot);
+
+	while (timer) {
+		Timer *next = timer->Next;
+		Insert(timer);
+		timer = next;
+	}
+}
@@ -0,0 +1,116 @@
+#ifndef _TIMER_WHEEL_HPP
+#define _TIMER_WHEEL_HPP
+
+#include <cstdint>
+
+struct Timer;
+
+class TimerHandler
+{
+public:
+	virtual ~TimerHandler()
+	{
+	}
+
+	virtual void TimerExpired(Timer *timer) = 0;
+};
+
+// Timers of an event loop for objects that do not own the wheel.
+class TimerQueue
+{
+public:
+	virtual ~TimerQueue()
+	{
+	}
+
+	virtual void AddTimer(Timer *timer, int64_t expiry) = 0;
+	virtual void RemoveTimer(Timer *timer) = 0;
+	virtual int64_t GetTime() = 0;
+};
+
+// Intrusive timer. Owner embeds it and keeps it alive while armed.
+struct Timer
+{
+	Timer *Prev;
+	Timer *Next;
+
+	// Milliseconds, same clock as the one used by the wheel.
+	int64_t Expiry;
+
+	TimerHandler *Handler;
+	void *Data;
+
+	// Index of the wheel list containing the timer.
+	// -1 if the timer is not armed.
+	int32_t List;
+
+	Timer()
+	{
+		Prev = nullptr;
+		Next = nullptr;
+		Expiry = 0;
+		Handler = nullptr;
+		Data = nullptr;
+		List = -1;
+	}
+
+	bool Armed() const
+	{
+		return List != -1;
+	}
+};
+
+// Hierarchical timer wheel with 1 ms tick.
+// Level N has 64 slots, each slot covers 64^N ticks. Timers are
+// placed on the lowest level able to hold them and moved to lower
+// levels when time reaches their slot. Expiries beyond the last level
+// are placed into its farthest slot and rescheduled later.
+// Occupancy bitmaps are used to skip empty slots, so idle periods
+// cost nothing.
+//
+// Add and Remove are O(1).
+class TimerWheel
+{
+public:
+	TimerWheel(int64_t now);
+
+	void Add(Timer *timer, int64_t expiry);
+	void Remove(Timer *timer);
+
+	// Moves time forward and collects expired timers.
+	void Advance(int64_t now);
+
+	// Returns expired timer and disarms it, nullptr if there are
+	// no more expired timers.
+	Timer *GetExpired();
+
+	// Milliseconds until the next call of Advance has work to do,
+	// -1 if no timers are armed.
+	int GetTimeout(int64_t now);
+
+private:
+	enum
+	{
+		LevelCount = 5,
+		SlotBits = 6,
+		SlotCount = 1 << SlotBits,
+		ExpiredList = LevelCount * SlotCount,
+		ListCount = ExpiredList + 1
+	};
+
+	Timer *_lists[ListCount];
+	uint64_t _occupied[LevelCount];
+
+	int64_t _current;
+
+	void Insert(Timer *timer);
+	void Link(Timer *timer, int list);
+	void Unlink(Timer *timer);
+
+	// Returns the nearest tick that has a slot to process,
+	// -1 if the wheel is empty.
+	int64_t NextTick();
+	void ProcessSlot(int level, int slot);
+};
+
+#endif
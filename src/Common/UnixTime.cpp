@@ -14,3 +14,15 @@ int64_t GetUnixTime()
 
 	return val;
 }
+
+int64_t GetMonotonicTime()
+{
+	struct timespec ts;
+	int res = clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	if (res == -1) {
+		THROW("Failed to get monotonic time.");
+	}
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
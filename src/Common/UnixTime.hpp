@@ -5,4 +5,7 @@
 
 int64_t GetUnixTime();
 
+// Milliseconds of monotonic clock.
+int64_t GetMonotonicTime();
+
 #endif
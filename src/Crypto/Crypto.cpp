@@ -18,14 +18,82 @@ static uint8_t Gen(uint8_t val)
 	return (val >> 1) | (bit << 7);
 }
 
-static void Scramble(uint8_t *buffer, uint64_t size, uint8_t init)
+// Generator passes all 255 nonzero states in one cycle, so output from
+// any state is a part of the same periodic sequence. Sequence is stored
+// twice to take a full period from any position.
+struct ScrambleTable
 {
-	uint8_t val = init;
+	enum
+	{
+		Period = 255
+	};
+
+	uint8_t Sequence[Period * 2];
+	uint8_t Position[256];
+
+	ScrambleTable()
+	{
+		uint8_t val = 1;
+
+		for (int i = 0; i < Period; i++) {
+			Sequence[i] = val;
+			Sequence[i + Period] = val;
+			Position[val] = i;
+			val = Gen(val);
+		}
 
-	for (uint64_t i = 0; i < size; i++) {
-		buffer[i] = buffer[i] ^ val;
-		val = Gen(val);
+		Position[0] = Position[Gen(0)];
+	}
+};
+
+static const ScrambleTable ScrambleSequence;
+
+// Returns state to continue scrambling of the following data.
+static uint8_t Scramble(
+	uint8_t *dest,
+	const uint8_t *src,
+	uint64_t size,
+	uint8_t init)
+{
+	if (!size) {
+		return init;
+	}
+
+	// Zero state masks the first byte with zero and continues as 1.
+	if (init == 0) {
+		dest[0] = src[0];
+		dest++;
+		src++;
+		size--;
+		init = Gen(0);
 	}
+
+	const uint8_t *sequence =
+		ScrambleSequence.Sequence + ScrambleSequence.Position[init];
+
+	while (size) {
+		uint64_t part = size < ScrambleTable::Period ?
+			size : ScrambleTable::Period;
+
+		for (uint64_t i = 0; i < part; i++) {
+			dest[i] = src[i] ^ sequence[i];
+		}
+
+		dest += part;
+		src += part;
+		size -= part;
+
+		if (part < ScrambleTable::Period) {
+			return sequence[part];
+		}
+	}
+
+	return sequence[0];
+}
+
+static void Scramble(uint8_t *buffer, uint64_t size, uint8_t init)
+{
+	Scramble(buffer, buffer, size, init);
 }
 
 static void GenerateRandomData(
@@ -105,6 +173,32 @@ void InitNonce(uint8_t nonce[NONCE_SIZE])
 		false);
 }
 
+void InitNonce(
+	uint8_t nonce[NONCE_SIZE],
+	int64_t seed,
+	const uint8_t salt[NONCE_SALT_SIZE])
+{
+	memcpy(nonce, &seed, sizeof(seed));
+	memcpy(nonce + sizeof(seed), salt, NONCE_SALT_SIZE);
+}
+
+void GenerateNonceSalt(uint8_t salt[NONCE_SALT_SIZE])
+{
+	GenerateRandomData(NONCE_SALT_SIZE, salt, false);
+}
+
+void AdvanceNonce(uint8_t nonce[NONCE_SIZE])
+{
+	for (int i = NONCE_SIZE - 1; i >= (int)sizeof(int64_t); i--) {
+		if (nonce[i] < 255) {
+			nonce[i] += 1;
+			break;
+		} else {
+			nonce[i] = 0;
+		}
+	}
+}
+
 void InitStream(
 	EncryptedStream &stream,
 	const uint8_t key[KEY_SIZE])
@@ -123,7 +217,7 @@ void InitStream(
 }
 
 CowBuffer<uint8_t> Encrypt(
-	const CowBuffer<uint8_t> plaintext,
+	const CowBuffer<uint8_t> &plaintext,
 	EncryptedStream &stream,
 	const uint8_t *addData,
 	uint64_t addSize)
@@ -157,7 +251,7 @@ CowBuffer<uint8_t> Encrypt(
 }
 
 CowBuffer<uint8_t> Decrypt(
-	const CowBuffer<uint8_t> cyphertext,
+	const CowBuffer<uint8_t> &cyphertext,
 	EncryptedStream &stream,
 	const uint8_t *addData,
 	uint64_t addSize)
@@ -166,17 +260,15 @@ CowBuffer<uint8_t> Decrypt(
 		return CowBuffer<uint8_t>();
 	}
 
-	CowBuffer<uint8_t> workplace = cyphertext;
+	// Header is descrambled aside and the message into the result,
+	// which is then decrypted in place. Input buffer is not changed.
+	const uint8_t *input = cyphertext.Pointer();
 
-	uint8_t *scramblerInit = workplace.Pointer();
-	uint8_t *mac = workplace.Pointer() + 1;
-	uint8_t *nonce = workplace.Pointer() + 1 + MAC_SIZE;
-	uint8_t *message = workplace.Pointer() + 1 + MAC_SIZE + NONCE_SIZE;
+	uint8_t header[MAC_SIZE + NONCE_SIZE];
+	uint8_t *mac = header;
+	uint8_t *nonce = header + MAC_SIZE;
 
-	Scramble(
-		workplace.Pointer() + 1,
-		workplace.Size() - 1,
-		scramblerInit[0]);
+	uint8_t val = Scramble(header, input + 1, sizeof(header), input[0]);
 
 	int success = VerifyNonce(stream.Nonce, nonce);
 
@@ -185,10 +277,13 @@ CowBuffer<uint8_t> Decrypt(
 	}
 
 	CowBuffer<uint8_t> result(
-		workplace.Size() - (1 + MAC_SIZE + NONCE_SIZE));
+		cyphertext.Size() - (1 + MAC_SIZE + NONCE_SIZE));
+
+	uint8_t *message = result.Pointer();
+	Scramble(message, input + 1 + sizeof(header), result.Size(), val);
 
 	success = crypto_aead_unlock(
-		result.Pointer(),
+		message,
 		mac,
 		stream.Key,
 		nonce,
@@ -206,7 +301,7 @@ CowBuffer<uint8_t> Decrypt(
 }
 
 void Sign(
-	const CowBuffer<uint8_t> data,
+	const CowBuffer<uint8_t> &data,
 	const uint8_t key[SIGNATURE_PRIVATE_KEY_SIZE],
 	uint8_t signature[SIGNATURE_SIZE])
 {
@@ -214,7 +309,7 @@ void Sign(
 }
 
 bool Verify(
-	const CowBuffer<uint8_t> data,
+	const CowBuffer<uint8_t> &data,
 	const uint8_t key[SIGNATURE_PUBLIC_KEY_SIZE],
 	const uint8_t signature[SIGNATURE_SIZE])
 {
@@ -337,6 +432,88 @@ void GetSalt(String file, uint8_t salt[SALT_SIZE])
 	close(fd);
 }
 
+void GenerateHashKey(uint8_t key[HASH_KEY_SIZE])
+{
+	GenerateRandomData(HASH_KEY_SIZE, key, false);
+}
+
+static uint64_t Rotate(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t LoadWord(const uint8_t *data, uint64_t size)
+{
+	uint64_t word = 0;
+
+	for (uint64_t i = 0; i < size; i++) {
+		word |= (uint64_t)data[i] << (i * 8);
+	}
+
+	return word;
+}
+
+static void SipRound(uint64_t v[4])
+{
+	v[0] += v[1];
+	v[1] = Rotate(v[1], 13);
+	v[1] ^= v[0];
+	v[0] = Rotate(v[0], 32);
+	v[2] += v[3];
+	v[3] = Rotate(v[3], 16);
+	v[3] ^= v[2];
+	v[0] += v[3];
+	v[3] = Rotate(v[3], 21);
+	v[3] ^= v[0];
+	v[2] += v[1];
+	v[1] = Rotate(v[1], 17);
+	v[1] ^= v[2];
+	v[2] = Rotate(v[2], 32);
+}
+
+uint64_t KeyedHash(
+	const uint8_t *data,
+	uint64_t size,
+	const uint8_t key[HASH_KEY_SIZE])
+{
+	uint64_t k0 = LoadWord(key, 8);
+	uint64_t k1 = LoadWord(key + 8, 8);
+
+	uint64_t v[4] = {
+		k0 ^ 0x736f6d6570736575,
+		k1 ^ 0x646f72616e646f6d,
+		k0 ^ 0x6c7967656e657261,
+		k1 ^ 0x7465646279746573
+	};
+
+	uint64_t tail = size % 8;
+	const uint8_t *end = data + size - tail;
+
+	for (; data < end; data += 8) {
+		uint64_t word = LoadWord(data, 8);
+
+		v[3] ^= word;
+		SipRound(v);
+		SipRound(v);
+		v[0] ^= word;
+	}
+
+	uint64_t last = LoadWord(data, tail) | size << 56;
+
+	v[3] ^= last;
+	SipRound(v);
+	SipRound(v);
+	v[0] ^= last;
+
+	v[2] ^= 0xff;
+
+	for (int i = 0; i < 4; i++) {
+		SipRound(v);
+	}
+
+	return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
 CowBuffer<uint8_t> ApplyScrambler(CowBuffer<uint8_t> data)
 {
 	CowBuffer<uint8_t> result(data.Size() + 1);
@@ -388,32 +565,35 @@ bool CryptoStreamReader::Init(
 	return true;
 }
 
-CowBuffer<uint8_t> CryptoStreamReader::Decrypt(
-	const CowBuffer<uint8_t> cyphertext,
-	const CowBuffer<uint8_t> add)
+void CryptoStreamReader::InitNext(EncryptedStream *ES)
 {
-	const CowBuffer<uint8_t> cyphertextDes = RemoveScrambler(cyphertext);
+	AdvanceNonce(ES->Nonce);
+	crypto_aead_init_x(&_ctx, ES->Key, ES->Nonce);
+}
 
-	if (cyphertextDes.Size() <= MAC_SIZE) {
-		return CowBuffer<uint8_t>();
+bool CryptoStreamReader::Decrypt(
+	uint8_t *slice,
+	uint64_t size,
+	uint8_t *plaintext,
+	const uint8_t *add,
+	uint64_t addSize)
+{
+	if (size <= STREAM_OVERHEAD) {
+		return false;
 	}
 
-	CowBuffer<uint8_t> result(cyphertextDes.Size() - MAC_SIZE);
+	Scramble(slice + 1, size - 1, slice[0]);
 
 	int error = crypto_aead_read(
 		&_ctx,
-		result.Pointer(),
-		cyphertextDes.Pointer(),
-		add.Size() ? add.Pointer() : nullptr,
-		add.Size(),
-		cyphertextDes.Pointer(MAC_SIZE),
-		result.Size());
-
-	if (error) {
-		return CowBuffer<uint8_t>();
-	}
+		plaintext,
+		slice + 1,
+		add,
+		addSize,
+		slice + STREAM_OVERHEAD,
+		size - STREAM_OVERHEAD);
 
-	return result;
+	return !error;
 }
 
 // Stream writer.
@@ -428,20 +608,28 @@ void CryptoStreamWriter::Init(EncryptedStream *ES)
 	crypto_aead_init_x(&_ctx, ES->Key, ES->Nonce);
 }
 
-CowBuffer<uint8_t> CryptoStreamWriter::Encrypt(
-	const CowBuffer<uint8_t> plaintext,
-	const CowBuffer<uint8_t> add)
+void CryptoStreamWriter::InitNext(EncryptedStream *ES)
 {
-	CowBuffer<uint8_t> result(plaintext.Size() + MAC_SIZE);
+	AdvanceNonce(ES->Nonce);
+	crypto_aead_init_x(&_ctx, ES->Key, ES->Nonce);
+}
 
+void CryptoStreamWriter::Encrypt(
+	const uint8_t *plaintext,
+	uint64_t size,
+	uint8_t *slice,
+	const uint8_t *add,
+	uint64_t addSize)
+{
 	crypto_aead_write(
 		&_ctx,
-		result.Pointer(MAC_SIZE),
-		result.Pointer(),
-		add.Size() ? add.Pointer() : nullptr,
-		add.Size(),
-		plaintext.Pointer(),
-		plaintext.Size());
+		slice + STREAM_OVERHEAD,
+		slice + 1,
+		add,
+		addSize,
+		plaintext,
+		size);
 
-	return ApplyScrambler(result);
+	GenerateRandomData(1, slice, false);
+	Scramble(slice + 1, size + MAC_SIZE, slice[0]);
 }
@@ -20,25 +20,35 @@ void InitStream(
 
 void InitNonce(uint8_t nonce[NONCE_SIZE]);
 
+// Nonces that are not transmitted. Both sides start from the same seed
+// and random salt, and derive nonce of each block by incrementing the
+// counter part.
+void InitNonce(
+	uint8_t nonce[NONCE_SIZE],
+	int64_t seed,
+	const uint8_t salt[NONCE_SALT_SIZE]);
+void GenerateNonceSalt(uint8_t salt[NONCE_SALT_SIZE]);
+void AdvanceNonce(uint8_t nonce[NONCE_SIZE]);
+
 CowBuffer<uint8_t> Encrypt(
-	const CowBuffer<uint8_t> plaintext,
+	const CowBuffer<uint8_t> &plaintext,
 	EncryptedStream &stream,
 	const uint8_t *addData = nullptr,
 	uint64_t addSize = 0);
 
 CowBuffer<uint8_t> Decrypt(
-	const CowBuffer<uint8_t> cyphertext,
+	const CowBuffer<uint8_t> &cyphertext,
 	struct EncryptedStream &stream,
 	const uint8_t *addData = nullptr,
 	uint64_t addSize = 0);
 
 void Sign(
-	const CowBuffer<uint8_t> data,
+	const CowBuffer<uint8_t> &data,
 	const uint8_t key[SIGNATURE_PRIVATE_KEY_SIZE],
 	uint8_t signature[SIGNATURE_SIZE]);
 
 bool Verify(
-	const CowBuffer<uint8_t> data,
+	const CowBuffer<uint8_t> &data,
 	const uint8_t key[SIGNATURE_PUBLIC_KEY_SIZE],
 	const uint8_t signature[SIGNATURE_SIZE]);
 
@@ -67,19 +77,39 @@ void GenerateSignature(
 
 void GetSalt(String file, uint8_t salt[SALT_SIZE]);
 
+// Keyed hash (SipHash-2-4) for tables indexed by data that peers
+// choose. Collisions can not be forced without the key.
+#define HASH_KEY_SIZE 16
+
+void GenerateHashKey(uint8_t key[HASH_KEY_SIZE]);
+uint64_t KeyedHash(
+	const uint8_t *data,
+	uint64_t size,
+	const uint8_t key[HASH_KEY_SIZE]);
+
 CowBuffer<uint8_t> ApplyScrambler(CowBuffer<uint8_t> data);
 CowBuffer<uint8_t> RemoveScrambler(CowBuffer<uint8_t> data);
 
+// Slice of encrypted stream is scrambler seed, MAC and ciphertext.
+#define STREAM_OVERHEAD (1 + MAC_SIZE)
+
 class CryptoStreamReader
 {
 public:
 	~CryptoStreamReader();
 
 	bool Init(EncryptedStream *ES, const uint8_t nonce[NONCE_SIZE]);
-
-	CowBuffer<uint8_t> Decrypt(
-		const CowBuffer<uint8_t> cyphertext,
-		const CowBuffer<uint8_t> add);
+	void InitNext(EncryptedStream *ES);
+
+	// Slice is descrambled in place and its plaintext of
+	// size - STREAM_OVERHEAD bytes is written to the destination,
+	// which is not changed if authentication fails.
+	bool Decrypt(
+		uint8_t *slice,
+		uint64_t size,
+		uint8_t *plaintext,
+		const uint8_t *add,
+		uint64_t addSize);
 
 private:
 	crypto_aead_ctx _ctx;
@@ -91,10 +121,15 @@ public:
 	~CryptoStreamWriter();
 
 	void Init(EncryptedStream *ES);
-
-	CowBuffer<uint8_t> Encrypt(
-		const CowBuffer<uint8_t> plaintext,
-		const CowBuffer<uint8_t> add);
+	void InitNext(EncryptedStream *ES);
+
+	// Writes slice of size + STREAM_OVERHEAD bytes.
+	void Encrypt(
+		const uint8_t *plaintext,
+		uint64_t size,
+		uint8_t *slice,
+		const uint8_t *add,
+		uint64_t addSize);
 
 private:
 	crypto_aead_ctx _ctx;
@@ -6,6 +6,7 @@
 #define SIGNATURE_PUBLIC_KEY_SIZE 32
 #define SIGNATURE_SIZE 64
 #define NONCE_SIZE 24
+#define NONCE_SALT_SIZE 16
 #define MAC_SIZE 16
 #define SALT_SIZE 16
 
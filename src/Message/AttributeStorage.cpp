@@ -10,6 +10,23 @@
 #include "../Crypto/CryptoDefinitions.hpp"
 #include "../ThirdParty/monocypher.h"
 
+// Length of the longest path,
+// storage/<owner>/attributes/<peer>/<timestamp>_<index>_<direction>.
+#define ATTRIBUTE_PATH_LENGTH (KEY_SIZE * 4 + 56)
+
+// Attribute file name, <timestamp>_<index> in hex and direction,
+// r for received and s for sent messages.
+static void AppendEntryName(
+	StringBuilder &path,
+	const Message::Header &header,
+	bool incoming)
+{
+	path.AppendHex(header.Timestamp);
+	path.Append('_');
+	path.AppendHex(header.Index);
+	path.Append(incoming ? "_r" : "_s");
+}
+
 AttributeStorage::AttributeStorage(const uint8_t *ownerKey)
 {
 	_ownerKey = ownerKey;
@@ -41,21 +58,21 @@ void AttributeStorage::SetAttribute(
 		peerKey = header.Source;
 	}
 
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-
-	String entryPath = "storage";
-	CreateDirectory(entryPath);
-	entryPath += "/" + ownerKeyHex;
-	CreateDirectory(entryPath);
-	entryPath += "/attributes";
-	CreateDirectory(entryPath);
-	entryPath += "/" + peerKeyHex;
-	CreateDirectory(entryPath);
-
-	entryPath += "/" +
-		ToHex(header.Timestamp) + "_" + ToHex(header.Index) +
-		(incoming ? "_r" : "_s");
+	StringBuilder path(ATTRIBUTE_PATH_LENGTH);
+	path.Append("storage");
+	CreateDirectory(path.GetString());
+	path.Append('/');
+	path.AppendHex(_ownerKey, KEY_SIZE);
+	CreateDirectory(path.GetString());
+	path.Append("/attributes");
+	CreateDirectory(path.GetString());
+	path.Append('/');
+	path.AppendHex(peerKey, KEY_SIZE);
+	CreateDirectory(path.GetString());
+
+	path.Append('/');
+	AppendEntryName(path, header, incoming);
+	String entryPath = path.Build();
 
 	if (!attribute) {
 		if (FileExists(entryPath)) {
@@ -93,17 +110,14 @@ uint32_t AttributeStorage::GetAttribute(CowBuffer<uint8_t> message)
 		peerKey = header.Source;
 	}
 
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-
-	String entryPath = "storage";
-	entryPath += "/" + ownerKeyHex;
-	entryPath += "/attributes";
-	entryPath += "/" + peerKeyHex;
-
-	entryPath += "/" +
-		ToHex(header.Timestamp) + "_" + ToHex(header.Index) +
-		(incoming ? "_r" : "_s");
+	StringBuilder path(ATTRIBUTE_PATH_LENGTH);
+	path.Append("storage/");
+	path.AppendHex(_ownerKey, KEY_SIZE);
+	path.Append("/attributes/");
+	path.AppendHex(peerKey, KEY_SIZE);
+	path.Append('/');
+	AppendEntryName(path, header, incoming);
+	String entryPath = path.Build();
 
 	if (!FileExists(entryPath)) {
 		return 0;
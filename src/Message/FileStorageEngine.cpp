@@ -0,0 +1,538 @@
+#include "FileStorageEngine.hpp"
+
+#include "MessageStorageIndex.hpp"
+#include "../Common/BinaryFile.hpp"
+#include "../Common/UnixTime.hpp"
+#include "../Common/File.hpp"
+#include "../Common/Hex.hpp"
+#include "../Crypto/CryptoDefinitions.hpp"
+
+// Message file name, <timestamp>_<index> in hex.
+static void AppendEntryName(
+	StringBuilder &path,
+	int64_t timestamp,
+	int32_t index)
+{
+	path.AppendHex(timestamp);
+	path.Append('_');
+	path.AppendHex(index);
+}
+
+// Returns false for names of other files.
+static bool ParseEntryName(
+	const String &name,
+	int64_t &timestamp,
+	int32_t &index)
+{
+	int timestampLength = sizeof(timestamp) * 2;
+	int indexLength = sizeof(index) * 2;
+
+	if (name.Length() != timestampLength + 1 + indexLength) {
+		return false;
+	}
+
+	if (name.CStr()[timestampLength] != '_') {
+		return false;
+	}
+
+	try {
+		timestamp = HexToInt<int64_t>(
+			name.Substring(0, timestampLength));
+		index = HexToInt<int32_t>(
+			name.Substring(timestampLength + 1, indexLength));
+	} catch (Exception&) {
+		return false;
+	}
+
+	return true;
+}
+
+static CowBuffer<uint8_t> ReadMessage(const String &path)
+{
+	BinaryFile file(path, false);
+	uint64_t size = file.Size();
+
+	if (size >= MESSAGE_MAP_THRESHOLD) {
+		CowBuffer<uint8_t> message = file.Map();
+
+		if (message.Size()) {
+			return message;
+		}
+	}
+
+	CowBuffer<uint8_t> message(size);
+	file.Read<uint8_t>(message.Pointer(), message.Size(), 0);
+	return message;
+}
+
+FileStorageEngine::FileStorageEngine(const uint8_t *ownerKey) :
+	StorageEngine(ownerKey)
+{
+}
+
+void FileStorageEngine::GetFreeTimestampIndex(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t &index)
+{
+	index = 0;
+
+	StringBuilder prefix(STORAGE_PATH_LENGTH);
+	AppendPeerPath(prefix, peerKey);
+	prefix.Append("/out/");
+
+	for (;;) {
+		StringBuilder path(STORAGE_PATH_LENGTH);
+		path.Append(prefix.GetString());
+		AppendEntryName(path, timestamp, index);
+
+		if (!FileExists(path.Build())) {
+			break;
+		}
+
+		++index;
+	}
+}
+
+bool FileStorageEngine::MessageExists(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index,
+	bool incoming)
+{
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	AppendPeerPath(path, peerKey);
+	path.Append(incoming ? "/in/" : "/out/");
+	AppendEntryName(path, timestamp, index);
+
+	return FileExists(path.Build());
+}
+
+bool FileStorageEngine::AddMessage(const CowBuffer<uint8_t> &message)
+{
+	Message::Header header;
+	bool res = Message::GetHeader(message, header);
+
+	if (!res) {
+		THROW("Invalid message header.");
+	}
+
+	bool incoming;
+	const uint8_t *peerKey = GetPeerKey(header, incoming);
+
+	CreatePeerDirectory(peerKey);
+
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	AppendPeerPath(path, peerKey);
+	path.Append(incoming ? "/in" : "/out");
+	CreateDirectory(path.GetString());
+
+	path.Append('/');
+	AppendEntryName(path, header.Timestamp, header.Index);
+	String entryPath = path.Build();
+
+	// Index entry of stored message is added again, index page can
+	// be lost while the file is kept.
+	if (FileExists(entryPath)) {
+		if (FileMatches(entryPath, message)) {
+			AddIndexEntry(peerKey, header, incoming);
+			return false;
+		}
+
+		RemoveFile(entryPath);
+	}
+
+	StringBuilder peerPath(STORAGE_PATH_LENGTH);
+	AppendMirrorPath(peerPath, peerKey);
+	peerPath.Append(incoming ? "/out/" : "/in/");
+	AppendEntryName(peerPath, header.Timestamp, header.Index);
+	String peerEntryPath = peerPath.Build();
+
+	bool linked =
+		FileExists(peerEntryPath) &&
+		FileMatches(peerEntryPath, message) &&
+		LinkFile(peerEntryPath, entryPath);
+
+	if (!linked) {
+		BinaryFile file(entryPath, true);
+
+		file.Write<uint8_t>(
+			message.Pointer(),
+			message.Size(),
+			0);
+	}
+
+	AddIndexEntry(peerKey, header, incoming);
+
+	return true;
+}
+
+bool FileStorageEngine::RemoveMessage(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index,
+	bool incoming)
+{
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	AppendPeerPath(path, peerKey);
+	path.Append(incoming ? "/in/" : "/out/");
+	AppendEntryName(path, timestamp, index);
+	String entryPath = path.Build();
+
+	if (!FileExists(entryPath)) {
+		return false;
+	}
+
+	StringBuilder indexPath(STORAGE_PATH_LENGTH);
+	AppendPeerPath(indexPath, peerKey);
+	indexPath.Append("/index");
+
+	{
+		MessageStorageIndex storageIndex(indexPath.Build());
+		storageIndex.RemoveEntry(timestamp, index, incoming);
+		storageIndex.Flush();
+	}
+
+	// Data is freed with the last link of the file.
+	RemoveFile(entryPath);
+
+	return true;
+}
+
+CowBuffer<CowBuffer<uint8_t>> FileStorageEngine::GetMessageRange(
+	const uint8_t *peerKey,
+	int64_t from,
+	int64_t to)
+{
+	struct Elem
+	{
+		Elem *Next;
+		CowBuffer<uint8_t> Message;
+	};
+
+	Elem *first = nullptr;
+	Elem **last = &first;
+
+	int messageCount = 0;
+
+	StringBuilder builder(STORAGE_PATH_LENGTH);
+	AppendPeerPath(builder, peerKey);
+	String path = builder.Build();
+
+	if (!FileExists(path)) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	String indexPath = path + "/index";
+
+	if (!FileExists(indexPath)) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+
+	uint32_t position = storageIndex.FindSmallest(from);
+
+	while (position) {
+		int64_t timestamp;
+		int32_t index;
+		bool incoming;
+
+		storageIndex.GetEntry(position, timestamp, index, incoming);
+		position = storageIndex.Next(position);
+
+		if (timestamp > to) {
+			break;
+		}
+
+		StringBuilder entryPath(STORAGE_PATH_LENGTH);
+		entryPath.Append(path);
+		entryPath.Append(incoming ? "/in/" : "/out/");
+		AppendEntryName(entryPath, timestamp, index);
+
+		Elem *elem = new Elem;
+		elem->Next = nullptr;
+
+		elem->Message = ReadMessage(entryPath.Build());
+
+		*last = elem;
+		last = &((*last)->Next);
+
+		++messageCount;
+	}
+
+	if (!messageCount) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> result(messageCount);
+	uint64_t index = 0;
+
+	while (first) {
+		result[index] = first->Message;
+		++index;
+
+		Elem *tmp = first;
+		first = first->Next;
+		delete tmp;
+	}
+
+	return result;
+}
+
+CowBuffer<CowBuffer<uint8_t>> FileStorageEngine::GetLatestNMessages(
+	const uint8_t *peerKey,
+	int requestedMessageCount)
+{
+	struct Elem
+	{
+		Elem *Next;
+		CowBuffer<uint8_t> Message;
+	};
+
+	Elem *first = nullptr;
+	Elem **last = &first;
+
+	int messageCount = 0;
+
+	StringBuilder builder(STORAGE_PATH_LENGTH);
+	AppendPeerPath(builder, peerKey);
+	String path = builder.Build();
+
+	if (!FileExists(path)) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	String indexPath = path + "/index";
+
+	if (!FileExists(indexPath)) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+	uint32_t position = storageIndex.FindBiggest();
+
+	while (position && messageCount < requestedMessageCount) {
+		int64_t timestamp;
+		int32_t index;
+		bool incoming;
+
+		storageIndex.GetEntry(position, timestamp, index, incoming);
+		position = storageIndex.Previous(position);
+
+		StringBuilder entryPath(STORAGE_PATH_LENGTH);
+		entryPath.Append(path);
+		entryPath.Append(incoming ? "/in/" : "/out/");
+		AppendEntryName(entryPath, timestamp, index);
+
+		Elem *elem = new Elem;
+		elem->Next = nullptr;
+
+		elem->Message = ReadMessage(entryPath.Build());
+
+		*last = elem;
+		last = &((*last)->Next);
+
+		++messageCount;
+	}
+
+	if (!messageCount) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> result(messageCount);
+	uint64_t index = 0;
+
+	while (first) {
+		result[index] = first->Message;
+		++index;
+
+		Elem *tmp = first;
+		first = first->Next;
+		delete tmp;
+	}
+
+	return result;
+}
+
+CowBuffer<StorageEngine::MessageKey> FileStorageEngine::GetMessageKeys(
+	const uint8_t *peerKey)
+{
+	StringBuilder indexPath(STORAGE_PATH_LENGTH);
+	AppendPeerPath(indexPath, peerKey);
+	indexPath.Append("/index");
+
+	return ReadKeys(indexPath.Build());
+}
+
+CowBuffer<CowBuffer<uint8_t>> FileStorageEngine::GetMessages(
+	const uint8_t *peerKey,
+	const CowBuffer<MessageKey> &keys)
+{
+	CowBuffer<CowBuffer<uint8_t>> messages(keys.Size());
+
+	StringBuilder builder(STORAGE_PATH_LENGTH);
+	AppendPeerPath(builder, peerKey);
+	String path = builder.Build();
+
+	for (uint64_t i = 0; i < keys.Size(); i++) {
+		StringBuilder entryPath(STORAGE_PATH_LENGTH);
+		entryPath.Append(path);
+		entryPath.Append(keys[i].Incoming ? "/in/" : "/out/");
+		AppendEntryName(entryPath, keys[i].Timestamp, keys[i].Index);
+		String messagePath = entryPath.Build();
+
+		if (FileExists(messagePath)) {
+			messages[i] = ReadMessage(messagePath);
+		}
+	}
+
+	return messages;
+}
+
+int64_t FileStorageEngine::MoveMessages(
+	const uint8_t *peerKey,
+	StorageEngine *target)
+{
+	StringBuilder builder(STORAGE_PATH_LENGTH);
+	AppendPeerPath(builder, peerKey);
+	String path = builder.Build();
+	String indexPath = path + "/index";
+
+	if (!FileExists(indexPath)) {
+		return 0;
+	}
+
+	int64_t messageCount = 0;
+
+	{
+		MessageStorageIndex storageIndex(indexPath);
+		uint32_t position = storageIndex.FindSmallest(INT64_MIN);
+
+		while (position) {
+			int64_t timestamp;
+			int32_t index;
+			bool incoming;
+
+			storageIndex.GetEntry(
+				position,
+				timestamp,
+				index,
+				incoming);
+			position = storageIndex.Next(position);
+
+			StringBuilder entryPath(STORAGE_PATH_LENGTH);
+			entryPath.Append(path);
+			entryPath.Append(incoming ? "/in/" : "/out/");
+			AppendEntryName(entryPath, timestamp, index);
+
+			target->AddMessage(ReadMessage(entryPath.Build()));
+			++messageCount;
+		}
+	}
+
+	const char *directories[] = {"/in", "/out"};
+
+	for (const char *directory : directories) {
+		String directoryPath = path + directory;
+
+		if (!FileExists(directoryPath)) {
+			continue;
+		}
+
+		CowBuffer<String> files = ListDirectory(directoryPath);
+
+		for (uint32_t i = 0; i < files.Size(); i++) {
+			RemoveFile(directoryPath + "/" + files[i]);
+		}
+
+		RemoveDirectory(directoryPath);
+	}
+
+	RemoveFile(indexPath);
+
+	return messageCount;
+}
+
+void FileStorageEngine::AddIndexEntry(
+	const uint8_t *peerKey,
+	const Message::Header &header,
+	bool incoming)
+{
+	StringBuilder indexPath(STORAGE_PATH_LENGTH);
+	AppendPeerPath(indexPath, peerKey);
+	indexPath.Append("/index");
+	String path = indexPath.Build();
+
+	// Rebuilt index has the entry, message file is written before.
+	try {
+		MessageStorageIndex storageIndex(path);
+		storageIndex.FindEntry(
+			header.Timestamp,
+			header.Index,
+			incoming);
+	} catch (Exception&) {
+		RebuildIndex(peerKey);
+		return;
+	}
+
+	MessageStorageIndex storageIndex(path);
+	storageIndex.AddEntry(header.Timestamp, header.Index, incoming);
+	storageIndex.Flush();
+}
+
+// Index is built under temporary name.
+void FileStorageEngine::RebuildIndex(const uint8_t *peerKey)
+{
+	StringBuilder builder(STORAGE_PATH_LENGTH);
+	AppendPeerPath(builder, peerKey);
+	String path = builder.Build();
+	String buildPath = path + "/index.build";
+
+	RemoveFile(buildPath);
+
+	{
+		MessageStorageIndex storageIndex(buildPath);
+
+		for (int incoming = 0; incoming < 2; incoming++) {
+			String directoryPath =
+				path + (incoming ? "/in" : "/out");
+
+			if (!FileExists(directoryPath)) {
+				continue;
+			}
+
+			CowBuffer<String> files = ListDirectory(directoryPath);
+
+			for (uint32_t i = 0; i < files.Size(); i++) {
+				int64_t timestamp;
+				int32_t index;
+
+				bool valid =
+					ParseEntryName(files[i], timestamp, index);
+
+				if (valid) {
+					storageIndex.AddEntry(
+						timestamp,
+						index,
+						incoming);
+				}
+			}
+		}
+
+		storageIndex.Flush();
+	}
+
+	RenameFile(buildPath, path + "/index");
+}
+
+bool FileStorageEngine::FileMatches(
+	const String &path,
+	const CowBuffer<uint8_t> &message)
+{
+	BinaryFile file(path, false);
+
+	return
+		file.Size() == message.Size() &&
+		StoredCopyMatches(file, 0, message);
+}
@@ -0,0 +1,71 @@
+#ifndef _FILE_STORAGE_ENGINE_HPP
+#define _FILE_STORAGE_ENGINE_HPP
+
+#include "StorageEngine.hpp"
+
+// Each message is stored in its own file,
+// storage/<owner>/storage/<peer>/{in,out}/<timestamp>_<index>.
+// Index file of the peer directory orders the messages. Message that
+// is already stored by the peer is linked to the peer file, the file
+// is freed with its last link.
+class FileStorageEngine : public StorageEngine
+{
+public:
+	FileStorageEngine(const uint8_t *ownerKey);
+
+	void GetFreeTimestampIndex(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t &index) override;
+
+	bool MessageExists(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t index,
+		bool incoming) override;
+
+	bool AddMessage(const CowBuffer<uint8_t> &message) override;
+
+	bool RemoveMessage(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t index,
+		bool incoming) override;
+
+	CowBuffer<CowBuffer<uint8_t>> GetMessageRange(
+		const uint8_t *peerKey,
+		int64_t from,
+		int64_t to) override;
+
+	CowBuffer<CowBuffer<uint8_t>> GetLatestNMessages(
+		const uint8_t *peerKey,
+		int requestedMessageCount) override;
+
+	CowBuffer<MessageKey> GetMessageKeys(const uint8_t *peerKey) override;
+
+	CowBuffer<CowBuffer<uint8_t>> GetMessages(
+		const uint8_t *peerKey,
+		const CowBuffer<MessageKey> &keys) override;
+
+	// Adds messages exchanged with the peer to the target and removes
+	// their files, returns number of messages. Interrupted move can
+	// be repeated, messages that are already in the target are
+	// skipped.
+	int64_t MoveMessages(const uint8_t *peerKey, StorageEngine *target);
+
+private:
+	// Index that can not be read is built again from names of message
+	// files.
+	void AddIndexEntry(
+		const uint8_t *peerKey,
+		const Message::Header &header,
+		bool incoming);
+	void RebuildIndex(const uint8_t *peerKey);
+
+	// Message file that does not match is left by interrupted write.
+	static bool FileMatches(
+		const String &path,
+		const CowBuffer<uint8_t> &message);
+};
+
+#endif
@@ -2,7 +2,7 @@
 
 #include <cstring>
 
-bool Message::GetHeader(const CowBuffer<uint8_t> message, Header &result)
+bool Message::GetHeader(const CowBuffer<uint8_t> &message, Header &result)
 {
 	if (message.Size() <= HeaderSize) {
 		return false;
@@ -10,13 +10,21 @@ bool Message::GetHeader(const CowBuffer<uint8_t> message, Header &result)
 
 	result.Source = message.Pointer(SourceOffset);
 	result.Destination = message.Pointer(DestinationOffset);
-	result.Timestamp = *message.SwitchType<int64_t>(TimestampOffset);
-	result.Index = *message.SwitchType<int32_t>(IndexOffset);
+
+	// Message can be a slice of journal at any offset.
+	memcpy(
+		&result.Timestamp,
+		message.Pointer(TimestampOffset),
+		sizeof(result.Timestamp));
+	memcpy(
+		&result.Index,
+		message.Pointer(IndexOffset),
+		sizeof(result.Index));
 	return true;
 }
 
 bool Message::GetMessage(
-	const CowBuffer<uint8_t> message,
+	const CowBuffer<uint8_t> &message,
 	CowBuffer<uint8_t> &result)
 {
 	if (message.Size() <= HeaderSize) {
@@ -39,8 +47,8 @@ CowBuffer<uint8_t> Message::BuildHeader(const Header &header)
 }
 
 CowBuffer<uint8_t> Message::BuildMessage(
-	const CowBuffer<uint8_t> header,
-	const CowBuffer<uint8_t> message)
+	const CowBuffer<uint8_t> &header,
+	const CowBuffer<uint8_t> &message)
 {
 	return header.Concat(message);
 }
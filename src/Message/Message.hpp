@@ -23,15 +23,15 @@ namespace Message
 		int32_t Index;
 	};
 
-	bool GetHeader(const CowBuffer<uint8_t> message, Header &result);
+	bool GetHeader(const CowBuffer<uint8_t> &message, Header &result);
 	bool GetMessage(
-		const CowBuffer<uint8_t> message,
+		const CowBuffer<uint8_t> &message,
 		CowBuffer<uint8_t> &result);
 
 	CowBuffer<uint8_t> BuildHeader(const Header &header);
 	CowBuffer<uint8_t> BuildMessage(
-		const CowBuffer<uint8_t> header,
-		const CowBuffer<uint8_t> message);
+		const CowBuffer<uint8_t> &header,
+		const CowBuffer<uint8_t> &message);
 };
 
 #endif
@@ -1,757 +1,350 @@
 #include "MessageStorage.hpp"
 
-#include "Message.hpp"
-#include "../Common/Hex.hpp"
+#include <cstdlib>
+
+#include "MessageStorageIndex.hpp"
 #include "../Common/BinaryFile.hpp"
-#include "../Common/UnixTime.hpp"
+#include "../Common/Hex.hpp"
 #include "../Common/File.hpp"
-#include "../Crypto/CryptoDefinitions.hpp"
 #include "../ThirdParty/monocypher.h"
 
-// Index.
-MessageStorageIndex::MessageStorageIndex(String path) :
-	_file(path, true),
-	_cache(&_file)
+MessageStorage::MessageStorage(
+	const uint8_t *ownerKey,
+	StorageEngine::Type type)
 {
-	if (_file.Size() == 0) {
-		IndexEntry entry;
-		memset(&entry, 0, sizeof(entry));
-		_file.Write<IndexEntry>(&entry, 1, 0);
-	}
+	_ownerKey = ownerKey;
+	_engine = StorageEngine::Create(type, ownerKey);
 }
 
-bool MessageStorageIndex::EntryExists(
-	int64_t timestamp,
-	int32_t index,
-	bool incoming)
+MessageStorage::~MessageStorage()
 {
-	IndexEntry indexEntry = _cache[0];
-
-	int64_t currentAddress = indexEntry.Right;
-
-	EntryValue value;
-	value.Timestamp = timestamp;
-	value.Index = index;
-	value.Incoming = incoming ? 1 : 0;
-
-	while (currentAddress) {
-		indexEntry = _cache[currentAddress];
-
-		if (value == indexEntry.Value) {
-			return indexEntry.Valid;
-		}
-
-		if (value < indexEntry.Value) {
-			currentAddress = indexEntry.Left;
-		} else {
-			currentAddress = indexEntry.Right;
-		}
-	}
-
-	return false;
+	delete _engine;
 }
 
-void MessageStorageIndex::AddEntry(
+void MessageStorage::GetFreeTimestampIndex(
+	const uint8_t *peerKey,
 	int64_t timestamp,
-	int32_t index,
-	bool incoming)
+	int32_t &index)
 {
-	EntryValue value;
-	value.Timestamp = timestamp;
-	value.Index = index;
-	value.Incoming = incoming ? 1 : 0;
-
-	IndexEntry parentEntry = _cache[0];
-
-	uint32_t *currentAddress = &parentEntry.Right;
-
-	while (*currentAddress) {
-		IndexEntry entry = _cache[*currentAddress];
-
-		if (value == entry.Value) {
-			if (!entry.Valid) {
-				entry.Valid = 1;
-				_cache[*currentAddress] = entry;
-			}
-
-			return;
-		}
-
-		if (value < entry.Value) {
-			currentAddress = &parentEntry.Left;
-		} else {
-			currentAddress = &parentEntry.Right;
-		}
-
-		parentEntry = entry;
-	}
-
-	uint32_t parentAddress = parentEntry.This;
-	uint32_t newAddress = Allocate();
-	*currentAddress = newAddress;
-	_cache[parentEntry.This] = parentEntry;
-
-	memset(&parentEntry, 0, sizeof(parentEntry));
-	parentEntry.Value = value;
-	parentEntry.Valid = 1;
-	parentEntry.This = newAddress;
-	parentEntry.Parent = parentAddress;
-	parentEntry.Depth = 0;
-
-	_cache[newAddress] = parentEntry;
-
-	Rollup(newAddress);
+	_engine->GetFreeTimestampIndex(peerKey, timestamp, index);
 }
 
-void MessageStorageIndex::RemoveEntry(
+bool MessageStorage::MessageExists(
+	const uint8_t *peerKey,
 	int64_t timestamp,
 	int32_t index,
 	bool incoming)
 {
-	EntryValue value;
-	value.Timestamp = timestamp;
-	value.Index = index;
-	value.Incoming = incoming ? 1 : 0;
-
-	IndexEntry parentEntry = _cache[0];
-
-	uint32_t currentAddress = parentEntry.Right;
-
-	while (currentAddress) {
-		IndexEntry entry = _cache[currentAddress];
-
-		if (value == entry.Value) {
-			entry.Valid = 0;
-			_cache[currentAddress] = entry;
-			Rollup(currentAddress);
-			return;
-		}
-
-		if (value < entry.Value) {
-			currentAddress = parentEntry.Left;
-		} else {
-			currentAddress = parentEntry.Right;
-		}
-
-		parentEntry = entry;
-	}
-}
-
-void MessageStorageIndex::GetEntry(
-	uint32_t address,
-	int64_t &timestamp,
-	int32_t &index,
-	bool &incoming)
-{
-	IndexEntry entry = _cache[address];
-	timestamp = entry.Value.Timestamp;
-	index = entry.Value.Index;
-	incoming = entry.Value.Incoming;
+	return _engine->MessageExists(peerKey, timestamp, index, incoming);
 }
 
-uint32_t MessageStorageIndex::FindSmallest(int64_t timestamp)
+bool MessageStorage::AddMessage(const CowBuffer<uint8_t> &message)
 {
-	IndexEntry entry = _cache[0];
+	bool added = _engine->AddMessage(message);
 
-	uint32_t smallestAddress = 0;
-	int64_t smallestValue = 0;
+	String timelinePath = GetOwnerPath() + "/timeline";
 
-	uint32_t address = entry.Right;
-
-	while (address) {
-		entry = _cache[address];
-
-		if (timestamp > entry.Value.Timestamp) {
-			address = entry.Right;
-		} else {
-			bool newSmallest = 
-				!smallestAddress ||
-				entry.Value.Timestamp < smallestValue;
-
-			if (newSmallest) {
-				smallestAddress = address;
-				smallestValue = entry.Value.Timestamp;
-			}
-
-			address = entry.Left;
-		}
+	if (!FileExists(timelinePath)) {
+		return added;
 	}
 
-	return smallestAddress;
-}
-
-uint32_t MessageStorageIndex::Next(uint32_t address)
-{
-	IndexEntry entry = _cache[address];
+	Message::Header header;
+	Message::GetHeader(message, header);
 
-	if (entry.Right) {
-		address = entry.Right;
-		entry = _cache[address];
+	bool incoming = crypto_verify32(_ownerKey, header.Source);
+	const uint8_t *peerKey =
+		incoming ? header.Source : header.Destination;
 
-		while (entry.Left) {
-			address = entry.Left;
-			entry = _cache[address];
-		}
+	uint32_t peer = GetPeerNumber(peerKey);
 
-		return address;
+	// Timeline that can not be read is removed, it is built again on
+	// the next range query.
+	try {
+		MessageStorageIndex timeline(timelinePath);
+		timeline.FindEntry(
+			header.Timestamp,
+			header.Index,
+			incoming,
+			peer);
+	} catch (Exception&) {
+		RemoveFile(timelinePath);
+		return added;
 	}
 
-	for (;;) {
-		uint32_t childAddress = address;
-		address = entry.Parent;
+	MessageStorageIndex timeline(timelinePath);
+	timeline.AddEntry(header.Timestamp, header.Index, incoming, peer);
+	timeline.Flush();
 
-		if (!address) {
-			return 0;
-		}
-
-		entry = _cache[address];
-
-		if (childAddress == entry.Left) {
-			return address;
-		}
-	}
+	return added;
 }
 
-uint32_t MessageStorageIndex::Previous(uint32_t address)
+bool MessageStorage::RemoveMessage(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index,
+	bool incoming)
 {
-	IndexEntry entry = _cache[address];
-
-	if (entry.Left) {
-		address = entry.Left;
-		entry = _cache[address];
+	bool removed = _engine->RemoveMessage(
+		peerKey,
+		timestamp,
+		index,
+		incoming);
 
-		while (entry.Right) {
-			address = entry.Right;
-			entry = _cache[address];
-		}
+	String timelinePath = GetOwnerPath() + "/timeline";
 
-		return address;
+	if (!removed || !FileExists(timelinePath)) {
+		return removed;
 	}
 
-	for (;;) {
-		uint32_t childAddress = address;
-		address = entry.Parent;
+	uint32_t peer = GetPeerNumber(peerKey);
 
-		if (!address) {
-			return 0;
-		}
-
-		entry = _cache[address];
+	MessageStorageIndex timeline(timelinePath);
+	timeline.RemoveEntry(timestamp, index, incoming, peer);
+	timeline.Flush();
 
-		if (childAddress == entry.Right) {
-			return address;
-		}
-	}
+	return removed;
 }
 
-uint32_t MessageStorageIndex::FindBiggest()
+// Timeline is scanned once for the range, then messages of each peer
+// are read together and put at their positions in the range.
+CowBuffer<CowBuffer<uint8_t>> MessageStorage::GetMessageRange(
+	int64_t from,
+	int64_t to)
 {
-	IndexEntry entry = _cache[0];
+	String ownerPath = GetOwnerPath();
 
-	uint32_t address = entry.Right;
-
-	while (address) {
-		entry = _cache[address];
+	if (!FileExists(ownerPath + "/storage")) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
 
-		if (!entry.Right) {
-			return address;
-		}
+	String timelinePath = ownerPath + "/timeline";
 
-		address = entry.Right;
+	if (!FileExists(timelinePath)) {
+		BuildTimeline();
 	}
 
-	return 0;
-}
+	CowBuffer<TimelineEntry> entries;
+	uint32_t count = 0;
 
-void MessageStorageIndex::RotateLeft(uint32_t address)
-{
-	/*      1                 2
-	 *     / \               / \
-	 *    A   2    --->     1   C
-	 *       / \           / \
-	 *      B   C         A   B
-	 *
-	 * Input argument is the address of node 1.
-	 */
-	uint32_t address1 = address;
-	IndexEntry node1 = _cache[address1];
-
-	if (!node1.Right) {
-		return;
-	}
+	{
+		MessageStorageIndex timeline(timelinePath);
+		uint32_t position = timeline.FindSmallest(from);
 
-	uint32_t address2 = node1.Right;
-	IndexEntry node2 = _cache[address2];
+		while (position) {
+			TimelineEntry entry;
 
-	uint32_t addressA = node1.Left;
-	uint32_t addressB = node2.Left;
-	uint32_t addressC = node2.Right;
+			timeline.GetEntry(
+				position,
+				entry.Key.Timestamp,
+				entry.Key.Index,
+				entry.Key.Incoming);
 
-	uint32_t depthA = -1;
-	uint32_t depthB = -1;
-	uint32_t depthC = -1;
+			if (entry.Key.Timestamp > to) {
+				break;
+			}
 
-	if (addressA) {
-		depthA = _cache[addressA].operator IndexEntry().Depth;
-	}
+			entry.Peer = timeline.GetPeer(position);
+			entry.Position = count;
+			position = timeline.Next(position);
 
-	if (addressB) {
-		depthB = _cache[addressB].operator IndexEntry().Depth;
-	}
+			if (count == entries.Size()) {
+				entries.Resize(count ? count * 2 : 64);
+			}
 
-	if (addressC) {
-		depthC = _cache[addressC].operator IndexEntry().Depth;
+			entries[count] = entry;
+			++count;
+		}
 	}
 
-	uint32_t parentAddress = node1.Parent;
-	IndexEntry parentNode = _cache[parentAddress];
-
-	node1.Left = addressA;
-	node1.Right = addressB;
-	node1.Parent = address2;
-	node1.Depth = (depthA > depthB ? depthA : depthB) + 1;
-	_cache[address1] = node1;
-
-	node2.Left = address1;
-	node2.Right = addressC;
-	node2.Parent = parentAddress;
-	node2.Depth = (node1.Depth > depthC ? node1.Depth : depthC) + 1;
-	_cache[address2] = node2;
-
-	if (parentNode.Left == address1) {
-		parentNode.Left = address2;
-	} else if (parentNode.Right == address1) {
-		parentNode.Right = address2;
-	} else {
-		THROW("Parent does not have child reference.");
+	if (!count) {
+		return CowBuffer<CowBuffer<uint8_t>>();
 	}
 
-	_cache[parentAddress] = parentNode;
+	qsort(entries.Pointer(), count, sizeof(TimelineEntry), CompareEntries);
 
-	if (addressB) {
-		IndexEntry nodeB = _cache[addressB];
-		nodeB.Parent = address1;
-		_cache[addressB] = nodeB;
-	}
-}
+	CowBuffer<CowBuffer<uint8_t>> messages(count);
 
-void MessageStorageIndex::Rollup(uint32_t address)
-{
-	IndexEntry entry;
+	BinaryFile peers(ownerPath + "/timeline.peers", false);
+	uint64_t peerCount = peers.Size() / KEY_SIZE;
 
-	while (address) {
-		entry = _cache[address];
+	uint32_t first = 0;
 
-		if (!entry.Valid && !entry.Left && !entry.Right) {
-			IndexEntry parent = _cache[entry.Parent];
+	while (first < count) {
+		uint32_t peer = entries[first].Peer;
+		uint32_t last = first + 1;
 
-			if (address == parent.Left) {
-				parent.Left = 0;
-			} else if (address == parent.Right) {
-				parent.Right = 0;
-			} else {
-				THROW("Parent does not have child reference.");
-			}
+		while (last < count && entries[last].Peer == peer) {
+			++last;
+		}
 
-			_cache[entry.Parent] = parent;
-			Free(address);
+		if (peer && peer <= peerCount) {
+			uint8_t peerKey[KEY_SIZE];
+			peers.Read<uint8_t>(
+				peerKey,
+				KEY_SIZE,
+				(uint64_t)(peer - 1) * KEY_SIZE);
 
-			address = parent.This;
-			continue;
-		}
+			CowBuffer<StorageEngine::MessageKey> keys(last - first);
 
-		uint32_t leftDepth = 0;
-		uint32_t rightDepth = 0;
+			for (uint32_t i = first; i < last; i++) {
+				keys[i - first] = entries[i].Key;
+			}
 
-		if (entry.Left) {
-			IndexEntry left = _cache[entry.Left];
-			leftDepth = left.Depth + 1;
-		}
+			CowBuffer<CowBuffer<uint8_t>> peerMessages =
+				_engine->GetMessages(peerKey, keys);
 
-		if (entry.Right) {
-			IndexEntry right = _cache[entry.Right];
-			rightDepth = right.Depth + 1;
+			for (uint32_t i = first; i < last; i++) {
+				messages[entries[i].Position] =
+					peerMessages[i - first];
+			}
 		}
 
-		entry.Depth = leftDepth > rightDepth ? leftDepth : rightDepth;
+		first = last;
+	}
 
-		_cache[entry.This] = entry;
+	// Entries of messages that are not stored are skipped.
+	uint32_t messageCount = 0;
 
-		if (rightDepth > leftDepth + 2) {
-			RotateLeft(address);
-			entry = _cache[address];
-		} else {
-			address = entry.Parent;
+	for (uint32_t i = 0; i < count; i++) {
+		if (messages[i].Size()) {
+			messages[messageCount] = messages[i];
+			++messageCount;
 		}
 	}
-}
-
-uint32_t MessageStorageIndex::Allocate()
-{
-	IndexEntry entry = _cache[0];
 
-	if (!entry.Left) {
-		return _file.Size() / sizeof(IndexEntry);
+	if (!messageCount) {
+		return CowBuffer<CowBuffer<uint8_t>>();
 	}
 
-	uint32_t newAddress = entry.Left;
-
-	IndexEntry allocEntry = _cache[newAddress];
-
-	entry.Left = allocEntry.Right;
-	_cache[0] = entry;
-
-	return newAddress;
+	return messages.Slice(0, messageCount);
 }
 
-void MessageStorageIndex::Free(uint32_t address)
-{
-	IndexEntry root = _cache[0];
-
-	IndexEntry entry = _cache[address];
-	entry.Valid = 0;
-	entry.Right = root.Left;
-	root.Left = entry.This;
-	_cache[address] = entry;
-	_cache[0] = root;
-}
-
-// Storage.
-MessageStorage::MessageStorage(const uint8_t *ownerKey)
-{
-	_ownerKey = ownerKey;
-}
-
-MessageStorage::~MessageStorage()
-{
-}
-
-void MessageStorage::GetFreeTimestampIndex(
+CowBuffer<CowBuffer<uint8_t>> MessageStorage::GetMessageRange(
 	const uint8_t *peerKey,
-	int64_t timestamp,
-	int32_t &index)
+	int64_t from,
+	int64_t to)
 {
-	index = 0;
-
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-	String timeString = ToHex(timestamp);
-
-	String prefix = "storage/" + ownerKeyHex + "/storage/" +
-		peerKeyHex + "/out/";
-
-	String path = prefix + timeString + "_" + ToHex(index);
-
-	while (FileExists(path)) {
-		++index;
-		path = prefix + timeString + "_" + ToHex(index);
-	}
+	return _engine->GetMessageRange(peerKey, from, to);
 }
 
-bool MessageStorage::MessageExists(
+CowBuffer<CowBuffer<uint8_t>> MessageStorage::GetLatestNMessages(
 	const uint8_t *peerKey,
-	int64_t timestamp,
-	int32_t index,
-	bool incoming)
+	int requestedMessageCount)
 {
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-
-	String path = "storage/" + ownerKeyHex + "/storage/" +
-		peerKeyHex + (incoming ? "/in/" : "/out/") +
-		ToHex(timestamp) + "_" + ToHex(index);
-
-	return FileExists(path);
+	return _engine->GetLatestNMessages(peerKey, requestedMessageCount);
 }
 
-bool MessageStorage::AddMessage(CowBuffer<uint8_t> message)
+String MessageStorage::GetOwnerPath()
 {
-	Message::Header header;
-	bool res = Message::GetHeader(message, header);
-
-	if (!res) {
-		THROW("Invalid message header.");
-	}
-
-	const uint8_t *peerKey = nullptr;
-	bool incoming;
-
-	if (!crypto_verify32(_ownerKey, header.Source)) {
-		incoming = false;
-		peerKey = header.Destination;
-	} else {
-		incoming = true;
-		peerKey = header.Source;
-	}
-
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-
-	String entryPath = "storage";
-	CreateDirectory(entryPath);
-	entryPath += "/" + ownerKeyHex;
-	CreateDirectory(entryPath);
-	entryPath += "/storage";
-	CreateDirectory(entryPath);
-	entryPath += "/" + peerKeyHex;
-	CreateDirectory(entryPath);
-	entryPath += incoming ? "/in" : "/out";
-	CreateDirectory(entryPath);
-
-	entryPath += "/" + ToHex(header.Timestamp) + "_" +
-		ToHex(header.Index);
-
-	if (FileExists(entryPath)) {
-		return false;
-	}
-
-	BinaryFile file(entryPath, true);
-
-	file.Write<uint8_t>(
-		message.Pointer(),
-		message.Size(),
-		0);
-
-	MessageStorageIndex storageIndex(
-		"storage/" + ownerKeyHex + "/storage/" +
-		peerKeyHex + "/index");
-	storageIndex.AddEntry(header.Timestamp, header.Index, incoming);
-
-	return true;
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	path.Append("storage/");
+	path.AppendHex(_ownerKey, KEY_SIZE);
+	return path.Build();
 }
 
-CowBuffer<CowBuffer<uint8_t>> MessageStorage::GetMessageRange(
-	int64_t from,
-	int64_t to)
+// Number is also kept in the peer directory, so the table is not
+// searched. Table and number file are not synced together, number
+// that the table does not confirm is given again.
+uint32_t MessageStorage::GetPeerNumber(const uint8_t *peerKey)
 {
-	struct Elem
-	{
-		Elem *Next;
-		CowBuffer<uint8_t> Message;
-	};
+	String ownerPath = GetOwnerPath();
 
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
+	StringBuilder numberPathBuilder(STORAGE_PATH_LENGTH);
+	numberPathBuilder.Append(ownerPath);
+	numberPathBuilder.Append("/storage/");
+	numberPathBuilder.AppendHex(peerKey, KEY_SIZE);
+	numberPathBuilder.Append("/timeline.peer");
+	String numberPath = numberPathBuilder.Build();
 
-	Elem *first = nullptr;
-	Elem **last = &first;
+	BinaryFile peers(ownerPath + "/timeline.peers", true);
+	uint64_t peerCount = peers.Size() / KEY_SIZE;
 
-	int messageCount = 0;
+	BinaryFile numberFile(numberPath, true);
+	uint32_t number = 0;
 
-	String path = "storage/" + ownerKeyHex + "/storage";
-
-	if (!FileExists(path)) {
-		return CowBuffer<CowBuffer<uint8_t>>();
+	if (numberFile.Size() == sizeof(number)) {
+		numberFile.Read<uint32_t>(&number, 1, 0);
 	}
 
-	CowBuffer<String> peers = ListDirectory(path);
-
-	for (uint32_t peerIdx = 0; peerIdx < peers.Size(); peerIdx++) {
-		uint8_t peerKey[KEY_SIZE];
-		HexToData(peers[peerIdx], peerKey);
-
-		CowBuffer<CowBuffer<uint8_t>> peerMessages = GetMessageRange(
-			peerKey,
-			from,
-			to);
-
-		for (
-			uint32_t msgIdx = 0;
-			msgIdx < peerMessages.Size();
-			msgIdx++)
-		{
-			Elem *elem = new Elem;
-			elem->Next = nullptr;
-
-			elem->Message = peerMessages[msgIdx];
-
-			*last = elem;
-			last = &((*last)->Next);
+	if (number && number <= peerCount) {
+		uint8_t key[KEY_SIZE];
+		peers.Read<uint8_t>(
+			key,
+			KEY_SIZE,
+			(uint64_t)(number - 1) * KEY_SIZE);
 
-			++messageCount;
+		if (!crypto_verify32(key, peerKey)) {
+			return number;
 		}
 	}
 
-	if (!messageCount) {
-		return CowBuffer<CowBuffer<uint8_t>>();
-	}
+	// Incomplete key at the end of the table is overwritten.
+	peers.Write<uint8_t>(peerKey, KEY_SIZE, peerCount * KEY_SIZE);
 
-	CowBuffer<CowBuffer<uint8_t>> result(messageCount);
-	uint64_t index = 0;
-
-	while (first) {
-		result[index] = first->Message;
-		++index;
-
-		Elem *tmp = first;
-		first = first->Next;
-		delete tmp;
-	}
+	number = peerCount + 1;
+	numberFile.Write<uint32_t>(&number, 1, 0);
 
-	return result;
+	return number;
 }
 
-CowBuffer<CowBuffer<uint8_t>> MessageStorage::GetMessageRange(
-	const uint8_t *peerKey,
-	int64_t from,
-	int64_t to)
+// Timeline is built under temporary name, interrupted build is
+// started again.
+void MessageStorage::BuildTimeline()
 {
-	struct Elem
-	{
-		Elem *Next;
-		CowBuffer<uint8_t> Message;
-	};
-
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-
-	Elem *first = nullptr;
-	Elem **last = &first;
-
-	int messageCount = 0;
+	String ownerPath = GetOwnerPath();
+	String buildPath = ownerPath + "/timeline.build";
 
-	String path = "storage/" + ownerKeyHex + "/storage/" +
-		peerKeyHex;
+	RemoveFile(buildPath);
 
-	if (!FileExists(path)) {
-		return CowBuffer<CowBuffer<uint8_t>>();
-	}
-
-	String indexPath = path + "/index";
+	{
+		MessageStorageIndex timeline(buildPath);
+		CowBuffer<String> peerNames = ListDirectory(
+			ownerPath + "/storage");
 
-	if (!FileExists(indexPath)) {
-		return CowBuffer<CowBuffer<uint8_t>>();
-	}
+		for (uint32_t i = 0; i < peerNames.Size(); i++) {
+			if (peerNames[i].Length() != KEY_SIZE * 2) {
+				continue;
+			}
 
-	MessageStorageIndex storageIndex(indexPath);
+			uint8_t peerKey[KEY_SIZE];
+			HexToData(peerNames[i], peerKey);
 
-	uint32_t address = storageIndex.FindSmallest(from);
+			CowBuffer<StorageEngine::MessageKey> keys =
+				_engine->GetMessageKeys(peerKey);
 
-	while (address) {
-		int64_t timestamp;
-		int32_t index;
-		bool incoming;
+			if (!keys.Size()) {
+				continue;
+			}
 
-		storageIndex.GetEntry(address, timestamp, index, incoming);
-		address = storageIndex.Next(address);
+			uint32_t peer = GetPeerNumber(peerKey);
 
-		if (timestamp > to) {
-			break;
+			for (uint64_t k = 0; k < keys.Size(); k++) {
+				timeline.AddEntry(
+					keys[k].Timestamp,
+					keys[k].Index,
+					keys[k].Incoming,
+					peer);
+			}
 		}
 
-		String entryPath = path + (incoming ? "/in/" : "/out/") +
-			ToHex(timestamp) + "_" + ToHex(index);
-
-		Elem *elem = new Elem;
-		elem->Next = nullptr;
-
-		BinaryFile file(entryPath, false);
-		elem->Message = CowBuffer<uint8_t>(file.Size());
-		file.Read<uint8_t>(
-			elem->Message.Pointer(),
-			elem->Message.Size(),
-			0);
-
-		*last = elem;
-		last = &((*last)->Next);
-
-		++messageCount;
-	}
-
-	if (!messageCount) {
-		return CowBuffer<CowBuffer<uint8_t>>();
-	}
-
-	CowBuffer<CowBuffer<uint8_t>> result(messageCount);
-	uint64_t index = 0;
-
-	while (first) {
-		result[index] = first->Message;
-		++index;
-
-		Elem *tmp = first;
-		first = first->Next;
-		delete tmp;
+		timeline.Flush();
 	}
 
-	return result;
+	RenameFile(buildPath, ownerPath + "/timeline");
 }
 
-CowBuffer<CowBuffer<uint8_t>> MessageStorage::GetLatestNMessages(
-	const uint8_t *peerKey,
-	int requestedMessageCount)
+int MessageStorage::CompareEntries(const void *first, const void *second)
 {
-	struct Elem
-	{
-		Elem *Next;
-		CowBuffer<uint8_t> Message;
-	};
-
-	String ownerKeyHex = DataToHex(_ownerKey, KEY_SIZE);
-	String peerKeyHex = DataToHex(peerKey, KEY_SIZE);
-
-	Elem *first = nullptr;
-	Elem **last = &first;
-
-	int messageCount = 0;
-
-	String path = "storage/" + ownerKeyHex + "/storage/" +
-		peerKeyHex;
+	const TimelineEntry *a = (const TimelineEntry*)first;
+	const TimelineEntry *b = (const TimelineEntry*)second;
 
-	if (!FileExists(path)) {
-		return CowBuffer<CowBuffer<uint8_t>>();
+	if (a->Peer != b->Peer) {
+		return a->Peer < b->Peer ? -1 : 1;
 	}
 
-	String indexPath = path + "/index";
-
-	if (!FileExists(indexPath)) {
-		return CowBuffer<CowBuffer<uint8_t>>();
+	if (a->Position != b->Position) {
+		return a->Position < b->Position ? -1 : 1;
 	}
 
-	MessageStorageIndex storageIndex(indexPath);
-	uint32_t address = storageIndex.FindBiggest();
-
-	while (address && messageCount < requestedMessageCount) {
-		int64_t timestamp;
-		int32_t index;
-		bool incoming;
-
-		storageIndex.GetEntry(address, timestamp, index, incoming);
-		address = storageIndex.Previous(address);
-
-		String entryPath = path + (incoming ? "/in/" : "/out/") +
-			ToHex(timestamp) + "_" + ToHex(index);
-
-		Elem *elem = new Elem;
-		elem->Next = nullptr;
-
-		BinaryFile file(entryPath, false);
-		elem->Message = CowBuffer<uint8_t>(file.Size());
-		file.Read<uint8_t>(
-			elem->Message.Pointer(),
-			elem->Message.Size(),
-			0);
-
-		*last = elem;
-		last = &((*last)->Next);
-
-		++messageCount;
-	}
-
-	if (!messageCount) {
-		return CowBuffer<CowBuffer<uint8_t>>();
-	}
-
-	CowBuffer<CowBuffer<uint8_t>> result(messageCount);
-	uint64_t index = 0;
-
-	while (first) {
-		result[index] = first->Message;
-		++index;
-
-		Elem *tmp = first;
-		first = first->Next;
-		delete tmp;
-	}
-
-	return result;
+	return 0;
 }
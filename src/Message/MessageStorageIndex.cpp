@@ -0,0 +1,773 @@
+#include "MessageStorageIndex.hpp"
+
+#include "../Common/File.hpp"
+
+// Node of the binary tree index of earlier versions. Free nodes and
+// nodes of removed values are not valid.
+struct LegacyNode
+{
+	struct
+	{
+		int64_t Timestamp;
+		int32_t Index;
+		uint8_t Incoming;
+	} Value;
+
+	int8_t Valid;
+
+	uint32_t This;
+	uint32_t Left;
+	uint32_t Right;
+	uint32_t Parent;
+	uint32_t Depth;
+};
+
+MessageStorageIndex::MessageStorageIndex(String path) :
+	_file(UpgradeLegacy(path), true)
+{
+	memset(_buckets, 0, sizeof(_buckets));
+	_newest = nullptr;
+	_oldest = nullptr;
+	_cachedCount = 0;
+	_headerDirty = false;
+
+	if (_file.Size() == 0) {
+		memset(&_header, 0, sizeof(_header));
+		_header.Magic = Magic;
+		_header.PageCount = 1;
+		_header.Root = AllocatePage(true);
+		_header.FirstLeaf = _header.Root;
+		_header.LastLeaf = _header.Root;
+		_header.NextNumber = 1;
+		_headerDirty = true;
+
+		Flush();
+		return;
+	}
+
+	_file.Read<FileHeader>(&_header, 1, 0);
+
+	if (_header.Magic != Magic) {
+		THROW("Invalid index file.");
+	}
+}
+
+MessageStorageIndex::~MessageStorageIndex()
+{
+	try {
+		Flush();
+	} catch (...) {
+	}
+
+	while (_newest) {
+		CachedPage *page = _newest;
+		_newest = page->Older;
+		delete page;
+	}
+}
+
+bool MessageStorageIndex::EntryExists(
+	int64_t timestamp,
+	int32_t index,
+	bool incoming,
+	uint32_t peer)
+{
+	return FindEntry(timestamp, index, incoming, peer);
+}
+
+uint32_t MessageStorageIndex::FindEntry(
+	int64_t timestamp,
+	int32_t index,
+	bool incoming,
+	uint32_t peer)
+{
+	Key key = MakeKey(timestamp, index, incoming, peer);
+
+	uint32_t path[MaxHeight];
+	uint32_t depth;
+	Page *page = GetPage(FindLeaf(key, path, depth), false);
+
+	uint32_t slot = LowerBound(page, key);
+
+	if (slot < page->Header.Count && GetKey(page->Entries[slot]) == key) {
+		return page->Entries[slot].Link;
+	}
+
+	return 0;
+}
+
+uint32_t MessageStorageIndex::AddEntry(
+	int64_t timestamp,
+	int32_t index,
+	bool incoming,
+	uint32_t peer)
+{
+	uint32_t number = FindEntry(timestamp, index, incoming, peer);
+
+	if (number) {
+		return number;
+	}
+
+	number = _header.NextNumber;
+	Insert(MakeKey(timestamp, index, incoming, peer), number);
+
+	_header.NextNumber++;
+	_headerDirty = true;
+
+	return number;
+}
+
+// Pages are not merged, leaf that becomes empty stays in the list and
+// is skipped by scans.
+void MessageStorageIndex::RemoveEntry(
+	int64_t timestamp,
+	int32_t index,
+	bool incoming,
+	uint32_t peer)
+{
+	Key key = MakeKey(timestamp, index, incoming, peer);
+
+	uint32_t path[MaxHeight];
+	uint32_t depth;
+	uint32_t leaf = FindLeaf(key, path, depth);
+	Page *page = GetPage(leaf, false);
+
+	uint32_t slot = LowerBound(page, key);
+
+	bool found =
+		slot < page->Header.Count &&
+		GetKey(page->Entries[slot]) == key;
+
+	if (!found) {
+		return;
+	}
+
+	page = GetPage(leaf, true);
+	page->Header.Count--;
+
+	memmove(
+		&page->Entries[slot],
+		&page->Entries[slot + 1],
+		(page->Header.Count - slot) * sizeof(Entry));
+}
+
+// Pages go to the file before the header, so the header never refers
+// to pages that are not written.
+void MessageStorageIndex::Flush()
+{
+	for (CachedPage *page = _oldest; page; page = page->Newer) {
+		if (page->Dirty) {
+			WritePage(page);
+		}
+	}
+
+	if (_headerDirty) {
+		_file.Write<FileHeader>(&_header, 1, 0);
+		_headerDirty = false;
+	}
+}
+
+void MessageStorageIndex::GetEntry(
+	uint32_t position,
+	int64_t &timestamp,
+	int32_t &index,
+	bool &incoming)
+{
+	Page *page = GetPage(position >> 8, false);
+	uint32_t slot = position & 0xff;
+
+	if (!page->Header.Leaf || slot >= page->Header.Count) {
+		THROW("Invalid index position.");
+	}
+
+	timestamp = page->Entries[slot].Timestamp;
+	index = page->Entries[slot].Index;
+	incoming = page->Entries[slot].Incoming;
+}
+
+uint32_t MessageStorageIndex::GetNumber(uint32_t position)
+{
+	Page *page = GetPage(position >> 8, false);
+	uint32_t slot = position & 0xff;
+
+	if (!page->Header.Leaf || slot >= page->Header.Count) {
+		THROW("Invalid index position.");
+	}
+
+	return page->Entries[slot].Link;
+}
+
+uint32_t MessageStorageIndex::GetPeer(uint32_t position)
+{
+	Page *page = GetPage(position >> 8, false);
+	uint32_t slot = position & 0xff;
+
+	if (!page->Header.Leaf || slot >= page->Header.Count) {
+		THROW("Invalid index position.");
+	}
+
+	return page->Entries[slot].Peer;
+}
+
+uint32_t MessageStorageIndex::FindSmallest(int64_t timestamp)
+{
+	Key key = MakeKey(timestamp, INT32_MIN, false, 0);
+
+	uint32_t path[MaxHeight];
+	uint32_t depth;
+	uint32_t leaf = FindLeaf(key, path, depth);
+	Page *page = GetPage(leaf, false);
+
+	uint32_t slot = LowerBound(page, key);
+
+	if (slot < page->Header.Count) {
+		return MakePosition(leaf, slot);
+	}
+
+	// Entries of the next leaf are bigger than the key.
+	for (leaf = page->Header.Next; leaf; leaf = page->Header.Next) {
+		page = GetPage(leaf, false);
+
+		if (page->Header.Count) {
+			return MakePosition(leaf, 0);
+		}
+	}
+
+	return 0;
+}
+
+uint32_t MessageStorageIndex::FindBiggest()
+{
+	for (uint32_t leaf = _header.LastLeaf; leaf;) {
+		Page *page = GetPage(leaf, false);
+
+		if (page->Header.Count) {
+			return MakePosition(leaf, page->Header.Count - 1);
+		}
+
+		leaf = page->Header.Previous;
+	}
+
+	return 0;
+}
+
+uint32_t MessageStorageIndex::Next(uint32_t position)
+{
+	uint32_t leaf = position >> 8;
+	uint32_t slot = position & 0xff;
+	Page *page = GetPage(leaf, false);
+
+	if (slot + 1 < page->Header.Count) {
+		return position + 1;
+	}
+
+	for (leaf = page->Header.Next; leaf; leaf = page->Header.Next) {
+		page = GetPage(leaf, false);
+
+		if (page->Header.Count) {
+			return MakePosition(leaf, 0);
+		}
+	}
+
+	return 0;
+}
+
+uint32_t MessageStorageIndex::Previous(uint32_t position)
+{
+	uint32_t leaf = position >> 8;
+	uint32_t slot = position & 0xff;
+	Page *page = GetPage(leaf, false);
+
+	if (slot > 0) {
+		return position - 1;
+	}
+
+	for (leaf = page->Header.Previous; leaf; leaf = page->Header.Previous) {
+		page = GetPage(leaf, false);
+
+		if (page->Header.Count) {
+			return MakePosition(leaf, page->Header.Count - 1);
+		}
+	}
+
+	return 0;
+}
+
+MessageStorageIndex::Page *MessageStorageIndex::GetPage(
+	uint32_t number,
+	bool modify)
+{
+	if (!number || number >= _header.PageCount) {
+		THROW("Invalid index page.");
+	}
+
+	CachedPage *page = _buckets[number % BucketCount];
+
+	while (page && page->Number != number) {
+		page = page->NextInBucket;
+	}
+
+	if (page) {
+		Unlink(page);
+		LinkNewest(page);
+	} else {
+		page = GetFreePage();
+
+		try {
+			_file.Read<Page>(
+				&page->Data,
+				1,
+				(uint64_t)number * PageSize);
+
+			// Page torn by a crash must not be searched.
+			if (page->Data.Header.Count > Capacity) {
+				THROW("Invalid index page.");
+			}
+		} catch (...) {
+			delete page;
+			_cachedCount--;
+			throw;
+		}
+
+		AddToCache(page, number);
+	}
+
+	if (modify) {
+		page->Dirty = true;
+	}
+
+	return &page->Data;
+}
+
+uint32_t MessageStorageIndex::AllocatePage(bool leaf)
+{
+	// Positions keep slot in the lowest byte.
+	if (_header.PageCount >= 1 << 24) {
+		THROW("Index is too large.");
+	}
+
+	uint32_t number = _header.PageCount;
+	_header.PageCount++;
+	_headerDirty = true;
+
+	CachedPage *page = GetFreePage();
+	memset(&page->Data, 0, sizeof(page->Data));
+	page->Data.Header.Leaf = leaf ? 1 : 0;
+	AddToCache(page, number);
+	page->Dirty = true;
+
+	return number;
+}
+
+// Page that is not in the cache, the oldest page is evicted when the
+// cache is full.
+MessageStorageIndex::CachedPage *MessageStorageIndex::GetFreePage()
+{
+	if (_cachedCount < CacheSize) {
+		_cachedCount++;
+		return new CachedPage;
+	}
+
+	CachedPage *page = _oldest;
+
+	if (page->Dirty) {
+		WritePage(page);
+	}
+
+	Unlink(page);
+	RemoveFromBucket(page);
+
+	return page;
+}
+
+void MessageStorageIndex::AddToCache(CachedPage *page, uint32_t number)
+{
+	page->Number = number;
+	page->Dirty = false;
+	page->NextInBucket = _buckets[number % BucketCount];
+	_buckets[number % BucketCount] = page;
+
+	LinkNewest(page);
+}
+
+void MessageStorageIndex::Unlink(CachedPage *page)
+{
+	if (page->Newer) {
+		page->Newer->Older = page->Older;
+	} else {
+		_newest = page->Older;
+	}
+
+	if (page->Older) {
+		page->Older->Newer = page->Newer;
+	} else {
+		_oldest = page->Newer;
+	}
+}
+
+void MessageStorageIndex::LinkNewest(CachedPage *page)
+{
+	page->Newer = nullptr;
+	page->Older = _newest;
+
+	if (_newest) {
+		_newest->Newer = page;
+	} else {
+		_oldest = page;
+	}
+
+	_newest = page;
+}
+
+void MessageStorageIndex::RemoveFromBucket(CachedPage *page)
+{
+	CachedPage **link = &_buckets[page->Number % BucketCount];
+
+	while (*link != page) {
+		link = &(*link)->NextInBucket;
+	}
+
+	*link = page->NextInBucket;
+}
+
+void MessageStorageIndex::WritePage(CachedPage *page)
+{
+	_file.Write<Page>(&page->Data, 1, (uint64_t)page->Number * PageSize);
+	page->Dirty = false;
+}
+
+MessageStorageIndex::Key MessageStorageIndex::MakeKey(
+	int64_t timestamp,
+	int32_t index,
+	bool incoming,
+	uint32_t peer)
+{
+	Key key;
+	key.Timestamp = timestamp;
+	key.Peer = peer;
+	key.Index = index;
+	key.Incoming = incoming ? 1 : 0;
+	return key;
+}
+
+MessageStorageIndex::Key MessageStorageIndex::GetKey(const Entry &entry)
+{
+	Key key;
+	key.Timestamp = entry.Timestamp;
+	key.Peer = entry.Peer;
+	key.Index = entry.Index;
+	key.Incoming = entry.Incoming;
+	return key;
+}
+
+void MessageStorageIndex::SetKey(Entry &entry, const Key &key)
+{
+	entry.Timestamp = key.Timestamp;
+	entry.Peer = key.Peer;
+	entry.Index = key.Index;
+	entry.Incoming = key.Incoming;
+}
+
+uint32_t MessageStorageIndex::MakePosition(uint32_t page, uint32_t slot)
+{
+	return page << 8 | slot;
+}
+
+uint32_t MessageStorageIndex::LowerBound(const Page *page, const Key &key)
+{
+	uint32_t begin = 0;
+	uint32_t end = page->Header.Count;
+
+	while (begin < end) {
+		uint32_t middle = (begin + end) / 2;
+
+		if (GetKey(page->Entries[middle]) < key) {
+			begin = middle + 1;
+		} else {
+			end = middle;
+		}
+	}
+
+	return begin;
+}
+
+uint32_t MessageStorageIndex::GetChild(const Page *page, const Key &key)
+{
+	uint32_t begin = 0;
+	uint32_t end = page->Header.Count;
+
+	// Number of entries with keys that are not bigger than the key.
+	while (begin < end) {
+		uint32_t middle = (begin + end) / 2;
+
+		if (key < GetKey(page->Entries[middle])) {
+			end = middle;
+		} else {
+			begin = middle + 1;
+		}
+	}
+
+	return begin ? page->Entries[begin - 1].Link : page->Header.First;
+}
+
+uint32_t MessageStorageIndex::FindLeaf(
+	const Key &key,
+	uint32_t *path,
+	uint32_t &depth)
+{
+	depth = 0;
+
+	uint32_t number = _header.Root;
+	Page *page = GetPage(number, false);
+
+	while (!page->Header.Leaf) {
+		if (depth == MaxHeight) {
+			THROW("Index is too deep.");
+		}
+
+		path[depth] = number;
+		depth++;
+
+		number = GetChild(page, key);
+		page = GetPage(number, false);
+	}
+
+	return number;
+}
+
+void MessageStorageIndex::Insert(const Key &key, uint32_t number)
+{
+	uint32_t path[MaxHeight];
+	uint32_t depth;
+	uint32_t leaf = FindLeaf(key, path, depth);
+	Page *page = GetPage(leaf, false);
+
+	uint32_t slot = LowerBound(page, key);
+
+	if (slot < page->Header.Count && GetKey(page->Entries[slot]) == key) {
+		return;
+	}
+
+	Entry entry;
+	memset(&entry, 0, sizeof(entry));
+	SetKey(entry, key);
+	entry.Link = number;
+
+	InsertIntoLeaf(path, depth, leaf, slot, entry);
+}
+
+void MessageStorageIndex::InsertIntoLeaf(
+	uint32_t *path,
+	uint32_t depth,
+	uint32_t leaf,
+	uint32_t slot,
+	const Entry &entry)
+{
+	Page *page = GetPage(leaf, true);
+	uint32_t count = page->Header.Count;
+
+	if (count < Capacity) {
+		memmove(
+			&page->Entries[slot + 1],
+			&page->Entries[slot],
+			(count - slot) * sizeof(Entry));
+		page->Entries[slot] = entry;
+		page->Header.Count++;
+		return;
+	}
+
+	Entry entries[Capacity + 1];
+	memcpy(entries, page->Entries, slot * sizeof(Entry));
+	entries[slot] = entry;
+	memcpy(
+		entries + slot + 1,
+		page->Entries + slot,
+		(count - slot) * sizeof(Entry));
+
+	// Messages are mostly added in time order, the last leaf stays
+	// full when it is split at its end.
+	uint32_t keep = (count + 1) / 2;
+
+	if (slot == count && !page->Header.Next) {
+		keep = count;
+	}
+
+	uint32_t right = AllocatePage(true);
+	Page *rightPage = GetPage(right, true);
+	page = GetPage(leaf, true);
+
+	memcpy(page->Entries, entries, keep * sizeof(Entry));
+	page->Header.Count = keep;
+
+	memcpy(
+		rightPage->Entries,
+		entries + keep,
+		(count + 1 - keep) * sizeof(Entry));
+	rightPage->Header.Count = count + 1 - keep;
+
+	rightPage->Header.Previous = leaf;
+	rightPage->Header.Next = page->Header.Next;
+	page->Header.Next = right;
+
+	Key separator = GetKey(rightPage->Entries[0]);
+	uint32_t next = rightPage->Header.Next;
+
+	if (next) {
+		GetPage(next, true)->Header.Previous = right;
+	} else {
+		_header.LastLeaf = right;
+		_headerDirty = true;
+	}
+
+	InsertIntoParent(path, depth, leaf, separator, right);
+}
+
+void MessageStorageIndex::InsertIntoParent(
+	uint32_t *path,
+	uint32_t depth,
+	uint32_t left,
+	const Key &key,
+	uint32_t right)
+{
+	Entry entry;
+	memset(&entry, 0, sizeof(entry));
+	SetKey(entry, key);
+	entry.Link = right;
+
+	if (!depth) {
+		uint32_t root = AllocatePage(false);
+		Page *page = GetPage(root, true);
+		page->Header.First = left;
+		page->Entries[0] = entry;
+		page->Header.Count = 1;
+
+		_header.Root = root;
+		_header.Height++;
+		_headerDirty = true;
+		return;
+	}
+
+	uint32_t parent = path[depth - 1];
+	Page *page = GetPage(parent, true);
+	uint32_t count = page->Header.Count;
+
+	// Key of the new page is bigger than keys of the split page, so
+	// it goes right after the link to the split page.
+	uint32_t slot = LowerBound(page, key);
+
+	if (count < Capacity) {
+		memmove(
+			&page->Entries[slot + 1],
+			&page->Entries[slot],
+			(count - slot) * sizeof(Entry));
+		page->Entries[slot] = entry;
+		page->Header.Count++;
+		return;
+	}
+
+	Entry entries[Capacity + 1];
+	memcpy(entries, page->Entries, slot * sizeof(Entry));
+	entries[slot] = entry;
+	memcpy(
+		entries + slot + 1,
+		page->Entries + slot,
+		(count - slot) * sizeof(Entry));
+
+	// Middle key moves to the parent, its child becomes the first
+	// child of the new page.
+	uint32_t keep = (count + 1) / 2;
+	uint32_t moved = count - keep;
+
+	uint32_t sibling = AllocatePage(false);
+	Page *siblingPage = GetPage(sibling, true);
+	page = GetPage(parent, true);
+
+	memcpy(page->Entries, entries, keep * sizeof(Entry));
+	page->Header.Count = keep;
+
+	siblingPage->Header.First = entries[keep].Link;
+	memcpy(
+		siblingPage->Entries,
+		entries + keep + 1,
+		moved * sizeof(Entry));
+	siblingPage->Header.Count = moved;
+
+	InsertIntoParent(
+		path,
+		depth - 1,
+		parent,
+		GetKey(entries[keep]),
+		sibling);
+}
+
+String MessageStorageIndex::UpgradeLegacy(String path)
+{
+	if (!FileExists(path)) {
+		return path;
+	}
+
+	{
+		BinaryFile file(path, false);
+		uint64_t magic;
+
+		if (file.Size() < sizeof(magic)) {
+			return path;
+		}
+
+		file.Read<uint64_t>(&magic, 1, 0);
+
+		if (magic == Magic) {
+			return path;
+		}
+	}
+
+	String upgradePath = path + ".upgrade";
+	RemoveFile(upgradePath);
+
+	{
+		MessageStorageIndex index(upgradePath);
+		BinaryFile legacy(path, false);
+
+		const uint64_t batchSize = 4096;
+		CowBuffer<LegacyNode> nodes(batchSize);
+		uint64_t nodeCount = legacy.Size() / sizeof(LegacyNode);
+
+		// Node zero is the header of the tree.
+		uint64_t first = 1;
+
+		for (; first < nodeCount; first += batchSize) {
+			uint64_t count = nodeCount - first;
+
+			if (count > batchSize) {
+				count = batchSize;
+			}
+
+			legacy.Read<LegacyNode>(
+				nodes.Pointer(),
+				count,
+				first * sizeof(LegacyNode));
+
+			for (uint64_t i = 0; i < count; i++) {
+				if (nodes[i].Valid != 1) {
+					continue;
+				}
+
+				Key key = MakeKey(
+					nodes[i].Value.Timestamp,
+					nodes[i].Value.Index,
+					nodes[i].Value.Incoming,
+					0);
+
+				index.Insert(key, first + i);
+			}
+		}
+
+		index._header.NextNumber = nodeCount > 1 ? nodeCount : 1;
+		index._headerDirty = true;
+		index.Flush();
+	}
+
+	RenameFile(upgradePath, path);
+
+	return path;
+}
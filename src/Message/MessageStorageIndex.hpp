@@ -0,0 +1,235 @@
+#ifndef _MESSAGE_STORAGE_INDEX_HPP
+#define _MESSAGE_STORAGE_INDEX_HPP
+
+#include <cstring>
+
+#include "../Common/BinaryFile.hpp"
+
+// B+tree of message keys stored in pages of 4 KB. Leaves are linked in
+// key order for range scans. Pages are kept in LRU cache, modified
+// pages are written when they are evicted or the index is flushed.
+//
+// Each entry has a number that does not change while the entry is
+// stored, storage engines keep data of the entry at its number.
+// Positions returned by search functions refer to entries in leaves
+// and are valid until the index is modified.
+//
+// Keys are ordered by timestamp, peer, index and direction. Peer is a
+// number given to the peer by the owner of index that holds messages
+// of all peers, indices of one conversation keep it zero.
+class MessageStorageIndex
+{
+public:
+	MessageStorageIndex(String path);
+	~MessageStorageIndex();
+
+	bool EntryExists(
+		int64_t timestamp,
+		int32_t index,
+		bool incoming,
+		uint32_t peer = 0);
+
+	// Number of the entry, zero if there is none.
+	uint32_t FindEntry(
+		int64_t timestamp,
+		int32_t index,
+		bool incoming,
+		uint32_t peer = 0);
+
+	// Returns number of the entry.
+	uint32_t AddEntry(
+		int64_t timestamp,
+		int32_t index,
+		bool incoming,
+		uint32_t peer = 0);
+	void RemoveEntry(
+		int64_t timestamp,
+		int32_t index,
+		bool incoming,
+		uint32_t peer = 0);
+
+	// Writes modified pages to the file.
+	void Flush();
+
+	void GetEntry(
+		uint32_t position,
+		int64_t &timestamp,
+		int32_t &index,
+		bool &incoming);
+	uint32_t GetNumber(uint32_t position);
+	uint32_t GetPeer(uint32_t position);
+
+	// First entry with timestamp that is not less than the given one.
+	uint32_t FindSmallest(int64_t timestamp);
+	uint32_t FindBiggest();
+
+	uint32_t Next(uint32_t position);
+	uint32_t Previous(uint32_t position);
+
+private:
+	enum
+	{
+		PageSize = 4096,
+		CacheSize = 128,
+		BucketCount = 256,
+		MaxHeight = 16
+	};
+
+	static const uint64_t Magic = 0x3145455254425354;
+
+	struct Key
+	{
+		int64_t Timestamp;
+		uint32_t Peer;
+		int32_t Index;
+		uint32_t Incoming;
+
+		bool operator==(const Key &key) const
+		{
+			return
+				Timestamp == key.Timestamp &&
+				Peer == key.Peer &&
+				Index == key.Index &&
+				Incoming == key.Incoming;
+		}
+
+		bool operator<(const Key &key) const
+		{
+			if (Timestamp != key.Timestamp) {
+				return Timestamp < key.Timestamp;
+			}
+
+			if (Peer != key.Peer) {
+				return Peer < key.Peer;
+			}
+
+			if (Index != key.Index) {
+				return Index < key.Index;
+			}
+
+			return Incoming < key.Incoming;
+		}
+	};
+
+	// Entry of inner page links to the child with keys that are not
+	// less than its key. Entry of leaf holds the entry number.
+	// Peer takes the place that was reserved in earlier versions.
+	struct Entry
+	{
+		int64_t Timestamp;
+		int32_t Index;
+		uint32_t Incoming;
+		uint32_t Link;
+		uint32_t Peer;
+	};
+
+	struct PageHeader
+	{
+		uint32_t Leaf;
+		uint32_t Count;
+		// Neighbour leaves, zero for inner pages.
+		uint32_t Previous;
+		uint32_t Next;
+		// Child with keys less than the first key of inner page.
+		uint32_t First;
+		uint32_t Reserved;
+	};
+
+	enum
+	{
+		Capacity = (PageSize - sizeof(PageHeader)) / sizeof(Entry)
+	};
+
+	struct Page
+	{
+		PageHeader Header;
+		Entry Entries[Capacity];
+		uint8_t Padding[
+			PageSize -
+			sizeof(PageHeader) -
+			Capacity * sizeof(Entry)];
+	};
+
+	// Page zero.
+	struct FileHeader
+	{
+		uint64_t Magic;
+		uint32_t Root;
+		uint32_t Height;
+		uint32_t FirstLeaf;
+		uint32_t LastLeaf;
+		uint32_t PageCount;
+		uint32_t NextNumber;
+	};
+
+	struct CachedPage
+	{
+		Page Data;
+		uint32_t Number;
+		bool Dirty;
+
+		// LRU list.
+		CachedPage *Newer;
+		CachedPage *Older;
+
+		CachedPage *NextInBucket;
+	};
+
+	BinaryFile _file;
+	FileHeader _header;
+	bool _headerDirty;
+
+	CachedPage *_buckets[BucketCount];
+	CachedPage *_newest;
+	CachedPage *_oldest;
+	uint32_t _cachedCount;
+
+	// Page pointer stays valid until CacheSize other pages are
+	// requested.
+	Page *GetPage(uint32_t number, bool modify);
+	uint32_t AllocatePage(bool leaf);
+
+	CachedPage *GetFreePage();
+	void AddToCache(CachedPage *page, uint32_t number);
+	void Unlink(CachedPage *page);
+	void LinkNewest(CachedPage *page);
+	void RemoveFromBucket(CachedPage *page);
+	void WritePage(CachedPage *page);
+
+	static Key MakeKey(
+		int64_t timestamp,
+		int32_t index,
+		bool incoming,
+		uint32_t peer);
+	static Key GetKey(const Entry &entry);
+	static void SetKey(Entry &entry, const Key &key);
+	static uint32_t MakePosition(uint32_t page, uint32_t slot);
+
+	// First slot with key that is not less than the given one.
+	static uint32_t LowerBound(const Page *page, const Key &key);
+	// Child of inner page that can contain the key.
+	static uint32_t GetChild(const Page *page, const Key &key);
+
+	uint32_t FindLeaf(const Key &key, uint32_t *path, uint32_t &depth);
+
+	void Insert(const Key &key, uint32_t number);
+	void InsertIntoLeaf(
+		uint32_t *path,
+		uint32_t depth,
+		uint32_t leaf,
+		uint32_t slot,
+		const Entry &entry);
+	void InsertIntoParent(
+		uint32_t *path,
+		uint32_t depth,
+		uint32_t left,
+		const Key &key,
+		uint32_t right);
+
+	// Index of earlier versions is a binary tree of nodes, valid
+	// nodes are moved to B+tree under the node address as number.
+	// Returns the path.
+	static String UpgradeLegacy(String path);
+};
+
+#endif
@@ -0,0 +1,772 @@
+#include "SegmentStorageEngine.hpp"
+
+#include "MessageStorageIndex.hpp"
+#include "../Common/File.hpp"
+
+// Segment file name, log_<segment> in hex.
+static void AppendSegmentName(StringBuilder &path, uint32_t segment)
+{
+	path.Append("/log_");
+	path.AppendHex(segment);
+}
+
+SegmentStorageEngine::SegmentStorageEngine(const uint8_t *ownerKey) :
+	StorageEngine(ownerKey)
+{
+}
+
+void SegmentStorageEngine::GetFreeTimestampIndex(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t &index)
+{
+	index = 0;
+
+	String indexPath = GetPeerPath(peerKey) + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return;
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+
+	while (storageIndex.FindEntry(timestamp, index, false)) {
+		++index;
+	}
+}
+
+bool SegmentStorageEngine::MessageExists(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index,
+	bool incoming)
+{
+	String indexPath = GetPeerPath(peerKey) + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return false;
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+	return storageIndex.FindEntry(timestamp, index, incoming);
+}
+
+bool SegmentStorageEngine::AddMessage(const CowBuffer<uint8_t> &message)
+{
+	Message::Header header;
+	bool res = Message::GetHeader(message, header);
+
+	if (!res) {
+		THROW("Invalid message header.");
+	}
+
+	if (message.Size() > UINT32_MAX) {
+		THROW("Message is too large for segment storage.");
+	}
+
+	bool incoming;
+	const uint8_t *peerKey = GetPeerKey(header, incoming);
+
+	CreatePeerDirectory(peerKey);
+
+	String path = GetPeerPath(peerKey);
+	String sharedPath = GetSharedPath(peerKey);
+	uint32_t number = FindEntry(peerKey, header, incoming);
+	Location location;
+
+	// Damaged location is replaced, its record keeps the reference
+	// and its space is not reused.
+	if (number) {
+		BinaryFile offsets(path + "/log.offsets", true);
+		memset(&location, 0, sizeof(location));
+
+		uint64_t offset = number * sizeof(location);
+
+		if (offsets.Size() >= offset + sizeof(location)) {
+			offsets.Read<Location>(&location, 1, offset);
+		}
+
+		if (LocationMatches(path, sharedPath, location, message)) {
+			return false;
+		}
+	}
+
+	bool shared =
+		FindPeerCopy(peerKey, header, incoming, location) &&
+		LocationMatches(path, sharedPath, location, message);
+
+	if (!shared) {
+		CreateMirrorDirectory(peerKey);
+		location = AppendMessage(sharedPath, message);
+	}
+
+	// Reference is taken before the message is indexed, so
+	// interrupted add leaves a record that is never freed and not a
+	// freed record that is still used.
+	AddReference(sharedPath, location);
+
+	if (!number) {
+		MessageStorageIndex storageIndex(path + "/log.index");
+		number = storageIndex.AddEntry(
+			header.Timestamp,
+			header.Index,
+			incoming);
+		storageIndex.Flush();
+	}
+
+	BinaryFile offsets(path + "/log.offsets", true);
+	offsets.Write<Location>(&location, 1, number * sizeof(location));
+
+	return true;
+}
+
+bool SegmentStorageEngine::RemoveMessage(
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index,
+	bool incoming)
+{
+	String path = GetPeerPath(peerKey);
+	String indexPath = path + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return false;
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+	uint32_t number = storageIndex.FindEntry(timestamp, index, incoming);
+
+	if (!number) {
+		return false;
+	}
+
+	BinaryFile offsets(path + "/log.offsets", true);
+	Location location;
+	memset(&location, 0, sizeof(location));
+
+	uint64_t offset = number * sizeof(location);
+
+	if (offsets.Size() >= offset + sizeof(location)) {
+		offsets.Read<Location>(&location, 1, offset);
+	}
+
+	storageIndex.RemoveEntry(timestamp, index, incoming);
+	storageIndex.Flush();
+
+	Location empty;
+	memset(&empty, 0, sizeof(empty));
+	offsets.Write<Location>(&empty, 1, offset);
+
+	// Records written before segments were shared are not counted,
+	// their space is not reused.
+	if (location.Record) {
+		ReleaseReference(GetSharedPath(peerKey), location);
+	}
+
+	return true;
+}
+
+CowBuffer<CowBuffer<uint8_t>> SegmentStorageEngine::GetMessageRange(
+	const uint8_t *peerKey,
+	int64_t from,
+	int64_t to)
+{
+	String path = GetPeerPath(peerKey);
+	String indexPath = path + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+	BinaryFile offsetFile(path + "/log.offsets", true);
+	CowBuffer<uint8_t> offsets = offsetFile.Map();
+
+	CowBuffer<Location> locations;
+	uint64_t count = 0;
+
+	uint32_t position = storageIndex.FindSmallest(from);
+
+	while (position) {
+		int64_t timestamp;
+		int32_t index;
+		bool incoming;
+
+		storageIndex.GetEntry(position, timestamp, index, incoming);
+
+		if (timestamp > to) {
+			break;
+		}
+
+		AddLocation(
+			locations,
+			count,
+			GetLocation(offsets, storageIndex.GetNumber(position)));
+		position = storageIndex.Next(position);
+	}
+
+	return ReadMessages(path, GetSharedPath(peerKey), locations, count);
+}
+
+CowBuffer<CowBuffer<uint8_t>> SegmentStorageEngine::GetLatestNMessages(
+	const uint8_t *peerKey,
+	int requestedMessageCount)
+{
+	String path = GetPeerPath(peerKey);
+	String indexPath = path + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+	BinaryFile offsetFile(path + "/log.offsets", true);
+	CowBuffer<uint8_t> offsets = offsetFile.Map();
+
+	CowBuffer<Location> locations;
+	uint64_t count = 0;
+
+	uint32_t position = storageIndex.FindBiggest();
+
+	while (position && count < (uint64_t)requestedMessageCount) {
+		AddLocation(
+			locations,
+			count,
+			GetLocation(offsets, storageIndex.GetNumber(position)));
+		position = storageIndex.Previous(position);
+	}
+
+	return ReadMessages(path, GetSharedPath(peerKey), locations, count);
+}
+
+CowBuffer<StorageEngine::MessageKey> SegmentStorageEngine::GetMessageKeys(
+	const uint8_t *peerKey)
+{
+	return ReadKeys(GetPeerPath(peerKey) + "/log.index");
+}
+
+// Messages are read in the order of keys, so keys that are close in
+// time are read from one chunk.
+CowBuffer<CowBuffer<uint8_t>> SegmentStorageEngine::GetMessages(
+	const uint8_t *peerKey,
+	const CowBuffer<MessageKey> &keys)
+{
+	CowBuffer<CowBuffer<uint8_t>> messages(keys.Size());
+
+	String path = GetPeerPath(peerKey);
+	String indexPath = path + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return messages;
+	}
+
+	CowBuffer<Location> locations(keys.Size());
+	CowBuffer<uint64_t> slots(keys.Size());
+	uint64_t count = 0;
+
+	{
+		MessageStorageIndex storageIndex(indexPath);
+		BinaryFile offsetFile(path + "/log.offsets", true);
+		CowBuffer<uint8_t> offsets = offsetFile.Map();
+
+		for (uint64_t i = 0; i < keys.Size(); i++) {
+			uint32_t number = storageIndex.FindEntry(
+				keys[i].Timestamp,
+				keys[i].Index,
+				keys[i].Incoming);
+
+			if (!number) {
+				continue;
+			}
+
+			Location location = GetLocation(offsets, number);
+
+			if (!location.Size) {
+				continue;
+			}
+
+			locations[count] = location;
+			slots[count] = i;
+			count++;
+		}
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> found = ReadMessages(
+		path,
+		GetSharedPath(peerKey),
+		locations,
+		count);
+
+	for (uint64_t i = 0; i < count; i++) {
+		messages[slots[i]] = found[i];
+	}
+
+	return messages;
+}
+
+String SegmentStorageEngine::GetPeerPath(const uint8_t *peerKey)
+{
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	AppendPeerPath(path, peerKey);
+	return path.Build();
+}
+
+String SegmentStorageEngine::GetMirrorPath(const uint8_t *peerKey)
+{
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	AppendMirrorPath(path, peerKey);
+	return path.Build();
+}
+
+String SegmentStorageEngine::GetSharedPath(const uint8_t *peerKey)
+{
+	if (memcmp(_ownerKey, peerKey, KEY_SIZE) <= 0) {
+		return GetPeerPath(peerKey);
+	}
+
+	return GetMirrorPath(peerKey);
+}
+
+uint32_t SegmentStorageEngine::FindEntry(
+	const uint8_t *peerKey,
+	const Message::Header &header,
+	bool incoming)
+{
+	String indexPath = GetPeerPath(peerKey) + "/log.index";
+
+	try {
+		MessageStorageIndex storageIndex(indexPath);
+		return storageIndex.FindEntry(
+			header.Timestamp,
+			header.Index,
+			incoming);
+	} catch (Exception&) {
+		RebuildIndex(peerKey);
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+	return storageIndex.FindEntry(header.Timestamp, header.Index, incoming);
+}
+
+// New files are built under temporary names. Location zero of the
+// shared directory is kept. Entries without readable message are
+// dropped.
+void SegmentStorageEngine::RebuildIndex(const uint8_t *peerKey)
+{
+	String path = GetPeerPath(peerKey);
+	String sharedPath = GetSharedPath(peerKey);
+	String indexPath = path + "/log.index.build";
+	String offsetsPath = path + "/log.offsets.build";
+
+	RemoveFile(indexPath);
+	RemoveFile(offsetsPath);
+
+	{
+		BinaryFile offsetFile(path + "/log.offsets", true);
+		CowBuffer<uint8_t> offsets = offsetFile.Map();
+
+		MessageStorageIndex storageIndex(indexPath);
+		BinaryFile newOffsets(offsetsPath, true);
+
+		Location location = GetLocation(offsets, 0);
+		newOffsets.Write<Location>(&location, 1, 0);
+
+		uint64_t count = offsets.Size() / sizeof(Location);
+
+		for (uint64_t number = 1; number < count; number++) {
+			location = GetLocation(offsets, number);
+
+			if (location.Size <= Message::HeaderSize) {
+				continue;
+			}
+
+			StringBuilder segmentPath(STORAGE_PATH_LENGTH);
+			segmentPath.Append(location.Record ? sharedPath : path);
+			AppendSegmentName(segmentPath, location.Segment);
+
+			uint8_t data[Message::HeaderSize + 1];
+
+			try {
+				BinaryFile segment(segmentPath.Build(), false);
+				segment.Read<uint8_t>(
+					data,
+					sizeof(data),
+					location.Offset);
+			} catch (Exception&) {
+				continue;
+			}
+
+			CowBuffer<uint8_t> message(sizeof(data));
+			memcpy(message.Pointer(), data, sizeof(data));
+
+			Message::Header header;
+			Message::GetHeader(message, header);
+
+			bool incoming;
+			const uint8_t *messagePeer =
+				GetPeerKey(header, incoming);
+
+			if (memcmp(messagePeer, peerKey, KEY_SIZE)) {
+				continue;
+			}
+
+			uint32_t newNumber = storageIndex.AddEntry(
+				header.Timestamp,
+				header.Index,
+				incoming);
+			newOffsets.Write<Location>(
+				&location,
+				1,
+				newNumber * sizeof(location));
+		}
+
+		storageIndex.Flush();
+	}
+
+	RenameFile(offsetsPath, path + "/log.offsets");
+	RenameFile(indexPath, path + "/log.index");
+}
+
+bool SegmentStorageEngine::LocationMatches(
+	const String &path,
+	const String &sharedPath,
+	const Location &location,
+	const CowBuffer<uint8_t> &message)
+{
+	if (location.Size != message.Size()) {
+		return false;
+	}
+
+	StringBuilder segmentPath(STORAGE_PATH_LENGTH);
+	segmentPath.Append(location.Record ? sharedPath : path);
+	AppendSegmentName(segmentPath, location.Segment);
+	String name = segmentPath.Build();
+
+	if (!FileExists(name)) {
+		return false;
+	}
+
+	BinaryFile segment(name, false);
+	return StoredCopyMatches(segment, location.Offset, message);
+}
+
+bool SegmentStorageEngine::FindPeerCopy(
+	const uint8_t *peerKey,
+	const Message::Header &header,
+	bool incoming,
+	Location &location)
+{
+	String path = GetMirrorPath(peerKey);
+	String indexPath = path + "/log.index";
+
+	if (!FileExists(indexPath)) {
+		return false;
+	}
+
+	// Damaged peer index is built again when the peer storage adds
+	// the message, until then the message is not shared.
+	uint32_t number;
+
+	try {
+		MessageStorageIndex storageIndex(indexPath);
+		number = storageIndex.FindEntry(
+			header.Timestamp,
+			header.Index,
+			!incoming);
+	} catch (Exception&) {
+		return false;
+	}
+
+	if (!number) {
+		return false;
+	}
+
+	BinaryFile offsets(path + "/log.offsets", true);
+	uint64_t offset = number * sizeof(location);
+
+	if (offsets.Size() < offset + sizeof(location)) {
+		return false;
+	}
+
+	offsets.Read<Location>(&location, 1, offset);
+	return location.Record && location.Size;
+}
+
+SegmentStorageEngine::Location SegmentStorageEngine::AppendMessage(
+	const String &sharedPath,
+	const CowBuffer<uint8_t> &message)
+{
+	BinaryFile offsets(sharedPath + "/log.offsets", true);
+	BinaryFile live(sharedPath + "/log.live", true);
+
+	Location last;
+	memset(&last, 0, sizeof(last));
+
+	if (offsets.Size() >= sizeof(last)) {
+		offsets.Read<Location>(&last, 1, 0);
+	}
+
+	// Segments written before records were counted are kept.
+	if (!live.Size() && (last.Offset || last.Segment)) {
+		for (uint32_t i = 0; i <= last.Segment; i++) {
+			AddCounter(live, i, 1);
+		}
+	}
+
+	uint64_t end = (uint64_t)last.Offset + message.Size();
+
+	if (last.Offset && end > SegmentSize) {
+		if (!AddCounter(live, last.Segment, 0)) {
+			StringBuilder segmentPath(STORAGE_PATH_LENGTH);
+			segmentPath.Append(sharedPath);
+			AppendSegmentName(segmentPath, last.Segment);
+			RemoveFile(segmentPath.Build());
+		}
+
+		last.Segment++;
+		last.Offset = 0;
+	}
+
+	Location location = last;
+	location.Size = message.Size();
+	location.Record = last.Record + 1;
+
+	StringBuilder segmentPath(STORAGE_PATH_LENGTH);
+	segmentPath.Append(sharedPath);
+	AppendSegmentName(segmentPath, location.Segment);
+
+	BinaryFile segment(segmentPath.Build(), true);
+	segment.Write<uint8_t>(
+		message.Pointer(),
+		message.Size(),
+		location.Offset);
+
+	AddCounter(live, location.Segment, 1);
+
+	// Space is taken before the message is indexed, so interrupted
+	// write leaves unused space and not a damaged message.
+	last.Offset += message.Size();
+	last.Size = 0;
+	last.Record = location.Record;
+	offsets.Write<Location>(&last, 1, 0);
+
+	return location;
+}
+
+void SegmentStorageEngine::AddReference(
+	const String &sharedPath,
+	const Location &location)
+{
+	BinaryFile references(sharedPath + "/log.refs", true);
+	AddCounter(references, location.Record, 1);
+}
+
+void SegmentStorageEngine::ReleaseReference(
+	const String &sharedPath,
+	const Location &location)
+{
+	BinaryFile references(sharedPath + "/log.refs", true);
+
+	if (AddCounter(references, location.Record, -1)) {
+		return;
+	}
+
+	BinaryFile live(sharedPath + "/log.live", true);
+
+	if (AddCounter(live, location.Segment, -1)) {
+		return;
+	}
+
+	BinaryFile offsets(sharedPath + "/log.offsets", true);
+	Location last;
+	memset(&last, 0, sizeof(last));
+
+	if (offsets.Size() >= sizeof(last)) {
+		offsets.Read<Location>(&last, 1, 0);
+	}
+
+	// The last segment is still appended to.
+	if (location.Segment == last.Segment) {
+		return;
+	}
+
+	StringBuilder segmentPath(STORAGE_PATH_LENGTH);
+	segmentPath.Append(sharedPath);
+	AppendSegmentName(segmentPath, location.Segment);
+	RemoveFile(segmentPath.Build());
+}
+
+uint32_t SegmentStorageEngine::AddCounter(
+	BinaryFile &file,
+	uint32_t counter,
+	int32_t value)
+{
+	uint32_t count = 0;
+	uint64_t position = (uint64_t)counter * sizeof(count);
+
+	if (file.Size() >= position + sizeof(count)) {
+		file.Read<uint32_t>(&count, 1, position);
+	}
+
+	if (!value) {
+		return count;
+	}
+
+	if (value < 0 && count < (uint32_t)-value) {
+		count = 0;
+	} else {
+		count += value;
+	}
+
+	file.Write<uint32_t>(&count, 1, position);
+	return count;
+}
+
+// Location of entry without recorded location has zero size.
+SegmentStorageEngine::Location SegmentStorageEngine::GetLocation(
+	const CowBuffer<uint8_t> &offsets,
+	uint32_t number)
+{
+	Location location;
+
+	if ((number + 1) * sizeof(Location) > offsets.Size()) {
+		memset(&location, 0, sizeof(location));
+		return location;
+	}
+
+	memcpy(
+		&location,
+		offsets.Pointer() + number * sizeof(Location),
+		sizeof(location));
+
+	return location;
+}
+
+void SegmentStorageEngine::AddLocation(
+	CowBuffer<Location> &locations,
+	uint64_t &count,
+	const Location &location)
+{
+	if (!location.Size) {
+		return;
+	}
+
+	if (count == locations.Size()) {
+		locations.Resize(count ? count * 2 : 64);
+	}
+
+	locations[count] = location;
+	count++;
+}
+
+bool SegmentStorageEngine::SameSegment(
+	const Location &first,
+	const Location &second)
+{
+	return
+		first.Segment == second.Segment &&
+		!first.Record == !second.Record;
+}
+
+CowBuffer<CowBuffer<uint8_t>> SegmentStorageEngine::ReadMessages(
+	const String &path,
+	const String &sharedPath,
+	const CowBuffer<Location> &locations,
+	uint64_t count)
+{
+	if (!count) {
+		return CowBuffer<CowBuffer<uint8_t>>();
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> messages(count);
+	uint64_t first = 0;
+
+	while (first < count) {
+		Location location = locations[first];
+
+		StringBuilder segmentPath(STORAGE_PATH_LENGTH);
+		segmentPath.Append(location.Record ? sharedPath : path);
+		AppendSegmentName(segmentPath, location.Segment);
+
+		BinaryFile segment(segmentPath.Build(), false);
+
+		while (
+			first < count &&
+			SameSegment(locations[first], location))
+		{
+			first = ReadChunk(
+				segment,
+				locations,
+				first,
+				count,
+				messages);
+		}
+	}
+
+	return messages;
+}
+
+uint64_t SegmentStorageEngine::ReadChunk(
+	BinaryFile &segment,
+	const CowBuffer<Location> &locations,
+	uint64_t first,
+	uint64_t count,
+	CowBuffer<CowBuffer<uint8_t>> &messages)
+{
+	Location location = locations[first];
+
+	if (location.Size >= MESSAGE_MAP_THRESHOLD) {
+		CowBuffer<uint8_t> message =
+			segment.Map(location.Offset, location.Size);
+
+		if (!message.Size()) {
+			message = CowBuffer<uint8_t>(location.Size);
+			segment.Read<uint8_t>(
+				message.Pointer(),
+				location.Size,
+				location.Offset);
+		}
+
+		messages[first] = message;
+		return first + 1;
+	}
+
+	uint64_t start = location.Offset;
+	uint64_t end = location.Offset + location.Size;
+	uint64_t last = first + 1;
+
+	while (last < count) {
+		Location next = locations[last];
+
+		bool sameChunk =
+			SameSegment(next, location) &&
+			next.Size < MESSAGE_MAP_THRESHOLD;
+
+		if (!sameChunk) {
+			break;
+		}
+
+		uint64_t nextEnd = next.Offset + next.Size;
+		uint64_t chunkStart = next.Offset < start ? next.Offset : start;
+		uint64_t chunkEnd = nextEnd > end ? nextEnd : end;
+
+		if (chunkEnd - chunkStart > ChunkSize) {
+			break;
+		}
+
+		start = chunkStart;
+		end = chunkEnd;
+		last++;
+	}
+
+	CowBuffer<uint8_t> chunk(end - start);
+	segment.Read<uint8_t>(chunk.Pointer(), chunk.Size(), start);
+
+	for (uint64_t i = first; i < last; i++) {
+		messages[i] = chunk.Slice(
+			locations[i].Offset - start,
+			locations[i].Size);
+	}
+
+	return last;
+}
@@ -0,0 +1,149 @@
+#ifndef _SEGMENT_STORAGE_ENGINE_HPP
+#define _SEGMENT_STORAGE_ENGINE_HPP
+
+#include "StorageEngine.hpp"
+#include "../Common/BinaryFile.hpp"
+
+// Messages exchanged with the peer are appended to segment files,
+// storage/<owner>/storage/<peer>/log_<segment>. Index file orders the
+// messages, offset file holds location of each message at the number
+// of its index entry. Messages of a range are read from segments in
+// large chunks.
+//
+// Segments of a pair of users are shared. They are kept in the
+// directory of the owner with the smaller key, and the peer index
+// refers to the same record of the segment. Records have reference
+// counts, segment file is removed when none of its records is
+// referenced.
+class SegmentStorageEngine : public StorageEngine
+{
+public:
+	SegmentStorageEngine(const uint8_t *ownerKey);
+
+	void GetFreeTimestampIndex(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t &index) override;
+
+	bool MessageExists(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t index,
+		bool incoming) override;
+
+	bool AddMessage(const CowBuffer<uint8_t> &message) override;
+
+	bool RemoveMessage(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t index,
+		bool incoming) override;
+
+	CowBuffer<CowBuffer<uint8_t>> GetMessageRange(
+		const uint8_t *peerKey,
+		int64_t from,
+		int64_t to) override;
+
+	CowBuffer<CowBuffer<uint8_t>> GetLatestNMessages(
+		const uint8_t *peerKey,
+		int requestedMessageCount) override;
+
+	CowBuffer<MessageKey> GetMessageKeys(const uint8_t *peerKey) override;
+
+	CowBuffer<CowBuffer<uint8_t>> GetMessages(
+		const uint8_t *peerKey,
+		const CowBuffer<MessageKey> &keys) override;
+
+private:
+	enum
+	{
+		SegmentSize = 64 * 1024 * 1024,
+		ChunkSize = 1024 * 1024
+	};
+
+	// Location zero of the shared directory holds the last
+	// segment, its size and the last record number. Record numbers
+	// start from one, locations with zero record number were written
+	// before segments were shared and refer to segments of the owner.
+	struct Location
+	{
+		uint32_t Offset;
+		uint32_t Segment;
+		uint32_t Size;
+		uint32_t Record;
+	};
+
+	String GetPeerPath(const uint8_t *peerKey);
+	String GetMirrorPath(const uint8_t *peerKey);
+	// Directory of the shared segments.
+	String GetSharedPath(const uint8_t *peerKey);
+
+	// Number of the index entry, zero if there is none. Index that
+	// can not be read is built again.
+	uint32_t FindEntry(
+		const uint8_t *peerKey,
+		const Message::Header &header,
+		bool incoming);
+
+	// Index and offsets are built again from the locations of the
+	// entries, keys are read from message headers in segments.
+	void RebuildIndex(const uint8_t *peerKey);
+
+	// True if the location holds the message.
+	bool LocationMatches(
+		const String &path,
+		const String &sharedPath,
+		const Location &location,
+		const CowBuffer<uint8_t> &message);
+
+	// Location of the message in the peer storage, if it is shared.
+	bool FindPeerCopy(
+		const uint8_t *peerKey,
+		const Message::Header &header,
+		bool incoming,
+		Location &location);
+
+	Location AppendMessage(
+		const String &sharedPath,
+		const CowBuffer<uint8_t> &message);
+
+	void AddReference(const String &sharedPath, const Location &location);
+	void ReleaseReference(
+		const String &sharedPath,
+		const Location &location);
+
+	// Adds value to the counter and returns the result.
+	static uint32_t AddCounter(
+		BinaryFile &file,
+		uint32_t counter,
+		int32_t value);
+
+	static Location GetLocation(
+		const CowBuffer<uint8_t> &offsets,
+		uint32_t number);
+
+	// Entries without location are skipped.
+	static void AddLocation(
+		CowBuffer<Location> &locations,
+		uint64_t &count,
+		const Location &location);
+
+	static bool SameSegment(const Location &first, const Location &second);
+
+	CowBuffer<CowBuffer<uint8_t>> ReadMessages(
+		const String &path,
+		const String &sharedPath,
+		const CowBuffer<Location> &locations,
+		uint64_t count);
+
+	// Reads messages starting from the first one that lie close to
+	// each other in the segment. Returns index of the next message.
+	uint64_t ReadChunk(
+		BinaryFile &segment,
+		const CowBuffer<Location> &locations,
+		uint64_t first,
+		uint64_t count,
+		CowBuffer<CowBuffer<uint8_t>> &messages);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "StorageConverter.hpp"
+
+#include "FileStorageEngine.hpp"
+#include "SegmentStorageEngine.hpp"
+#include "../Common/Hex.hpp"
+#include "../Common/File.hpp"
+
+static bool IsKey(const String &name)
+{
+	return name.Length() == KEY_SIZE * 2;
+}
+
+static int64_t ConvertOwner(const String &owner)
+{
+	uint8_t ownerKey[KEY_SIZE];
+	HexToData(owner, ownerKey);
+
+	String path = "storage/" + owner + "/storage";
+
+	if (!FileExists(path)) {
+		return 0;
+	}
+
+	FileStorageEngine files(ownerKey);
+	SegmentStorageEngine segments(ownerKey);
+
+	CowBuffer<String> peers = ListDirectory(path);
+	int64_t messageCount = 0;
+
+	for (uint32_t i = 0; i < peers.Size(); i++) {
+		if (!IsKey(peers[i])) {
+			continue;
+		}
+
+		uint8_t peerKey[KEY_SIZE];
+		HexToData(peers[i], peerKey);
+
+		messageCount += files.MoveMessages(peerKey, &segments);
+	}
+
+	return messageCount;
+}
+
+int64_t ConvertStorageToSegments()
+{
+	if (!FileExists("storage")) {
+		return 0;
+	}
+
+	CowBuffer<String> owners = ListDirectory("storage");
+	int64_t messageCount = 0;
+
+	for (uint32_t i = 0; i < owners.Size(); i++) {
+		if (IsKey(owners[i])) {
+			messageCount += ConvertOwner(owners[i]);
+		}
+	}
+
+	return messageCount;
+}
@@ -0,0 +1,11 @@
+#ifndef _STORAGE_CONVERTER_HPP
+#define _STORAGE_CONVERTER_HPP
+
+#include <cstdint>
+
+// Moves messages of all owners from message files to segments and
+// returns number of moved messages. Storage must not be used during
+// conversion.
+int64_t ConvertStorageToSegments();
+
+#endif
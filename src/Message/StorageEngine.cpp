@@ -0,0 +1,158 @@
+#include "StorageEngine.hpp"
+
+#include <cstring>
+
+#include "FileStorageEngine.hpp"
+#include "SegmentStorageEngine.hpp"
+#include "MessageStorageIndex.hpp"
+#include "../Common/File.hpp"
+#include "../ThirdParty/monocypher.h"
+
+StorageEngine *StorageEngine::Create(Type type, const uint8_t *ownerKey)
+{
+	if (type == TypeSegments) {
+		return new SegmentStorageEngine(ownerKey);
+	}
+
+	return new FileStorageEngine(ownerKey);
+}
+
+static void AppendPath(
+	StringBuilder &path,
+	const uint8_t *ownerKey,
+	const uint8_t *peerKey)
+{
+	path.Append("storage/");
+	path.AppendHex(ownerKey, KEY_SIZE);
+	path.Append("/storage");
+
+	if (peerKey) {
+		path.Append('/');
+		path.AppendHex(peerKey, KEY_SIZE);
+	}
+}
+
+static void CreatePath(const uint8_t *ownerKey, const uint8_t *peerKey)
+{
+	StringBuilder path(STORAGE_PATH_LENGTH);
+	AppendPath(path, ownerKey, peerKey);
+
+	if (FileExists(path.GetString())) {
+		return;
+	}
+
+	StringBuilder directory(STORAGE_PATH_LENGTH);
+	directory.Append("storage");
+	CreateDirectory(directory.GetString());
+	directory.Append('/');
+	directory.AppendHex(ownerKey, KEY_SIZE);
+	CreateDirectory(directory.GetString());
+	directory.Append("/storage");
+	CreateDirectory(directory.GetString());
+
+	CreateDirectory(path.GetString());
+}
+
+void StorageEngine::AppendOwnerPath(StringBuilder &path)
+{
+	AppendPath(path, _ownerKey, nullptr);
+}
+
+void StorageEngine::AppendPeerPath(
+	StringBuilder &path,
+	const uint8_t *peerKey)
+{
+	AppendPath(path, _ownerKey, peerKey);
+}
+
+void StorageEngine::AppendMirrorPath(
+	StringBuilder &path,
+	const uint8_t *peerKey)
+{
+	AppendPath(path, peerKey, _ownerKey);
+}
+
+void StorageEngine::CreatePeerDirectory(const uint8_t *peerKey)
+{
+	CreatePath(_ownerKey, peerKey);
+}
+
+void StorageEngine::CreateMirrorDirectory(const uint8_t *peerKey)
+{
+	CreatePath(peerKey, _ownerKey);
+}
+
+const uint8_t *StorageEngine::GetPeerKey(
+	const Message::Header &header,
+	bool &incoming)
+{
+	if (!crypto_verify32(_ownerKey, header.Source)) {
+		incoming = false;
+		return header.Destination;
+	}
+
+	incoming = true;
+	return header.Source;
+}
+
+CowBuffer<StorageEngine::MessageKey> StorageEngine::ReadKeys(
+	const String &indexPath)
+{
+	if (!FileExists(indexPath)) {
+		return CowBuffer<MessageKey>();
+	}
+
+	MessageStorageIndex storageIndex(indexPath);
+
+	CowBuffer<MessageKey> keys;
+	uint64_t count = 0;
+
+	for (
+		uint32_t position = storageIndex.FindSmallest(INT64_MIN);
+		position;
+		position = storageIndex.Next(position))
+	{
+		if (count == keys.Size()) {
+			keys.Resize(count ? count * 2 : 64);
+		}
+
+		storageIndex.GetEntry(
+			position,
+			keys[count].Timestamp,
+			keys[count].Index,
+			keys[count].Incoming);
+		count++;
+	}
+
+	return keys.Slice(0, count);
+}
+
+bool StorageEngine::StoredCopyMatches(
+	BinaryFile &file,
+	uint64_t offset,
+	const CowBuffer<uint8_t> &message)
+{
+	uint64_t size = message.Size();
+
+	if (file.Size() < offset + size) {
+		return false;
+	}
+
+	if (size < MESSAGE_MAP_THRESHOLD) {
+		CowBuffer<uint8_t> stored(size);
+		file.Read<uint8_t>(stored.Pointer(), size, offset);
+		return !memcmp(stored.Pointer(), message.Pointer(), size);
+	}
+
+	uint8_t stored[MESSAGE_CHECK_SIZE];
+	file.Read<uint8_t>(stored, MESSAGE_CHECK_SIZE, offset);
+
+	if (memcmp(stored, message.Pointer(), MESSAGE_CHECK_SIZE)) {
+		return false;
+	}
+
+	uint64_t tail = size - MESSAGE_CHECK_SIZE;
+	file.Read<uint8_t>(stored, MESSAGE_CHECK_SIZE, offset + tail);
+
+	return !memcmp(stored, message.Pointer(tail), MESSAGE_CHECK_SIZE);
+}
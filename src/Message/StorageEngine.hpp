@@ -0,0 +1,132 @@
+#ifndef _STORAGE_ENGINE_HPP
+#define _STORAGE_ENGINE_HPP
+
+#include "Message.hpp"
+#include "../Common/MyString.hpp"
+#include "../Common/CowBuffer.hpp"
+#include "../Common/BinaryFile.hpp"
+
+// Message storage layout interface.
+// Messages of an owner are grouped by peer, both engines keep them in
+// storage/<owner>/storage/<peer> and order them by timestamp, index
+// and direction.
+class StorageEngine
+{
+public:
+	enum Type
+	{
+		TypeFiles = 0,
+		TypeSegments = 1
+	};
+
+	// Key of a message in the owner storage.
+	struct MessageKey
+	{
+		int64_t Timestamp;
+		int32_t Index;
+		bool Incoming;
+	};
+
+	virtual ~StorageEngine()
+	{
+	}
+
+	static StorageEngine *Create(Type type, const uint8_t *ownerKey);
+
+	virtual void GetFreeTimestampIndex(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t &index) = 0;
+
+	virtual bool MessageExists(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t index,
+		bool incoming) = 0;
+
+	// Returns false if the message is already stored. Message that
+	// the peer already stores is shared with the peer storage
+	// instead of being copied, so the peer storage is read too.
+	// Storage files are not synced, a crash can keep the index entry
+	// of a message and lose its data. Data of indexed message is
+	// checked and written again if it does not match, index that
+	// can not be read is built again.
+	virtual bool AddMessage(const CowBuffer<uint8_t> &message) = 0;
+
+	// Returns false if the message is not stored. Shared message is
+	// freed when the last storage that refers to it removes it.
+	virtual bool RemoveMessage(
+		const uint8_t *peerKey,
+		int64_t timestamp,
+		int32_t index,
+		bool incoming) = 0;
+
+	// Messages with timestamps in range, ordered by timestamp.
+	virtual CowBuffer<CowBuffer<uint8_t>> GetMessageRange(
+		const uint8_t *peerKey,
+		int64_t from,
+		int64_t to) = 0;
+
+	// Latest messages, the latest one first.
+	virtual CowBuffer<CowBuffer<uint8_t>> GetLatestNMessages(
+		const uint8_t *peerKey,
+		int requestedMessageCount) = 0;
+
+	// Keys of all messages exchanged with the peer, in index order.
+	virtual CowBuffer<MessageKey> GetMessageKeys(
+		const uint8_t *peerKey) = 0;
+
+	// Messages with the given keys in the same order, empty buffer
+	// for a key that is not stored.
+	virtual CowBuffer<CowBuffer<uint8_t>> GetMessages(
+		const uint8_t *peerKey,
+		const CowBuffer<MessageKey> &keys) = 0;
+
+protected:
+	const uint8_t *_ownerKey;
+
+	StorageEngine(const uint8_t *ownerKey)
+	{
+		_ownerKey = ownerKey;
+	}
+
+	// Path of the owner storage, storage/<owner>/storage.
+	void AppendOwnerPath(StringBuilder &path);
+	// Directory of messages exchanged with the peer,
+	// storage/<owner>/storage/<peer>.
+	void AppendPeerPath(StringBuilder &path, const uint8_t *peerKey);
+	// Directory of the same messages in the peer storage,
+	// storage/<peer>/storage/<owner>.
+	void AppendMirrorPath(StringBuilder &path, const uint8_t *peerKey);
+	// Creates missing directories of the peer path.
+	void CreatePeerDirectory(const uint8_t *peerKey);
+	// Creates missing directories of the mirror path.
+	void CreateMirrorDirectory(const uint8_t *peerKey);
+
+	// Peer of the message and its direction for the owner.
+	const uint8_t *GetPeerKey(
+		const Message::Header &header,
+		bool &incoming);
+
+	static CowBuffer<MessageKey> ReadKeys(const String &indexPath);
+
+	// True if the file holds the message at the offset. Large
+	// messages are compared by their first and last pages only.
+	static bool StoredCopyMatches(
+		BinaryFile &file,
+		uint64_t offset,
+		const CowBuffer<uint8_t> &message);
+};
+
+// Length of the longest path,
+// storage/<owner>/storage/<peer>/out/<timestamp>_<index>.
+#define STORAGE_PATH_LENGTH (KEY_SIZE * 4 + 48)
+
+// Messages of this size and larger are mapped instead of being read,
+// their pages are loaded from the file on demand.
+#define MESSAGE_MAP_THRESHOLD (1024 * 1024)
+
+// Part of large message compared at each end by StoredCopyMatches.
+#define MESSAGE_CHECK_SIZE 4096
+
+#endif
@@ -5,7 +5,7 @@
 #include "../Message/Message.hpp"
 
 bool CommandKeepAlive::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + sizeof(int64_t)) {
@@ -31,7 +31,7 @@ CowBuffer<uint8_t> CommandKeepAlive::BuildCommand(const Command &data)
 }
 
 int32_t CommandTextMessage::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() <= sizeof(int32_t) + Message::HeaderSize) {
@@ -59,7 +59,7 @@ CowBuffer<uint8_t> CommandTextMessage::BuildCommand(const Command &data)
 }
 
 bool CommandTextMessage::ParseResponse(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Response &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + sizeof(result.Status)) {
@@ -85,7 +85,7 @@ CowBuffer<uint8_t> CommandTextMessage::BuildResponse(const Response &data)
 }
 
 bool CommandDeliverMessage::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() <= sizeof(int32_t) + Message::HeaderSize) {
@@ -120,7 +120,7 @@ CowBuffer<uint8_t> CommandListUsers::BuildCommand()
 }
 
 bool CommandListUsers::ParseResponse(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Response &result)
 {
 	int nameLength = 55;
@@ -189,7 +189,7 @@ CowBuffer<uint8_t> CommandListUsers::BuildResponse(const Response &data)
 }
 
 bool CommandGetMessages::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + sizeof(result.Timestamp)) {
@@ -215,7 +215,7 @@ CowBuffer<uint8_t> CommandGetMessages::BuildCommand(const Command &data)
 }
 
 bool CommandVoiceInit::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + KEY_SIZE + sizeof(int64_t)) {
@@ -249,7 +249,7 @@ CowBuffer<uint8_t> CommandVoiceInit::BuildCommand(const Command &data)
 }
 
 bool CommandVoiceInit::ParseResponse(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Response &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + sizeof(result.Status)) {
@@ -275,7 +275,7 @@ CowBuffer<uint8_t> CommandVoiceInit::BuildResponse(const Response &data)
 }
 
 bool CommandVoiceRequest::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + KEY_SIZE + sizeof(int64_t)) {
@@ -309,7 +309,7 @@ CowBuffer<uint8_t> CommandVoiceRequest::BuildCommand(const Command &data)
 }
 
 bool CommandVoiceRequest::ParseResponse(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Response &result)
 {
 	if (buffer.Size() != sizeof(int32_t) + sizeof(result.Status)) {
@@ -342,7 +342,7 @@ CowBuffer<uint8_t> CommandVoiceEnd::BuildCommand()
 }
 
 bool CommandVoiceData::ParseCommand(
-	const CowBuffer<uint8_t> buffer,
+	const CowBuffer<uint8_t> &buffer,
 	Command &result)
 {
 	if (buffer.Size() <= sizeof(int32_t)) {
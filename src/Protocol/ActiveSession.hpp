@@ -34,7 +34,7 @@ namespace CommandKeepAlive
 		int64_t Timestamp;
 	};
 
-	bool ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	bool ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
 }
 
@@ -50,9 +50,9 @@ namespace CommandTextMessage
 		int32_t Status;
 	};
 
-	int32_t ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	int32_t ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
-	bool ParseResponse(const CowBuffer<uint8_t> buffer, Response &result);
+	bool ParseResponse(const CowBuffer<uint8_t> &buffer, Response &result);
 	CowBuffer<uint8_t> BuildResponse(const Response &data);
 }
 
@@ -63,7 +63,7 @@ namespace CommandDeliverMessage
 		CowBuffer<uint8_t> Message;
 	};
 
-	bool ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	bool ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
 }
 
@@ -81,7 +81,7 @@ namespace CommandListUsers
 	};
 
 	CowBuffer<uint8_t> BuildCommand();
-	bool ParseResponse(const CowBuffer<uint8_t> buffer, Response &result);
+	bool ParseResponse(const CowBuffer<uint8_t> &buffer, Response &result);
 	CowBuffer<uint8_t> BuildResponse(const Response &data);
 }
 
@@ -92,7 +92,7 @@ namespace CommandGetMessages
 		int64_t Timestamp;
 	};
 
-	bool ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	bool ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
 }
 
@@ -109,9 +109,9 @@ namespace CommandVoiceInit
 		int32_t Status;
 	};
 
-	bool ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	bool ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
-	bool ParseResponse(const CowBuffer<uint8_t> buffer, Response &result);
+	bool ParseResponse(const CowBuffer<uint8_t> &buffer, Response &result);
 	CowBuffer<uint8_t> BuildResponse(const Response &data);
 }
 
@@ -128,9 +128,9 @@ namespace CommandVoiceRequest
 		int32_t Status;
 	};
 
-	bool ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	bool ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
-	bool ParseResponse(const CowBuffer<uint8_t> buffer, Response &result);
+	bool ParseResponse(const CowBuffer<uint8_t> &buffer, Response &result);
 	CowBuffer<uint8_t> BuildResponse(const Response &data);
 }
 
@@ -146,7 +146,7 @@ namespace CommandVoiceData
 		CowBuffer<uint8_t> VoiceData;
 	};
 
-	bool ParseCommand(const CowBuffer<uint8_t> buffer, Command &result);
+	bool ParseCommand(const CowBuffer<uint8_t> &buffer, Command &result);
 	CowBuffer<uint8_t> BuildCommand(const Command &data);
 }
 
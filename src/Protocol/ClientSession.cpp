@@ -8,6 +8,22 @@
 #include "../Common/UnixTime.hpp"
 #include "../Common/Exception.hpp"
 
+// Keep alive and voice streams use small slices, so that bulk data does
+// not delay them for long. Messages are sent in large slices.
+static const uint32_t SliceSizes[Session::StreamCount] = {
+	SLICE_SIZE_DEFAULT,
+	SLICE_SIZE_DEFAULT,
+	64 * 1024
+};
+
+// Only bulk stream is flow controlled, keep alive and voice are small
+// and must not wait for credit.
+static const uint32_t Windows[Session::StreamCount] = {
+	0,
+	0,
+	1024 * 1024
+};
+
 MessageProcessor::~MessageProcessor()
 { }
 
@@ -91,7 +107,7 @@ bool ClientSession::InitSession()
 }
 
 bool ClientSession::SendMessage(
-	const CowBuffer<uint8_t> message,
+	const CowBuffer<uint8_t> &message,
 	void *userPointer)
 {
 	if (!ConnectedActive()) {
@@ -201,7 +217,7 @@ bool ClientSession::EndVoice()
 	return true;
 }
 
-bool ClientSession::SendVoiceFrame(const CowBuffer<uint8_t> frame)
+bool ClientSession::SendVoiceFrame(const CowBuffer<uint8_t> &frame)
 {
 	if (!ConnectedActive()) {
 		return false;
@@ -275,9 +291,31 @@ bool ClientSession::ProcessInitialWaitForServer()
 
 	Handshake3::Data response;
 	response.Timestamp = value;
+	response.HasSliceSize = true;
+	response.Framing = FRAMING_V2;
+	response.HasWindow = true;
+
+	for (int i = 0; i < StreamCount; i++) {
+		response.SliceSize[i] = SliceSizes[i];
+		response.Window[i] = Windows[i];
+	}
 
 	Send(Handshake3::Build(response), 0, true);
 
+	// Server applies slice sizes, framing and windows before reading
+	// following data. Handshake itself is sent with old framing.
+	for (int i = 0; i < StreamCount; i++) {
+		SetSliceSize(i, SliceSizes[i]);
+	}
+
+	uint8_t nonce[NONCE_SIZE];
+	InitNonce(nonce, value, request.Salt);
+	SetFraming(FRAMING_V2, nonce);
+
+	for (int i = 0; i < StreamCount; i++) {
+		SetWindow(i, Windows[i]);
+	}
+
 	State = ClientStateActiveSession;
 	TimeState = 0;
 
@@ -321,7 +359,7 @@ bool ClientSession::ProcessActiveSession()
 	return false;
 }
 
-bool ClientSession::ProcessKeepAlive(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessKeepAlive(const CowBuffer<uint8_t> &plainText)
 {
 	if (!TimeState) {
 		return false;
@@ -342,7 +380,7 @@ bool ClientSession::ProcessKeepAlive(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ClientSession::ProcessSendMessage(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessSendMessage(const CowBuffer<uint8_t> &plainText)
 {
 	if (!SMUserPointersFirst) {
 		return false;
@@ -370,7 +408,7 @@ bool ClientSession::ProcessSendMessage(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ClientSession::ProcessDeliverMessage(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessDeliverMessage(const CowBuffer<uint8_t> &plainText)
 {
 	CommandDeliverMessage::Command command;
 	bool parseResult = CommandDeliverMessage::ParseCommand(
@@ -385,7 +423,7 @@ bool ClientSession::ProcessDeliverMessage(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ClientSession::ProcessListUsers(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessListUsers(const CowBuffer<uint8_t> &plainText)
 {
 	CommandListUsers::Response response;
 	bool parseResult = CommandListUsers::ParseResponse(plainText, response);
@@ -403,7 +441,7 @@ bool ClientSession::ProcessListUsers(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ClientSession::ProcessVoiceInit(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessVoiceInit(const CowBuffer<uint8_t> &plainText)
 {
 	CommandVoiceInit::Response response;
 	bool parseResult = CommandVoiceInit::ParseResponse(plainText, response);
@@ -416,7 +454,7 @@ bool ClientSession::ProcessVoiceInit(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ClientSession::ProcessVoiceRequest(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessVoiceRequest(const CowBuffer<uint8_t> &plainText)
 {
 	CommandVoiceRequest::Command command;
 	bool parseResult = CommandVoiceRequest::ParseCommand(
@@ -431,13 +469,13 @@ bool ClientSession::ProcessVoiceRequest(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ClientSession::ProcessVoiceEnd(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessVoiceEnd(const CowBuffer<uint8_t> &plainText)
 {
 	Processor->VoiceEnd();
 	return true;
 }
 
-bool ClientSession::ProcessVoiceFrame(const CowBuffer<uint8_t> plainText)
+bool ClientSession::ProcessVoiceFrame(const CowBuffer<uint8_t> &plainText)
 {
 	CommandVoiceData::Command command;
 	bool parseResult = CommandVoiceData::ParseCommand(plainText, command);
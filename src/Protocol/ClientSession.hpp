@@ -69,7 +69,7 @@ struct ClientSession : public Session
 	Stream Streams[StreamCount];
 
 	bool InitSession();
-	bool SendMessage(const CowBuffer<uint8_t> message, void *userPointer);
+	bool SendMessage(const CowBuffer<uint8_t> &message, void *userPointer);
 
 	struct SMUser
 	{
@@ -87,7 +87,7 @@ struct ClientSession : public Session
 	bool InitVoice(const uint8_t *key, int64_t timestamp);
 	bool ResponseVoiceRequest(bool accept);
 	bool EndVoice();
-	bool SendVoiceFrame(const CowBuffer<uint8_t> frame);
+	bool SendVoiceFrame(const CowBuffer<uint8_t> &frame);
 
 	bool Process() override;
 	bool ProcessInitialWaitForServer();
@@ -95,15 +95,15 @@ struct ClientSession : public Session
 
 	bool TimePassed() override;
 
-	bool ProcessKeepAlive(const CowBuffer<uint8_t> plainText);
-	bool ProcessSendMessage(const CowBuffer<uint8_t> plainText);
-	bool ProcessDeliverMessage(const CowBuffer<uint8_t> plainText);
-	bool ProcessListUsers(const CowBuffer<uint8_t> plainText);
+	bool ProcessKeepAlive(const CowBuffer<uint8_t> &plainText);
+	bool ProcessSendMessage(const CowBuffer<uint8_t> &plainText);
+	bool ProcessDeliverMessage(const CowBuffer<uint8_t> &plainText);
+	bool ProcessListUsers(const CowBuffer<uint8_t> &plainText);
 
-	bool ProcessVoiceInit(const CowBuffer<uint8_t> plainText);
-	bool ProcessVoiceRequest(const CowBuffer<uint8_t> plainText);
-	bool ProcessVoiceEnd(const CowBuffer<uint8_t> plainText);
-	bool ProcessVoiceFrame(const CowBuffer<uint8_t> plainText);
+	bool ProcessVoiceInit(const CowBuffer<uint8_t> &plainText);
+	bool ProcessVoiceRequest(const CowBuffer<uint8_t> &plainText);
+	bool ProcessVoiceEnd(const CowBuffer<uint8_t> &plainText);
+	bool ProcessVoiceFrame(const CowBuffer<uint8_t> &plainText);
 };
 
 #endif
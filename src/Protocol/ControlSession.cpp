@@ -12,17 +12,6 @@ ControlSession::ControlSession()
 	InputSizeLimit = 1024 * 1024;
 }
 
-bool ControlSession::TimePassed()
-{
-	int64_t t = GetUnixTime();
-
-	if (t - Time > 10) {
-		return false;
-	}
-
-	return true;
-}
-
 bool ControlSession::Process()
 {
 	CowBuffer<uint8_t> message = Receive();
@@ -62,6 +51,9 @@ bool ControlSession::Process()
 	case COMMAND_RELOAD:
 		ProcessReload();
 		break;
+	case COMMAND_MEMORY_STATUS:
+		ProcessMemoryStatus();
+		break;
 	default:
 		ProcessUnknownCommand();
 		break;
@@ -70,7 +62,12 @@ bool ControlSession::Process()
 	return true;
 }
 
-void ControlSession::SendResponse(int32_t code, const CowBuffer<uint8_t> data)
+Session::Priority ControlSession::GetPriority()
+{
+	return PriorityControl;
+}
+
+void ControlSession::SendResponse(int32_t code, const CowBuffer<uint8_t> &data)
 {
 	CowBuffer<uint8_t> message(sizeof(code));
 	*message.SwitchType<int32_t>() = code;
@@ -92,7 +89,7 @@ void ControlSession::ProcessGetPublicKeyCommand()
 	SendResponse(OK, message);
 }
 
-void ControlSession::ProcessAddUserCommand(const CowBuffer<uint8_t> message)
+void ControlSession::ProcessAddUserCommand(const CowBuffer<uint8_t> &message)
 {
 	uint32_t minMessageLength =
 		sizeof(int32_t) +
@@ -150,7 +147,7 @@ void ControlSession::ProcessAddUserCommand(const CowBuffer<uint8_t> message)
 		DataToHex(key, KEY_SIZE) + ".");
 }
 
-void ControlSession::ProcessRemoveUserCommand(const CowBuffer<uint8_t> message)
+void ControlSession::ProcessRemoveUserCommand(const CowBuffer<uint8_t> &message)
 {
 	if (message.Size() != sizeof(int32_t) + KEY_SIZE) {
 		SendResponse(ERROR_INVALID_SIZE, CowBuffer<uint8_t>());
@@ -213,7 +210,7 @@ void ControlSession::ProcessListBannedIP()
 	SendResponse(OK, result);
 }
 
-void ControlSession::ProcessBanIP(const CowBuffer<uint8_t> message)
+void ControlSession::ProcessBanIP(const CowBuffer<uint8_t> &message)
 {
 	if (message.Size() != sizeof(int32_t) + sizeof(uint32_t)) {
 		SendResponse(ERROR_INVALID_SIZE, CowBuffer<uint8_t>());
@@ -232,7 +229,7 @@ void ControlSession::ProcessBanIP(const CowBuffer<uint8_t> message)
 	}
 }
 
-void ControlSession::ProcessUnbanIP(const CowBuffer<uint8_t> message)
+void ControlSession::ProcessUnbanIP(const CowBuffer<uint8_t> &message)
 {
 	if (message.Size() != sizeof(int32_t) + sizeof(uint32_t)) {
 		SendResponse(ERROR_INVALID_SIZE, CowBuffer<uint8_t>());
@@ -258,6 +255,33 @@ void ControlSession::ProcessReload()
 	SendResponse(OK, CowBuffer<uint8_t>());
 }
 
+// | limit | input | output | storage | dropped sessions | level |
+void ControlSession::ProcessMemoryStatus()
+{
+	MemoryBudget::Status status;
+	Budget->GetStatus(status);
+
+	MemoryPool::Statistics pool;
+	MemoryPool::GetStatistics(pool);
+
+	CowBuffer<uint8_t> message(sizeof(int64_t) * 9 + sizeof(int32_t));
+	int64_t *values = message.SwitchType<int64_t>();
+
+	values[0] = status.Limit;
+	values[1] = status.Usage.Input;
+	values[2] = status.Usage.Output;
+	values[3] = status.Usage.Storage;
+	values[4] = status.DroppedSessions;
+	values[5] = pool.Hits;
+	values[6] = pool.Misses;
+	values[7] = pool.Large;
+	values[8] = pool.Cached;
+
+	*message.SwitchType<int32_t>(sizeof(int64_t) * 9) = status.Level;
+
+	SendResponse(OK, message);
+}
+
 void ControlSession::ProcessUnknownCommand()
 {
 	SendResponse(ERROR_UNKNOWN_COMMAND, CowBuffer<uint8_t>());
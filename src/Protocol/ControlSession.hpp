@@ -4,6 +4,7 @@
 #include "Session.hpp"
 #include "../Server/UserDB.hpp"
 #include "../Server/FailBan.hpp"
+#include "../Server/MemoryBudget.hpp"
 
 struct ControlSession : public Session
 {
@@ -13,23 +14,25 @@ struct ControlSession : public Session
 	FailBan *Ban;
 	bool *Work;
 	bool *Reload;
+	MemoryBudget *Budget;
 
 	const uint8_t *PublicKey;
 
 	bool Process() override;
-	bool TimePassed() override;
+	Priority GetPriority() override;
 
-	void SendResponse(int32_t value, const CowBuffer<uint8_t> data);
+	void SendResponse(int32_t value, const CowBuffer<uint8_t> &data);
 
 	void ProcessShutdownCommand();
 	void ProcessGetPublicKeyCommand();
-	void ProcessAddUserCommand(const CowBuffer<uint8_t> message);
-	void ProcessRemoveUserCommand(const CowBuffer<uint8_t> message);
+	void ProcessAddUserCommand(const CowBuffer<uint8_t> &message);
+	void ProcessRemoveUserCommand(const CowBuffer<uint8_t> &message);
 	void ProcessListUsersCommand();
 	void ProcessListBannedIP();
-	void ProcessBanIP(const CowBuffer<uint8_t> message);
-	void ProcessUnbanIP(const CowBuffer<uint8_t> message);
+	void ProcessBanIP(const CowBuffer<uint8_t> &message);
+	void ProcessUnbanIP(const CowBuffer<uint8_t> &message);
 	void ProcessReload();
+	void ProcessMemoryStatus();
 
 	void ProcessUnknownCommand();
 };
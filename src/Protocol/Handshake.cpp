@@ -4,7 +4,7 @@
 
 #include "../Crypto/Crypto.hpp"
 
-bool Handshake1::Parse(const CowBuffer<uint8_t> buffer, Data &result)
+bool Handshake1::Parse(const CowBuffer<uint8_t> &buffer, Data &result)
 {
 	unsigned int validSize = KEY_SIZE + sizeof(result.Timestamp) +
 		SIGNATURE_SIZE;
@@ -37,44 +37,132 @@ CowBuffer<uint8_t> Handshake1::Build(
 	return result.Concat(signature);
 }
 
-bool Handshake2::Parse(const CowBuffer<uint8_t> buffer, Data &result)
+bool Handshake2::Parse(const CowBuffer<uint8_t> &buffer, Data &result)
 {
 	unsigned int validSize = KEY_SIZE + sizeof(result.Timestamp);
+	unsigned int saltEnd = validSize + sizeof(result.Salt);
 
-	if (buffer.Size() != validSize) {
+	if (buffer.Size() != validSize && buffer.Size() != saltEnd) {
 		return false;
 	}
 
 	result.Key = buffer.Pointer();
 	result.Timestamp = *buffer.SwitchType<int64_t>(KEY_SIZE);
+	result.HasSalt = buffer.Size() == saltEnd;
+
+	if (result.HasSalt) {
+		memcpy(
+			result.Salt,
+			buffer.Pointer(validSize),
+			sizeof(result.Salt));
+	} else {
+		memset(result.Salt, 0, sizeof(result.Salt));
+	}
+
 	return true;
 }
 
 CowBuffer<uint8_t> Handshake2::Build(const Data &data)
 {
-	CowBuffer<uint8_t> result(KEY_SIZE + sizeof(data.Timestamp));
+	uint64_t size = KEY_SIZE + sizeof(data.Timestamp);
+
+	if (data.HasSalt) {
+		size += sizeof(data.Salt);
+	}
+
+	CowBuffer<uint8_t> result(size);
 
 	memcpy(result.Pointer(), data.Key, KEY_SIZE);
 	*result.SwitchType<int64_t>(KEY_SIZE) = data.Timestamp;
 
+	if (data.HasSalt) {
+		memcpy(
+			result.Pointer(KEY_SIZE + sizeof(data.Timestamp)),
+			data.Salt,
+			sizeof(data.Salt));
+	}
+
 	return result;
 }
 
-bool Handshake3::Parse(const CowBuffer<uint8_t> buffer, Data &result)
+bool Handshake3::Parse(const CowBuffer<uint8_t> &buffer, Data &result)
 {
 	unsigned int validSize = sizeof(result.Timestamp);
-
-	if (buffer.Size() != validSize) {
+	unsigned int sliceSizeEnd = validSize + sizeof(result.SliceSize);
+	unsigned int framingEnd = sliceSizeEnd + sizeof(result.Framing);
+	unsigned int windowEnd = framingEnd + sizeof(result.Window);
+
+	if (buffer.Size() != validSize &&
+		buffer.Size() != sliceSizeEnd &&
+		buffer.Size() != framingEnd &&
+		buffer.Size() != windowEnd)
+	{
 		return false;
 	}
 
 	result.Timestamp = *buffer.SwitchType<int64_t>();
+	result.HasSliceSize = buffer.Size() >= sliceSizeEnd;
+	result.Framing = FRAMING_V1;
+	result.HasWindow = buffer.Size() == windowEnd;
+
+	if (result.HasSliceSize) {
+		memcpy(
+			result.SliceSize,
+			buffer.Pointer(validSize),
+			sizeof(result.SliceSize));
+	}
+
+	if (buffer.Size() >= framingEnd) {
+		result.Framing = *buffer.SwitchType<uint32_t>(sliceSizeEnd);
+	}
+
+	if (result.HasWindow) {
+		memcpy(
+			result.Window,
+			buffer.Pointer(framingEnd),
+			sizeof(result.Window));
+	}
+
 	return true;
 }
 
+// Framing is sent only together with slice sizes, windows are sent
+// only together with framing.
 CowBuffer<uint8_t> Handshake3::Build(const Data &data)
 {
-	CowBuffer<uint8_t> result(sizeof(data.Timestamp));
+	uint64_t size = sizeof(data.Timestamp);
+
+	if (data.HasSliceSize) {
+		size += sizeof(data.SliceSize) + sizeof(data.Framing);
+
+		if (data.HasWindow) {
+			size += sizeof(data.Window);
+		}
+	}
+
+	CowBuffer<uint8_t> result(size);
 	*result.SwitchType<int64_t>() = data.Timestamp;
+
+	if (data.HasSliceSize) {
+		memcpy(
+			result.Pointer(sizeof(data.Timestamp)),
+			data.SliceSize,
+			sizeof(data.SliceSize));
+
+		*result.SwitchType<uint32_t>(
+			sizeof(data.Timestamp) + sizeof(data.SliceSize)) =
+			data.Framing;
+
+		if (data.HasWindow) {
+			memcpy(
+				result.Pointer(
+					sizeof(data.Timestamp) +
+					sizeof(data.SliceSize) +
+					sizeof(data.Framing)),
+				data.Window,
+				sizeof(data.Window));
+		}
+	}
+
 	return result;
 }
@@ -2,6 +2,7 @@
 #define _HANDSHAKE_HPP
 
 #include "../Common/CowBuffer.hpp"
+#include "Session.hpp"
 
 namespace Handshake1
 {
@@ -12,30 +13,46 @@ namespace Handshake1
 		CowBuffer<uint8_t> Signature;
 	};
 
-	bool Parse(const CowBuffer<uint8_t> buffer, Data &result);
+	bool Parse(const CowBuffer<uint8_t> &buffer, Data &result);
 	CowBuffer<uint8_t> Build(const Data &data, const uint8_t *signatureKey);
 }
 
 namespace Handshake2
 {
+	// Salt is random value of the session that is mixed into nonces of
+	// framing v2. Old servers do not send it.
 	struct Data
 	{
 		const uint8_t *Key;
 		int64_t Timestamp;
+
+		bool HasSalt;
+		uint8_t Salt[NONCE_SALT_SIZE];
 	};
 
-	bool Parse(const CowBuffer<uint8_t> buffer, Data &result);
+	bool Parse(const CowBuffer<uint8_t> &buffer, Data &result);
 	CowBuffer<uint8_t> Build(const Data &data);
 }
 
 namespace Handshake3
 {
+	// Slice sizes, framing and flow control windows are proposed by
+	// client and used in both directions after handshake. Old clients
+	// do not send them, framing is not sent by clients that only send
+	// slice sizes, windows are sent only after framing.
 	struct Data
 	{
 		int64_t Timestamp;
+
+		bool HasSliceSize;
+		uint32_t SliceSize[Session::StreamCount];
+		uint32_t Framing;
+
+		bool HasWindow;
+		uint32_t Window[Session::StreamCount];
 	};
 
-	bool Parse(const CowBuffer<uint8_t> buffer, Data &result);
+	bool Parse(const CowBuffer<uint8_t> &buffer, Data &result);
 	CowBuffer<uint8_t> Build(const Data &data);
 }
 
@@ -8,16 +8,46 @@
 
 #include "../Common/Debug.hpp"
 
+ServerSession::ServerSession()
+{
+	Limits = nullptr;
+	Storage = StorageEngine::TypeFiles;
+	Timers = nullptr;
+	ThrottleTimer.Handler = this;
+	Throttled = false;
+	MemoryPressure = false;
+	HistoryRequested = false;
+	HistoryTimestamp = 0;
+	HistoryIndex = 0;
+	HistorySize = 0;
+	PendingFirst = nullptr;
+	PendingLast = nullptr;
+	PendingCount = 0;
+}
+
 ServerSession::~ServerSession()
 {
+	if (ThrottleTimer.Armed()) {
+		Timers->RemoveTimer(&ThrottleTimer);
+	}
+
+	if (Limits) {
+		Limits->Release(IPv4, State == ServerStateActiveSession);
+	}
+
 	if (InVoice()) {
-		VoicePeer->EndVoice();
-		VoicePeer = nullptr;
-		VoiceState = VoiceStateInactive;
+		Pipe->EndVoice(VoicePeer, PeerPublicKey);
+		ResetVoice();
 	}
 
 	if (PeerPublicKey) {
-		Pipe->Unregister(PeerPublicKey);
+		Pipe->Unregister(PeerPublicKey, this);
+	}
+
+	while (PendingFirst) {
+		PendingResponse *response = PendingFirst;
+		PendingFirst = response->Next;
+		delete response;
 	}
 
 	for (int i = 0; i < StreamCount; i++) {
@@ -44,17 +74,6 @@ bool ServerSession::Process()
 	return false;
 }
 
-bool ServerSession::TimePassed()
-{
-	int64_t t = GetUnixTime();
-
-	if (t - Time > 10) {
-		return false;
-	}
-
-	return true;
-}
-
 bool ServerSession::ProcessFirstSyn()
 {
 	CowBuffer<uint8_t> message = Receive();
@@ -72,7 +91,7 @@ bool ServerSession::ProcessFirstSyn()
 		return false;
 	}
 
-	if (Pipe->GetHandler(request.Key)) {
+	if (Pipe->IsOnline(request.Key)) {
 		return false;
 	}
 
@@ -82,8 +101,13 @@ bool ServerSession::ProcessFirstSyn()
 	int64_t prevTime = Users->GetUserAccessTime(PeerPublicKey);
 	int64_t currentTime = request.Timestamp;
 
+	// Honest clients are rejected until the floor left by unclean
+	// shutdown passes, such rejections are not counted as failures.
 	if (currentTime <= prevTime) {
-		Ban->RecordFailure(IPv4);
+		if (prevTime > Users->GetTimeFloor()) {
+			Ban->RecordFailure(IPv4);
+		}
+
 		return false;
 	}
 
@@ -119,9 +143,13 @@ bool ServerSession::ProcessFirstSyn()
 
 	currentTime += 1;
 
+	GenerateNonceSalt(NonceSalt);
+
 	Handshake2::Data response;
 	response.Key = PublicKey;
 	response.Timestamp = currentTime;
+	response.HasSalt = true;
+	memcpy(response.Salt, NonceSalt, sizeof(response.Salt));
 
 	Send(Handshake2::Build(response), 0, true);
 
@@ -147,13 +175,60 @@ bool ServerSession::ProcessSecondSyn()
 		return false;
 	}
 
+	if (request.HasSliceSize) {
+		for (int i = 0; i < StreamCount; i++) {
+			uint32_t size = request.SliceSize[i];
+
+			if (size < SLICE_SIZE_MIN || size > SLICE_SIZE_MAX) {
+				return false;
+			}
+
+			SetSliceSize(i, size);
+		}
+	}
+
+	if (request.Framing != FRAMING_V1 && request.Framing != FRAMING_V2) {
+		return false;
+	}
+
+	// Nonces of framing v2 are derived from the handshake timestamp
+	// and salt sent in response to the first request.
+	if (request.Framing != FRAMING_V1) {
+		uint8_t nonce[NONCE_SIZE];
+		InitNonce(nonce, value, NonceSalt);
+		SetFraming(request.Framing, nonce);
+	}
+
+	if (request.HasWindow) {
+		if (request.Framing != FRAMING_V2) {
+			return false;
+		}
+
+		for (int i = 0; i < StreamCount; i++) {
+			uint32_t window = request.Window[i];
+
+			if (window && (window < WINDOW_MIN || window > WINDOW_MAX)) {
+				return false;
+			}
+
+			SetWindow(i, window);
+		}
+	}
+
 	State = ServerStateActiveSession;
+
+	if (Limits) {
+		Limits->Authenticated();
+	}
+
 	InputSizeLimit = 1024 * 1024 * 1024;
 	RestrictStreams = false;
 
-	Pipe->Register(PeerPublicKey, this);
+	// Handshake deadline is replaced with idle timeout.
+	Deadline = false;
+	Timeout = IdleTimeout;
 
-	return true;
+	return Pipe->Register(PeerPublicKey, this, Inbox, &OutputSize);
 }
 
 bool ServerSession::ProcessActiveSession()
@@ -187,7 +262,7 @@ bool ServerSession::ProcessActiveSession()
 	return false;
 }
 
-bool ServerSession::ProcessKeepAlive(const CowBuffer<uint8_t> plainText)
+bool ServerSession::ProcessKeepAlive(const CowBuffer<uint8_t> &plainText)
 {
 	CommandKeepAlive::Command command;
 	bool parseResult = CommandKeepAlive::ParseCommand(plainText, command);
@@ -200,7 +275,7 @@ bool ServerSession::ProcessKeepAlive(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ServerSession::ProcessTextMessage(const CowBuffer<uint8_t> plainText)
+bool ServerSession::ProcessTextMessage(const CowBuffer<uint8_t> &plainText)
 {
 	CommandTextMessage::Command command;
 	CommandTextMessage::Response response;
@@ -232,30 +307,81 @@ bool ServerSession::ProcessTextMessage(const CowBuffer<uint8_t> plainText)
 			}
 		}
 
+		// Message is stored and relayed by the journal.
 		if (response.Status == SESSION_RESPONSE_OK) {
-			MessageStorage container1(header.Source);
-			bool addSuccessful = container1.AddMessage(
-				command.Message);
-
-			if (addSuccessful) {
-				MessageStorage container2(header.Destination);
-				addSuccessful = container2.AddMessage(
-					command.Message);
-			}
-
-			if (addSuccessful) {
-				Pipe->SendMessage(command.Message);
-			}
+			QueueResponse(
+				Journal->Append(command.Message),
+				header.Destination,
+				response.Status);
+			return true;
 		}
 	}
 
-	Send(CommandTextMessage::BuildResponse(response), 1, true);
+	QueueResponse(0, nullptr, response.Status);
 	return true;
 }
 
-bool ServerSession::ProcessListUsers(const CowBuffer<uint8_t> plainText)
+void ServerSession::QueueResponse(
+	int64_t sequence,
+	const uint8_t *destination,
+	int32_t status)
 {
-	if (*RestrictedMode) {
+	PendingResponse *response = new PendingResponse;
+	response->Next = nullptr;
+	response->Sequence = sequence;
+	response->Status = status;
+	response->Stored = !destination;
+
+	if (destination) {
+		memcpy(response->Destination, destination, KEY_SIZE);
+	}
+
+	if (PendingLast) {
+		PendingLast->Next = response;
+	} else {
+		PendingFirst = response;
+	}
+
+	PendingLast = response;
+	PendingCount++;
+
+	SendResponses();
+	UpdateInputPause();
+}
+
+void ServerSession::SendResponses()
+{
+	while (PendingFirst && PendingFirst->Stored) {
+		PendingResponse *pending = PendingFirst;
+
+		CommandTextMessage::Response response;
+		response.Status = pending->Status;
+		Send(CommandTextMessage::BuildResponse(response), 1, true);
+
+		bool stored =
+			pending->Status == SESSION_RESPONSE_OK &&
+			pending->Sequence;
+
+		if (stored &&
+			Pipe->GetBacklog(pending->Destination) >
+			RelayBacklogLimit)
+		{
+			Throttle(pending->Destination);
+		}
+
+		PendingFirst = pending->Next;
+		delete pending;
+		PendingCount--;
+	}
+
+	if (!PendingFirst) {
+		PendingLast = nullptr;
+	}
+}
+
+bool ServerSession::ProcessListUsers(const CowBuffer<uint8_t> &plainText)
+{
+	if (__atomic_load_n(RestrictedMode, __ATOMIC_RELAXED)) {
 		return true;
 	}
 
@@ -294,7 +420,7 @@ bool ServerSession::ProcessListUsers(const CowBuffer<uint8_t> plainText)
 	return true;
 }
 
-bool ServerSession::ProcessGetMessages(const CowBuffer<uint8_t> plainText)
+bool ServerSession::ProcessGetMessages(const CowBuffer<uint8_t> &plainText)
 {
 	CommandGetMessages::Command command;
 
@@ -304,23 +430,27 @@ bool ServerSession::ProcessGetMessages(const CowBuffer<uint8_t> plainText)
 		return false;
 	}
 
-	const int64_t intMax = 0x7fffffffffffffff;
-
-	MessageStorage container(
-		PeerPublicKey);
+	// Rest of previous history is queued at once, new history is
+	// queued as output is sent.
+	while (HistoryIndex < History.Size()) {
+		SendMessage(History[HistoryIndex++]);
+	}
 
-	CowBuffer<CowBuffer<uint8_t>> messages = container.GetMessageRange(
-		command.Timestamp,
-		intMax);
+	History = CowBuffer<CowBuffer<uint8_t>>();
+	HistoryIndex = 0;
+	HistorySize = 0;
 
-	for (uint32_t i = 0; i < messages.Size(); i++) {
-		SendMessage(messages[i]);
+	if (!HistoryRequested || command.Timestamp < HistoryTimestamp) {
+		HistoryTimestamp = command.Timestamp;
 	}
 
+	HistoryRequested = true;
+	Refill();
+
 	return true;
 }
 
-void ServerSession::SendMessage(const CowBuffer<uint8_t> message)
+void ServerSession::SendMessage(const CowBuffer<uint8_t> &message)
 {
 	CommandDeliverMessage::Command command;
 	command.Message = message;
@@ -328,26 +458,180 @@ void ServerSession::SendMessage(const CowBuffer<uint8_t> message)
 	Send(CommandDeliverMessage::BuildCommand(command), 2, true);
 }
 
-bool ServerSession::InVoice()
+// Notification of previous session of the user is ignored.
+void ServerSession::MessageStored(int64_t sequence, bool stored)
 {
-	return VoicePeer;
+	PendingResponse *response = PendingFirst;
+
+	while (response && response->Sequence != sequence) {
+		response = response->Next;
+	}
+
+	if (!response) {
+		return;
+	}
+
+	response->Stored = true;
+
+	if (!stored) {
+		response->Status = SESSION_RESPONSE_ERROR;
+	}
+
+	SendResponses();
+	UpdateInputPause();
 }
 
-void ServerSession::SendVoiceFrame(const CowBuffer<uint8_t> frame)
+// Peer stops sending bulk data when its window is used. Paused input
+// is checked periodically, recipient can be served by other worker.
+void ServerSession::Throttle(const uint8_t *peerKey)
 {
-	if (!InVoice() || VoiceState != VoiceStateActive) {
+	if (!Timers) {
 		return;
 	}
 
-	Send(frame, 1, true);
+	memcpy(ThrottlePeer, peerKey, KEY_SIZE);
+	Throttled = true;
+	UpdateInputPause();
+
+	if (!ThrottleTimer.Armed()) {
+		Timers->AddTimer(
+			&ThrottleTimer,
+			Timers->GetTime() + ThrottleInterval);
+	}
 }
 
-void ServerSession::StartVoice(
-	const uint8_t *peerKey,
-	int64_t timestamp,
-	SendMessageHandler *handler)
+void ServerSession::TimerExpired(Timer *timer)
+{
+	if (Pipe->GetBacklog(ThrottlePeer) > RelayBacklogLimit / 2) {
+		Timers->AddTimer(
+			&ThrottleTimer,
+			Timers->GetTime() + ThrottleInterval);
+		return;
+	}
+
+	Throttled = false;
+	UpdateInputPause();
+}
+
+void ServerSession::UpdateInputPause()
+{
+	bool paused =
+		Throttled ||
+		MemoryPressure ||
+		PendingCount >= PendingResponseLimit;
+
+	if (paused) {
+		PauseInput(2);
+	} else {
+		ResumeInput(2);
+	}
+}
+
+void ServerSession::LoadHistory()
+{
+	const int64_t intMax = 0x7fffffffffffffff;
+
+	{
+		KeyLockGuard guard(StorageLock, PeerPublicKey);
+
+		MessageStorage container(PeerPublicKey, Storage);
+
+		History = container.GetMessageRange(
+			HistoryTimestamp,
+			intMax);
+	}
+
+	HistoryRequested = false;
+	HistoryIndex = 0;
+	HistorySize = 0;
+
+	// Mapped messages are read from storage files on demand.
+	for (uint32_t i = 0; i < History.Size(); i++) {
+		if (!History[i].IsMapped()) {
+			HistorySize += History[i].Size();
+		}
+	}
+}
+
+void ServerSession::Refill()
+{
+	if (MemoryPressure) {
+		return;
+	}
+
+	if (HistoryRequested) {
+		LoadHistory();
+	}
+
+	if (!History.Size()) {
+		return;
+	}
+
+	while (HistoryIndex < History.Size() &&
+		OutputSize < HistoryBacklogLimit)
+	{
+		if (!History[HistoryIndex].IsMapped()) {
+			HistorySize -= History[HistoryIndex].Size();
+		}
+
+		SendMessage(History[HistoryIndex++]);
+	}
+
+	if (HistoryIndex == History.Size()) {
+		History = CowBuffer<CowBuffer<uint8_t>>();
+		HistoryIndex = 0;
+	}
+}
+
+void ServerSession::GetMemoryUsage(SessionMemory &usage)
+{
+	Session::GetMemoryUsage(usage);
+	usage.Storage = HistorySize;
+}
+
+Session::Priority ServerSession::GetPriority()
+{
+	if (State != ServerStateActiveSession) {
+		return PriorityHandshake;
+	}
+
+	return PriorityActive;
+}
+
+// Reading of bulk stream and history is resumed when pressure ends.
+void ServerSession::SetMemoryPressure(bool pressure)
+{
+	MemoryPressure = pressure;
+	UpdateInputPause();
+
+	if (!pressure) {
+		Refill();
+	}
+}
+
+bool ServerSession::InVoice()
+{
+	return VoiceState != VoiceStateInactive;
+}
+
+bool ServerSession::IsVoicePeer(const uint8_t *peerKey)
+{
+	return InVoice() && !crypto_verify32(VoicePeer, peerKey);
+}
+
+void ServerSession::ResetVoice()
+{
+	VoiceState = VoiceStateInactive;
+	memset(VoicePeer, 0, KEY_SIZE);
+}
+
+bool ServerSession::StartVoice(const uint8_t *peerKey, int64_t timestamp)
 {
-	VoicePeer = handler;
+	if (InVoice()) {
+		return false;
+	}
+
+	memcpy(VoicePeer, peerKey, KEY_SIZE);
 	VoiceState = VoiceStateRinging;
 
 	CommandVoiceRequest::Command command;
@@ -355,10 +639,38 @@ void ServerSession::StartVoice(
 	command.Timestamp = timestamp;
 
 	Send(CommandVoiceRequest::BuildCommand(command), 1, true);
+	return true;
 }
 
-void ServerSession::AcceptVoice()
+void ServerSession::VoiceStarted(
+	const uint8_t *peerKey,
+	VoiceStartStatus status)
 {
+	if (!IsVoicePeer(peerKey) || VoiceState != VoiceStateWaitingForCallee) {
+		return;
+	}
+
+	CommandVoiceInit::Response response;
+
+	if (status == VoiceStartRinging) {
+		response.Status = SESSION_RESPONSE_VOICE_RINGING;
+	} else if (status == VoiceStartBusy) {
+		response.Status = SESSION_RESPONSE_ERROR_USER_IN_VOICE;
+		ResetVoice();
+	} else {
+		response.Status = SESSION_RESPONSE_ERROR_USER_OFFLINE;
+		ResetVoice();
+	}
+
+	Send(CommandVoiceInit::BuildResponse(response), 1, true);
+}
+
+void ServerSession::AcceptVoice(const uint8_t *peerKey)
+{
+	if (!IsVoicePeer(peerKey) || VoiceState != VoiceStateWaitingForCallee) {
+		return;
+	}
+
 	CommandVoiceInit::Response response;
 	response.Status = SESSION_RESPONSE_VOICE_ACCEPT;
 
@@ -367,26 +679,43 @@ void ServerSession::AcceptVoice()
 	Send(CommandVoiceInit::BuildResponse(response), 1, true);
 }
 
-void ServerSession::DeclineVoice()
+void ServerSession::DeclineVoice(const uint8_t *peerKey)
 {
+	if (!IsVoicePeer(peerKey)) {
+		return;
+	}
+
 	CommandVoiceInit::Response response;
 	response.Status = SESSION_RESPONSE_VOICE_DECLINE;
 
-	VoiceState = VoiceStateInactive;
-	VoicePeer = nullptr;
+	ResetVoice();
 
 	Send(CommandVoiceInit::BuildResponse(response), 1, true);
 }
 
-void ServerSession::EndVoice()
+void ServerSession::EndVoice(const uint8_t *peerKey)
 {
-	VoiceState = VoiceStateInactive;
-	VoicePeer = nullptr;
+	if (!IsVoicePeer(peerKey)) {
+		return;
+	}
+
+	ResetVoice();
 
 	Send(CommandVoiceEnd::BuildCommand(), 1, true);
 }
 
-bool ServerSession::ProcessVoiceInit(const CowBuffer<uint8_t> plainText)
+void ServerSession::SendVoiceFrame(
+	const uint8_t *peerKey,
+	const CowBuffer<uint8_t> &frame)
+{
+	if (!IsVoicePeer(peerKey) || VoiceState != VoiceStateActive) {
+		return;
+	}
+
+	Send(frame, 1, true);
+}
+
+bool ServerSession::ProcessVoiceInit(const CowBuffer<uint8_t> &plainText)
 {
 	CommandVoiceInit::Command command;
 	bool parseResult = CommandVoiceInit::ParseCommand(plainText, command);
@@ -409,31 +738,22 @@ bool ServerSession::ProcessVoiceInit(const CowBuffer<uint8_t> plainText)
 		return true;
 	}
 
-	SendMessageHandler *handler = Pipe->GetHandler(command.Key);
-
-	if (!handler) {
+	if (!Pipe->IsOnline(command.Key)) {
 		response.Status = SESSION_RESPONSE_ERROR_USER_OFFLINE;
 		Send(CommandVoiceInit::BuildResponse(response), 1, true);
 		return true;
 	}
 
-	if (handler->InVoice()) {
-		response.Status = SESSION_RESPONSE_ERROR_USER_IN_VOICE;
-		Send(CommandVoiceInit::BuildResponse(response), 1, true);
-		return true;
-	}
-
-	VoicePeer = handler;
+	memcpy(VoicePeer, command.Key, KEY_SIZE);
 	VoiceState = VoiceStateWaitingForCallee;
 
-	VoicePeer->StartVoice(PeerPublicKey, command.Timestamp, this);
-
-	response.Status = SESSION_RESPONSE_VOICE_RINGING;
-	Send(CommandVoiceInit::BuildResponse(response), 1, true);
+	// Callee checks whether it is busy. Response is sent
+	// from VoiceStarted.
+	Pipe->StartVoice(command.Key, PeerPublicKey, command.Timestamp);
 	return true;
 }
 
-bool ServerSession::ProcessVoiceRequest(const CowBuffer<uint8_t> plainText)
+bool ServerSession::ProcessVoiceRequest(const CowBuffer<uint8_t> &plainText)
 {
 	CommandVoiceRequest::Response response;
 	bool parseResult = CommandVoiceRequest::ParseResponse(
@@ -444,45 +764,48 @@ bool ServerSession::ProcessVoiceRequest(const CowBuffer<uint8_t> plainText)
 		return false;
 	}
 
-	if (!VoicePeer || VoiceState != VoiceStateRinging) {
-		EndVoice();
+	if (VoiceState != VoiceStateRinging) {
+		if (InVoice()) {
+			Pipe->EndVoice(VoicePeer, PeerPublicKey);
+			ResetVoice();
+		}
+
+		Send(CommandVoiceEnd::BuildCommand(), 1, true);
 		return true;
 	}
 
 	if (response.Status == SESSION_RESPONSE_VOICE_ACCEPT) {
-		VoicePeer->AcceptVoice();
 		VoiceState = VoiceStateActive;
+		Pipe->AcceptVoice(VoicePeer, PeerPublicKey);
 		return true;
 	}
 
 	if (response.Status == SESSION_RESPONSE_VOICE_DECLINE) {
-		VoicePeer->DeclineVoice();
-		VoicePeer = nullptr;
-		VoiceState = VoiceStateInactive;
+		Pipe->DeclineVoice(VoicePeer, PeerPublicKey);
+		ResetVoice();
 		return true;
 	}
 
 	return false;
 }
 
-bool ServerSession::ProcessVoiceEnd(const CowBuffer<uint8_t> plainText)
+bool ServerSession::ProcessVoiceEnd(const CowBuffer<uint8_t> &plainText)
 {
 	if (!InVoice()) {
 		return true;
 	}
 
-	VoicePeer->EndVoice();
-	VoicePeer = nullptr;
-	VoiceState = VoiceStateInactive;
+	Pipe->EndVoice(VoicePeer, PeerPublicKey);
+	ResetVoice();
 	return true;
 }
 
-bool ServerSession::ProcessVoiceData(const CowBuffer<uint8_t> plainText)
+bool ServerSession::ProcessVoiceData(const CowBuffer<uint8_t> &plainText)
 {
-	if (!InVoice() || VoiceState != VoiceStateActive) {
+	if (VoiceState != VoiceStateActive) {
 		return true;
 	}
 
-	VoicePeer->SendVoiceFrame(plainText);
+	Pipe->SendVoiceFrame(VoicePeer, PeerPublicKey, plainText);
 	return true;
 }
@@ -5,12 +5,36 @@
 #include "../Server/UserDB.hpp"
 #include "../Server/MessagePipe.hpp"
 #include "../Server/FailBan.hpp"
+#include "../Server/KeyLock.hpp"
+#include "../Server/MessageJournal.hpp"
+#include "../Server/ConnectionLimits.hpp"
+#include "../Message/StorageEngine.hpp"
 #include "../Crypto/Crypto.hpp"
 
-struct ServerSession : public Session, public SendMessageHandler
+struct ServerSession :
+	public Session,
+	public SendMessageHandler,
+	public TimerHandler
 {
+	ServerSession();
 	~ServerSession();
 
+	enum
+	{
+		// Messages are not relayed faster than the slowest recipient
+		// receives them. Input of bulk stream is paused while output
+		// backlog of the recipient is above the limit.
+		RelayBacklogLimit = 4 * 1024 * 1024,
+		ThrottleInterval = 50,
+
+		// Stored messages are queued as previous ones are sent.
+		HistoryBacklogLimit = 1024 * 1024,
+
+		// Input of bulk stream is paused while this many messages
+		// wait for the journal.
+		PendingResponseLimit = 1024
+	};
+
 	enum ServerSessionState
 	{
 		ServerStateWaitFirstSyn = 0,
@@ -20,9 +44,52 @@ struct ServerSession : public Session, public SendMessageHandler
 
 	UserDB *Users;
 	MessagePipe *Pipe;
+	Mailbox *Inbox;
 	FailBan *Ban;
+	KeyLock *StorageLock;
+	MessageJournal *Journal;
+	StorageEngine::Type Storage;
 	uint32_t IPv4;
 
+	// Sent in handshake, makes nonces of framing v2 unique even if
+	// handshake is replayed.
+	uint8_t NonceSalt[NONCE_SALT_SIZE];
+
+	// Connection admitted by limits is released on destruction.
+	ConnectionLimits *Limits;
+
+	// Timers of the worker, relay throttling is disabled if not set.
+	TimerQueue *Timers;
+	Timer ThrottleTimer;
+	uint8_t ThrottlePeer[KEY_SIZE];
+	bool Throttled;
+
+	bool MemoryPressure;
+
+	// Responses to text messages are sent in order of the messages.
+	// Response to stored message waits until the journal commits it.
+	struct PendingResponse
+	{
+		PendingResponse *Next;
+		int64_t Sequence;
+		int32_t Status;
+		bool Stored;
+		uint8_t Destination[KEY_SIZE];
+
+		POOL_ALLOCATED
+	};
+
+	PendingResponse *PendingFirst;
+	PendingResponse *PendingLast;
+	int64_t PendingCount;
+
+	// History is read from storage when there is no memory pressure.
+	bool HistoryRequested;
+	int64_t HistoryTimestamp;
+	CowBuffer<CowBuffer<uint8_t>> History;
+	uint32_t HistoryIndex;
+	int64_t HistorySize;
+
 	const bool *RestrictedMode;
 
 	ServerSessionState State;
@@ -46,14 +113,30 @@ struct ServerSession : public Session, public SendMessageHandler
 	bool ProcessSecondSyn();
 	bool ProcessActiveSession();
 
-	bool TimePassed() override;
+	bool ProcessKeepAlive(const CowBuffer<uint8_t> &plainText);
+	bool ProcessTextMessage(const CowBuffer<uint8_t> &plainText);
+	bool ProcessListUsers(const CowBuffer<uint8_t> &plainText);
+	bool ProcessGetMessages(const CowBuffer<uint8_t> &plainText);
+
+	void QueueResponse(
+		int64_t sequence,
+		const uint8_t *destination,
+		int32_t status);
+	void SendResponses();
+
+	void SendMessage(const CowBuffer<uint8_t> &message) override;
+	void MessageStored(int64_t sequence, bool stored) override;
 
-	bool ProcessKeepAlive(const CowBuffer<uint8_t> plainText);
-	bool ProcessTextMessage(const CowBuffer<uint8_t> plainText);
-	bool ProcessListUsers(const CowBuffer<uint8_t> plainText);
-	bool ProcessGetMessages(const CowBuffer<uint8_t> plainText);
+	void Throttle(const uint8_t *peerKey);
+	void TimerExpired(Timer *timer) override;
+	void UpdateInputPause();
 
-	void SendMessage(const CowBuffer<uint8_t> message) override;
+	void LoadHistory();
+	void Refill() override;
+
+	void GetMemoryUsage(SessionMemory &usage) override;
+	Priority GetPriority() override;
+	void SetMemoryPressure(bool pressure) override;
 
 	// Voice.
 	enum ServerSessionVoiceState
@@ -65,21 +148,26 @@ struct ServerSession : public Session, public SendMessageHandler
 	};
 
 	ServerSessionVoiceState VoiceState;
-	SendMessageHandler *VoicePeer;
-	bool InVoice() override;
-	void SendVoiceFrame(const CowBuffer<uint8_t> frame) override;
-	void StartVoice(
+	uint8_t VoicePeer[KEY_SIZE];
+	bool InVoice();
+	bool IsVoicePeer(const uint8_t *peerKey);
+	void ResetVoice();
+
+	bool StartVoice(const uint8_t *peerKey, int64_t timestamp) override;
+	void VoiceStarted(
 		const uint8_t *peerKey,
-		int64_t timestamp,
-		SendMessageHandler *handler) override;
-	void AcceptVoice() override;
-	void DeclineVoice() override;
-	void EndVoice() override;
-
-	bool ProcessVoiceInit(const CowBuffer<uint8_t> plainText);
-	bool ProcessVoiceRequest(const CowBuffer<uint8_t> plainText);
-	bool ProcessVoiceEnd(const CowBuffer<uint8_t> plainText);
-	bool ProcessVoiceData(const CowBuffer<uint8_t> plainText);
+		VoiceStartStatus status) override;
+	void AcceptVoice(const uint8_t *peerKey) override;
+	void DeclineVoice(const uint8_t *peerKey) override;
+	void EndVoice(const uint8_t *peerKey) override;
+	void SendVoiceFrame(
+		const uint8_t *peerKey,
+		const CowBuffer<uint8_t> &frame) override;
+
+	bool ProcessVoiceInit(const CowBuffer<uint8_t> &plainText);
+	bool ProcessVoiceRequest(const CowBuffer<uint8_t> &plainText);
+	bool ProcessVoiceEnd(const CowBuffer<uint8_t> &plainText);
+	bool ProcessVoiceData(const CowBuffer<uint8_t> &plainText);
 };
 
 #endif
@@ -3,38 +3,42 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <utility>
 
-#include "../Common/UnixTime.hpp"
 #include "../Common/Exception.hpp"
 
-static int64_t Read(int fd, void *buffer, int64_t size)
+// Little endian base 128 encoding.
+static int PutVarint(uint8_t *buffer, uint64_t value)
 {
-	for (;;) {
-		int64_t res = read(fd, buffer, size);
+	int size = 0;
 
-		if (res == -1) {
-			if (errno == EINTR) {
-				continue;
-			}
-		}
-
-		return res;
+	while (value >= 0x80) {
+		buffer[size++] = value | 0x80;
+		value >>= 7;
 	}
+
+	buffer[size++] = value;
+	return size;
 }
 
-static int64_t Write(int fd, const void *buffer, int64_t size)
+// Returns encoded size, 0 if data is incomplete, -1 if encoding is invalid.
+static int GetVarint(const uint8_t *data, int64_t size, uint64_t *value)
 {
-	for (;;) {
-		int64_t res = write(fd, buffer, size);
+	*value = 0;
 
-		if (res == -1) {
-			if (errno == EINTR) {
-				continue;
-			}
+	for (int i = 0; i < 10; i++) {
+		if (i == size) {
+			return 0;
 		}
 
-		return res;
+		*value |= (uint64_t)(data[i] & 0x7f) << (7 * i);
+
+		if (!(data[i] & 0x80)) {
+			return i + 1;
+		}
 	}
+
+	return -1;
 }
 
 // BufferQueue.
@@ -42,6 +46,8 @@ BufferQueue::BufferQueue()
 {
 	_first = nullptr;
 	_last = nullptr;
+	_size = 0;
+	_memory = 0;
 }
 
 BufferQueue::~BufferQueue()
@@ -54,11 +60,17 @@ bool BufferQueue::IsEmpty()
 	return !_first;
 }
 
-void BufferQueue::Put(const CowBuffer<uint8_t> buffer)
+void BufferQueue::Put(CowBuffer<uint8_t> buffer)
 {
 	Sequence *seq = new Sequence;
 	seq->Next = nullptr;
-	seq->Data = buffer;
+	_size += buffer.Size();
+
+	if (!buffer.IsMapped()) {
+		_memory += buffer.Size();
+	}
+
+	seq->Data = std::move(buffer);
 
 	if (!_first) {
 		_first = seq;
@@ -82,7 +94,12 @@ CowBuffer<uint8_t> BufferQueue::Get()
 		_last = nullptr;
 	}
 
-	CowBuffer<uint8_t> result = tmp->Data;
+	CowBuffer<uint8_t> result = std::move(tmp->Data);
+	_size -= result.Size();
+
+	if (!result.IsMapped()) {
+		_memory -= result.Size();
+	}
 	delete tmp;
 	return result;
 }
@@ -96,403 +113,666 @@ void BufferQueue::Clear()
 	}
 
 	_last = nullptr;
+	_size = 0;
+	_memory = 0;
 }
 
-// StreamReader.
-StreamReader::StreamReader()
+// SocketInput.
+SocketInput::SocketInput()
 {
-	_expectedData = 0;
-	_expectedSlice = 0;
-	_expectedInt = 0;
-	_inES = nullptr;
+	_buffer = nullptr;
+	_capacity = 0;
+	_head = 0;
+	_tail = 0;
+	_external = false;
+	_end = false;
+	_unparsed = false;
 }
 
-bool StreamReader::Finalized()
+SocketInput::~SocketInput()
 {
-	return !_expectedSlice && !_expectedInt;
+	Clear();
 }
 
-bool StreamReader::HasData()
+void SocketInput::Append(const uint8_t *data, int64_t size)
 {
-	return !_queue.IsEmpty();
+	Reserve(size);
+	memcpy(_buffer + _tail, data, size);
+	_tail += size;
+	_unparsed = true;
 }
 
-CowBuffer<uint8_t> StreamReader::GetData()
+void SocketInput::SetEnd()
 {
-	return _queue.Get();
+	_end = true;
 }
 
-bool StreamReader::Process(int sockFd, uint64_t sizeLimit)
+bool SocketInput::Fill(int sockFd)
 {
-	if (!_expectedData) {
-		return ReadDataSize(sockFd, sizeLimit);
+	if (_external) {
+		return true;
 	}
 
-	if (!_expectedSlice) {
-		return ReadSliceSize(sockFd);
+	Reserve(1);
+
+	for (;;) {
+		int64_t rb = read(sockFd, _buffer + _tail, _capacity - _tail);
+
+		if (rb == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+
+			return false;
+		}
+
+		if (!rb) {
+			_end = true;
+		}
+
+		_tail += rb;
+		_unparsed = true;
+
+		return true;
 	}
+}
 
-	return ReadSlice(sockFd);
+void SocketInput::Consume(int64_t size)
+{
+	_head += size;
+
+	if (_head == _tail) {
+		MemoryPool::Free(_buffer, _capacity);
+		_buffer = nullptr;
+		_capacity = 0;
+		_head = 0;
+		_tail = 0;
+	}
 }
 
-void StreamReader::Reset()
+void SocketInput::Clear()
 {
-	_data = CowBuffer<uint8_t>();
-	_expectedData = 0;
-	_slice = CowBuffer<uint8_t>();
-	_expectedSlice = 0;
-	_intBuffer = CowBuffer<uint8_t>();
-	_expectedInt = 0;
-	_queue.Clear();
+	if (_buffer) {
+		MemoryPool::Free(_buffer, _capacity);
+	}
+
+	_buffer = nullptr;
+	_capacity = 0;
+	_head = 0;
+	_tail = 0;
+	_end = false;
+	_unparsed = false;
 }
 
-bool StreamReader::ReadDataSize(int sockFd, uint64_t sizeLimit)
+// Unparsed data is moved to the beginning of the buffer, buffer grows
+// only if appended data does not fit.
+void SocketInput::Reserve(int64_t size)
 {
-	uint64_t dataSize;
+	if (_capacity - _tail >= size) {
+		return;
+	}
 
-	if (!_expectedInt) {
-		if (!_inES) {
-			_intBuffer = CowBuffer<uint8_t>(sizeof(dataSize));
-		} else {
-			_intBuffer = CowBuffer<uint8_t>(
-				sizeof(dataSize) + NONCE_SIZE);
+	int64_t dataSize = _tail - _head;
+	int64_t capacity = _capacity ? _capacity : Capacity;
+
+	while (capacity < dataSize + size) {
+		capacity *= 2;
+	}
+
+	if (capacity == _capacity) {
+		memmove(_buffer, _buffer + _head, dataSize);
+	} else {
+		uint8_t *buffer = (uint8_t*)MemoryPool::Allocate(capacity);
+
+		if (_buffer) {
+			memcpy(buffer, _buffer + _head, dataSize);
+			MemoryPool::Free(_buffer, _capacity);
 		}
 
-		_expectedInt = _intBuffer.Size();
-		return true;
+		_buffer = buffer;
+		_capacity = capacity;
 	}
 
-	int rb = Read(
-		sockFd,
-		_intBuffer.Pointer(_intBuffer.Size() - _expectedInt),
-		_expectedInt);
+	_head = 0;
+	_tail = dataSize;
+}
 
-	if (rb <= 0) {
-		return false;
+// StreamReader.
+StreamReader::StreamReader()
+{
+	_block = nullptr;
+	_expectedData = 0;
+	_sliceSize = SLICE_SIZE_DEFAULT;
+	_framing = FRAMING_V1;
+	_window = 0;
+	_received = 0;
+	_limited = false;
+	_paused = false;
+	_inES = nullptr;
+}
+
+StreamReader::~StreamReader()
+{
+	ReleaseBlock();
+}
+
+bool StreamReader::HasData()
+{
+	return _block && !_block->Queue.IsEmpty();
+}
+
+CowBuffer<uint8_t> StreamReader::GetData()
+{
+	CowBuffer<uint8_t> data = _block->Queue.Get();
+
+	if (!_expectedData && _block->Queue.IsEmpty()) {
+		ReleaseBlock();
 	}
 
-	_expectedInt -= rb;
+	return data;
+}
 
-	if (_expectedInt) {
-		return true;
+void StreamReader::SetFraming(int framing, const uint8_t nonce[NONCE_SIZE])
+{
+	_framing = framing;
+
+	if (_inES && framing == FRAMING_V2) {
+		memcpy(_inES->Nonce, nonce, NONCE_SIZE);
 	}
+}
 
-	dataSize = *_intBuffer.SwitchType<uint64_t>();
+void StreamReader::SetWindow(uint32_t window)
+{
+	_window = window;
+}
 
-	if (_inES) {
-		bool success = _eStream.Init(
-			_inES,
-			_intBuffer.Pointer(sizeof(dataSize)));
+// Credit is granted when a quarter of the window is used, so the peer
+// does not wait for grants while the stream is not paused.
+bool StreamReader::HasCredit()
+{
+	return _received && !_paused && _received >= _window / 4;
+}
 
-		if (!success) {
+uint64_t StreamReader::TakeCredit()
+{
+	uint64_t credit = _received;
+	_received = 0;
+	return credit;
+}
+
+bool StreamReader::ProcessDataSize(
+	uint64_t dataSize,
+	const uint8_t *nonce,
+	uint64_t sizeLimit,
+	uint64_t spillThreshold)
+{
+	if (!_block) {
+		_block = new Block;
+	}
+
+	if (_inES) {
+		if (_framing == FRAMING_V2) {
+			_block->EStream.InitNext(_inES);
+		} else if (!_block->EStream.Init(_inES, nonce)) {
 			return false;
 		}
 	}
 
-	_intBuffer = CowBuffer<uint8_t>();
-
 	if (!dataSize || dataSize > sizeLimit) {
 		return false;
 	}
 
 	_expectedData = dataSize;
-	_data = CowBuffer<uint8_t>(dataSize);
+	_block->Data = CowBuffer<uint8_t>();
+
+	if (spillThreshold && dataSize > spillThreshold) {
+		_block->Data = CowBuffer<uint8_t>::MapTemporary(dataSize);
+	}
+
+	if (!_block->Data.Size()) {
+		_block->Data = CowBuffer<uint8_t>(dataSize);
+	}
+
+	_limited = _window;
 
 	return true;
 }
 
-bool StreamReader::ReadSliceSize(int sockFd)
+// Slice is decrypted or copied straight from receive buffer into its
+// place in the block.
+bool StreamReader::ProcessSlice(uint8_t *data, uint32_t size)
 {
-	uint32_t sliceSize;
+	uint32_t overhead = _inES ? STREAM_OVERHEAD : 0;
 
-	if (!_expectedInt) {
-		_intBuffer = CowBuffer<uint8_t>(sizeof(sliceSize));
-		_expectedInt = _intBuffer.Size();
-		return true;
+	if (size <= overhead) {
+		return false;
 	}
 
-	int rb = Read(
-		sockFd,
-		_intBuffer.Pointer(_intBuffer.Size() - _expectedInt),
-		_expectedInt);
+	uint64_t length = size - overhead;
 
-	if (rb <= 0) {
+	if (length > _expectedData) {
 		return false;
 	}
 
-	_expectedInt -= rb;
+	if (_limited) {
+		_received += length;
 
-	if (_expectedInt) {
-		return true;
+		if (_received > _window) {
+			return false;
+		}
 	}
 
-	sliceSize = *_intBuffer.SwitchType<uint32_t>();
-	_intBuffer = CowBuffer<uint8_t>();
+	CowBuffer<uint8_t> &block = _block->Data;
+	uint8_t *target = block.Pointer() + block.Size() - _expectedData;
 
-	if (!sliceSize || sliceSize > 2048) {
-		return false;
+	if (_inES) {
+		uint8_t add[sizeof(uint64_t) + sizeof(uint32_t)];
+		uint64_t blockSize = block.Size();
+		memcpy(add, &blockSize, sizeof(uint64_t));
+		memcpy(add + sizeof(uint64_t), &size, sizeof(uint32_t));
+
+		bool success = _block->EStream.Decrypt(
+			data,
+			size,
+			target,
+			add,
+			sizeof(add));
+
+		if (!success) {
+			return false;
+		}
+	} else {
+		memcpy(target, data, length);
 	}
 
-	_expectedSlice = sliceSize;
-	_slice = CowBuffer<uint8_t>(_expectedSlice);
+	_expectedData -= length;
+
+	if (!_expectedData) {
+		_block->Queue.Put(std::move(block));
+	}
 
 	return true;
 }
 
-bool StreamReader::ReadSlice(int sockFd)
+void StreamReader::Reset()
 {
-	int rb = Read(
-		sockFd,
-		_slice.Pointer(_slice.Size() - _expectedSlice),
-		_expectedSlice);
+	ReleaseBlock();
+	_expectedData = 0;
+	_sliceSize = SLICE_SIZE_DEFAULT;
+	_framing = FRAMING_V1;
+	_window = 0;
+	_received = 0;
+	_limited = false;
+	_paused = false;
+}
 
-	if (rb <= 0) {
-		return false;
-	}
+void StreamReader::ReleaseBlock()
+{
+	delete _block;
+	_block = nullptr;
+}
 
-	_expectedSlice -= rb;
+// OutputBatch.
+OutputBatch::OutputBatch()
+{
+	_first = 0;
+	_count = 0;
+	_size = 0;
+}
 
-	if (_expectedSlice) {
-		return true;
+uint8_t *OutputBatch::AddHeader(int size)
+{
+	if (_count == MaxParts || size > HeaderSize) {
+		THROW("Header does not fit into output batch.");
 	}
 
-	bool result;
+	_parts[_count].iov_base = _headers[_count];
+	_parts[_count].iov_len = size;
+	_isData[_count] = false;
+	_size += size;
 
-	if (_inES) {
-		result = DecryptSlice();
-	} else {
-		result = AppendSlice(_slice);
+	return _headers[_count++];
+}
+
+void OutputBatch::AddData(CowBuffer<uint8_t> data)
+{
+	if (_count == MaxParts) {
+		THROW("Data does not fit into output batch.");
 	}
 
-	_slice = CowBuffer<uint8_t>();
+	const CowBuffer<uint8_t> &constData = data;
+	_parts[_count].iov_base = (void*)constData.Pointer();
+	_parts[_count].iov_len = data.Size();
+	_isData[_count] = true;
+	_size += data.Size();
 
-	return result;
+	_data.Put(std::move(data));
+
+	_count++;
 }
 
-bool StreamReader::DecryptSlice()
+bool OutputBatch::Flush(int sockFd, bool *blocked)
 {
-	CowBuffer<uint8_t> mdBuffer(sizeof(uint64_t) + sizeof(uint32_t));
-	*mdBuffer.SwitchType<uint64_t>() = _data.Size();
-	*mdBuffer.SwitchType<uint32_t>(sizeof(uint64_t)) = _slice.Size();
+	*blocked = false;
 
-	CowBuffer<uint8_t> plaintext = _eStream.Decrypt(_slice, mdBuffer);
+	while (!IsEmpty()) {
+		int64_t wb = writev(sockFd, _parts + _first, _count - _first);
 
-	if (!plaintext.Size()) {
-		return false;
+		if (wb == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				*blocked = true;
+				return true;
+			}
+
+			return false;
+		}
+
+		if (wb == 0) {
+			return false;
+		}
+
+		Consume(wb);
 	}
 
-	return AppendSlice(plaintext);
+	return true;
 }
 
-bool StreamReader::AppendSlice(const CowBuffer<uint8_t> slice)
+void OutputBatch::Clear()
 {
-	if (slice.Size() > _expectedData) {
-		return false;
-	}
+	_first = 0;
+	_count = 0;
+	_size = 0;
+	_data.Clear();
+}
 
-	memcpy(
-		_data.Pointer(_data.Size() - _expectedData),
-		slice.Pointer(),
-		slice.Size());
+void OutputBatch::Consume(int64_t size)
+{
+	_size -= size;
 
-	_expectedData -= slice.Size();
+	while (size) {
+		struct iovec *part = &_parts[_first];
 
-	if (!_expectedData) {
-		_queue.Put(_data);
-		_data = CowBuffer<uint8_t>();
+		if ((uint64_t)size < part->iov_len) {
+			part->iov_base = (uint8_t*)part->iov_base + size;
+			part->iov_len -= size;
+			return;
+		}
+
+		size -= part->iov_len;
+
+		if (_isData[_first]) {
+			_data.Get();
+		}
+
+		_first++;
 	}
 
-	return true;
+	if (IsEmpty()) {
+		_first = 0;
+		_count = 0;
+	}
 }
 
 // StreamWriter.
 StreamWriter::StreamWriter()
 {
+	_block = nullptr;
 	_remainingData = 0;
-	_remainingSlice = 0;
-	_remainingInt = 0;
+	_sliceSize = SLICE_SIZE_DEFAULT;
+	_queued = 0;
+	_framing = FRAMING_V1;
+	_nextFraming = FRAMING_V1;
+	memset(_nextNonce, 0, NONCE_SIZE);
+	_window = 0;
+	_nextWindow = 0;
+	_oldBlocks = 0;
+	_switch = false;
+	_credit = 0;
+	_limited = false;
 	_outES = nullptr;
 	_encrypt = false;
 }
 
-bool StreamWriter::Finalized()
+StreamWriter::~StreamWriter()
 {
-	return !_remainingSlice && !_remainingInt;
+	ReleaseBlock();
 }
 
+// Header of the next block does not need credit.
 bool StreamWriter::CanWrite()
 {
-	return _remainingData || _remainingSlice ||
-		!_queue.IsEmpty() || _remainingInt;
+	if (_remainingData) {
+		return !_limited || _credit > 0;
+	}
+
+	return _block && !_block->Queue.IsEmpty();
 }
 
-void StreamWriter::AddData(const CowBuffer<uint8_t> data, bool encrypt)
+void StreamWriter::AddData(CowBuffer<uint8_t> data, bool encrypt)
 {
-	_queue.Put(data);
+	if (!_block) {
+		_block = new Block;
+	}
+
+	_block->Queue.Put(std::move(data));
+	_queued++;
 	_encrypt = encrypt;
 }
 
-bool StreamWriter::Process(int sockFd, uint8_t stream)
+void StreamWriter::SetFraming(int framing, const uint8_t nonce[NONCE_SIZE])
 {
-	if (_remainingInt) {
-		return WriteInt(sockFd);
-	}
+	_nextFraming = framing;
+	memcpy(_nextNonce, nonce, NONCE_SIZE);
+	_oldBlocks = _queued;
+	_switch = true;
+}
 
-	if (!_remainingData && !_remainingSlice) {
-		return WriteDataSize(sockFd, stream);
-	}
+void StreamWriter::SetWindow(uint32_t window)
+{
+	_nextWindow = window;
+	_oldBlocks = _queued;
+	_switch = true;
+}
 
-	if (!_remainingSlice) {
-		return WriteSliceSize(sockFd, stream);
+bool StreamWriter::AddCredit(uint64_t credit)
+{
+	if (!_window || credit > _window) {
+		return false;
 	}
 
-	return WriteSlice(sockFd);
+	_credit += credit;
+	return _credit <= _window;
+}
+
+void StreamWriter::PrepareFrame(uint8_t stream, OutputBatch *batch)
+{
+	if (!_remainingData) {
+		PrepareDataSize(stream, batch);
+	} else {
+		PrepareSlice(stream, batch);
+	}
 }
 
 void StreamWriter::Reset()
 {
-	_data = CowBuffer<uint8_t>();
+	ReleaseBlock();
 	_remainingData = 0;
-	_slice = CowBuffer<uint8_t>();
-	_remainingSlice = 0;
-	_intBuffer = CowBuffer<uint8_t>();
-	_remainingInt = 0;
-	_queue.Clear();
+	_sliceSize = SLICE_SIZE_DEFAULT;
+	_queued = 0;
+	_framing = FRAMING_V1;
+	_nextFraming = FRAMING_V1;
+	_window = 0;
+	_nextWindow = 0;
+	_oldBlocks = 0;
+	_switch = false;
+	_credit = 0;
+	_limited = false;
 }
 
-bool StreamWriter::WriteInt(int sockFd)
+void StreamWriter::PrepareDataSize(uint8_t stream, OutputBatch *batch)
 {
-	int wb = Write(
-		sockFd,
-		_intBuffer.Pointer(_intBuffer.Size() - _remainingInt),
-		_remainingInt);
-
-	if (wb <= 0) {
-		return false;
+	if (!_block || _block->Queue.IsEmpty()) {
+		return;
 	}
 
-	_remainingInt -= wb;
+	if (_oldBlocks) {
+		_oldBlocks--;
+	} else if (_switch) {
+		_switch = false;
 
-	if (!_remainingInt) {
-		_intBuffer = CowBuffer<uint8_t>();
-	}
+		if (_framing != _nextFraming) {
+			_framing = _nextFraming;
 
-	return true;
-}
+			if (_outES && _framing == FRAMING_V2) {
+				memcpy(_outES->Nonce, _nextNonce, NONCE_SIZE);
+			}
+		}
 
-bool StreamWriter::WriteDataSize(int sockFd, uint8_t stream)
-{
-	if (_queue.IsEmpty()) {
-		return true;
+		if (_window != _nextWindow) {
+			_window = _nextWindow;
+			_credit = _window;
+		}
 	}
 
-	_data = _queue.Get();
-	_remainingData = _data.Size();
+	_block->Data = _block->Queue.Get();
+	_queued--;
+	_remainingData = _block->Data.Size();
+	_limited = _window;
 
-	int wb = Write(sockFd, &stream, 1);
+	if (_framing == FRAMING_V2) {
+		uint8_t header[10];
+		int size = PutVarint(header, _remainingData << 2 | stream);
+		memcpy(batch->AddHeader(size), header, size);
 
-	if (wb != 1) {
-		return false;
+		if (_encrypt) {
+			_block->EStream.InitNext(_outES);
+		}
+
+		return;
 	}
 
-	if (!_encrypt) {
-		_intBuffer = CowBuffer<uint8_t>(sizeof(uint64_t));
-	} else {
-		_intBuffer = CowBuffer<uint8_t>(sizeof(uint64_t) + NONCE_SIZE);
-		_eStream.Init(_outES);
+	int size = 1 + sizeof(uint64_t);
+
+	if (_encrypt) {
+		size += NONCE_SIZE;
+	}
+
+	uint8_t *header = batch->AddHeader(size);
+	header[0] = stream;
+	memcpy(header + 1, &_remainingData, sizeof(uint64_t));
+
+	if (_encrypt) {
+		_block->EStream.Init(_outES);
 		memcpy(
-			_intBuffer.Pointer(sizeof(uint64_t)),
+			header + 1 + sizeof(uint64_t),
 			_outES->Nonce,
 			NONCE_SIZE);
 	}
-
-	*_intBuffer.SwitchType<uint64_t>() = _remainingData;
-	_remainingInt = _intBuffer.Size();
-
-	return true;
 }
 
-bool StreamWriter::WriteSliceSize(int sockFd, uint8_t stream)
+void StreamWriter::PrepareSlice(uint8_t stream, OutputBatch *batch)
 {
-	_remainingSlice = _remainingData;
+	uint32_t sliceSize = _sliceSize;
+	uint64_t overhead = _encrypt ? STREAM_OVERHEAD : 0;
 
-	if (_encrypt) {
-		_remainingSlice += 1 + MAC_SIZE;
+	if (_remainingData + overhead < sliceSize) {
+		sliceSize = _remainingData + overhead;
 	}
 
-	if (_remainingSlice > 2048) {
-		_remainingSlice = 2048;
+	if (_limited) {
+		if ((uint64_t)_credit + overhead < sliceSize) {
+			sliceSize = _credit + overhead;
+		}
+
+		_credit -= sliceSize - overhead;
 	}
 
+	const CowBuffer<uint8_t> &data = _block->Data;
+	CowBuffer<uint8_t> slice;
+
+	// Encrypted slice is written straight into the frame buffer.
 	if (_encrypt) {
-		CowBuffer<uint8_t> mdBuffer(
-			sizeof(uint64_t) + sizeof(uint32_t));
-		*mdBuffer.SwitchType<uint64_t>() = _data.Size();
-		*mdBuffer.SwitchType<uint32_t>(sizeof(uint64_t)) =
-			_remainingSlice;
-
-		_slice = _eStream.Encrypt(
-			_data.Slice(
-				_data.Size() - _remainingData,
-				_remainingSlice - 1 - MAC_SIZE),
-			mdBuffer);
-
-		_remainingData -= _remainingSlice - 1 - MAC_SIZE;
+		uint8_t add[sizeof(uint64_t) + sizeof(uint32_t)];
+		uint64_t blockSize = data.Size();
+		memcpy(add, &blockSize, sizeof(uint64_t));
+		memcpy(add + sizeof(uint64_t), &sliceSize, sizeof(uint32_t));
+
+		slice = CowBuffer<uint8_t>(sliceSize);
+
+		_block->EStream.Encrypt(
+			data.Pointer() + data.Size() - _remainingData,
+			sliceSize - overhead,
+			slice.Pointer(),
+			add,
+			sizeof(add));
 	} else {
-		_slice = _data.Slice(
-			_data.Size() - _remainingData,
-			_remainingSlice);
-
-		_remainingData -= _remainingSlice;
+		slice = data.Slice(data.Size() - _remainingData, sliceSize);
 	}
 
+	_remainingData -= sliceSize - overhead;
+
 	if (!_remainingData) {
-		_data = CowBuffer<uint8_t>();
+		if (_block->Queue.IsEmpty()) {
+			ReleaseBlock();
+		} else {
+			_block->Data = CowBuffer<uint8_t>();
+		}
 	}
 
-	int wb = Write(sockFd, &stream, 1);
-
-	if (wb != 1) {
-		return false;
+	if (_framing == FRAMING_V2) {
+		uint8_t header[10];
+		int size = PutVarint(header, (uint64_t)sliceSize << 2 | stream);
+		memcpy(batch->AddHeader(size), header, size);
+	} else {
+		uint8_t *header = batch->AddHeader(1 + sizeof(uint32_t));
+		header[0] = stream;
+		memcpy(header + 1, &sliceSize, sizeof(uint32_t));
 	}
 
-	_intBuffer = CowBuffer<uint8_t>(sizeof(uint32_t));
-	*_intBuffer.SwitchType<uint32_t>() = _remainingSlice;
-	_remainingInt = _intBuffer.Size();
-
-	return true;
+	batch->AddData(std::move(slice));
 }
 
-bool StreamWriter::WriteSlice(int sockFd)
+void StreamWriter::ReleaseBlock()
 {
-	int wb = Write(
-		sockFd,
-		_slice.Pointer(_slice.Size() - _remainingSlice),
-		_remainingSlice);
-
-	if (wb <= 0) {
-		return false;
-	}
-
-	_remainingSlice -= wb;
-
-	if (!_remainingSlice) {
-		_slice = CowBuffer<uint8_t>();
-	}
-
-	return true;
+	delete _block;
+	_block = nullptr;
 }
 
 // Session.
 Session::Session()
 {
 	Next = nullptr;
+	Prev = nullptr;
+
+	Observer = nullptr;
+	ReadEvents = false;
+	WriteEvents = false;
+	BackendSlot = -1;
+
+	Time = 0;
+	Timeout = IdleTimeout;
+	Deadline = false;
 
-	Time = GetUnixTime();
 	Socket = -1;
 
 	InputSizeLimit = 1024;
+	SpillThreshold = 0;
 	RestrictStreams = true;
+
+	InputPaused = false;
+
+	Output = nullptr;
+	OutputSize = 0;
+
+	_inputFraming = FRAMING_V1;
 }
 
 Session::~Session()
@@ -500,66 +780,113 @@ Session::~Session()
 	Close();
 }
 
+// Socket is read once, then all complete units in receive buffer are
+// parsed. Parsing stops when a message is complete, processing of the
+// message can change how following units are parsed.
 bool Session::Read()
 {
 	if (Closed()) {
 		return false;
 	}
 
-	Time = GetUnixTime();
+	if (!Input.HasInput() && !Input.Fill(Socket)) {
+		return false;
+	}
 
 	int maxStream = RestrictStreams ? 0 : StreamCount - 1;
 
-	for (int i = 0; i <= maxStream; i++) {
-		if (!InputStreams[i].Finalized()) {
-			return InputStreams[i].Process(Socket, InputSizeLimit);
+	while (!CanReceive() && Input.Size()) {
+		int64_t unitSize;
+
+		if (_inputFraming == FRAMING_V2) {
+			unitSize = ParseUnitV2(maxStream);
+		} else {
+			unitSize = ParseUnitV1(maxStream);
 		}
-	}
 
-	uint8_t stream;
+		if (unitSize == -1) {
+			return false;
+		}
 
-	int rb = ::Read(Socket, &stream, 1);
+		if (!unitSize) {
+			break;
+		}
 
-	if (rb != 1) {
-		return false;
+		Input.Consume(unitSize);
 	}
 
-	if (stream > maxStream) {
-		return false;
+	if (CanReceive()) {
+		return true;
 	}
 
-	return InputStreams[stream].Process(Socket, InputSizeLimit);
+	Input.SetParsed();
+
+	return !Input.Ended();
 }
 
+// Frames of all streams are collected into output batch in priority
+// order and written together. Writing continues until socket is full
+// or there is nothing more to send.
 bool Session::Write()
 {
 	if (Closed()) {
 		return false;
 	}
 
-	Time = GetUnixTime();
-
 	int maxStream = RestrictStreams ? 0 : StreamCount - 1;
 
-	for (int i = 0; i <= maxStream; i++) {
-		if (!OutputStreams[i].Finalized()) {
-			return OutputStreams[i].Process(Socket, i);
+	for (;;) {
+		Refill();
+
+		if (!Output) {
+			Output = new OutputBatch;
 		}
-	}
 
-	for (int i = 0; i <= maxStream; i++) {
-		if (!OutputStreams[i].CanWrite()) {
-			continue;
+		AddCredits(Output);
+
+		while (Output->CanAdd()) {
+			int stream = -1;
+
+			for (int i = 0; i <= maxStream; i++) {
+				if (OutputStreams[i].CanWrite()) {
+					stream = i;
+					break;
+				}
+			}
+
+			if (stream == -1) {
+				break;
+			}
+
+			OutputStreams[stream].PrepareFrame(stream, Output);
 		}
 
-		return OutputStreams[i].Process(Socket, i);
-	}
+		UpdateOutputSize();
 
-	return true;
+		if (Output->IsEmpty()) {
+			delete Output;
+			Output = nullptr;
+			return true;
+		}
+
+		bool blocked;
+
+		if (!Output->Flush(Socket, &blocked)) {
+			return false;
+		}
+
+		if (blocked) {
+			return true;
+		}
+	}
 }
 
 bool Session::CanWrite()
 {
+	if (Output && !Output->IsEmpty()) {
+		return true;
+	}
+
 	int maxStream = RestrictStreams ? 0 : StreamCount - 1;
 
 	for (int i = 0; i <= maxStream; i++) {
@@ -568,6 +895,12 @@ bool Session::CanWrite()
 		}
 	}
 
+	for (int i = 0; i < StreamCount; i++) {
+		if (InputStreams[i].HasCredit()) {
+			return true;
+		}
+	}
+
 	return false;
 }
 
@@ -607,7 +940,75 @@ void Session::Send(CowBuffer<uint8_t> data, int stream, bool encrypt)
 		THROW("Transmitted data cannot be empty.");
 	}
 
-	OutputStreams[stream].AddData(data, encrypt);
+	OutputStreams[stream].AddData(std::move(data), encrypt);
+	UpdateOutputSize();
+
+	if (Observer) {
+		Observer->OutputQueued(this);
+	}
+}
+
+void Session::SetSliceSize(int stream, uint32_t size)
+{
+	if (stream >= StreamCount) {
+		THROW("Invalid stream index.");
+	}
+
+	if (size < SLICE_SIZE_MIN || size > SLICE_SIZE_MAX) {
+		THROW("Invalid slice size.");
+	}
+
+	InputStreams[stream].SetSliceSize(size);
+	OutputStreams[stream].SetSliceSize(size);
+}
+
+void Session::SetFraming(int framing, const uint8_t nonce[NONCE_SIZE])
+{
+	if (framing != FRAMING_V1 && framing != FRAMING_V2) {
+		THROW("Invalid framing version.");
+	}
+
+	_inputFraming = framing;
+
+	for (int i = 0; i < StreamCount; i++) {
+		InputStreams[i].SetFraming(framing, nonce);
+		OutputStreams[i].SetFraming(framing, nonce);
+	}
+}
+
+void Session::SetWindow(int stream, uint32_t window)
+{
+	if (stream >= StreamCount) {
+		THROW("Invalid stream index.");
+	}
+
+	if (window && (window < WINDOW_MIN || window > WINDOW_MAX)) {
+		THROW("Invalid window size.");
+	}
+
+	if (_inputFraming != FRAMING_V2) {
+		THROW("Flow control requires framing v2.");
+	}
+
+	InputStreams[stream].SetWindow(window);
+	OutputStreams[stream].SetWindow(window);
+	UpdateInputPaused();
+}
+
+void Session::PauseInput(int stream)
+{
+	InputStreams[stream].SetPaused(true);
+	UpdateInputPaused();
+}
+
+void Session::ResumeInput(int stream)
+{
+	InputStreams[stream].SetPaused(false);
+	UpdateInputPaused();
+
+	if (Observer && InputStreams[stream].HasCredit()) {
+		Observer->OutputQueued(this);
+	}
 }
 
 bool Session::Process()
@@ -620,6 +1021,155 @@ bool Session::TimePassed()
 	return false;
 }
 
+void Session::Refill()
+{
+}
+
+void Session::GetMemoryUsage(SessionMemory &usage)
+{
+	usage.Input = Input.GetMemoryUsage();
+	usage.Output = Output ? Output->GetMemoryUsage() : 0;
+	usage.Storage = 0;
+
+	for (int i = 0; i < StreamCount; i++) {
+		usage.Input += InputStreams[i].GetMemoryUsage();
+		usage.Output += OutputStreams[i].GetMemoryUsage();
+	}
+}
+
+Session::Priority Session::GetPriority()
+{
+	return PriorityActive;
+}
+
+void Session::SetMemoryPressure(bool pressure)
+{
+}
+
+// | stream id | data size | nonce |
+// | stream id | slice size | slice |
+int64_t Session::ParseUnitV1(int maxStream)
+{
+	int64_t size = Input.Size();
+	uint8_t *data = Input.Data();
+	uint8_t stream = data[0];
+
+	if (stream > maxStream) {
+		return -1;
+	}
+
+	StreamReader &reader = InputStreams[stream];
+
+	if (!reader.ExpectsSlice()) {
+		int64_t unitSize = 1 + sizeof(uint64_t);
+
+		if (reader.IsEncrypted()) {
+			unitSize += NONCE_SIZE;
+		}
+
+		if (size < unitSize) {
+			return 0;
+		}
+
+		uint64_t dataSize;
+		memcpy(&dataSize, data + 1, sizeof(dataSize));
+
+		bool success = reader.ProcessDataSize(
+			dataSize,
+			data + 1 + sizeof(dataSize),
+			InputSizeLimit,
+			SpillThreshold);
+
+		return success ? unitSize : -1;
+	}
+
+	uint32_t sliceSize;
+
+	if (size < (int64_t)(1 + sizeof(sliceSize))) {
+		return 0;
+	}
+
+	memcpy(&sliceSize, data + 1, sizeof(sliceSize));
+
+	if (!reader.IsSliceSizeValid(sliceSize)) {
+		return -1;
+	}
+
+	int64_t unitSize = 1 + sizeof(sliceSize) + sliceSize;
+
+	if (size < unitSize) {
+		Input.Reserve(unitSize - size);
+		return 0;
+	}
+
+	bool success = reader.ProcessSlice(
+		data + 1 + sizeof(sliceSize),
+		sliceSize);
+
+	return success ? unitSize : -1;
+}
+
+// | varint (data size << 2 | stream id) |
+// | varint (slice size << 2 | stream id) | slice |
+// | varint ((credit << 2 | stream id) << 2 | 3) |
+int64_t Session::ParseUnitV2(int maxStream)
+{
+	int64_t size = Input.Size();
+	uint8_t *data = Input.Data();
+
+	uint64_t value;
+	int headerSize = GetVarint(data, size, &value);
+
+	if (headerSize <= 0) {
+		return headerSize;
+	}
+
+	int stream = value & 3;
+	value >>= 2;
+
+	bool credit = stream == StreamCount;
+
+	if (credit) {
+		stream = value & 3;
+		value >>= 2;
+	}
+
+	if (stream > maxStream) {
+		return -1;
+	}
+
+	if (credit) {
+		bool success = OutputStreams[stream].AddCredit(value);
+		return success ? headerSize : -1;
+	}
+
+	StreamReader &reader = InputStreams[stream];
+
+	if (!reader.ExpectsSlice()) {
+		bool success = reader.ProcessDataSize(
+			value,
+			nullptr,
+			InputSizeLimit,
+			SpillThreshold);
+
+		return success ? headerSize : -1;
+	}
+
+	if (!reader.IsSliceSizeValid(value)) {
+		return -1;
+	}
+
+	int64_t unitSize = headerSize + value;
+
+	if (size < unitSize) {
+		Input.Reserve(unitSize - size);
+		return 0;
+	}
+
+	bool success = reader.ProcessSlice(data + headerSize, value);
+	return success ? unitSize : -1;
+}
+
 void Session::Close()
 {
 	if (Socket != -1) {
@@ -639,8 +1189,72 @@ void Session::Close()
 		Socket = -1;
 	}
 
+	Input.Clear();
+
+	if (Output) {
+		delete Output;
+		Output = nullptr;
+	}
+
 	for (int i = 0; i < StreamCount; i++) {
 		InputStreams[i].Reset();
 		OutputStreams[i].Reset();
 	}
+
+	UpdateOutputSize();
+	_inputFraming = FRAMING_V1;
+	InputPaused = false;
+}
+
+// Credit goes before frames, so the peer can continue sending while
+// the batch is written.
+void Session::AddCredits(OutputBatch *batch)
+{
+	for (int i = 0; i < StreamCount && batch->CanAdd(); i++) {
+		if (!InputStreams[i].HasCredit()) {
+			continue;
+		}
+
+		uint64_t value = InputStreams[i].TakeCredit() << 2 | i;
+
+		uint8_t header[10];
+		int size = PutVarint(header, value << 2 | StreamCount);
+		memcpy(batch->AddHeader(size), header, size);
+	}
+}
+
+void Session::UpdateOutputSize()
+{
+	int64_t size = 0;
+
+	for (int i = 0; i < StreamCount; i++) {
+		size += OutputStreams[i].GetQueuedSize();
+	}
+
+	__atomic_store_n(&OutputSize, size, __ATOMIC_RELAXED);
+}
+
+// Peer without credit keeps sending, so its input can only be paused by
+// not reading the socket.
+void Session::UpdateInputPaused()
+{
+	bool paused = false;
+
+	for (int i = 0; i < StreamCount; i++) {
+		if (InputStreams[i].IsPaused() &&
+			!InputStreams[i].IsFlowControlled())
+		{
+			paused = true;
+		}
+	}
+
+	if (paused == InputPaused) {
+		return;
+	}
+
+	InputPaused = paused;
+
+	if (Observer) {
+		Observer->InputChanged(this);
+	}
 }
@@ -1,9 +1,27 @@
 #ifndef _SESSION_HPP
 #define _SESSION_HPP
 
+#include <sys/uio.h>
+
 #include "../Common/CowBuffer.hpp"
+#include "../Common/TimerWheel.hpp"
 #include "../Crypto/Crypto.hpp"
 
+// Limits of segment data size. Default size is used until other size
+// is negotiated during handshake.
+#define SLICE_SIZE_DEFAULT 2048
+#define SLICE_SIZE_MIN 256
+#define SLICE_SIZE_MAX (1024 * 1024)
+
+// Wire framing versions, see docs/architecture.txt.
+#define FRAMING_V1 1
+#define FRAMING_V2 2
+
+// Limits of flow control window. Window 0 disables flow control
+// of the stream.
+#define WINDOW_MIN (4 * 1024)
+#define WINDOW_MAX (64 * 1024 * 1024)
+
 class BufferQueue
 {
 public:
@@ -12,7 +30,19 @@ public:
 
 	bool IsEmpty();
 
-	void Put(const CowBuffer<uint8_t> buffer);
+	// Total size of queued buffers.
+	int64_t GetSize()
+	{
+		return _size;
+	}
+
+	// Size of queued buffers that are not mapped from files.
+	int64_t GetMemoryUsage()
+	{
+		return _memory;
+	}
+
+	void Put(CowBuffer<uint8_t> buffer);
 	CowBuffer<uint8_t> Get();
 
 	void Clear();
@@ -22,12 +52,95 @@ private:
 	{
 		Sequence *Next;
 		CowBuffer<uint8_t> Data;
+
+		POOL_ALLOCATED
 	};
 
 	Sequence *_first;
 	Sequence *_last;
+	int64_t _size;
+	int64_t _memory;
 };
 
+// Receive buffer of the session socket.
+// Socket is read with one large read into free space of the buffer,
+// unless I/O backend receives data on its own and appends it here.
+// Memory is held only while there is unparsed data.
+class SocketInput
+{
+public:
+	enum
+	{
+		Capacity = 64 * 1024
+	};
+
+	SocketInput();
+	~SocketInput();
+
+	void SetExternal(bool external)
+	{
+		_external = external;
+	}
+
+	void Append(const uint8_t *data, int64_t size);
+	void SetEnd();
+
+	bool Ended()
+	{
+		return _end;
+	}
+
+	// Reads socket once. Does nothing if data is appended externally.
+	bool Fill(int sockFd);
+
+	uint8_t *Data()
+	{
+		return _buffer + _head;
+	}
+
+	int64_t Size()
+	{
+		return _tail - _head;
+	}
+
+	void Consume(int64_t size);
+
+	// Makes room for size more bytes.
+	void Reserve(int64_t size);
+
+	int64_t GetMemoryUsage()
+	{
+		return _capacity;
+	}
+
+	// True if received data was not parsed yet or end of stream was
+	// not reported.
+	bool HasInput()
+	{
+		return _unparsed || _end;
+	}
+
+	void SetParsed()
+	{
+		_unparsed = false;
+	}
+
+	void Clear();
+
+private:
+	uint8_t *_buffer;
+	int64_t _capacity;
+	int64_t _head;
+	int64_t _tail;
+
+	bool _external;
+	bool _end;
+	bool _unparsed;
+};
+
+// Block state of a stream (buffers and cipher context) is allocated
+// when a block starts and released when received blocks are taken,
+// so idle stream holds only its settings.
 class StreamReader
 {
 public:
@@ -38,100 +151,343 @@ public:
 		_inES = ES;
 	}
 
-	bool Finalized();
+	void SetSliceSize(uint32_t size)
+	{
+		_sliceSize = size;
+	}
+
+	~StreamReader();
 
 	bool HasData();
 	CowBuffer<uint8_t> GetData();
 
-	bool Process(int sockFd, uint64_t sizeLimit);
+	// Framing applies to data received after the call.
+	void SetFraming(int framing, const uint8_t nonce[NONCE_SIZE]);
+
+	// Window applies to blocks started after the call.
+	void SetWindow(uint32_t window);
+
+	// Paused stream keeps credit of received data, so the peer stops
+	// sending after its window is used.
+	void SetPaused(bool paused)
+	{
+		_paused = paused;
+	}
+
+	bool IsPaused()
+	{
+		return _paused;
+	}
+
+	bool IsFlowControlled()
+	{
+		return _window;
+	}
+
+	// True if enough data is received to grant credit to the peer.
+	bool HasCredit();
+	uint64_t TakeCredit();
+
+	// Incomplete block is allocated in full when its header arrives.
+	int64_t GetMemoryUsage()
+	{
+		if (!_block) {
+			return 0;
+		}
+
+		return _block->Queue.GetMemoryUsage() +
+			(_block->Data.IsMapped() ? 0 : _block->Data.Size());
+	}
+
+	bool IsEncrypted()
+	{
+		return _inES;
+	}
+
+	// True if data block is in progress and slice is expected.
+	bool ExpectsSlice()
+	{
+		return _expectedData;
+	}
+
+	bool IsSliceSizeValid(uint64_t size)
+	{
+		return size && size <= _sliceSize;
+	}
+
+	// Nonce is not used with framing that does not transmit nonces.
+	// Blocks larger than spill threshold are received into temporary
+	// file, threshold 0 disables it.
+	bool ProcessDataSize(
+		uint64_t dataSize,
+		const uint8_t *nonce,
+		uint64_t sizeLimit,
+		uint64_t spillThreshold);
+	bool ProcessSlice(uint8_t *data, uint32_t size);
 
 	void Reset();
 
 private:
-	CowBuffer<uint8_t> _data;
-	uint64_t _expectedData;
+	struct Block
+	{
+		CowBuffer<uint8_t> Data;
+		BufferQueue Queue;
+		CryptoStreamReader EStream;
 
-	CowBuffer<uint8_t> _slice;
-	uint64_t _expectedSlice;
+		POOL_ALLOCATED
+	};
 
-	CowBuffer<uint8_t> _intBuffer;
-	int _expectedInt;
+	Block *_block;
+	uint64_t _expectedData;
+	uint32_t _sliceSize;
+	int _framing;
 
-	BufferQueue _queue;
+	// Data received on the window that is not granted back yet.
+	uint32_t _window;
+	uint64_t _received;
+	bool _limited;
+	bool _paused;
 
-	bool ReadDataSize(int sockFd, uint64_t sizeLimit);
-	bool ReadSliceSize(int sockFd);
-	bool ReadSlice(int sockFd);
-	bool DecryptSlice();
-	bool AppendSlice(const CowBuffer<uint8_t> slice);
+	void ReleaseBlock();
 
-	CryptoStreamReader _eStream;
 	EncryptedStream *_inES;
 };
 
+// Frames prepared for sending, written to socket with one writev call.
+// Slices are referenced, headers are stored in the batch.
+class OutputBatch
+{
+public:
+	enum
+	{
+		MaxParts = 64,
+		WindowSize = 64 * 1024,
+		HeaderSize = 1 + sizeof(uint64_t) + NONCE_SIZE
+	};
+
+	OutputBatch();
+
+	POOL_ALLOCATED
+
+	bool IsEmpty()
+	{
+		return _first == _count;
+	}
+
+	int64_t GetMemoryUsage()
+	{
+		return sizeof(*this) + _size;
+	}
+
+	// True if one more frame (header and slice) fits into the batch.
+	bool CanAdd()
+	{
+		return _count + 2 <= MaxParts && _size < WindowSize;
+	}
+
+	uint8_t *AddHeader(int size);
+	void AddData(CowBuffer<uint8_t> data);
+
+	// Writes until batch is empty or socket is full.
+	// Blocked is set if socket cannot accept more data.
+	bool Flush(int sockFd, bool *blocked);
+
+	void Clear();
+
+private:
+	struct iovec _parts[MaxParts];
+	uint8_t _headers[MaxParts][HeaderSize];
+	bool _isData[MaxParts];
+
+	int _first;
+	int _count;
+	int64_t _size;
+
+	BufferQueue _data;
+
+	void Consume(int64_t size);
+};
+
+// Block state is allocated when data is queued and released when
+// the last queued block is sent.
 class StreamWriter
 {
 public:
 	StreamWriter();
+	~StreamWriter();
 
 	void SetES(EncryptedStream *ES)
 	{
 		_outES = ES;
 	}
 
-	bool Finalized();
+	void SetSliceSize(uint32_t size)
+	{
+		_sliceSize = size;
+	}
 
 	bool CanWrite();
-	void AddData(const CowBuffer<uint8_t> data, bool encrypt);
+	void AddData(CowBuffer<uint8_t> data, bool encrypt);
+
+	// Framing and window apply to data queued after the call.
+	void SetFraming(int framing, const uint8_t nonce[NONCE_SIZE]);
+	void SetWindow(uint32_t window);
+
+	// Returns false if stream is not flow controlled or credit exceeds
+	// the window.
+	bool AddCredit(uint64_t credit);
+
+	// Size of data queued and not sent yet.
+	int64_t GetQueuedSize()
+	{
+		if (!_block) {
+			return 0;
+		}
+
+		return _block->Queue.GetSize() + _remainingData;
+	}
+
+	// Block in progress is held until its last slice is sent.
+	int64_t GetMemoryUsage()
+	{
+		if (!_block) {
+			return 0;
+		}
 
-	bool Process(int sockFd, uint8_t stream);
+		return _block->Queue.GetMemoryUsage() +
+			(_block->Data.IsMapped() ? 0 : _block->Data.Size());
+	}
+
+	// Adds data size header of next message or next slice of current
+	// message to the batch.
+	void PrepareFrame(uint8_t stream, OutputBatch *batch);
 
 	void Reset();
 
 private:
-	CowBuffer<uint8_t> _data;
+	struct Block
+	{
+		CowBuffer<uint8_t> Data;
+		BufferQueue Queue;
+		CryptoStreamWriter EStream;
+
+		POOL_ALLOCATED
+	};
+
+	Block *_block;
 	uint64_t _remainingData;
+	uint32_t _sliceSize;
+	int64_t _queued;
+
+	// Framing and window of current block. New settings are applied
+	// after blocks queued before the change are sent.
+	int _framing;
+	int _nextFraming;
+	uint8_t _nextNonce[NONCE_SIZE];
+	uint32_t _window;
+	uint32_t _nextWindow;
+	int64_t _oldBlocks;
+	bool _switch;
+
+	// Data that can be sent before the peer grants more.
+	int64_t _credit;
+	bool _limited;
+
+	void PrepareDataSize(uint8_t stream, OutputBatch *batch);
+	void PrepareSlice(uint8_t stream, OutputBatch *batch);
+	void ReleaseBlock();
+
+	EncryptedStream *_outES;
+	bool _encrypt;
+};
 
-	CowBuffer<uint8_t> _slice;
-	uint64_t _remainingSlice;
+// Memory held by session buffers.
+// Input is the receive buffer and received blocks, output is queued
+// blocks and frames in flight, storage is data read from message
+// storage and not queued for sending yet.
+struct SessionMemory
+{
+	int64_t Input;
+	int64_t Output;
+	int64_t Storage;
 
-	CowBuffer<uint8_t> _intBuffer;
-	int _remainingInt;
+	SessionMemory()
+	{
+		Input = 0;
+		Output = 0;
+		Storage = 0;
+	}
 
-	BufferQueue _queue;
+	int64_t Total() const
+	{
+		return Input + Output + Storage;
+	}
+};
 
-	bool WriteInt(int sockFd);
-	bool WriteDataSize(int sockFd, uint8_t stream);
-	bool WriteSliceSize(int sockFd, uint8_t stream);
-	bool WriteSlice(int sockFd);
+struct Session;
 
-	CryptoStreamWriter _eStream;
-	EncryptedStream *_outES;
-	bool _encrypt;
+class SessionObserver
+{
+public:
+	virtual void OutputQueued(Session *session) = 0;
+	virtual void InputChanged(Session *session) = 0;
 };
 
 struct Session
 {
 	enum
 	{
-		StreamCount = 3
+		StreamCount = 3,
+		IdleTimeout = 10000
+	};
+
+	// Sessions with lower priority are closed first when memory
+	// is short. Control sessions are never closed.
+	enum Priority
+	{
+		PriorityHandshake = 0,
+		PriorityActive = 1,
+		PriorityControl = 2
 	};
 
 	Session();
 	virtual ~Session();
 
 	Session *Next;
-
+	Session *Prev;
+
+	// Event loop that is notified when output is queued.
+	SessionObserver *Observer;
+	bool ReadEvents;
+	bool WriteEvents;
+	int BackendSlot;
+
+	// Timeout handling, maintained by event loop.
+	// Time is the moment of last activity in milliseconds of monotonic
+	// clock. Session with deadline is not extended by activity.
+	Timer IdleTimer;
 	int64_t Time;
+	int64_t Timeout;
+	bool Deadline;
+
+	// Memory usage reported to the memory budget, maintained by event
+	// loop.
+	SessionMemory Memory;
+
 	int Socket;
 
 	uint64_t InputSizeLimit;
+	uint64_t SpillThreshold;
 	bool RestrictStreams;
 
 	bool Read();
 	bool Write();
 
+	SocketInput Input;
 	StreamReader InputStreams[StreamCount];
+
+	// Allocated while there is output in flight.
+	OutputBatch *Output;
 	StreamWriter OutputStreams[StreamCount];
 
 	bool CanWrite();
@@ -140,15 +496,58 @@ struct Session
 	CowBuffer<uint8_t> Receive(int *stream = nullptr);
 	void Send(CowBuffer<uint8_t> data, int stream, bool encrypt);
 
+	// Applies to both directions. Reset to default on close.
+	void SetSliceSize(int stream, uint32_t size);
+	// Nonces of framing v2 start from the given value.
+	void SetFraming(int framing, const uint8_t nonce[NONCE_SIZE]);
+
+	// Flow control, requires framing v2. Each direction starts with
+	// the window, receiver grants credit as data arrives unless input
+	// of the stream is paused.
+	// Paused stream without flow control pauses reading of the whole
+	// socket, event loop stops reading while InputPaused is set.
+	void SetWindow(int stream, uint32_t window);
+	void PauseInput(int stream);
+	void ResumeInput(int stream);
+
+	bool InputPaused;
+
+	// Size of queued output that is not framed yet. Written only by
+	// the owning thread, can be read atomically by other threads.
+	int64_t OutputSize;
+
 	virtual bool Process();
 	virtual bool TimePassed();
 
+	// Called by Write before output is framed, session can queue
+	// deferred data here.
+	virtual void Refill();
+
+	virtual void GetMemoryUsage(SessionMemory &usage);
+	virtual Priority GetPriority();
+
+	// Under memory pressure session should stop reading bulk data and
+	// defer work that allocates memory.
+	virtual void SetMemoryPressure(bool pressure);
+
 	void Close();
 
 	bool Closed()
 	{
 		return Socket == -1;
 	}
+
+private:
+	int _inputFraming;
+
+	// Return size of parsed unit, 0 if unit is not complete,
+	// -1 on error.
+	int64_t ParseUnitV1(int maxStream);
+	int64_t ParseUnitV2(int maxStream);
+
+	void AddCredits(OutputBatch *batch);
+	void UpdateOutputSize();
+	void UpdateInputPaused();
 };
 
 #endif
@@ -0,0 +1,120 @@
+#include "ConnectionLimits.hpp"
+
+ConnectionLimits::ConnectionLimits()
+{
+	pthread_mutex_init(&_mutex, nullptr);
+
+	_maxConnections = 0;
+	_maxConnectionsPerAddress = 0;
+	_maxUnauthenticated = 0;
+
+	_connections = 0;
+	_unauthenticated = 0;
+
+	for (int i = 0; i < BucketCount; i++) {
+		_counters[i] = nullptr;
+	}
+}
+
+ConnectionLimits::~ConnectionLimits()
+{
+	for (int i = 0; i < BucketCount; i++) {
+		while (_counters[i]) {
+			Counter *tmp = _counters[i];
+			_counters[i] = _counters[i]->Next;
+			delete tmp;
+		}
+	}
+
+	pthread_mutex_destroy(&_mutex);
+}
+
+void ConnectionLimits::SetLimits(
+	int64_t connections,
+	int64_t connectionsPerAddress,
+	int64_t unauthenticated)
+{
+	pthread_mutex_lock(&_mutex);
+
+	_maxConnections = connections;
+	_maxConnectionsPerAddress = connectionsPerAddress;
+	_maxUnauthenticated = unauthenticated;
+
+	pthread_mutex_unlock(&_mutex);
+}
+
+bool ConnectionLimits::Admit(uint32_t ipv4)
+{
+	pthread_mutex_lock(&_mutex);
+
+	bool allowed =
+		(!_maxConnections || _connections < _maxConnections) &&
+		(!_maxUnauthenticated || _unauthenticated < _maxUnauthenticated);
+
+	Counter **counter = Find(ipv4);
+
+	if (allowed && *counter && _maxConnectionsPerAddress) {
+		allowed = (*counter)->Connections < _maxConnectionsPerAddress;
+	}
+
+	if (allowed) {
+		if (!*counter) {
+			*counter = new Counter;
+			(*counter)->IPv4 = ipv4;
+			(*counter)->Connections = 0;
+			(*counter)->Next = nullptr;
+		}
+
+		(*counter)->Connections++;
+		_connections++;
+		_unauthenticated++;
+	}
+
+	pthread_mutex_unlock(&_mutex);
+
+	return allowed;
+}
+
+void ConnectionLimits::Authenticated()
+{
+	pthread_mutex_lock(&_mutex);
+	_unauthenticated--;
+	pthread_mutex_unlock(&_mutex);
+}
+
+void ConnectionLimits::Release(uint32_t ipv4, bool authenticated)
+{
+	pthread_mutex_lock(&_mutex);
+
+	if (!authenticated) {
+		_unauthenticated--;
+	}
+
+	_connections--;
+
+	Counter **counter = Find(ipv4);
+
+	if (*counter) {
+		(*counter)->Connections--;
+
+		if (!(*counter)->Connections) {
+			Counter *tmp = *counter;
+			*counter = tmp->Next;
+			delete tmp;
+		}
+	}
+
+	pthread_mutex_unlock(&_mutex);
+}
+
+ConnectionLimits::Counter **ConnectionLimits::Find(uint32_t ipv4)
+{
+	uint32_t hash = ipv4 ^ (ipv4 >> 12) ^ (ipv4 >> 24);
+	Counter **curr = &_counters[hash % BucketCount];
+
+	while (*curr && (*curr)->IPv4 != ipv4) {
+		curr = &(*curr)->Next;
+	}
+
+	return curr;
+}
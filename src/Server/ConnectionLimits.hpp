@@ -0,0 +1,57 @@
+#ifndef _CONNECTION_LIMITS_HPP
+#define _CONNECTION_LIMITS_HPP
+
+#include <cstdint>
+#include <pthread.h>
+
+// Admission of incoming connections. Counts open connections in total,
+// per IPv4 address and the ones that have not completed handshake.
+// All IPv4 addresses are in network byte order.
+// Safe for concurrent use.
+class ConnectionLimits
+{
+public:
+	ConnectionLimits();
+	~ConnectionLimits();
+
+	// Zero means no limit.
+	void SetLimits(
+		int64_t connections,
+		int64_t connectionsPerAddress,
+		int64_t unauthenticated);
+
+	// Registers connection if all limits allow it.
+	bool Admit(uint32_t ipv4);
+
+	void Authenticated();
+	void Release(uint32_t ipv4, bool authenticated);
+
+private:
+	enum
+	{
+		BucketCount = 4096
+	};
+
+	struct Counter
+	{
+		uint32_t IPv4;
+		int64_t Connections;
+
+		Counter *Next;
+	};
+
+	pthread_mutex_t _mutex;
+
+	int64_t _maxConnections;
+	int64_t _maxConnectionsPerAddress;
+	int64_t _maxUnauthenticated;
+
+	int64_t _connections;
+	int64_t _unauthenticated;
+
+	Counter *_counters[BucketCount];
+
+	Counter **Find(uint32_t ipv4);
+};
+
+#endif
@@ -25,8 +25,6 @@ FailBan::FailBan() : _file("talkd.banned.ip", true)
 	_enabled = false;
 	_tries = 5;
 
-	_cooldownTimestamp = GetUnixTime();
-
 	_db = nullptr;
 	_freeIndices = nullptr;
 
@@ -53,16 +51,22 @@ FailBan::~FailBan()
 
 void FailBan::SetEnabled(bool enabled)
 {
+	WriteGuard guard(_lock);
+
 	_enabled = enabled;
 }
 
 void FailBan::SetTries(int tries)
 {
+	WriteGuard guard(_lock);
+
 	_tries = tries;
 }
 
 void FailBan::RecordFailure(uint32_t ipv4)
 {
+	WriteGuard guard(_lock);
+
 	if (!_enabled) {
 		return;
 	}
@@ -90,7 +94,7 @@ void FailBan::RecordFailure(uint32_t ipv4)
 	(*curr)->FailureCount += 1;
 
 	if ((*curr)->FailureCount > _tries) {
-		Ban(ipv4);
+		BanLocked(ipv4);
 
 		Counter *tmp = *curr;
 		*curr = (*curr)->Next;
@@ -98,14 +102,9 @@ void FailBan::RecordFailure(uint32_t ipv4)
 	}
 }
 
-int64_t FailBan::GetCooldownTimestamp()
-{
-	return _cooldownTimestamp;
-}
-
 void FailBan::Cooldown()
 {
-	_cooldownTimestamp = GetUnixTime();
+	WriteGuard guard(_lock);
 
 	for (int i = 0; i < _CounterCount; i++) {
 		Counter **curr = &(_counters[i]);
@@ -127,10 +126,19 @@ void FailBan::Cooldown()
 
 bool FailBan::IsAllowed(uint32_t ipv4)
 {
+	ReadGuard guard(_lock);
+
 	return !_enabled || !Find(ipv4);
 }
 
 bool FailBan::Ban(uint32_t ipv4)
+{
+	WriteGuard guard(_lock);
+
+	return BanLocked(ipv4);
+}
+
+bool FailBan::BanLocked(uint32_t ipv4)
 {
 	int index;
 
@@ -162,6 +170,8 @@ bool FailBan::Ban(uint32_t ipv4)
 
 bool FailBan::Unban(uint32_t ipv4)
 {
+	WriteGuard guard(_lock);
+
 	Entry **entry = Find(ipv4);
 
 	if (!entry) {
@@ -189,6 +199,8 @@ bool FailBan::Unban(uint32_t ipv4)
 
 CowBuffer<uint32_t> FailBan::ListBanned()
 {
+	ReadGuard guard(_lock);
+
 	int bannedCount = CountEntries(_db);
 	CowBuffer<uint32_t> result(bannedCount);
 
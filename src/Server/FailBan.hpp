@@ -3,8 +3,10 @@
 
 #include "../Common/BinaryFile.hpp"
 #include "../Common/CowBuffer.hpp"
+#include "../Common/RwLock.hpp"
 
 // All IPv4 addresses are stored and processed in network byte order.
+// Safe for concurrent use.
 class FailBan
 {
 public:
@@ -16,7 +18,6 @@ public:
 
 	void RecordFailure(uint32_t ipv4);
 
-	int64_t GetCooldownTimestamp();
 	void Cooldown();
 
 	bool IsAllowed(uint32_t ipv4);
@@ -58,7 +59,10 @@ private:
 		FreeIndex *Next;
 	};
 
+	RwLock _lock;
+
 	Entry *_db;
+	bool BanLocked(uint32_t ipv4);
 	bool Add(uint32_t ip, int index);
 	Entry **Find(uint32_t ip);
 	void Remove(Entry **entry);
@@ -85,7 +89,6 @@ private:
 
 	const int _CounterCount = 65536;
 	Counter **_counters;
-	int64_t _cooldownTimestamp;
 };
 
 #endif
@@ -0,0 +1,20 @@
+#include "IOBackend.hpp"
+
+#include "Poller.hpp"
+#include "Uring.hpp"
+#include "../Common/Exception.hpp"
+#include "../Common/Log.hpp"
+
+IOBackend *IOBackend::Create(Type type)
+{
+	if (type == TypeUring) {
+		try {
+			return new Uring;
+		} catch (Exception &ex) {
+			Log("io_uring is not available, using epoll.");
+			Log(ex.Message());
+		}
+	}
+
+	return new Poller;
+}
@@ -0,0 +1,40 @@
+#ifndef _IO_BACKEND_HPP
+#define _IO_BACKEND_HPP
+
+#include "../Protocol/Session.hpp"
+
+// Event loop backend interface.
+// Plain sockets only report readiness. Sessions are either notified
+// of readiness or get incoming data appended to Session::Input.
+class IOBackend : public SessionObserver
+{
+public:
+	enum Type
+	{
+		TypeEpoll = 0,
+		TypeUring = 1
+	};
+
+	virtual ~IOBackend()
+	{
+	}
+
+	// Falls back to epoll if io_uring is not available.
+	static IOBackend *Create(Type type);
+
+	virtual void AddSocket(int fd, void *data) = 0;
+	virtual void RemoveSocket(int fd) = 0;
+
+	virtual void AddSession(Session *session) = 0;
+	virtual void RemoveSession(Session *session) = 0;
+	virtual void UpdateSession(Session *session) = 0;
+
+	// Returns number of ready entries.
+	virtual int Wait(int timeout) = 0;
+
+	virtual void *GetData(int index) = 0;
+	virtual bool IsReadable(int index) = 0;
+	virtual bool IsWritable(int index) = 0;
+};
+
+#endif
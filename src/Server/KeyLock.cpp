@@ -0,0 +1,62 @@
+#include "KeyLock.hpp"
+
+KeyLock::KeyLock()
+{
+	for (int i = 0; i < StripeCount; i++) {
+		pthread_mutex_init(&_stripes[i], nullptr);
+	}
+}
+
+KeyLock::~KeyLock()
+{
+	for (int i = 0; i < StripeCount; i++) {
+		pthread_mutex_destroy(&_stripes[i]);
+	}
+}
+
+void KeyLock::Lock(const uint8_t *key)
+{
+	pthread_mutex_lock(GetStripe(key));
+}
+
+void KeyLock::Unlock(const uint8_t *key)
+{
+	pthread_mutex_unlock(GetStripe(key));
+}
+
+void KeyLock::Lock(const uint8_t *key1, const uint8_t *key2)
+{
+	pthread_mutex_t *stripe1 = GetStripe(key1);
+	pthread_mutex_t *stripe2 = GetStripe(key2);
+
+	if (stripe1 > stripe2) {
+		pthread_mutex_t *tmp = stripe1;
+		stripe1 = stripe2;
+		stripe2 = tmp;
+	}
+
+	pthread_mutex_lock(stripe1);
+
+	if (stripe2 != stripe1) {
+		pthread_mutex_lock(stripe2);
+	}
+}
+
+void KeyLock::Unlock(const uint8_t *key1, const uint8_t *key2)
+{
+	pthread_mutex_t *stripe1 = GetStripe(key1);
+	pthread_mutex_t *stripe2 = GetStripe(key2);
+
+	pthread_mutex_unlock(stripe1);
+
+	if (stripe2 != stripe1) {
+		pthread_mutex_unlock(stripe2);
+	}
+}
+
+pthread_mutex_t *KeyLock::GetStripe(const uint8_t *key)
+{
+	// Keys are public keys, so their bytes are uniformly distributed.
+	uint32_t hash = key[0] | (uint32_t)key[1] << 8;
+	return &_stripes[hash % StripeCount];
+}
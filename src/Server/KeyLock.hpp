@@ -0,0 +1,81 @@
+#ifndef _KEY_LOCK_HPP
+#define _KEY_LOCK_HPP
+
+#include <cstdint>
+#include <pthread.h>
+
+// Striped mutex table. Serializes access to per-user data,
+// for example message storage, between workers.
+class KeyLock
+{
+public:
+	KeyLock();
+	~KeyLock();
+
+	void Lock(const uint8_t *key);
+	void Unlock(const uint8_t *key);
+
+	// Stripes of both keys are locked in fixed order, so workers
+	// that lock the same pair do not deadlock.
+	void Lock(const uint8_t *key1, const uint8_t *key2);
+	void Unlock(const uint8_t *key1, const uint8_t *key2);
+
+private:
+	enum
+	{
+		StripeCount = 64
+	};
+
+	pthread_mutex_t _stripes[StripeCount];
+
+	pthread_mutex_t *GetStripe(const uint8_t *key);
+};
+
+// Holds key lock until the end of the scope.
+class KeyLockGuard
+{
+public:
+	KeyLockGuard(KeyLock *lock, const uint8_t *key)
+	{
+		_lock = lock;
+		_key = key;
+		_lock->Lock(_key);
+	}
+
+	~KeyLockGuard()
+	{
+		_lock->Unlock(_key);
+	}
+
+private:
+	KeyLock *_lock;
+	const uint8_t *_key;
+};
+
+// Holds key lock of both keys until the end of the scope.
+class KeyPairLockGuard
+{
+public:
+	KeyPairLockGuard(
+		KeyLock *lock,
+		const uint8_t *key1,
+		const uint8_t *key2)
+	{
+		_lock = lock;
+		_key1 = key1;
+		_key2 = key2;
+		_lock->Lock(_key1, _key2);
+	}
+
+	~KeyPairLockGuard()
+	{
+		_lock->Unlock(_key1, _key2);
+	}
+
+private:
+	KeyLock *_lock;
+	const uint8_t *_key1;
+	const uint8_t *_key2;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "Mailbox.hpp"
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+
+#include "../Common/Exception.hpp"
+
+Mailbox::Mailbox()
+{
+	_head = nullptr;
+	_hasOwner = false;
+
+	_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (_fd == -1) {
+		THROW("Failed to create mailbox eventfd.");
+	}
+}
+
+Mailbox::~Mailbox()
+{
+	PipeEvent *event = Take();
+
+	while (event) {
+		PipeEvent *next = event->Next;
+		delete event;
+		event = next;
+	}
+
+	close(_fd);
+}
+
+void Mailbox::SetOwner()
+{
+	_owner = pthread_self();
+	__atomic_store_n(&_hasOwner, true, __ATOMIC_RELEASE);
+}
+
+bool Mailbox::IsOwner()
+{
+	if (!__atomic_load_n(&_hasOwner, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	return pthread_equal(_owner, pthread_self());
+}
+
+void Mailbox::Post(PipeEvent *event)
+{
+	PipeEvent *head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+
+	do {
+		event->Next = head;
+	} while (!__atomic_compare_exchange_n(
+		&_head,
+		&head,
+		event,
+		true,
+		__ATOMIC_RELEASE,
+		__ATOMIC_RELAXED));
+
+	if (!head) {
+		Wake();
+	}
+}
+
+void Mailbox::Wake()
+{
+	uint64_t value = 1;
+	int64_t res;
+
+	do {
+		res = write(_fd, &value, sizeof(value));
+	} while (res == -1 && errno == EINTR);
+}
+
+void Mailbox::Clear()
+{
+	uint64_t value;
+	int64_t res;
+
+	do {
+		res = read(_fd, &value, sizeof(value));
+	} while (res == -1 && errno == EINTR);
+}
+
+PipeEvent *Mailbox::Take()
+{
+	PipeEvent *event = __atomic_exchange_n(
+		&_head,
+		nullptr,
+		__ATOMIC_ACQUIRE);
+
+	// Stack holds the newest event first.
+	PipeEvent *result = nullptr;
+
+	while (event) {
+		PipeEvent *next = event->Next;
+		event->Next = result;
+		result = event;
+		event = next;
+	}
+
+	return result;
+}
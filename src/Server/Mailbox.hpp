@@ -0,0 +1,63 @@
+#ifndef _MAILBOX_HPP
+#define _MAILBOX_HPP
+
+#include <pthread.h>
+
+#include "../Common/CowBuffer.hpp"
+#include "../Crypto/CryptoDefinitions.hpp"
+
+// Event passed between workers through mailboxes.
+// Data is a reference made by Share(), its counter is atomic, so the
+// sending and receiving threads may both hold the data. Neither of
+// them modifies it, the modifying side gets its own copy.
+struct PipeEvent
+{
+	PipeEvent *Next;
+
+	int32_t Type;
+	int32_t Status;
+	int64_t Timestamp;
+
+	uint8_t Destination[KEY_SIZE];
+	uint8_t Source[KEY_SIZE];
+
+	CowBuffer<uint8_t> Data;
+
+	POOL_ALLOCATED
+};
+
+// Lock-free multiple producer, single consumer queue.
+// Producers push events onto a stack with compare and swap.
+// Consumer takes the whole stack at once and restores posting order.
+// Eventfd is signaled when the first event is put into the empty mailbox.
+class Mailbox
+{
+public:
+	Mailbox();
+	~Mailbox();
+
+	int GetFd()
+	{
+		return _fd;
+	}
+
+	// Marks calling thread as the consumer.
+	void SetOwner();
+	bool IsOwner();
+
+	void Post(PipeEvent *event);
+	void Wake();
+
+	// Resets eventfd counter. Called by consumer before Take.
+	void Clear();
+	PipeEvent *Take();
+
+private:
+	PipeEvent *_head;
+	int _fd;
+
+	pthread_t _owner;
+	bool _hasOwner;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "MemoryBudget.hpp"
+
+MemoryBudget::MemoryBudget()
+{
+	_limit = 0;
+
+	_input = 0;
+	_output = 0;
+	_storage = 0;
+
+	_droppedSessions = 0;
+}
+
+void MemoryBudget::SetLimit(int64_t limit)
+{
+	__atomic_store_n(&_limit, limit, __ATOMIC_RELAXED);
+}
+
+bool MemoryBudget::HasLimit()
+{
+	return __atomic_load_n(&_limit, __ATOMIC_RELAXED);
+}
+
+void MemoryBudget::Update(
+	const SessionMemory &previous,
+	const SessionMemory &current)
+{
+	if (current.Input != previous.Input) {
+		__atomic_add_fetch(
+			&_input,
+			current.Input - previous.Input,
+			__ATOMIC_RELAXED);
+	}
+
+	if (current.Output != previous.Output) {
+		__atomic_add_fetch(
+			&_output,
+			current.Output - previous.Output,
+			__ATOMIC_RELAXED);
+	}
+
+	if (current.Storage != previous.Storage) {
+		__atomic_add_fetch(
+			&_storage,
+			current.Storage - previous.Storage,
+			__ATOMIC_RELAXED);
+	}
+}
+
+void MemoryBudget::RecordDrop()
+{
+	__atomic_add_fetch(&_droppedSessions, 1, __ATOMIC_RELAXED);
+}
+
+MemoryBudget::Level MemoryBudget::GetLevel()
+{
+	int64_t limit = __atomic_load_n(&_limit, __ATOMIC_RELAXED);
+
+	if (!limit) {
+		return LevelNormal;
+	}
+
+	int64_t usage =
+		__atomic_load_n(&_input, __ATOMIC_RELAXED) +
+		__atomic_load_n(&_output, __ATOMIC_RELAXED) +
+		__atomic_load_n(&_storage, __ATOMIC_RELAXED);
+
+	if (usage > limit + limit / 4) {
+		return LevelCritical;
+	}
+
+	if (usage > limit) {
+		return LevelPressure;
+	}
+
+	return LevelNormal;
+}
+
+void MemoryBudget::GetStatus(Status &status)
+{
+	status.Limit = __atomic_load_n(&_limit, __ATOMIC_RELAXED);
+	status.Usage.Input = __atomic_load_n(&_input, __ATOMIC_RELAXED);
+	status.Usage.Output = __atomic_load_n(&_output, __ATOMIC_RELAXED);
+	status.Usage.Storage = __atomic_load_n(&_storage, __ATOMIC_RELAXED);
+	status.DroppedSessions = __atomic_load_n(
+		&_droppedSessions,
+		__ATOMIC_RELAXED);
+	status.Level = GetLevel();
+}
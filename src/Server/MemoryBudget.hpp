@@ -0,0 +1,53 @@
+#ifndef _MEMORY_BUDGET_HPP
+#define _MEMORY_BUDGET_HPP
+
+#include <cstdint>
+
+#include "../Protocol/Session.hpp"
+
+// Server-wide accounting of memory held by sessions.
+// Workers report usage of their sessions, budget only sums it up and
+// tells how hard the server is pressed. Safe for concurrent use.
+class MemoryBudget
+{
+public:
+	// Pressure starts when usage exceeds the limit, it is critical
+	// when usage exceeds the limit by a quarter.
+	enum Level
+	{
+		LevelNormal = 0,
+		LevelPressure = 1,
+		LevelCritical = 2
+	};
+
+	struct Status
+	{
+		int64_t Limit;
+		SessionMemory Usage;
+		int64_t DroppedSessions;
+		int32_t Level;
+	};
+
+	MemoryBudget();
+
+	// Zero means no limit.
+	void SetLimit(int64_t limit);
+	bool HasLimit();
+
+	void Update(const SessionMemory &previous, const SessionMemory &current);
+	void RecordDrop();
+
+	Level GetLevel();
+	void GetStatus(Status &status);
+
+private:
+	int64_t _limit;
+
+	int64_t _input;
+	int64_t _output;
+	int64_t _storage;
+
+	int64_t _droppedSessions;
+};
+
+#endif
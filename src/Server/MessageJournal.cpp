@@ -0,0 +1,773 @@
+#include "MessageJournal.hpp"
+
+#include <time.h>
+#include <cstring>
+
+#include "../Message/MessageStorage.hpp"
+#include "../Message/Message.hpp"
+#include "../Crypto/Crypto.hpp"
+#include "../Common/UnixTime.hpp"
+#include "../Common/Log.hpp"
+
+MessageJournal::MessageJournal(
+	String path,
+	MessagePipe *pipe,
+	KeyLock *storageLock) : _file(path, true)
+{
+	_fileSize = _file.Size();
+	_failedPath = path + ".failed";
+
+	_pipe = pipe;
+	_storageLock = storageLock;
+	_storage = StorageEngine::TypeFiles;
+
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+	pthread_mutex_init(&_mutex, nullptr);
+	pthread_mutex_init(&_failedMutex, nullptr);
+	pthread_cond_init(&_condition, &attributes);
+	pthread_cond_init(&_applied, nullptr);
+	pthread_condattr_destroy(&attributes);
+
+	_first = nullptr;
+	_last = nullptr;
+	_count = 0;
+	_firstTime = 0;
+	_sequence = 0;
+
+	_applying = 0;
+
+	_recovered = nullptr;
+	_recoveredLast = nullptr;
+	_kept = false;
+
+	_applyQueues = nullptr;
+	_applyCount = 1;
+
+	_commitInterval = 0;
+	_batchSize = 1;
+	_statistics.Messages = 0;
+	_statistics.Commits = 0;
+
+	_running = false;
+	_work = false;
+}
+
+MessageJournal::~MessageJournal()
+{
+	Stop();
+
+	while (_first) {
+		Record *record = _first;
+		_first = record->Next;
+		delete record;
+	}
+
+	while (_recovered) {
+		Record *record = _recovered;
+		_recovered = record->Next;
+		delete record;
+	}
+
+	pthread_cond_destroy(&_applied);
+	pthread_cond_destroy(&_condition);
+	pthread_mutex_destroy(&_failedMutex);
+	pthread_mutex_destroy(&_mutex);
+}
+
+void MessageJournal::SetStorage(StorageEngine::Type storage)
+{
+	_storage = storage;
+}
+
+void MessageJournal::SetApplyThreads(int count)
+{
+	_applyCount = count > 0 ? count : 1;
+}
+
+void MessageJournal::SetCommitInterval(int64_t interval)
+{
+	pthread_mutex_lock(&_mutex);
+	_commitInterval = interval;
+	pthread_cond_signal(&_condition);
+	pthread_mutex_unlock(&_mutex);
+}
+
+void MessageJournal::SetBatchSize(int64_t size)
+{
+	pthread_mutex_lock(&_mutex);
+	_batchSize = size;
+	pthread_cond_signal(&_condition);
+	pthread_mutex_unlock(&_mutex);
+}
+
+// Last batch can be written partially, records are read until the
+// first incomplete one. Kept journal is cut after the last complete
+// record and new records continue its sequence.
+int64_t MessageJournal::Recover()
+{
+	uint64_t size = _file.Size();
+
+	if (size == 0) {
+		return 0;
+	}
+
+	int64_t count = 0;
+	uint64_t end = 0;
+
+	{
+		CowBuffer<uint8_t> data = _file.Map();
+
+		if (!data.Size()) {
+			THROW("Failed to map message journal.");
+		}
+
+		uint64_t offset = 0;
+		int64_t previous = 0;
+
+		while (size - offset >= sizeof(RecordHeader)) {
+			RecordHeader header;
+			memcpy(&header, data.Pointer() + offset, sizeof(header));
+			offset += sizeof(header);
+
+			if (header.Size > size - offset) {
+				break;
+			}
+
+			CowBuffer<uint8_t> message =
+				data.Slice(offset, header.Size);
+
+			bool valid =
+				header.Sequence > previous &&
+				GetChecksum(message) == header.Checksum;
+
+			if (!valid) {
+				break;
+			}
+
+			// Stored records are released with the mapping, kept
+			// ones must outlive it.
+			Record *record = new Record;
+			record->Next = nullptr;
+			record->Sequence = header.Sequence;
+			record->Message = message;
+
+			if (StoreRecord(record)) {
+				delete record;
+			} else {
+				record->Message = CopyMessage(message);
+
+				if (_recoveredLast) {
+					_recoveredLast->Next = record;
+				} else {
+					_recovered = record;
+				}
+
+				_recoveredLast = record;
+			}
+
+			previous = header.Sequence;
+			offset += header.Size;
+			end = offset;
+			count++;
+		}
+
+		_sequence = previous;
+	}
+
+	if (!_recovered) {
+		Checkpoint();
+		return count;
+	}
+
+	Log("Message journal is kept, some messages are not stored.");
+
+	if (end < size) {
+		_file.Resize(end);
+		_file.Sync();
+	}
+
+	_fileSize = end;
+	_kept = true;
+	return count;
+}
+
+void MessageJournal::Start()
+{
+	_work = true;
+	_applyQueues = new ApplyQueue[_applyCount];
+
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+	for (int i = 0; i < _applyCount; i++) {
+		ApplyQueue &queue = _applyQueues[i];
+		queue.Journal = this;
+		queue.First = nullptr;
+		queue.Last = nullptr;
+		queue.Work = true;
+
+		pthread_mutex_init(&queue.Mutex, nullptr);
+		pthread_cond_init(&queue.Condition, &attributes);
+
+		int res = pthread_create(
+			&queue.Thread,
+			nullptr,
+			ApplyThread,
+			&queue);
+
+		if (res) {
+			THROW("Failed to start journal apply thread.");
+		}
+	}
+
+	pthread_condattr_destroy(&attributes);
+
+	while (_recovered) {
+		Record *record = _recovered;
+		_recovered = record->Next;
+		Apply(record);
+	}
+
+	_recoveredLast = nullptr;
+
+	int res = pthread_create(&_thread, nullptr, Thread, this);
+
+	if (res) {
+		THROW("Failed to start journal thread.");
+	}
+
+	_running = true;
+}
+
+// Journal thread commits the rest of records before apply threads are
+// stopped, so they are applied as well.
+void MessageJournal::Stop()
+{
+	if (!_running) {
+		return;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	_work = false;
+	pthread_cond_signal(&_condition);
+	pthread_mutex_unlock(&_mutex);
+
+	pthread_join(_thread, nullptr);
+
+	for (int i = 0; i < _applyCount; i++) {
+		ApplyQueue &queue = _applyQueues[i];
+
+		pthread_mutex_lock(&queue.Mutex);
+		queue.Work = false;
+		pthread_cond_signal(&queue.Condition);
+		pthread_mutex_unlock(&queue.Mutex);
+
+		pthread_join(queue.Thread, nullptr);
+
+		pthread_cond_destroy(&queue.Condition);
+		pthread_mutex_destroy(&queue.Mutex);
+	}
+
+	delete[] _applyQueues;
+	_applyQueues = nullptr;
+
+	_running = false;
+}
+
+int64_t MessageJournal::Append(const CowBuffer<uint8_t> &message)
+{
+	Record *record = new Record;
+	record->Next = nullptr;
+	record->Message = message.Share();
+
+	pthread_mutex_lock(&_mutex);
+
+	record->Sequence = ++_sequence;
+
+	if (_last) {
+		_last->Next = record;
+	} else {
+		_first = record;
+		_firstTime = GetMonotonicTime();
+	}
+
+	_last = record;
+	_count++;
+
+	// Journal thread waits without timeout until the first record.
+	if (_count == 1 || _count >= _batchSize) {
+		pthread_cond_signal(&_condition);
+	}
+
+	int64_t sequence = record->Sequence;
+
+	pthread_mutex_unlock(&_mutex);
+
+	return sequence;
+}
+
+void MessageJournal::GetCommitStatistics(CommitStatistics &statistics)
+{
+	pthread_mutex_lock(&_mutex);
+	statistics = _statistics;
+	pthread_mutex_unlock(&_mutex);
+}
+
+void *MessageJournal::Thread(void *journal)
+{
+	((MessageJournal*)journal)->Run();
+	return nullptr;
+}
+
+// Appended records are committed before the thread stops.
+void MessageJournal::Run()
+{
+	pthread_mutex_lock(&_mutex);
+
+	while (_work || _first) {
+		if (!CommitDue()) {
+			if (!_first) {
+				pthread_cond_wait(&_condition, &_mutex);
+				continue;
+			}
+
+			int64_t deadline = _firstTime + _commitInterval;
+
+			struct timespec ts;
+			ts.tv_sec = deadline / 1000;
+			ts.tv_nsec = deadline % 1000 * 1000000;
+
+			pthread_cond_timedwait(&_condition, &_mutex, &ts);
+			continue;
+		}
+
+		Record *batch = TakeBatch();
+
+		pthread_mutex_unlock(&_mutex);
+		Commit(batch);
+		pthread_mutex_lock(&_mutex);
+	}
+
+	pthread_mutex_unlock(&_mutex);
+}
+
+bool MessageJournal::CommitDue()
+{
+	if (!_first) {
+		return false;
+	}
+
+	return
+		!_work ||
+		_count >= _batchSize ||
+		GetMonotonicTime() >= _firstTime + _commitInterval;
+}
+
+// Records left after the batch keep the time of the first record,
+// so they are committed next without waiting.
+MessageJournal::Record *MessageJournal::TakeBatch()
+{
+	Record *batch = _first;
+	Record *last = _first;
+	int64_t count = 1;
+
+	while (last->Next && count < _batchSize) {
+		last = last->Next;
+		count++;
+	}
+
+	_first = last->Next;
+	last->Next = nullptr;
+
+	if (!_first) {
+		_last = nullptr;
+	}
+
+	_count -= count;
+
+	_statistics.Messages += count;
+	_statistics.Commits++;
+
+	return batch;
+}
+
+// Sender is notified before the record is passed to apply thread,
+// which may release it.
+void MessageJournal::Commit(Record *batch)
+{
+	bool written = Write(batch);
+
+	while (batch) {
+		Record *record = batch;
+		batch = batch->Next;
+
+		Message::Header header;
+		Message::GetHeader(record->Message, header);
+
+		_pipe->MessageStored(header.Source, record->Sequence, written);
+
+		if (written) {
+			Apply(record);
+		} else {
+			delete record;
+		}
+	}
+
+	if (written) {
+		TryCheckpoint();
+	}
+}
+
+// Messages are written from their buffers, which can be mapped files,
+// with headers between them. Batch is synced once. Data of failed
+// write is cut, so it is not found on recovery.
+bool MessageJournal::Write(Record *batch)
+{
+	RecordHeader headers[WriteGroup];
+	struct iovec vector[WriteGroup * 2];
+	uint64_t size = 0;
+
+	try {
+		Record *record = batch;
+
+		while (record) {
+			int count = 0;
+			uint64_t offset = _fileSize + size;
+
+			while (record && count < WriteGroup) {
+				RecordHeader &header = headers[count];
+				header.Sequence = record->Sequence;
+				header.Checksum = GetChecksum(record->Message);
+				header.Size = record->Message.Size();
+				header.Reserved = 0;
+
+				vector[count * 2].iov_base = &header;
+				vector[count * 2].iov_len = sizeof(header);
+				vector[count * 2 + 1].iov_base =
+					(void*)record->Message.Pointer();
+				vector[count * 2 + 1].iov_len = header.Size;
+
+				size += sizeof(header) + header.Size;
+				record = record->Next;
+				count++;
+			}
+
+			_file.WriteVector(vector, count * 2, offset);
+		}
+
+		_file.Sync();
+	} catch (Exception &ex) {
+		Log("Failed to write message journal.");
+		Log(ex.Message());
+
+		// Records after the cut part have later sequence numbers,
+		// so recovery stops at leftover data if cutting fails.
+		try {
+			_file.Resize(_fileSize);
+		} catch (Exception&) {
+		}
+
+		return false;
+	}
+
+	_fileSize += size;
+	return true;
+}
+
+// Storage files of committed records reach the disk with the file
+// system sync, all of them are stored before it.
+void MessageJournal::Checkpoint()
+{
+	_file.SyncFileSystem();
+	_file.Resize(0);
+	_file.Sync();
+	_fileSize = 0;
+}
+
+// Journal that is due is cleared after a commit that finds no records
+// being applied. Commit waits for apply threads only at the limit,
+// their retries are bounded, so the journal does not grow without end.
+void MessageJournal::TryCheckpoint()
+{
+	if (_fileSize < CheckpointSize && !_kept) {
+		return;
+	}
+
+	pthread_mutex_lock(&_mutex);
+
+	if (_fileSize >= CheckpointLimit) {
+		while (_applying) {
+			pthread_cond_wait(&_applied, &_mutex);
+		}
+	}
+
+	bool applied = !_applying;
+
+	pthread_mutex_unlock(&_mutex);
+
+	if (!applied) {
+		return;
+	}
+
+	try {
+		Checkpoint();
+		_kept = false;
+	} catch (Exception &ex) {
+		Log("Failed to clear message journal.");
+		Log(ex.Message());
+	}
+}
+
+void *MessageJournal::ApplyThread(void *queue)
+{
+	ApplyQueue *applyQueue = (ApplyQueue*)queue;
+	applyQueue->Journal->RunApply(applyQueue);
+	return nullptr;
+}
+
+// Queued records are applied before the thread stops.
+void MessageJournal::RunApply(ApplyQueue *queue)
+{
+	pthread_mutex_lock(&queue->Mutex);
+
+	while (queue->Work || queue->First) {
+		if (!queue->First) {
+			pthread_cond_wait(&queue->Condition, &queue->Mutex);
+			continue;
+		}
+
+		Record *records = queue->First;
+		queue->First = nullptr;
+		queue->Last = nullptr;
+
+		pthread_mutex_unlock(&queue->Mutex);
+
+		while (records) {
+			Record *record = records;
+			records = records->Next;
+			record->Next = nullptr;
+
+			ApplyRecord(queue, record);
+			Applied(record);
+		}
+
+		pthread_mutex_lock(&queue->Mutex);
+	}
+
+	pthread_mutex_unlock(&queue->Mutex);
+}
+
+// Records of one pair of users go to the same thread in both
+// directions.
+void MessageJournal::Apply(Record *record)
+{
+	Message::Header header;
+	Message::GetHeader(record->Message, header);
+
+	uint32_t source;
+	uint32_t destination;
+	memcpy(&source, header.Source, sizeof(source));
+	memcpy(&destination, header.Destination, sizeof(destination));
+
+	ApplyQueue &queue = _applyQueues[(source ^ destination) % _applyCount];
+
+	pthread_mutex_lock(&_mutex);
+	_applying++;
+	pthread_mutex_unlock(&_mutex);
+
+	record->Next = nullptr;
+
+	pthread_mutex_lock(&queue.Mutex);
+
+	if (queue.Last) {
+		queue.Last->Next = record;
+	} else {
+		queue.First = record;
+	}
+
+	queue.Last = record;
+
+	pthread_cond_signal(&queue.Condition);
+	pthread_mutex_unlock(&queue.Mutex);
+}
+
+// Records after the failed one wait for its retries, so messages of a
+// pair are stored in order. Retries stop with the journal, the record
+// is then left in the journal for the next run. Record that can not be
+// written to the file of failed messages either is retried until it is
+// stored or written.
+void MessageJournal::ApplyRecord(ApplyQueue *queue, Record *record)
+{
+	int64_t interval = RetryInterval;
+
+	for (int attempt = 1; !StoreRecord(record); attempt++) {
+		if (attempt >= RetryCount && WriteFailed(record)) {
+			return;
+		}
+
+		if (!WaitRetry(queue, interval)) {
+			Log("Message is left in journal.");
+			return;
+		}
+
+		if (interval < MaxRetryInterval) {
+			interval *= 2;
+		}
+	}
+}
+
+void MessageJournal::Applied(Record *record)
+{
+	delete record;
+
+	pthread_mutex_lock(&_mutex);
+
+	_applying--;
+
+	if (!_applying) {
+		pthread_cond_signal(&_applied);
+	}
+
+	pthread_mutex_unlock(&_mutex);
+}
+
+bool MessageJournal::WaitRetry(ApplyQueue *queue, int64_t interval)
+{
+	int64_t deadline = GetMonotonicTime() + interval;
+
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000;
+	ts.tv_nsec = deadline % 1000 * 1000000;
+
+	pthread_mutex_lock(&queue->Mutex);
+
+	while (queue->Work && GetMonotonicTime() < deadline) {
+		pthread_cond_timedwait(&queue->Condition, &queue->Mutex, &ts);
+	}
+
+	bool work = queue->Work;
+
+	pthread_mutex_unlock(&queue->Mutex);
+
+	return work;
+}
+
+// Records are appended in journal format, so they are found by their
+// sequence numbers. Data of failed write is cut.
+bool MessageJournal::WriteFailed(Record *record)
+{
+	RecordHeader header;
+	header.Sequence = record->Sequence;
+	header.Checksum = GetChecksum(record->Message);
+	header.Size = record->Message.Size();
+	header.Reserved = 0;
+
+	struct iovec vector[2];
+	vector[0].iov_base = &header;
+	vector[0].iov_len = sizeof(header);
+	vector[1].iov_base = (void*)record->Message.Pointer();
+	vector[1].iov_len = header.Size;
+
+	bool written = true;
+
+	pthread_mutex_lock(&_failedMutex);
+
+	try {
+		BinaryFile file(_failedPath, true);
+		uint64_t size = file.Size();
+
+		try {
+			file.WriteVector(vector, 2, size);
+			file.Sync();
+		} catch (Exception&) {
+			try {
+				file.Resize(size);
+			} catch (Exception&) {
+			}
+
+			throw;
+		}
+	} catch (Exception &ex) {
+		Log("Failed to write failed message.");
+		Log(ex.Message());
+		written = false;
+	}
+
+	pthread_mutex_unlock(&_failedMutex);
+
+	if (written) {
+		Log("Message is moved to " + _failedPath + ".");
+	}
+
+	return written;
+}
+
+bool MessageJournal::StoreRecord(Record *record)
+{
+	try {
+		if (Store(record->Message)) {
+			_pipe->SendMessage(record->Message);
+		}
+	} catch (Exception &ex) {
+		Log("Failed to store message from journal.");
+		Log(ex.Message());
+		return false;
+	}
+
+	return true;
+}
+
+// Storing can be interrupted between the storages of sender and
+// recipient, so both are checked.
+bool MessageJournal::Store(const CowBuffer<uint8_t> &message)
+{
+	Message::Header header;
+	bool res = Message::GetHeader(message, header);
+
+	if (!res) {
+		THROW("Invalid message header.");
+	}
+
+	KeyPairLockGuard guard(
+		_storageLock,
+		header.Source,
+		header.Destination);
+
+	MessageStorage sender(header.Source, _storage);
+	bool added = sender.AddMessage(message);
+
+	MessageStorage recipient(header.Destination, _storage);
+
+	if (recipient.AddMessage(message)) {
+		added = true;
+	}
+
+	return added;
+}
+
+CowBuffer<uint8_t> MessageJournal::CopyMessage(
+	const CowBuffer<uint8_t> &message)
+{
+	CowBuffer<uint8_t> copy;
+
+	if (message.Size() >= LargeRecordSize) {
+		copy = CowBuffer<uint8_t>::MapTemporary(message.Size());
+	}
+
+	if (!copy.Size()) {
+		copy = CowBuffer<uint8_t>(message.Size());
+	}
+
+	memcpy(copy.Pointer(), message.Pointer(), message.Size());
+	return copy;
+}
+
+uint64_t MessageJournal::GetChecksum(const CowBuffer<uint8_t> &message)
+{
+	static const uint8_t key[HASH_KEY_SIZE] = {};
+	return KeyedHash(message.Pointer(), message.Size(), key);
+}
@@ -0,0 +1,198 @@
+#ifndef _MESSAGE_JOURNAL_HPP
+#define _MESSAGE_JOURNAL_HPP
+
+#include <pthread.h>
+
+#include "MessagePipe.hpp"
+#include "KeyLock.hpp"
+#include "../Message/StorageEngine.hpp"
+#include "../Common/BinaryFile.hpp"
+
+// Write-ahead journal of text messages.
+// Workers append messages, journal thread writes them in batches with
+// one sync per batch. Batch is committed when it reaches batch size or
+// commit interval passes since its first message. Sender is notified
+// through the pipe as soon as the batch is synced. Committed messages
+// are then added to storages of both users and relayed to the
+// recipient by apply threads. Messages of one pair of users are
+// applied by the same thread in order of commit.
+// Storage files are not synced by themselves. Journal is cleared after
+// all committed messages are stored and the whole file system is
+// synced, messages left in the journal are stored again on startup,
+// storages check data of messages that are already indexed. Message
+// that fails to be stored is retried by its apply thread before the
+// next messages of its queue, the one that keeps failing is moved to
+// the file of failed messages. Commit does not wait for apply threads
+// unless the journal reaches its limit.
+class MessageJournal
+{
+public:
+	struct CommitStatistics
+	{
+		int64_t Messages;
+		int64_t Commits;
+	};
+
+	MessageJournal(String path, MessagePipe *pipe, KeyLock *storageLock);
+	~MessageJournal();
+
+	// Set before recovery.
+	void SetStorage(StorageEngine::Type storage);
+
+	// Set before start.
+	void SetApplyThreads(int count);
+
+	// Can be changed while journal works. Interval is in milliseconds.
+	void SetCommitInterval(int64_t interval);
+	void SetBatchSize(int64_t size);
+
+	// Stores messages left by previous run and clears the journal.
+	// Journal is kept if some messages can not be stored, they are
+	// passed to apply threads on start. Returns number of messages
+	// found.
+	int64_t Recover();
+
+	void Start();
+	// Commits and applies appended messages and stops the threads.
+	void Stop();
+
+	// Can be called from any thread. Returns sequence number passed to
+	// MessageStored of the sender.
+	int64_t Append(const CowBuffer<uint8_t> &message);
+
+	void GetCommitStatistics(CommitStatistics &statistics);
+
+private:
+	enum
+	{
+		// Journal is cleared when it grows above this size.
+		CheckpointSize = 64 * 1024 * 1024,
+		// Commit waits for apply threads above this size.
+		CheckpointLimit = 256 * 1024 * 1024,
+		// Attempts to store a record before it is moved to the
+		// file of failed messages, the interval between them
+		// is in milliseconds and doubles up to the maximum.
+		RetryCount = 5,
+		RetryInterval = 100,
+		MaxRetryInterval = 10000,
+		// Records written with one vector.
+		WriteGroup = 64,
+		// Recovered records that are kept are copied out of the
+		// journal, the ones of this size and larger into temporary
+		// files.
+		LargeRecordSize = 1024 * 1024
+	};
+
+	struct RecordHeader
+	{
+		int64_t Sequence;
+		uint64_t Checksum;
+		uint32_t Size;
+		uint32_t Reserved;
+	};
+
+	struct Record
+	{
+		Record *Next;
+		int64_t Sequence;
+		CowBuffer<uint8_t> Message;
+
+		POOL_ALLOCATED
+	};
+
+	// Committed records waiting to be stored by one apply thread.
+	struct ApplyQueue
+	{
+		MessageJournal *Journal;
+		pthread_t Thread;
+
+		pthread_mutex_t Mutex;
+		pthread_cond_t Condition;
+		Record *First;
+		Record *Last;
+		bool Work;
+	};
+
+	BinaryFile _file;
+	uint64_t _fileSize;
+
+	// Records that kept failing, in journal format.
+	String _failedPath;
+	pthread_mutex_t _failedMutex;
+
+	MessagePipe *_pipe;
+	KeyLock *_storageLock;
+	StorageEngine::Type _storage;
+
+	// Appended records, protected by the mutex.
+	pthread_mutex_t _mutex;
+	pthread_cond_t _condition;
+	Record *_first;
+	Record *_last;
+	int64_t _count;
+	int64_t _firstTime;
+	int64_t _sequence;
+
+	// Committed records not yet applied, protected by the mutex.
+	// Checkpoint at the limit waits on the applied condition until no
+	// records are being applied.
+	pthread_cond_t _applied;
+	int64_t _applying;
+
+	// Recovered records that failed to be stored, passed to apply
+	// threads on start. Journal kept for them is cleared once they
+	// are applied.
+	Record *_recovered;
+	Record *_recoveredLast;
+	bool _kept;
+
+	ApplyQueue *_applyQueues;
+	int _applyCount;
+
+	int64_t _commitInterval;
+	int64_t _batchSize;
+	CommitStatistics _statistics;
+
+	pthread_t _thread;
+	bool _running;
+	bool _work;
+
+	static void *Thread(void *journal);
+	void Run();
+
+	bool CommitDue();
+	Record *TakeBatch();
+
+	void Commit(Record *batch);
+	bool Write(Record *batch);
+	void Checkpoint();
+
+	// Clears the journal if it is due and all committed records are
+	// applied.
+	void TryCheckpoint();
+
+	static void *ApplyThread(void *queue);
+	void RunApply(ApplyQueue *queue);
+	void Apply(Record *record);
+	void ApplyRecord(ApplyQueue *queue, Record *record);
+	void Applied(Record *record);
+
+	// Returns false if the queue is stopped during the wait.
+	bool WaitRetry(ApplyQueue *queue, int64_t interval);
+
+	// Appends record to the file of failed messages and syncs it.
+	bool WriteFailed(Record *record);
+
+	// Stores record and relays it if it is new. Returns false if
+	// storing failed.
+	bool StoreRecord(Record *record);
+
+	// Returns true if the message was added to any storage.
+	bool Store(const CowBuffer<uint8_t> &message);
+
+	static uint64_t GetChecksum(const CowBuffer<uint8_t> &message);
+	static CowBuffer<uint8_t> CopyMessage(
+		const CowBuffer<uint8_t> &message);
+};
+
+#endif
@@ -9,7 +9,15 @@
 
 MessagePipe::MessagePipe()
 {
-	_first = nullptr;
+	_bucketCount = InitialBucketCount;
+	_userCount = 0;
+	_buckets = new OnlineUser*[_bucketCount];
+
+	for (uint64_t i = 0; i < _bucketCount; i++) {
+		_buckets[i] = nullptr;
+	}
+
+	GenerateHashKey(_hashKey);
 }
 
 MessagePipe::~MessagePipe()
@@ -17,7 +25,7 @@ MessagePipe::~MessagePipe()
 	FreeData();
 }
 
-void MessagePipe::SendMessage(const CowBuffer<uint8_t> message)
+int64_t MessagePipe::SendMessage(const CowBuffer<uint8_t> &message)
 {
 	Message::Header header;
 	bool res = Message::GetHeader(message, header);
@@ -26,68 +34,359 @@ void MessagePipe::SendMessage(const CowBuffer<uint8_t> message)
 		THROW("Invalid message header.");
 	}
 
-	OnlineUser *user = _first;
+	Post(EventMessage, header.Destination, header.Source, 0, 0, message);
+	return GetBacklog(header.Destination);
+}
 
-	while (user) {
-		if (!crypto_verify32(header.Destination, user->Key)) {
-			user->Handler->SendMessage(message);
-			return;
-		}
+void MessagePipe::MessageStored(
+	const uint8_t *destination,
+	int64_t sequence,
+	bool stored)
+{
+	Post(
+		EventMessageStored,
+		destination,
+		destination,
+		sequence,
+		stored,
+		CowBuffer<uint8_t>());
+}
 
-		user = user->Next;
-	}
+bool MessagePipe::IsOnline(const uint8_t *key)
+{
+	ReadGuard guard(_lock);
+	return Find(key);
 }
 
-SendMessageHandler *MessagePipe::GetHandler(const uint8_t *key)
+int64_t MessagePipe::GetBacklog(const uint8_t *key)
 {
-	OnlineUser *user = _first;
+	ReadGuard guard(_lock);
 
-	while (user) {
-		if (!crypto_verify32(key, user->Key)) {
-			return user->Handler;
-		}
+	OnlineUser *user = Find(key);
 
-		user = user->Next;
+	if (!user) {
+		return 0;
 	}
 
-	return nullptr;
+	return __atomic_load_n(user->Backlog, __ATOMIC_RELAXED);
 }
 
-void MessagePipe::Register(const uint8_t *key, SendMessageHandler *handler)
+bool MessagePipe::Register(
+	const uint8_t *key,
+	SendMessageHandler *handler,
+	Mailbox *inbox,
+	const int64_t *backlog)
 {
+	WriteGuard guard(_lock);
+
+	uint64_t hash = KeyedHash(key, KEY_SIZE, _hashKey);
+	OnlineUser **link = Find(key, hash);
+
+	if (*link) {
+		return false;
+	}
+
 	OnlineUser *user = new OnlineUser;
+	user->Next = nullptr;
+	user->Hash = hash;
 	user->Key = key;
 	user->Handler = handler;
-	user->Next = _first;
+	user->Inbox = inbox;
+	user->Backlog = backlog;
+
+	*link = user;
+	_userCount++;
+
+	if (_userCount > _bucketCount) {
+		Grow();
+	}
 
-	_first = user;
+	return true;
 }
 
-void MessagePipe::Unregister(const uint8_t *key)
+void MessagePipe::Unregister(const uint8_t *key, SendMessageHandler *handler)
 {
 	if (!key) {
 		return;
 	}
 
-	OnlineUser **user = &_first;
+	WriteGuard guard(_lock);
+
+	OnlineUser **link = Find(key, KeyedHash(key, KEY_SIZE, _hashKey));
+
+	if (*link && (*link)->Handler == handler) {
+		OnlineUser *user = *link;
+		*link = user->Next;
+		delete user;
+		_userCount--;
+	}
+}
+
+void MessagePipe::StartVoice(
+	const uint8_t *destination,
+	const uint8_t *source,
+	int64_t timestamp)
+{
+	Post(
+		EventVoiceStart,
+		destination,
+		source,
+		timestamp,
+		0,
+		CowBuffer<uint8_t>());
+}
 
-	while (*user) {
-		if (!crypto_verify32(key, (*user)->Key)) {
-			OnlineUser *tmp = *user;
-			*user = (*user)->Next;
-			delete tmp;
-			return;
+void MessagePipe::AcceptVoice(
+	const uint8_t *destination,
+	const uint8_t *source)
+{
+	Post(EventVoiceAccept, destination, source, 0, 0, CowBuffer<uint8_t>());
+}
+
+void MessagePipe::DeclineVoice(
+	const uint8_t *destination,
+	const uint8_t *source)
+{
+	Post(
+		EventVoiceDecline,
+		destination,
+		source,
+		0,
+		0,
+		CowBuffer<uint8_t>());
+}
+
+void MessagePipe::EndVoice(const uint8_t *destination, const uint8_t *source)
+{
+	Post(EventVoiceEnd, destination, source, 0, 0, CowBuffer<uint8_t>());
+}
+
+void MessagePipe::SendVoiceFrame(
+	const uint8_t *destination,
+	const uint8_t *source,
+	const CowBuffer<uint8_t> &frame)
+{
+	Post(EventVoiceFrame, destination, source, 0, 0, frame);
+}
+
+void MessagePipe::Deliver(PipeEvent *event, Mailbox *inbox)
+{
+	SendMessageHandler *handler;
+	Mailbox *userInbox;
+	bool online = Lookup(event->Destination, handler, userInbox);
+
+	if (!online) {
+		if (event->Type == EventVoiceStart) {
+			Post(
+				EventVoiceStarted,
+				event->Source,
+				event->Destination,
+				0,
+				VoiceStartOffline,
+				CowBuffer<uint8_t>());
 		}
 
-		user = &((*user)->Next);
+		delete event;
+		return;
+	}
+
+	// User has reconnected to another worker.
+	if (userInbox != inbox) {
+		userInbox->Post(event);
+		return;
 	}
+
+	Dispatch(
+		handler,
+		(EventType)event->Type,
+		event->Destination,
+		event->Source,
+		event->Timestamp,
+		event->Status,
+		event->Data);
+
+	delete event;
+}
+
+// Keys are compared only when hashes match.
+MessagePipe::OnlineUser **MessagePipe::Find(
+	const uint8_t *key,
+	uint64_t hash)
+{
+	OnlineUser **link = &_buckets[hash & (_bucketCount - 1)];
+
+	while (*link) {
+		OnlineUser *user = *link;
+
+		if (user->Hash == hash && !crypto_verify32(key, user->Key)) {
+			break;
+		}
+
+		link = &user->Next;
+	}
+
+	return link;
+}
+
+MessagePipe::OnlineUser *MessagePipe::Find(const uint8_t *key)
+{
+	return *Find(key, KeyedHash(key, KEY_SIZE, _hashKey));
+}
+
+bool MessagePipe::Lookup(
+	const uint8_t *key,
+	SendMessageHandler *&handler,
+	Mailbox *&inbox)
+{
+	ReadGuard guard(_lock);
+
+	OnlineUser *user = Find(key);
+
+	if (!user) {
+		return false;
+	}
+
+	handler = user->Handler;
+	inbox = user->Inbox;
+	return true;
+}
+
+void MessagePipe::Post(
+	EventType type,
+	const uint8_t *destination,
+	const uint8_t *source,
+	int64_t timestamp,
+	int32_t status,
+	const CowBuffer<uint8_t> &data)
+{
+	SendMessageHandler *handler;
+	Mailbox *inbox;
+	bool online = Lookup(destination, handler, inbox);
+
+	if (!online) {
+		if (type == EventVoiceStart) {
+			Post(
+				EventVoiceStarted,
+				source,
+				destination,
+				0,
+				VoiceStartOffline,
+				CowBuffer<uint8_t>());
+		}
+
+		return;
+	}
+
+	// Handler belongs to the calling worker and can not be removed
+	// while it is being called.
+	if (inbox->IsOwner()) {
+		Dispatch(
+			handler,
+			type,
+			destination,
+			source,
+			timestamp,
+			status,
+			data);
+		return;
+	}
+
+	PipeEvent *event = new PipeEvent;
+	event->Type = type;
+	event->Status = status;
+	event->Timestamp = timestamp;
+	memcpy(event->Destination, destination, KEY_SIZE);
+	memcpy(event->Source, source, KEY_SIZE);
+
+	// Reference counter of the data becomes atomic, so the other
+	// worker can hold the data without copying it.
+	if (data.Size()) {
+		event->Data = data.Share();
+	}
+
+	inbox->Post(event);
+}
+
+void MessagePipe::Dispatch(
+	SendMessageHandler *handler,
+	EventType type,
+	const uint8_t *destination,
+	const uint8_t *source,
+	int64_t timestamp,
+	int32_t status,
+	const CowBuffer<uint8_t> &data)
+{
+	switch (type) {
+	case EventMessage:
+		handler->SendMessage(data);
+		break;
+	case EventMessageStored:
+		handler->MessageStored(timestamp, status);
+		break;
+	case EventVoiceStart:
+		Post(
+			EventVoiceStarted,
+			source,
+			destination,
+			0,
+			handler->StartVoice(source, timestamp) ?
+				VoiceStartRinging :
+				VoiceStartBusy,
+			CowBuffer<uint8_t>());
+		break;
+	case EventVoiceStarted:
+		handler->VoiceStarted(source, (VoiceStartStatus)status);
+		break;
+	case EventVoiceAccept:
+		handler->AcceptVoice(source);
+		break;
+	case EventVoiceDecline:
+		handler->DeclineVoice(source);
+		break;
+	case EventVoiceEnd:
+		handler->EndVoice(source);
+		break;
+	case EventVoiceFrame:
+		handler->SendVoiceFrame(source, data);
+		break;
+	}
+}
+
+void MessagePipe::Grow()
+{
+	uint64_t bucketCount = _bucketCount * 2;
+	OnlineUser **buckets = new OnlineUser*[bucketCount];
+
+	for (uint64_t i = 0; i < bucketCount; i++) {
+		buckets[i] = nullptr;
+	}
+
+	for (uint64_t i = 0; i < _bucketCount; i++) {
+		while (_buckets[i]) {
+			OnlineUser *user = _buckets[i];
+			_buckets[i] = user->Next;
+
+			uint64_t bucket = user->Hash & (bucketCount - 1);
+			user->Next = buckets[bucket];
+			buckets[bucket] = user;
+		}
+	}
+
+	delete[] _buckets;
+
+	_buckets = buckets;
+	_bucketCount = bucketCount;
 }
 
 void MessagePipe::FreeData()
 {
-	while (_first) {
-		OnlineUser *user = _first;
-		_first = _first->Next;
-		delete user;
+	for (uint64_t i = 0; i < _bucketCount; i++) {
+		while (_buckets[i]) {
+			OnlineUser *user = _buckets[i];
+			_buckets[i] = user->Next;
+			delete user;
+		}
 	}
+
+	delete[] _buckets;
 }
@@ -1,46 +1,154 @@
 #ifndef _MESSAGE_PIPE_HPP
 #define _MESSAGE_PIPE_HPP
 
+#include "Mailbox.hpp"
 #include "../Common/CowBuffer.hpp"
+#include "../Common/RwLock.hpp"
+#include "../Crypto/Crypto.hpp"
 
+enum VoiceStartStatus
+{
+	VoiceStartRinging = 0,
+	VoiceStartBusy = 1,
+	VoiceStartOffline = 2
+};
+
+// Handler methods are called only by the worker that registered
+// the handler. Peer key is the key of the user that caused the call.
 class SendMessageHandler
 {
 public:
-	virtual void SendMessage(const CowBuffer<uint8_t> message) = 0;
+	virtual void SendMessage(const CowBuffer<uint8_t> &message) = 0;
 
-	virtual bool InVoice() = 0;
-	virtual void SendVoiceFrame(const CowBuffer<uint8_t> frame) = 0;
-	virtual void StartVoice(
+	// Message sent by the handler was written to the journal with
+	// the given sequence number, stored is false on failure.
+	virtual void MessageStored(int64_t sequence, bool stored) = 0;
+
+	// Returns false if handler is already in voice chat.
+	virtual bool StartVoice(const uint8_t *peerKey, int64_t timestamp) = 0;
+	virtual void VoiceStarted(
 		const uint8_t *peerKey,
-		int64_t timestamp,
-		SendMessageHandler *handler) = 0;
-	virtual void AcceptVoice() = 0;
-	virtual void DeclineVoice() = 0;
-	virtual void EndVoice() = 0;
+		VoiceStartStatus status) = 0;
+	virtual void AcceptVoice(const uint8_t *peerKey) = 0;
+	virtual void DeclineVoice(const uint8_t *peerKey) = 0;
+	virtual void EndVoice(const uint8_t *peerKey) = 0;
+	virtual void SendVoiceFrame(
+		const uint8_t *peerKey,
+		const CowBuffer<uint8_t> &frame) = 0;
 };
 
+// Routes messages and voice events to online users.
+// Handler registered by the calling worker is called directly,
+// handlers of other workers receive events through their mailboxes.
+// Online users are found by keyed hash of their keys, table grows with
+// the number of users.
 class MessagePipe
 {
 public:
 	MessagePipe();
 	~MessagePipe();
 
-	void SendMessage(const CowBuffer<uint8_t> message);
-	SendMessageHandler *GetHandler(const uint8_t *key);
+	// Returns output backlog of the destination, see GetBacklog.
+	int64_t SendMessage(const CowBuffer<uint8_t> &message);
+	void MessageStored(
+		const uint8_t *destination,
+		int64_t sequence,
+		bool stored);
+	bool IsOnline(const uint8_t *key);
 
-	void Register(const uint8_t *key, SendMessageHandler *handler);
-	void Unregister(const uint8_t *key);
+	// Size of output queued for the user and not sent yet, 0 if user
+	// is offline. Producers use it to slow down for slow readers.
+	int64_t GetBacklog(const uint8_t *key);
+
+	// Returns false if key is already registered.
+	// Backlog is updated by the owner of handler and read atomically.
+	bool Register(
+		const uint8_t *key,
+		SendMessageHandler *handler,
+		Mailbox *inbox,
+		const int64_t *backlog);
+	void Unregister(const uint8_t *key, SendMessageHandler *handler);
+
+	void StartVoice(
+		const uint8_t *destination,
+		const uint8_t *source,
+		int64_t timestamp);
+	void AcceptVoice(const uint8_t *destination, const uint8_t *source);
+	void DeclineVoice(const uint8_t *destination, const uint8_t *source);
+	void EndVoice(const uint8_t *destination, const uint8_t *source);
+	void SendVoiceFrame(
+		const uint8_t *destination,
+		const uint8_t *source,
+		const CowBuffer<uint8_t> &frame);
+
+	// Called by the owner of inbox for each received event.
+	// Takes ownership of the event.
+	void Deliver(PipeEvent *event, Mailbox *inbox);
 
 private:
+	enum EventType
+	{
+		EventMessage = 0,
+		EventVoiceStart = 1,
+		EventVoiceStarted = 2,
+		EventVoiceAccept = 3,
+		EventVoiceDecline = 4,
+		EventVoiceEnd = 5,
+		EventVoiceFrame = 6,
+		EventMessageStored = 7
+	};
+
+	enum
+	{
+		InitialBucketCount = 64
+	};
+
 	struct OnlineUser
 	{
 		OnlineUser *Next;
+		uint64_t Hash;
 
 		const uint8_t *Key;
 		SendMessageHandler *Handler;
+		Mailbox *Inbox;
+		const int64_t *Backlog;
+
+		POOL_ALLOCATED
 	};
 
-	OnlineUser *_first;
+	OnlineUser **_buckets;
+	uint64_t _bucketCount;
+	uint64_t _userCount;
+	uint8_t _hashKey[HASH_KEY_SIZE];
+	RwLock _lock;
+
+	// Returns the link that points to the user or the end of its
+	// bucket.
+	OnlineUser **Find(const uint8_t *key, uint64_t hash);
+	OnlineUser *Find(const uint8_t *key);
+	bool Lookup(
+		const uint8_t *key,
+		SendMessageHandler *&handler,
+		Mailbox *&inbox);
+
+	void Grow();
+
+	void Post(
+		EventType type,
+		const uint8_t *destination,
+		const uint8_t *source,
+		int64_t timestamp,
+		int32_t status,
+		const CowBuffer<uint8_t> &data);
+
+	void Dispatch(
+		SendMessageHandler *handler,
+		EventType type,
+		const uint8_t *destination,
+		const uint8_t *source,
+		int64_t timestamp,
+		int32_t status,
+		const CowBuffer<uint8_t> &data);
 
 	void FreeData();
 };
@@ -0,0 +1,150 @@
+#include "Poller.hpp"
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "../Common/Exception.hpp"
+
+Poller::Poller()
+{
+	_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (_fd == -1) {
+		THROW("Failed to create epoll instance.");
+	}
+
+	_events = new struct epoll_event[MaxEvents];
+}
+
+Poller::~Poller()
+{
+	delete[] _events;
+	close(_fd);
+}
+
+void Poller::AddSocket(int fd, void *data)
+{
+	Control(EPOLL_CTL_ADD, fd, EPOLLIN, data);
+}
+
+void Poller::RemoveSocket(int fd)
+{
+	Control(EPOLL_CTL_DEL, fd, 0, nullptr);
+}
+
+void Poller::AddSession(Session *session)
+{
+	session->ReadEvents = !session->InputPaused;
+	session->WriteEvents = session->CanWrite();
+	session->Observer = this;
+
+	ControlSession(EPOLL_CTL_ADD, session);
+}
+
+void Poller::RemoveSession(Session *session)
+{
+	session->Observer = nullptr;
+
+	if (session->Closed()) {
+		return;
+	}
+
+	Control(EPOLL_CTL_DEL, session->Socket, 0, nullptr);
+}
+
+void Poller::UpdateSession(Session *session)
+{
+	if (session->Closed()) {
+		return;
+	}
+
+	bool readEvents = !session->InputPaused;
+	bool writeEvents = session->CanWrite();
+
+	if (readEvents == session->ReadEvents &&
+		writeEvents == session->WriteEvents)
+	{
+		return;
+	}
+
+	session->ReadEvents = readEvents;
+	session->WriteEvents = writeEvents;
+
+	ControlSession(EPOLL_CTL_MOD, session);
+}
+
+int Poller::Wait(int timeout)
+{
+	int res = epoll_wait(_fd, _events, MaxEvents, timeout);
+
+	if (res == -1) {
+		if (errno == EINTR) {
+			return 0;
+		}
+
+		THROW("Error on epoll_wait.");
+	}
+
+	return res;
+}
+
+void *Poller::GetData(int index)
+{
+	return _events[index].data.ptr;
+}
+
+bool Poller::IsReadable(int index)
+{
+	return _events[index].events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+}
+
+bool Poller::IsWritable(int index)
+{
+	return _events[index].events & EPOLLOUT;
+}
+
+void Poller::OutputQueued(Session *session)
+{
+	if (session->WriteEvents || session->Closed()) {
+		return;
+	}
+
+	session->WriteEvents = true;
+	ControlSession(EPOLL_CTL_MOD, session);
+}
+
+void Poller::InputChanged(Session *session)
+{
+	UpdateSession(session);
+}
+
+void Poller::Control(int operation, int fd, uint32_t events, void *data)
+{
+	struct epoll_event event;
+	event.events = events;
+	event.data.ptr = data;
+
+	int res = epoll_ctl(_fd, operation, fd, &event);
+
+	if (res == -1) {
+		THROW("Error on epoll_ctl.");
+	}
+}
+
+// Hangup and errors are reported while reading is paused, reading then
+// finds the end of stream.
+void Poller::ControlSession(int operation, Session *session)
+{
+	uint32_t events = 0;
+
+	if (session->ReadEvents) {
+		events |= EPOLLIN;
+	}
+
+	if (session->WriteEvents) {
+		events |= EPOLLOUT;
+	}
+
+	Control(operation, session->Socket, events, session);
+}
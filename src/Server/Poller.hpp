@@ -0,0 +1,47 @@
+#ifndef _POLLER_HPP
+#define _POLLER_HPP
+
+#include <cstdint>
+
+#include "IOBackend.hpp"
+
+// Event loop backend based on epoll.
+// Sessions are registered once and stay registered until removal.
+// Write interest is requested only while session has pending output.
+class Poller : public IOBackend
+{
+public:
+	Poller();
+	~Poller();
+
+	void AddSocket(int fd, void *data) override;
+	void RemoveSocket(int fd) override;
+
+	void AddSession(Session *session) override;
+	void RemoveSession(Session *session) override;
+	void UpdateSession(Session *session) override;
+
+	int Wait(int timeout) override;
+
+	void *GetData(int index) override;
+	bool IsReadable(int index) override;
+	bool IsWritable(int index) override;
+
+	void OutputQueued(Session *session) override;
+	void InputChanged(Session *session) override;
+
+private:
+	int _fd;
+
+	enum
+	{
+		MaxEvents = 256
+	};
+
+	struct epoll_event *_events;
+
+	void Control(int operation, int fd, uint32_t events, void *data);
+	void ControlSession(int operation, Session *session);
+};
+
+#endif
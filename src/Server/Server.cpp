@@ -3,23 +3,19 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstdlib>
+#include <cstdio>
 #include <cstring>
-#include <poll.h>
-#include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/un.h>
 #include <sys/stat.h>
 
-#include "../Protocol/ServerSession.hpp"
-#include "../Protocol/ControlSession.hpp"
-#include "../ServerCtl/SocketName.hpp"
-#include "../Common/UnixTime.hpp"
 #include "../Common/File.hpp"
 #include "../Common/SignalHandling.hpp"
 #include "../Common/Log.hpp"
 #include "../Common/Debug.hpp"
+#include "../Common/UnixTime.hpp"
 #include "../Crypto/Crypto.hpp"
+#include "../Message/StorageConverter.hpp"
 
 static const char *RestrictedModeSetting = "RestrictedMode";
 static const char *RestrictedModeSettingValue = "No";
@@ -29,6 +25,40 @@ static const char *IPv4Setting = "IPv4";
 static const char *IPv4SettingValue = "0.0.0.0";
 static const char *PortSetting = "Port";
 static const char *PortSettingValue = "6524";
+static const char *WorkersSetting = "Workers";
+static const char *WorkersSettingValue = "0";
+static const char *IOBackendSetting = "IOBackend";
+static const char *IOBackendSettingValue = "epoll";
+static const char *HandshakeTimeoutSetting = "HandshakeTimeout";
+static const char *HandshakeTimeoutSettingValue = "10000";
+static const char *BacklogSetting = "Backlog";
+static const char *BacklogSettingValue = "1024";
+static const char *MaxConnectionsSetting = "MaxConnections";
+static const char *MaxConnectionsSettingValue = "0";
+static const char *MaxConnectionsPerIPSetting = "MaxConnectionsPerIP";
+static const char *MaxConnectionsPerIPSettingValue = "0";
+static const char *MaxUnauthenticatedSetting = "MaxUnauthenticated";
+static const char *MaxUnauthenticatedSettingValue = "0";
+
+static const char *MemorySection = "Memory";
+static const char *MemoryBudgetSetting = "Budget";
+static const char *MemoryBudgetSettingValue = "0";
+static const char *SpillThresholdSetting = "SpillThreshold";
+static const char *SpillThresholdSettingValue = "16";
+
+static const char *StorageSection = "Storage";
+static const char *StorageEngineSetting = "Engine";
+static const char *StorageEngineSettingValue = "segments";
+static const char *CommitIntervalSetting = "CommitInterval";
+static const char *CommitIntervalSettingValue = "5";
+static const char *CommitBatchSetting = "CommitBatch";
+static const char *CommitBatchSettingValue = "256";
+
+static const char *UsersSection = "Users";
+static const char *FlushIntervalSetting = "FlushInterval";
+static const char *FlushIntervalSettingValue = "10";
+static const char *ClockSkewSetting = "ClockSkew";
+static const char *ClockSkewSettingValue = "5";
 
 static const char *FailBanSection = "FailBan";
 static const char *FailBanEnabledSetting = "Enabled";
@@ -38,31 +68,61 @@ static const char *FailBanTriesSettingValue = "5";
 static const char *FailBanCooldownSetting = "CooldownInterval";
 static const char *FailBanCooldownSettingValue = "14400";
 
-Server::Server() : _configFile("talkd.conf")
+Server::Server() :
+	_journal("talkd.journal", &_pipe, &_storageLock),
+	_configFile("talkd.conf")
 {
 	umask(077);
 
 	InitConfigFile();
 
-	_sessionFirst = nullptr;
+	_control = nullptr;
+	_workers = nullptr;
+	_workerCount = 0;
 
-	_listeningSocket = -1;
-	_controlSocket = -1;
-
-	_activeUsers = 0;
 	_work = false;
 	_reload = false;
 	_restrictedMode = false;
+	_handshakeTimeout = 0;
+	_backlog = 0;
+	_spillThreshold = 0;
+
+	_cooldownTimer.Handler = this;
+	_flushTimer.Handler = this;
+	_flushInterval = 0;
 
 	LoadConfig();
+	LoadWorkerCount();
+	LoadIOBackend();
+	LoadStorageEngine();
+
+	_journal.SetStorage(_shared.Storage);
+	_journal.SetApplyThreads(_workerCount);
 
 	GetPassword();
+
+	_shared.Users = &_userDb;
+	_shared.Pipe = &_pipe;
+	_shared.Ban = &_failBan;
+	_shared.StorageLock = &_storageLock;
+	_shared.Journal = &_journal;
+	_shared.Limits = &_limits;
+	_shared.Memory = &_memory;
+	_shared.RestrictedMode = &_restrictedMode;
+	_shared.HandshakeTimeout = &_handshakeTimeout;
+	_shared.Backlog = &_backlog;
+	_shared.SpillThreshold = &_spillThreshold;
+	_shared.PublicKey = _publicKey;
+	_shared.PrivateKey = _privateKey;
+	_shared.Work = &_work;
+	_shared.Reload = &_reload;
+
+	CreateWorkers();
 }
 
 Server::~Server()
 {
-	CloseSessions(_sessionFirst);
-	CloseListeningSockets();
+	DestroyWorkers();
 	WipeKeys();
 }
 
@@ -71,36 +131,15 @@ int Server::Run()
 	_work = true;
 
 	DisableSigPipe();
+	RecoverJournal();
+	_journal.Start();
 	OpenListeningSockets();
+	StartWorkers();
+	ArmCooldownTimer();
+	FlushAccessTimes();
 
-	_activeUsers = 0;
-
-	int64_t currentTime = GetUnixTime();
-
-	while (_work) {
-		int fdCount;
-		struct pollfd *fds = BuildPollFds(fdCount);
-
-		int res = poll(fds, fdCount, 10000);
-
-		if (res == -1) {
-			THROW("Error on poll.");
-		}
-
-		int64_t newTime = GetUnixTime();
-		bool updateTime = newTime - currentTime >= 10;
-
-		if (newTime - _failBan.GetCooldownTimestamp() >
-			_failBanCooldownInterval)
-		{
-			_failBan.Cooldown();
-		}
-
-		if (updateTime) {
-			currentTime = newTime;
-		}
-
-		ProcessPollFds(fds, updateTime);
+	while (__atomic_load_n(&_work, __ATOMIC_ACQUIRE)) {
+		_control->Process(-1);
 
 		if (_reload) {
 			_reload = false;
@@ -108,6 +147,13 @@ int Server::Run()
 		}
 	}
 
+	StopWorkers();
+	_journal.Stop();
+	LogCommitStatistics();
+
+	_userDb.FlushAccessTimes(GetUnixTime());
+	LogAccessTimeStatistics();
+
 	return 0;
 }
 
@@ -121,6 +167,65 @@ void Server::InitConfigFile()
 
 		_configFile.Set(NetworkSection, IPv4Setting, IPv4SettingValue);
 		_configFile.Set(NetworkSection, PortSetting, PortSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			WorkersSetting,
+			WorkersSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			IOBackendSetting,
+			IOBackendSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			HandshakeTimeoutSetting,
+			HandshakeTimeoutSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			BacklogSetting,
+			BacklogSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			MaxConnectionsSetting,
+			MaxConnectionsSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			MaxConnectionsPerIPSetting,
+			MaxConnectionsPerIPSettingValue);
+		_configFile.Set(
+			NetworkSection,
+			MaxUnauthenticatedSetting,
+			MaxUnauthenticatedSettingValue);
+
+		_configFile.Set(
+			MemorySection,
+			MemoryBudgetSetting,
+			MemoryBudgetSettingValue);
+		_configFile.Set(
+			MemorySection,
+			SpillThresholdSetting,
+			SpillThresholdSettingValue);
+
+		_configFile.Set(
+			StorageSection,
+			StorageEngineSetting,
+			StorageEngineSettingValue);
+		_configFile.Set(
+			StorageSection,
+			CommitIntervalSetting,
+			CommitIntervalSettingValue);
+		_configFile.Set(
+			StorageSection,
+			CommitBatchSetting,
+			CommitBatchSettingValue);
+
+		_configFile.Set(
+			UsersSection,
+			FlushIntervalSetting,
+			FlushIntervalSettingValue);
+		_configFile.Set(
+			UsersSection,
+			ClockSkewSetting,
+			ClockSkewSettingValue);
 
 		_configFile.Set(
 			FailBanSection,
@@ -142,6 +247,11 @@ void Server::InitConfigFile()
 void Server::LoadConfig()
 {
 	LoadRestrictedMode();
+	LoadHandshakeTimeout();
+	LoadConnectionLimits();
+	LoadMemoryBudget();
+	LoadFlushInterval();
+	LoadJournal();
 	LoadFailBan();
 }
 
@@ -151,8 +261,9 @@ void Server::ReloadConfigFile()
 		_configFile.Reload();
 
 		LoadConfig();
-		CloseUserSocket();
-		OpenUserSocket();
+		ArmCooldownTimer();
+		FlushAccessTimes();
+		ReopenUserSockets();
 	} catch (Exception &ex) {
 		Log("Failed to reload config file.");
 		Log(ex.Message());
@@ -196,385 +307,484 @@ void Server::LoadFailBan()
 	_failBanCooldownInterval = cooldownInterval;
 }
 
-void Server::LoadRestrictedMode()
+void Server::ArmCooldownTimer()
 {
-	String restrictedModeValue = _configFile.Get("", RestrictedModeSetting);
-
-	if (restrictedModeValue == "Yes") {
-		_restrictedMode = true;
-	} else if (restrictedModeValue == "No") {
-		_restrictedMode = false;
-	} else {
-		THROW("Invalid RestrictedMode value. "
-			"Expected 'Yes' or 'No'.");
-	}
-
+	_control->AddTimer(
+		&_cooldownTimer,
+		_control->GetTime() + _failBanCooldownInterval * 1000);
 }
 
-void Server::GetPassword()
+void Server::LoadFlushInterval()
 {
-	// Password file.
-	int passFd = open("talkd.shadow", O_RDONLY);
-
-	if (passFd == -1) {
-		passFd = 0;
-		// Request password from stdin.
-		const char *prompt = "Enter password: ";
-
-		int res = write(1, prompt, strlen(prompt));
+	String value = _configFile.Get(UsersSection, FlushIntervalSetting);
 
-		if (res != (int)strlen(prompt)) {
-			THROW("Failed to ask for password.");
-		}
+	if (value.Length() == 0) {
+		value = FlushIntervalSettingValue;
 	}
 
-	String buffer;
+	int64_t interval = atoll(value.CStr());
 
-	while (buffer.Length() < 100000) {
-		char c;
+	if (interval <= 0) {
+		THROW("Users.FlushInterval value must be positive integer.");
+	}
 
-		int res = read(passFd, &c, 1);
+	_flushInterval = interval;
 
-		if (res <= 0 || c == '\n') {
-			break;
-		}
+	value = _configFile.Get(UsersSection, ClockSkewSetting);
 
-		buffer += c;
+	if (value.Length() == 0) {
+		value = ClockSkewSettingValue;
 	}
 
-	if (passFd) {
-		close(passFd);
-	}
+	int64_t skew = atoll(value.CStr());
 
-	if (buffer.Length() == 0) {
-		THROW("Empty password is not allowed.");
+	if (skew < 0) {
+		THROW("Users.ClockSkew value must be non-negative integer.");
 	}
 
-	GenerateKeys(buffer.CStr());
-	buffer.Wipe();
+	_userDb.SetClockSkew(skew);
 }
 
-void Server::GenerateKeys(const char *password)
+// Each flush allows buffering of access times until the next one.
+void Server::FlushAccessTimes()
 {
-	uint8_t salt[SALT_SIZE];
-	GetSalt("talkd.salt", salt);
-	DeriveKey(password, salt, _privateKey);
-	crypto_wipe(salt, SALT_SIZE);
-	GeneratePublicKey(_privateKey, _publicKey);
+	_userDb.FlushAccessTimes(GetUnixTime() + _flushInterval);
+
+	_control->AddTimer(
+		&_flushTimer,
+		_control->GetTime() + _flushInterval * 1000);
 }
 
-void Server::WipeKeys()
+void Server::LogAccessTimeStatistics()
 {
-	crypto_wipe(_privateKey, KEY_SIZE);
-	crypto_wipe(_publicKey, KEY_SIZE);
+	UserDB::AccessTimeStatistics statistics;
+	_userDb.GetAccessTimeStatistics(statistics);
+
+	int64_t coalesced = statistics.Updates - statistics.Immediate -
+		statistics.Written;
+
+	StringBuilder message;
+	message.Append("Access times: ");
+	message.AppendInt(statistics.Updates);
+	message.Append(" updates, ");
+	message.AppendInt(statistics.Immediate);
+	message.Append(" written at once, ");
+	message.AppendInt(statistics.Written);
+	message.Append(" written in ");
+	message.AppendInt(statistics.Flushes);
+	message.Append(" flushes, ");
+	message.AppendInt(coalesced);
+	message.Append(" coalesced.");
+
+	Log(message.Build());
 }
 
-void Server::OpenListeningSockets()
+void Server::TimerExpired(Timer *timer)
 {
-	OpenUserSocket();
-	OpenControlSocket();
+	if (timer == &_flushTimer) {
+		FlushAccessTimes();
+		return;
+	}
+
+	_failBan.Cooldown();
+	ArmCooldownTimer();
 }
 
-void Server::CloseListeningSockets()
+void Server::LoadRestrictedMode()
 {
-	CloseUserSocket();
-	CloseControlSocket();
+	String restrictedModeValue = _configFile.Get("", RestrictedModeSetting);
+
+	// Read by workers without locking.
+	if (restrictedModeValue == "Yes") {
+		__atomic_store_n(&_restrictedMode, true, __ATOMIC_RELAXED);
+	} else if (restrictedModeValue == "No") {
+		__atomic_store_n(&_restrictedMode, false, __ATOMIC_RELAXED);
+	} else {
+		THROW("Invalid RestrictedMode value. "
+			"Expected 'Yes' or 'No'.");
+	}
+
 }
 
-void Server::OpenUserSocket()
+void Server::LoadHandshakeTimeout()
 {
-	uint16_t port = atoi(
-		_configFile.Get(NetworkSection, PortSetting).CStr());
+	String value = _configFile.Get(NetworkSection, HandshakeTimeoutSetting);
 
-	if (port == 0) {
-		THROW("Invalid port number.");
+	// Missing value means default timeout.
+	if (value.Length() == 0) {
+		value = HandshakeTimeoutSettingValue;
 	}
 
-	struct sockaddr_in addr;
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(port);
-	int res = inet_aton(
-		_configFile.Get(NetworkSection, IPv4Setting).CStr(),
-		&addr.sin_addr);
+	int64_t timeout = atoi(value.CStr());
 
-	if (!res) {
-		THROW("Invalid IPv4 address.");
+	if (timeout <= 0) {
+		THROW("Network.HandshakeTimeout value must be positive "
+			"integer.");
 	}
 
-	_listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
+	// Read by workers without locking.
+	__atomic_store_n(&_handshakeTimeout, timeout, __ATOMIC_RELAXED);
+}
+
+// Reads non-negative integer setting of network section.
+// Missing value means default.
+int64_t Server::GetNetworkLimit(const char *setting, const char *defaultValue)
+{
+	String value = _configFile.Get(NetworkSection, setting);
 
-	if (_listeningSocket == -1) {
-		THROW("Failed to create listening socket.");
+	if (value.Length() == 0) {
+		value = defaultValue;
 	}
 
-	res = bind(_listeningSocket, (struct sockaddr*)&addr, sizeof(addr));
+	int64_t limit = atoll(value.CStr());
 
-	if (res == -1) {
-		CloseUserSocket();
-		THROW("Failed to bind listening socket.");
+	if (limit < 0) {
+		THROW(String("Network.") + setting +
+			" value must be non-negative integer.");
 	}
 
-	res = listen(_listeningSocket, 5);
+	return limit;
+}
 
-	if (res == -1) {
-		CloseUserSocket();
-		THROW("Failed to move socket to listening state.");
-	}
+void Server::LoadConnectionLimits()
+{
+	int64_t backlog = GetNetworkLimit(BacklogSetting, BacklogSettingValue);
+
+	if (backlog == 0) {
+		THROW("Network.Backlog value must be positive integer.");
+	}
+
+	_limits.SetLimits(
+		GetNetworkLimit(
+			MaxConnectionsSetting,
+			MaxConnectionsSettingValue),
+		GetNetworkLimit(
+			MaxConnectionsPerIPSetting,
+			MaxConnectionsPerIPSettingValue),
+		GetNetworkLimit(
+			MaxUnauthenticatedSetting,
+			MaxUnauthenticatedSettingValue));
+
+	// Read by workers without locking. Applied when listening sockets
+	// are opened.
+	__atomic_store_n(&_backlog, backlog, __ATOMIC_RELAXED);
 }
 
-void Server::OpenControlSocket()
+// Budget is set in megabytes, missing value means no limit.
+void Server::LoadMemoryBudget()
 {
-	_controlSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	String value = _configFile.Get(MemorySection, MemoryBudgetSetting);
 
-	if (_controlSocket == -1) {
-		THROW("Failed to create control socket.");
+	if (value.Length() == 0) {
+		value = MemoryBudgetSettingValue;
 	}
 
-	struct sockaddr_un addr;
-	addr.sun_family = AF_UNIX;
-	strncpy(
-		addr.sun_path,
-		TALKD_SOCKET_NAME,
-		sizeof(addr.sun_path) - 1);
+	int64_t budget = atoll(value.CStr());
 
-	int res = bind(_controlSocket, (struct sockaddr*)&addr, sizeof(addr));
+	if (budget < 0) {
+		THROW("Memory.Budget value must be non-negative integer.");
+	}
 
-	if (res == -1) {
-		CloseControlSocket();
-		THROW("Failed to bind control socket.");
+	_memory.SetLimit(budget * 1024 * 1024);
+
+	value = _configFile.Get(MemorySection, SpillThresholdSetting);
+
+	if (value.Length() == 0) {
+		value = SpillThresholdSettingValue;
 	}
 
-	res = listen(_controlSocket, 5);
+	int64_t threshold = atoll(value.CStr());
 
-	if (res == -1) {
-		CloseControlSocket();
-		THROW("Failed to move control socket to listening state.");
+	if (threshold < 0) {
+		THROW("Memory.SpillThreshold value must be non-negative "
+			"integer.");
 	}
+
+	__atomic_store_n(
+		&_spillThreshold,
+		threshold * 1024 * 1024,
+		__ATOMIC_RELAXED);
 }
 
-void Server::CloseUserSocket()
+void Server::LoadWorkerCount()
 {
-	if (_listeningSocket != -1) {
-		close(_listeningSocket);
-		_listeningSocket = -1;
+	// Missing value means one worker per CPU.
+	int workerCount = atoi(
+		_configFile.Get(NetworkSection, WorkersSetting).CStr());
+
+	if (workerCount < 0) {
+		THROW("Network.Workers value must be non-negative integer.");
+	}
+
+	if (workerCount == 0) {
+		workerCount = sysconf(_SC_NPROCESSORS_ONLN);
 	}
+
+	if (workerCount <= 0) {
+		workerCount = 1;
+	}
+
+	_workerCount = workerCount;
 }
 
-void Server::CloseControlSocket()
+void Server::LoadIOBackend()
 {
-	if (_controlSocket != -1) {
-		close(_controlSocket);
-		unlink(TALKD_SOCKET_NAME);
-		_controlSocket = -1;
+	String value = _configFile.Get(NetworkSection, IOBackendSetting);
+
+	// Missing value means epoll.
+	if (value == "epoll" || value.Length() == 0) {
+		_shared.Backend = IOBackend::TypeEpoll;
+	} else if (value == "io_uring") {
+		_shared.Backend = IOBackend::TypeUring;
+	} else {
+		THROW("Invalid Network.IOBackend value. "
+			"Expected 'epoll' or 'io_uring'.");
 	}
 }
 
-void Server::CloseSessions(Session *sessions)
+// Missing value means files, so existing storage is used as it is
+// until it is converted.
+void Server::LoadStorageEngine()
 {
-	while (sessions) {
-		--_activeUsers;
+	String value = _configFile.Get(StorageSection, StorageEngineSetting);
 
-		Session *tmp = sessions;
-		sessions = sessions->Next;
-		delete tmp;
+	if (value == "files" || value.Length() == 0) {
+		_shared.Storage = StorageEngine::TypeFiles;
+	} else if (value == "segments") {
+		_shared.Storage = StorageEngine::TypeSegments;
+	} else {
+		THROW("Invalid Storage.Engine value. "
+			"Expected 'files' or 'segments'.");
 	}
 }
 
-void Server::AcceptConnection()
+// Missing values mean defaults. Zero interval means that a batch is
+// committed as soon as the previous one is done.
+void Server::LoadJournal()
 {
-	struct sockaddr_in addr;
-	unsigned int addrSize = sizeof(addr);
-
-	int fd = accept(_listeningSocket, (struct sockaddr*)&addr, &addrSize);
+	String value = _configFile.Get(StorageSection, CommitIntervalSetting);
 
-	if (fd == -1) {
-		return;
+	if (value.Length() == 0) {
+		value = CommitIntervalSettingValue;
 	}
 
-	bool allowed = _failBan.IsAllowed(addr.sin_addr.s_addr);
+	int64_t interval = atoll(value.CStr());
 
-	if (!allowed) {
-		shutdown(fd, SHUT_RDWR);
-		close(fd);
-		return;
+	if (interval < 0) {
+		THROW("Storage.CommitInterval value must be non-negative "
+			"integer.");
 	}
 
-	bool res = MakeNonblocking(fd);
+	value = _configFile.Get(StorageSection, CommitBatchSetting);
 
-	if (!res) {
-		Log("Error: Failed to set NONBLOCK flag on socket.");
-		shutdown(fd, SHUT_RDWR);
-		close(fd);
-		return;
+	if (value.Length() == 0) {
+		value = CommitBatchSettingValue;
 	}
 
-	++_activeUsers;
+	int64_t batch = atoll(value.CStr());
 
-	ServerSession *session = new ServerSession;
-	session->Socket = fd;
-
-	session->Users = &_userDb;
-	session->Pipe = &_pipe;
-	session->Ban = &_failBan;
-	session->IPv4 = addr.sin_addr.s_addr;
-	session->RestrictedMode = &_restrictedMode;
-	session->State = ServerSession::ServerStateWaitFirstSyn;
-	session->SignatureKey = nullptr;
-	session->PeerPublicKey = nullptr;
-	session->PublicKey = _publicKey;
-	session->PrivateKey = _privateKey;
-	session->VoiceState = ServerSession::VoiceStateInactive;
-	session->VoicePeer = nullptr;
+	if (batch <= 0) {
+		THROW("Storage.CommitBatch value must be positive integer.");
+	}
 
-	session->Next = _sessionFirst;
-	_sessionFirst = session;
+	_journal.SetCommitInterval(interval);
+	_journal.SetBatchSize(batch);
 }
 
-void Server::AcceptControl()
+// Messages committed by the previous run are stored before users can
+// connect.
+void Server::RecoverJournal()
 {
-	int fd = accept(_controlSocket, nullptr, nullptr);
+	int64_t messageCount = _journal.Recover();
 
-	if (fd == -1) {
+	if (!messageCount) {
 		return;
 	}
 
-	++_activeUsers;
+	StringBuilder message;
+	message.Append("Recovered ");
+	message.AppendInt(messageCount);
+	message.Append(" messages from journal.");
 
-	ControlSession *session = new ControlSession;
-	session->Socket = fd;
+	Log(message.Build());
+}
+
+void Server::LogCommitStatistics()
+{
+	MessageJournal::CommitStatistics statistics;
+	_journal.GetCommitStatistics(statistics);
 
-	session->Users = &_userDb;
-	session->Ban = &_failBan;
-	session->Work = &_work;
-	session->Reload = &_reload;
-	session->PublicKey = _publicKey;
+	StringBuilder message;
+	message.Append("Journal: ");
+	message.AppendInt(statistics.Messages);
+	message.Append(" messages in ");
+	message.AppendInt(statistics.Commits);
+	message.Append(" commits.");
 
-	session->Next = _sessionFirst;
-	_sessionFirst = session;
+	Log(message.Build());
 }
 
-bool Server::MakeNonblocking(int fd)
+void Server::ConvertStorage()
 {
-	int flags = fcntl(fd, F_GETFL);
+	int64_t messageCount = ConvertStorageToSegments();
+	printf("Converted %ld messages.\n", messageCount);
 
-	if (flags == -1) {
-		return false;
-	}
-
-	flags = flags | O_NONBLOCK;
-	int res = fcntl(fd, F_SETFL, flags);
+	IniFile configFile("talkd.conf");
 
-	if (res == -1) {
-		return false;
+	if (FileExists(configFile.GetPath())) {
+		configFile.Set(
+			StorageSection,
+			StorageEngineSetting,
+			StorageEngineSettingValue);
+		configFile.Write();
 	}
-
-	return true;
 }
 
-struct pollfd *Server::BuildPollFds(int &fdCount)
+void Server::GetPassword()
 {
-	int specialSocketCount =
-		(_listeningSocket != -1 ? 1 : 0) +
-		(_controlSocket != -1 ? 1 : 0);
+	// Password file.
+	int passFd = open("talkd.shadow", O_RDONLY);
 
-	struct pollfd *fds = new struct pollfd[
-		_activeUsers + specialSocketCount];
+	if (passFd == -1) {
+		passFd = 0;
+		// Request password from stdin.
+		const char *prompt = "Enter password: ";
 
-	int index = 0;
+		int res = write(1, prompt, strlen(prompt));
 
-	if (_listeningSocket != -1) {
-		fds[index].fd = _listeningSocket;
-		fds[index].events = POLLIN;
-		++index;
+		if (res != (int)strlen(prompt)) {
+			THROW("Failed to ask for password.");
+		}
 	}
 
-	if (_controlSocket != -1) {
-		fds[index].fd = _controlSocket;
-		fds[index].events = POLLIN;
-		++index;
-	}
+	String buffer;
 
-	Session *session = _sessionFirst;
+	while (buffer.Length() < 100000) {
+		char c;
 
-	while (session) {
-		fds[index].fd = session->Socket;
+		int res = read(passFd, &c, 1);
 
-		if (session->CanWrite()) {
-			fds[index].events = POLLIN | POLLOUT;
-		} else {
-			fds[index].events = POLLIN;
+		if (res <= 0 || c == '\n') {
+			break;
 		}
 
-		++index;
-		session = session->Next;
+		buffer += c;
 	}
 
-	fdCount = index;
+	if (passFd) {
+		close(passFd);
+	}
 
-	return fds;
+	if (buffer.Length() == 0) {
+		THROW("Empty password is not allowed.");
+	}
+
+	GenerateKeys(buffer.CStr());
+	buffer.Wipe();
 }
 
-void Server::ProcessPollFds(struct pollfd *fds, bool updateTime)
+void Server::GenerateKeys(const char *password)
 {
-	Session **session = &_sessionFirst;
+	uint8_t salt[SALT_SIZE];
+	GetSalt("talkd.salt", salt);
+	DeriveKey(password, salt, _privateKey);
+	crypto_wipe(salt, SALT_SIZE);
+	GeneratePublicKey(_privateKey, _publicKey);
+}
 
-	int index =
-		(_listeningSocket != -1 ? 1 : 0) +
-		(_controlSocket != -1 ? 1 : 0);
+void Server::WipeKeys()
+{
+	crypto_wipe(_privateKey, KEY_SIZE);
+	crypto_wipe(_publicKey, KEY_SIZE);
+}
 
-	while (*session)
-	{
-		bool endSession = (fds[index].revents & POLLNVAL);
+void Server::CreateWorkers()
+{
+	_control = new Worker(&_shared);
+	_shared.Control = _control;
+	_workers = new Worker*[_workerCount];
 
-		if (!endSession && (fds[index].revents & POLLOUT)) {
-			endSession = !(*session)->Write();
-		}
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i] = new Worker(&_shared);
+	}
+}
 
-		if (!endSession &&
-			(fds[index].revents & (POLLIN | POLLHUP | POLLERR)))
-		{
-			endSession = !(*session)->Read();
-		}
+void Server::DestroyWorkers()
+{
+	StopWorkers();
 
-		if (!endSession && (*session)->CanReceive()) {
-			endSession = !(*session)->Process();
-		}
+	// Sessions notify voice peers of other workers on removal,
+	// so all mailboxes must exist until all sessions are closed.
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i]->CloseSessions();
+	}
 
-		if (!endSession && updateTime) {
-			endSession = !(*session)->TimePassed();
-		}
+	_control->CloseSessions();
 
-		if (endSession) {
-			Session *sessionToRm = *session;
+	for (int i = 0; i < _workerCount; i++) {
+		delete _workers[i];
+	}
 
-			*session = (*session)->Next;
+	delete[] _workers;
+	delete _control;
+}
 
-			sessionToRm->Next = nullptr;
-			CloseSessions(sessionToRm);
-		} else {
-			session = &((*session)->Next);
-		}
+void Server::StartWorkers()
+{
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i]->Start();
+	}
+}
 
-		++index;
+void Server::StopWorkers()
+{
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i]->Stop();
 	}
 
-	index = 0;
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i]->Join();
+	}
+}
 
-	if (_listeningSocket != -1) {
-		if (fds[index].revents & POLLIN) {
-			AcceptConnection();
-		}
+void Server::GetUserAddress(struct sockaddr_in &address)
+{
+	uint16_t port = atoi(
+		_configFile.Get(NetworkSection, PortSetting).CStr());
 
-		++index;
+	if (port == 0) {
+		THROW("Invalid port number.");
 	}
 
-	if (_controlSocket != -1) {
-		if (fds[index].revents & POLLIN) {
-			AcceptControl();
-		}
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	int res = inet_aton(
+		_configFile.Get(NetworkSection, IPv4Setting).CStr(),
+		&address.sin_addr);
 
-		++index;
+	if (!res) {
+		THROW("Invalid IPv4 address.");
 	}
+}
 
-	delete[] fds;
+void Server::OpenListeningSockets()
+{
+	struct sockaddr_in address;
+	GetUserAddress(address);
+
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i]->OpenUserSocket(address);
+	}
+
+	_control->OpenControlSocket();
+}
+
+void Server::ReopenUserSockets()
+{
+	struct sockaddr_in address;
+	GetUserAddress(address);
+
+	for (int i = 0; i < _workerCount; i++) {
+		_workers[i]->ReopenUserSocket(address);
+	}
 }
@@ -4,11 +4,15 @@
 #include "UserDB.hpp"
 #include "MessagePipe.hpp"
 #include "FailBan.hpp"
+#include "KeyLock.hpp"
+#include "MessageJournal.hpp"
+#include "ConnectionLimits.hpp"
+#include "MemoryBudget.hpp"
+#include "Worker.hpp"
 #include "../Common/IniFile.hpp"
-#include "../Protocol/Session.hpp"
 #include "../Crypto/CryptoDefinitions.hpp"
 
-class Server
+class Server : public TimerHandler
 {
 public:
 	Server();
@@ -16,17 +20,27 @@ public:
 
 	int Run();
 
+	// Converts message storage in working directory to segments
+	// and switches the server to them.
+	static void ConvertStorage();
+
 private:
 	UserDB _userDb;
 	MessagePipe _pipe;
+	KeyLock _storageLock;
+	MessageJournal _journal;
+
+	WorkerShared _shared;
 
-	Session *_sessionFirst;
+	// Serves control socket in the main thread.
+	Worker *_control;
+
+	Worker **_workers;
+	int _workerCount;
 
 	bool _work;
 	bool _reload;
 
-	int _activeUsers;
-
 	IniFile _configFile;
 	void InitConfigFile();
 	void LoadConfig();
@@ -34,38 +48,54 @@ private:
 
 	FailBan _failBan;
 	int64_t _failBanCooldownInterval;
+	Timer _cooldownTimer;
 	void LoadFailBan();
+	void ArmCooldownTimer();
+	void TimerExpired(Timer *timer) override;
 
 	bool _restrictedMode;
 	void LoadRestrictedMode();
 
-	uint8_t _privateKey[KEY_SIZE];
-	uint8_t _publicKey[KEY_SIZE];
+	int64_t _handshakeTimeout;
+	void LoadHandshakeTimeout();
 
-	int _listeningSocket;
-	int _controlSocket;
+	ConnectionLimits _limits;
+	int64_t _backlog;
+	int64_t GetNetworkLimit(const char *setting, const char *defaultValue);
+	void LoadConnectionLimits();
 
-	void GetPassword();
-	void GenerateKeys(const char *password);
-	void WipeKeys();
+	MemoryBudget _memory;
+	int64_t _spillThreshold;
+	void LoadMemoryBudget();
 
-	void OpenListeningSockets();
-	void CloseListeningSockets();
-	void OpenUserSocket();
-	void OpenControlSocket();
-	void CloseUserSocket();
-	void CloseControlSocket();
+	int64_t _flushInterval;
+	Timer _flushTimer;
+	void LoadFlushInterval();
+	void FlushAccessTimes();
+	void LogAccessTimeStatistics();
 
-	void CloseSessions(Session *sessions);
+	void LoadWorkerCount();
+	void LoadIOBackend();
+	void LoadStorageEngine();
+	void LoadJournal();
+	void RecoverJournal();
+	void LogCommitStatistics();
 
-	void AcceptConnection();
-	void AcceptControl();
+	uint8_t _privateKey[KEY_SIZE];
+	uint8_t _publicKey[KEY_SIZE];
 
-	bool MakeNonblocking(int fd);
+	void GetPassword();
+	void GenerateKeys(const char *password);
+	void WipeKeys();
 
-	struct pollfd *BuildPollFds(int &fdCount);
-	void ProcessPollFds(struct pollfd *fds, bool updateTime);
+	void CreateWorkers();
+	void DestroyWorkers();
+	void StartWorkers();
+	void StopWorkers();
 
+	void GetUserAddress(struct sockaddr_in &address);
+	void OpenListeningSockets();
+	void ReopenUserSockets();
 };
 
 #endif
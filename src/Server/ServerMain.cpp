@@ -114,6 +114,9 @@ int main(int argc, char **argv)
 		if (argc == 2) {
 			if (!strcmp(argv[1], "--noD")) {
 				daemonize = false;
+			} else if (!strcmp(argv[1], "--convert-storage")) {
+				Server::ConvertStorage();
+				return 0;
 			} else {
 				return 1;
 			}
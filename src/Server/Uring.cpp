@@ -0,0 +1,713 @@
+#include "Uring.hpp"
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "../Common/Exception.hpp"
+
+static int Setup(uint32_t entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int Enter(
+	int fd,
+	uint32_t toSubmit,
+	uint32_t minComplete,
+	uint32_t flags,
+	void *arg,
+	uint64_t argSize)
+{
+	return syscall(
+		__NR_io_uring_enter,
+		fd,
+		toSubmit,
+		minComplete,
+		flags,
+		arg,
+		argSize);
+}
+
+static int Register(int fd, uint32_t opcode, void *arg, uint32_t count)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+Uring::Uring()
+{
+	_sqRing = nullptr;
+	_cqRing = nullptr;
+	_sqes = nullptr;
+	_bufRing = nullptr;
+	_buffers = nullptr;
+
+	_entries = nullptr;
+	_entryCount = 0;
+	_freeEntry = -1;
+
+	_ready = nullptr;
+	_readyCount = 0;
+
+	_pending = nullptr;
+	_pendingCount = 0;
+
+	_backlog = false;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = QueueSize * 4;
+
+	_fd = Setup(QueueSize, &params);
+
+	if (_fd == -1) {
+		THROW("Failed to create io_uring instance.");
+	}
+
+	uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+		IORING_FEAT_EXT_ARG;
+
+	if ((params.features & required) != required) {
+		close(_fd);
+		THROW("Required io_uring features are not supported.");
+	}
+
+	try {
+		_sqRingSize = params.sq_off.array +
+			params.sq_entries * sizeof(uint32_t);
+		_cqRingSize = params.cq_off.cqes +
+			params.cq_entries * sizeof(struct io_uring_cqe);
+		_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+		Map();
+
+		_sqHead = (uint32_t*)(_sqRing + params.sq_off.head);
+		_sqTail = (uint32_t*)(_sqRing + params.sq_off.tail);
+		_sqMask = (uint32_t*)(_sqRing + params.sq_off.ring_mask);
+		_sqArray = (uint32_t*)(_sqRing + params.sq_off.array);
+		_sqEntries = params.sq_entries;
+		_sqLocalTail = *_sqTail;
+
+		_cqHead = (uint32_t*)(_cqRing + params.cq_off.head);
+		_cqTail = (uint32_t*)(_cqRing + params.cq_off.tail);
+		_cqMask = (uint32_t*)(_cqRing + params.cq_off.ring_mask);
+		_cqes = (struct io_uring_cqe*)(_cqRing + params.cq_off.cqes);
+
+		RegisterBuffers();
+		Probe();
+	} catch (Exception&) {
+		Unmap();
+		close(_fd);
+		throw;
+	}
+}
+
+Uring::~Uring()
+{
+	Unmap();
+	close(_fd);
+
+	delete[] _entries;
+	delete[] _ready;
+	delete[] _pending;
+}
+
+void Uring::AddSocket(int fd, void *data)
+{
+	int index = AddEntry(data, nullptr, fd);
+	ArmIn(index);
+}
+
+void Uring::RemoveSocket(int fd)
+{
+	for (int i = 0; i < _entryCount; i++) {
+		Entry &entry = _entries[i];
+
+		if (entry.Used && !entry.Owner && entry.Fd == fd) {
+			RemoveEntry(i);
+			return;
+		}
+	}
+}
+
+void Uring::AddSession(Session *session)
+{
+	int index = AddEntry(session, session, session->Socket);
+
+	session->BackendSlot = index;
+	session->Observer = this;
+	session->Input.SetExternal(true);
+
+	ArmIn(index);
+	UpdateSession(session);
+}
+
+void Uring::RemoveSession(Session *session)
+{
+	session->Observer = nullptr;
+
+	if (session->BackendSlot == -1) {
+		return;
+	}
+
+	RemoveEntry(session->BackendSlot);
+	session->BackendSlot = -1;
+}
+
+void Uring::UpdateSession(Session *session)
+{
+	if (session->Closed() || session->BackendSlot == -1) {
+		return;
+	}
+
+	int index = session->BackendSlot;
+	Entry &entry = _entries[index];
+
+	// Receive is restarted when its cancellation completes.
+	if (session->InputPaused != entry.InPaused) {
+		entry.InPaused = session->InputPaused;
+
+		if (entry.InPaused && entry.InArmed) {
+			Cancel(index, OperationRecv);
+		} else if (!entry.InPaused && !entry.InArmed) {
+			ArmIn(index);
+		}
+	}
+
+	session->ReadEvents = !entry.InPaused;
+	session->WriteEvents = session->CanWrite();
+
+	if (!session->WriteEvents || entry.OutArmed || entry.WritePending) {
+		return;
+	}
+
+	// Output left after a write means the socket is full. Output
+	// queued to idle socket is written on the next iteration without
+	// waiting for poll completion.
+	if (entry.Ready && entry.Writable) {
+		ArmOut(index);
+	} else {
+		entry.WritePending = true;
+		_pending[_pendingCount++] = index;
+	}
+}
+
+int Uring::Wait(int timeout)
+{
+	for (int i = 0; i < _readyCount; i++) {
+		Entry &entry = _entries[_ready[i]];
+		entry.Ready = false;
+		entry.Readable = false;
+		entry.Writable = false;
+	}
+
+	_readyCount = 0;
+
+	Submit(true, _pendingCount || _backlog ? 0 : timeout);
+	_backlog = ProcessCompletions();
+
+	for (int i = 0; i < _pendingCount; i++) {
+		int index = _pending[i];
+
+		if (_entries[index].WritePending) {
+			_entries[index].WritePending = false;
+			MarkReady(index, false, true);
+		}
+	}
+
+	_pendingCount = 0;
+
+	return _readyCount;
+}
+
+void *Uring::GetData(int index)
+{
+	return _entries[_ready[index]].Data;
+}
+
+bool Uring::IsReadable(int index)
+{
+	return _entries[_ready[index]].Readable;
+}
+
+bool Uring::IsWritable(int index)
+{
+	return _entries[_ready[index]].Writable;
+}
+
+void Uring::OutputQueued(Session *session)
+{
+	UpdateSession(session);
+}
+
+void Uring::InputChanged(Session *session)
+{
+	UpdateSession(session);
+}
+
+void Uring::Map()
+{
+	_sqRingSize = _sqRingSize > _cqRingSize ? _sqRingSize : _cqRingSize;
+	_cqRingSize = _sqRingSize;
+
+	void *ring = mmap(
+		nullptr,
+		_sqRingSize,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE,
+		_fd,
+		IORING_OFF_SQ_RING);
+
+	if (ring == MAP_FAILED) {
+		THROW("Failed to map io_uring queues.");
+	}
+
+	_sqRing = (uint8_t*)ring;
+	_cqRing = _sqRing;
+
+	void *sqes = mmap(
+		nullptr,
+		_sqesSize,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE,
+		_fd,
+		IORING_OFF_SQES);
+
+	if (sqes == MAP_FAILED) {
+		THROW("Failed to map io_uring submission entries.");
+	}
+
+	_sqes = (struct io_uring_sqe*)sqes;
+}
+
+void Uring::Unmap()
+{
+	if (_buffers) {
+		munmap(_buffers, (uint64_t)BufferCount * BufferSize);
+		_buffers = nullptr;
+	}
+
+	if (_bufRing) {
+		munmap(_bufRing, _bufRingSize);
+		_bufRing = nullptr;
+	}
+
+	if (_sqes) {
+		munmap(_sqes, _sqesSize);
+		_sqes = nullptr;
+	}
+
+	if (_sqRing) {
+		munmap(_sqRing, _sqRingSize);
+		_sqRing = nullptr;
+		_cqRing = nullptr;
+	}
+}
+
+void Uring::RegisterBuffers()
+{
+	_bufRingSize = BufferCount * sizeof(struct io_uring_buf);
+
+	void *ring = mmap(
+		nullptr,
+		_bufRingSize,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS,
+		-1,
+		0);
+
+	if (ring == MAP_FAILED) {
+		THROW("Failed to allocate buffer ring.");
+	}
+
+	// Ring tail overlays reserved field of the first buffer.
+	// Structure from the kernel header is not used, its flexible array
+	// has different layout in C++.
+	_bufRing = (struct io_uring_buf*)ring;
+	_bufRingTail = &_bufRing[0].resv;
+
+	void *buffers = mmap(
+		nullptr,
+		(uint64_t)BufferCount * BufferSize,
+		PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS,
+		-1,
+		0);
+
+	if (buffers == MAP_FAILED) {
+		THROW("Failed to allocate receive buffers.");
+	}
+
+	_buffers = (uint8_t*)buffers;
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)_bufRing;
+	reg.ring_entries = BufferCount;
+	reg.bgid = BufferGroup;
+
+	int res = Register(_fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+
+	if (res == -1) {
+		THROW("Failed to register buffer ring.");
+	}
+
+	_bufTail = 0;
+
+	for (int i = 0; i < BufferCount; i++) {
+		RecycleBuffer(i);
+	}
+}
+
+void Uring::Probe()
+{
+	// Kernels without multishot receive complete it only once.
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+		THROW("Failed to create probe sockets.");
+	}
+
+	struct io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fds[0];
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BufferGroup;
+	sqe->user_data = 0;
+
+	uint8_t byte = 0;
+	bool supported = write(fds[1], &byte, 1) == 1;
+
+	if (supported) {
+		Submit(true, 1000);
+
+		uint32_t head = *_cqHead;
+		uint32_t tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+		struct io_uring_cqe *cqe = &_cqes[head & *_cqMask];
+
+		uint32_t flags = IORING_CQE_F_MORE | IORING_CQE_F_BUFFER;
+		supported = head != tail && cqe->res == 1 &&
+			(cqe->flags & flags) == flags;
+
+		// Receive is finished by closing the sockets,
+		// its final completion is dropped as stale.
+		ProcessCompletions();
+	}
+
+	shutdown(fds[1], SHUT_RDWR);
+	close(fds[0]);
+	close(fds[1]);
+
+	if (!supported) {
+		THROW("Multishot receive is not supported.");
+	}
+}
+
+void Uring::RecycleBuffer(uint16_t id)
+{
+	struct io_uring_buf *buf = &_bufRing[_bufTail & (BufferCount - 1)];
+
+	buf->addr = (uint64_t)(_buffers + (uint64_t)id * BufferSize);
+	buf->len = BufferSize;
+	buf->bid = id;
+
+	++_bufTail;
+	__atomic_store_n(_bufRingTail, _bufTail, __ATOMIC_RELEASE);
+}
+
+int Uring::AddEntry(void *data, Session *owner, int fd)
+{
+	if (_freeEntry == -1) {
+		int newCount = _entryCount ? _entryCount * 2 : 64;
+
+		Entry *entries = new Entry[newCount];
+		int *ready = new int[newCount];
+		int *pending = new int[newCount];
+
+		if (_entryCount) {
+			memcpy(entries, _entries, sizeof(Entry) * _entryCount);
+			memcpy(ready, _ready, sizeof(int) * _readyCount);
+			memcpy(pending, _pending, sizeof(int) * _pendingCount);
+		}
+
+		for (int i = _entryCount; i < newCount; i++) {
+			entries[i].Used = false;
+			entries[i].Generation = 0;
+			entries[i].NextFree = i + 1 < newCount ? i + 1 : -1;
+		}
+
+		delete[] _entries;
+		delete[] _ready;
+		delete[] _pending;
+
+		_entries = entries;
+		_ready = ready;
+		_pending = pending;
+		_freeEntry = _entryCount;
+		_entryCount = newCount;
+	}
+
+	int index = _freeEntry;
+	Entry &entry = _entries[index];
+	_freeEntry = entry.NextFree;
+
+	entry.Data = data;
+	entry.Owner = owner;
+	entry.Fd = fd;
+	entry.Used = true;
+	entry.InArmed = false;
+	entry.OutArmed = false;
+	entry.InPaused = false;
+	entry.WritePending = false;
+	entry.Ready = false;
+	entry.Readable = false;
+	entry.Writable = false;
+
+	return index;
+}
+
+void Uring::RemoveEntry(int index)
+{
+	Entry &entry = _entries[index];
+
+	if (entry.InArmed) {
+		Cancel(index, entry.Owner ? OperationRecv : OperationPoll);
+	}
+
+	if (entry.OutArmed) {
+		Cancel(index, OperationPollOut);
+	}
+
+	// Entry can be in the list of ready entries being processed.
+	entry.Data = nullptr;
+	entry.Readable = false;
+	entry.Writable = false;
+	entry.WritePending = false;
+
+	entry.Used = false;
+	entry.Generation = (entry.Generation + 1) & 0xffffff;
+	entry.NextFree = _freeEntry;
+	_freeEntry = index;
+}
+
+struct io_uring_sqe *Uring::GetSqe()
+{
+	uint32_t head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+
+	if (_sqLocalTail - head >= _sqEntries) {
+		Submit(false, 0);
+	}
+
+	uint32_t index = _sqLocalTail & *_sqMask;
+	struct io_uring_sqe *sqe = &_sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+
+	_sqArray[index] = index;
+	++_sqLocalTail;
+
+	return sqe;
+}
+
+void Uring::Submit(bool wait, int timeout)
+{
+	uint32_t toSubmit = _sqLocalTail - *_sqTail;
+	__atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+	uint32_t flags = 0;
+	uint32_t minComplete = 0;
+
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+
+	if (wait) {
+		flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+		if (timeout) {
+			minComplete = 1;
+		}
+
+		if (timeout >= 0) {
+			ts.tv_sec = timeout / 1000;
+			ts.tv_nsec = (timeout % 1000) * 1000000LL;
+			arg.ts = (uint64_t)&ts;
+		}
+	}
+
+	if (!toSubmit && !wait) {
+		return;
+	}
+
+	int res = Enter(_fd, toSubmit, minComplete, flags, &arg, sizeof(arg));
+
+	if (res == -1) {
+		if (errno == EINTR || errno == ETIME || errno == EAGAIN ||
+			errno == EBUSY)
+		{
+			return;
+		}
+
+		THROW("Error on io_uring_enter.");
+	}
+}
+
+uint64_t Uring::UserData(int index, Operation operation)
+{
+	return (uint64_t)index |
+		(uint64_t)_entries[index].Generation << 32 |
+		(uint64_t)operation << 56;
+}
+
+void Uring::ArmIn(int index)
+{
+	Entry &entry = _entries[index];
+	struct io_uring_sqe *sqe = GetSqe();
+
+	sqe->fd = entry.Fd;
+
+	if (entry.Owner) {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = BufferGroup;
+		sqe->user_data = UserData(index, OperationRecv);
+	} else {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+		sqe->user_data = UserData(index, OperationPoll);
+	}
+
+	entry.InArmed = true;
+}
+
+void Uring::ArmOut(int index)
+{
+	Entry &entry = _entries[index];
+	struct io_uring_sqe *sqe = GetSqe();
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = entry.Fd;
+	sqe->poll32_events = POLLOUT;
+	sqe->user_data = UserData(index, OperationPollOut);
+
+	entry.OutArmed = true;
+}
+
+void Uring::Cancel(int index, Operation operation)
+{
+	struct io_uring_sqe *sqe = GetSqe();
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = UserData(index, operation);
+	sqe->user_data = UserData(index, OperationCancel);
+}
+
+// Completions are taken in bounded batches. Unprocessed receive
+// completions keep their buffers, so the kernel runs out of buffers and
+// stops receiving until sessions catch up, as epoll does with bounded
+// reads. Returns true if completions are left in the queue.
+bool Uring::ProcessCompletions()
+{
+	uint32_t head = *_cqHead;
+	uint32_t tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+	int count = 0;
+
+	while (head != tail && count < MaxCompletions) {
+		ProcessCompletion(&_cqes[head & *_cqMask]);
+		++head;
+		++count;
+	}
+
+	__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+	return head != tail;
+}
+
+void Uring::ProcessCompletion(struct io_uring_cqe *cqe)
+{
+	int index = cqe->user_data & 0xffffffff;
+	uint32_t generation = (cqe->user_data >> 32) & 0xffffff;
+	int operation = cqe->user_data >> 56;
+
+	const uint8_t *buffer = nullptr;
+	int bufferId = -1;
+
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+		bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		buffer = _buffers + (uint64_t)bufferId * BufferSize;
+	}
+
+	bool current = operation != OperationCancel &&
+		index < _entryCount &&
+		_entries[index].Used &&
+		_entries[index].Generation == generation;
+
+	if (!current) {
+		if (bufferId != -1) {
+			RecycleBuffer(bufferId);
+		}
+
+		return;
+	}
+
+	Entry &entry = _entries[index];
+	bool more = cqe->flags & IORING_CQE_F_MORE;
+
+	switch (operation) {
+	case OperationPoll:
+		entry.InArmed = false;
+		ArmIn(index);
+		MarkReady(index, true, false);
+		break;
+	case OperationPollOut:
+		entry.OutArmed = false;
+		MarkReady(index, false, true);
+		break;
+	case OperationRecv:
+		// Running out of buffers stops multishot receive,
+		// it is restarted when buffers are returned. Cancelled
+		// receive is restarted when input is resumed.
+		if (cqe->res > 0) {
+			entry.Owner->Input.Append(buffer, cqe->res);
+			MarkReady(index, true, false);
+		} else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+			entry.Owner->Input.SetEnd();
+			MarkReady(index, true, false);
+			more = true;
+		}
+
+		if (!more) {
+			entry.InArmed = false;
+
+			if (!entry.InPaused) {
+				ArmIn(index);
+			}
+		}
+
+		break;
+	}
+
+	if (bufferId != -1) {
+		RecycleBuffer(bufferId);
+	}
+}
+
+void Uring::MarkReady(int index, bool readable, bool writable)
+{
+	Entry &entry = _entries[index];
+
+	entry.Readable = entry.Readable || readable;
+	entry.Writable = entry.Writable || writable;
+
+	if (!entry.Ready) {
+		entry.Ready = true;
+		_ready[_readyCount++] = index;
+	}
+}
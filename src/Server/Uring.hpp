@@ -0,0 +1,147 @@
+#ifndef _URING_HPP
+#define _URING_HPP
+
+#include <cstdint>
+
+#include "IOBackend.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+// Event loop backend based on io_uring.
+// Sessions receive data with multishot recv into a ring of buffers
+// registered with the kernel, data is appended to Session::Input.
+// Receive of session with paused input is cancelled.
+// Plain sockets and session write readiness use one-shot polls.
+// Requests prepared during iteration are submitted together with
+// waiting for completions, so one io_uring_enter serves all sessions.
+class Uring : public IOBackend
+{
+public:
+	Uring();
+	~Uring();
+
+	void AddSocket(int fd, void *data) override;
+	void RemoveSocket(int fd) override;
+
+	void AddSession(Session *session) override;
+	void RemoveSession(Session *session) override;
+	void UpdateSession(Session *session) override;
+
+	int Wait(int timeout) override;
+
+	void *GetData(int index) override;
+	bool IsReadable(int index) override;
+	bool IsWritable(int index) override;
+
+	void OutputQueued(Session *session) override;
+	void InputChanged(Session *session) override;
+
+private:
+	enum
+	{
+		QueueSize = 1024,
+		BufferCount = 256,
+		BufferSize = 16 * 1024,
+		BufferGroup = 0,
+		MaxCompletions = BufferCount / 8
+	};
+
+	enum Operation
+	{
+		OperationPoll = 1,
+		OperationRecv = 2,
+		OperationPollOut = 3,
+		OperationCancel = 4
+	};
+
+	// Registration of socket or session.
+	// Completions carry slot index and generation, so completions of
+	// removed entries are recognized and dropped.
+	struct Entry
+	{
+		void *Data;
+		Session *Owner;
+		int Fd;
+
+		uint32_t Generation;
+		int NextFree;
+
+		bool Used;
+		bool InArmed;
+		bool OutArmed;
+		// Receive is cancelled and not restarted while session input
+		// is paused.
+		bool InPaused;
+		// Output was queued, write is tried on the next iteration.
+		bool WritePending;
+
+		bool Ready;
+		bool Readable;
+		bool Writable;
+	};
+
+	int _fd;
+
+	uint8_t *_sqRing;
+	uint8_t *_cqRing;
+	uint64_t _sqRingSize;
+	uint64_t _cqRingSize;
+
+	uint32_t *_sqHead;
+	uint32_t *_sqTail;
+	uint32_t *_sqMask;
+	uint32_t *_sqArray;
+	uint32_t _sqEntries;
+	uint32_t _sqLocalTail;
+
+	uint32_t *_cqHead;
+	uint32_t *_cqTail;
+	uint32_t *_cqMask;
+	struct io_uring_cqe *_cqes;
+
+	struct io_uring_sqe *_sqes;
+	uint64_t _sqesSize;
+
+	struct io_uring_buf *_bufRing;
+	uint16_t *_bufRingTail;
+	uint64_t _bufRingSize;
+	uint8_t *_buffers;
+	uint16_t _bufTail;
+
+	Entry *_entries;
+	int _entryCount;
+	int _freeEntry;
+
+	int *_ready;
+	int _readyCount;
+
+	int *_pending;
+	int _pendingCount;
+
+	bool _backlog;
+
+	void Map();
+	void Unmap();
+	void RegisterBuffers();
+	void Probe();
+	void RecycleBuffer(uint16_t id);
+
+	int AddEntry(void *data, Session *owner, int fd);
+	void RemoveEntry(int index);
+
+	struct io_uring_sqe *GetSqe();
+	void Submit(bool wait, int timeout);
+
+	uint64_t UserData(int index, Operation operation);
+	void ArmIn(int index);
+	void ArmOut(int index);
+	void Cancel(int index, Operation operation);
+
+	bool ProcessCompletions();
+	void ProcessCompletion(struct io_uring_cqe *cqe);
+	void MarkReady(int index, bool readable, bool writable);
+};
+
+#endif
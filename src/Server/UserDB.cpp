@@ -5,87 +5,152 @@
 #include "../ThirdParty/monocypher.h"
 #include "../Common/Debug.hpp"
 
-UserDB::UserDB() : _userFile("talkd.users", true)
+UserDB::UserDB() :
+	_userFile("talkd.users", true),
+	_floorFile("talkd.users.floor", true)
 {
-	_users = nullptr;
+	_table = nullptr;
+	_tableSize = 0;
+	_userCount = 0;
+	_keyChunks = nullptr;
+	_records = nullptr;
+	_recordCount = 0;
+	_recordCapacity = 0;
 	_freeIndices = nullptr;
-	_deletedUsers = nullptr;
-
+	_accessTimes = nullptr;
+	_dirty = nullptr;
+	_dirtyBegin = 0;
+	_dirtyEnd = 0;
+	_mapping = nullptr;
+	_mappedRecords = 0;
+	_clockSkew = 0;
+
+	memset(&_statistics, 0, sizeof(_statistics));
+
+	GenerateHashKey(_hashKey);
+	LoadFloor();
 	LoadUserData();
 }
 
 UserDB::~UserDB()
 {
+	try {
+		WriteAccessTimes();
+		WriteFloor(_timeFloor);
+	} catch (Exception &ex) {
+	}
+
 	FreeUserData();
 }
 
 bool UserDB::HasUser(const uint8_t key[KEY_SIZE])
 {
-	UserTree **data = FindEntry(key);
-	return data;
+	ReadGuard guard(_lock);
+
+	return FindUser(key);
 }
 
 const uint8_t *UserDB::GetUserPublicKey(const uint8_t key[KEY_SIZE])
 {
-	UserTree **data = FindEntry(key);
+	ReadGuard guard(_lock);
 
-	if (!data) {
+	Slot *slot = FindUser(key);
+
+	if (!slot) {
 		THROW("Requested user does not exist.");
 	}
 
-	return (*data)->Data->PublicKey;
+	return slot->Keys->PublicKey;
 }
 
 const uint8_t *UserDB::GetUserSignature(const uint8_t key[KEY_SIZE])
 {
-	UserTree **data = FindEntry(key);
+	ReadGuard guard(_lock);
+
+	Slot *slot = FindUser(key);
 
-	if (!data) {
+	if (!slot) {
 		THROW("Requested user does not exist.");
 	}
 
-	return (*data)->Data->SignaturePublicKey;
+	return slot->Keys->SignaturePublicKey;
 }
 
 int64_t UserDB::GetUserAccessTime(const uint8_t key[KEY_SIZE])
 {
-	UserTree **data = FindEntry(key);
+	ReadGuard guard(_lock);
 
-	if (!data) {
+	Slot *slot = FindUser(key);
+
+	if (!slot) {
 		THROW("Requested user does not exist.");
 	}
 
-	return (*data)->Data->AccessTime;
+	int64_t accessTime = _accessTimes[slot->Record];
+
+	return accessTime > _timeFloor ? accessTime : _timeFloor;
+}
+
+int64_t UserDB::GetTimeFloor()
+{
+	ReadGuard guard(_lock);
+	return _timeFloor;
 }
 
 String UserDB::GetUserName(const uint8_t key[KEY_SIZE])
 {
-	UserTree **data = FindEntry(key);
+	ReadGuard guard(_lock);
+
+	Slot *slot = FindUser(key);
 
-	if (!data) {
+	if (!slot) {
 		THROW("Requested user does not exist.");
 	}
 
-	return (*data)->Data->Name;
+	const char *name =
+		(const char*)GetRecord(slot->Record) + _UserNameOffset;
+
+	return String(name, strnlen(name, _MaxNameLength));
 }
 
 void UserDB::UpdateUserAccessTime(
 	const uint8_t key[KEY_SIZE],
 	int64_t accessTime)
 {
-	UserTree **data = FindEntry(key);
+	WriteGuard guard(_lock);
+
+	Slot *slot = FindUser(key);
 
-	if (!data) {
+	if (!slot) {
 		THROW("Requested user does not exist.");
 	}
 
-	(*data)->Data->AccessTime = accessTime;
+	uint32_t index = slot->Record;
+	_accessTimes[index] = accessTime;
+	_statistics.Updates++;
 
-	_userFile.Write<int64_t>(
-		&accessTime,
-		1,
-		(*data)->Data->IndexInFile * _EntrySize +
-		_UserAccessTimeOffset);
+	// Update later than the floor could be accepted again after crash.
+	if (accessTime > _fileFloor) {
+		WriteAccessTime(index);
+		_dirty[index] = 0;
+		_statistics.Immediate++;
+		return;
+	}
+
+	if (_dirty[index]) {
+		return;
+	}
+
+	_dirty[index] = 1;
+
+	if (_dirtyBegin == _dirtyEnd) {
+		_dirtyBegin = index;
+		_dirtyEnd = index + 1;
+	} else if (index < _dirtyBegin) {
+		_dirtyBegin = index;
+	} else if (index >= _dirtyEnd) {
+		_dirtyEnd = index + 1;
+	}
 }
 
 void UserDB::AddUser(
@@ -94,6 +159,12 @@ void UserDB::AddUser(
 	int64_t accessTime,
 	String name)
 {
+	WriteGuard guard(_lock);
+
+	if (FindUser(key)) {
+		THROW("Trying to add duplicate user.");
+	}
+
 	// Free index lookup.
 	uint64_t freeIndex;
 
@@ -103,315 +174,474 @@ void UserDB::AddUser(
 		_freeIndices = _freeIndices->Next;
 		delete tmp;
 	} else {
-		freeIndex = _userFile.Size() / _EntrySize;
-	}
-
-	// Write to file.
-	char *zeroBuffer = new char[_EntrySize];
-	memset(zeroBuffer, 0, _EntrySize);
-
-	_userFile.Write<char>(
-		zeroBuffer,
-		_EntrySize,
-		freeIndex * _EntrySize);
+		freeIndex = _recordCount;
 
-	delete[] zeroBuffer;
+		_userFile.Resize((_recordCount + 1) * _EntrySize);
+		MapRecords(_recordCount + 1);
+		_recordCount++;
+	}
 
-	_userFile.Write<uint8_t>(
-		key,
-		KEY_SIZE,
-		freeIndex * _EntrySize + _UserKeyOffset);
+	// Write to file. Record becomes valid when it is complete.
+	uint8_t *record = GetRecord(freeIndex);
+	memset(record, 0, _EntrySize);
 
-	_userFile.Write<uint8_t>(
+	memcpy(record + _UserKeyOffset, key, KEY_SIZE);
+	memcpy(
+		record + _UserSignatureOffset,
 		signature,
-		SIGNATURE_PUBLIC_KEY_SIZE,
-		freeIndex * _EntrySize + _UserSignatureOffset);
-
-	_userFile.Write<int64_t>(
-		&accessTime,
-		1,
-		freeIndex * _EntrySize + _UserAccessTimeOffset);
-
-	uint8_t valid = 1;
-
-	_userFile.Write<uint8_t>(
-		&valid,
-		1,
-		freeIndex * _EntrySize + _ValidOffset);
+		SIGNATURE_PUBLIC_KEY_SIZE);
+	memcpy(record + _UserAccessTimeOffset, &accessTime, sizeof(accessTime));
 
 	if (name.Length() >= _MaxNameLength) {
 		name = name.Substring(0, _MaxNameLength - 1);
 	}
 
-	_userFile.Write<char>(
-		name.CStr(),
-		name.Length() + 1,
-		freeIndex * _EntrySize + _UserNameOffset);
+	memcpy(record + _UserNameOffset, name.CStr(), name.Length() + 1);
+	record[_ValidOffset] = 1;
 
-	// Add tree entry.
-	UserData *data = new UserData;
-	data->IndexInFile = freeIndex;
+	// Add index entry.
+	UserKeys *keys = AllocateKeys();
+	memcpy(keys->PublicKey, key, KEY_SIZE);
+	memcpy(keys->SignaturePublicKey, signature, SIGNATURE_PUBLIC_KEY_SIZE);
 
-	memcpy(data->PublicKey, key, KEY_SIZE);
-	memcpy(data->SignaturePublicKey, signature, SIGNATURE_PUBLIC_KEY_SIZE);
-	data->AccessTime = accessTime;
-	data->Name = name;
+	AddRecord(freeIndex, keys, accessTime);
 
-	UserTree *entry = new UserTree;
-	entry->Data = data;
-	entry->Left = nullptr;
-	entry->Right = nullptr;
+	if ((_userCount + 1) * 2 > _tableSize) {
+		ResizeTable(_tableSize * 2);
+	}
 
-	AddEntry(&_users, entry);
+	InsertSlot(GetHash(key), freeIndex, keys);
+	_userCount++;
 }
 
 void UserDB::RemoveUser(const uint8_t key[KEY_SIZE])
 {
-	// Tree node lookup.
-	UserTree **root = FindEntry(key);
+	WriteGuard guard(_lock);
+
+	Slot *slot = FindUser(key);
 
-	if (!root) {
+	if (!slot) {
 		THROW("Requested user does not exist.");
 	}
 
 	// Erase entry in file.
-	uint8_t *buffer = new uint8_t[_EntrySize];
-	memset(buffer, 0, _EntrySize);
-
-	_userFile.Write<uint8_t>(
-		buffer,
-		_EntrySize,
-		(*root)->Data->IndexInFile * _EntrySize);
-
-	delete[] buffer;
+	uint32_t index = slot->Record;
+	memset(GetRecord(index), 0, _EntrySize);
 
 	// Add free index to list.
 	FreeIndex *idx = new FreeIndex;
-	idx->Index = (*root)->Data->IndexInFile;
+	idx->Index = index;
 	idx->Next = _freeIndices;
 	_freeIndices = idx;
 
-	// Remove tree node.
-	UserTree *deletedNode = new UserTree;
-	deletedNode->Data = (*root)->Data;
-	deletedNode->Left = nullptr;
-	deletedNode->Right = _deletedUsers;
-	_deletedUsers = deletedNode;
-
-	(*root)->Data = nullptr;
-	RemoveEntry(root);
+	// Keys stay allocated for holders of returned pointers.
+	_records[index] = nullptr;
+	_dirty[index] = 0;
+	RemoveSlot(slot);
+	_userCount--;
 }
 
 int32_t UserDB::GetUserCount()
 {
-	return GetEntryNumber(_users);
+	ReadGuard guard(_lock);
+
+	return _userCount;
 }
 
+// Users are listed in order of their records.
 CowBuffer<const uint8_t*> UserDB::ListUsers()
 {
-	int userCount = GetUserCount();
+	ReadGuard guard(_lock);
 
-	CowBuffer<const uint8_t*> data(userCount);
+	CowBuffer<const uint8_t*> data(_userCount);
+	uint64_t userCount = 0;
 
-	userCount = 0;
-	FillUserList(_users, data.Pointer(), &userCount);
+	for (uint64_t i = 0; i < _recordCount; i++) {
+		if (_records[i]) {
+			data[userCount] = _records[i]->PublicKey;
+			userCount++;
+		}
+	}
 
 	return data;
 }
 
-UserDB::UserData::~UserData()
+void UserDB::FlushAccessTimes(int64_t nextFlush)
 {
-	crypto_wipe(PublicKey, KEY_SIZE);
-	crypto_wipe(SignaturePublicKey, SIGNATURE_PUBLIC_KEY_SIZE);
+	WriteGuard guard(_lock);
+
+	WriteAccessTimes();
+
+	int64_t floor = nextFlush + _clockSkew;
+
+	if (floor > _fileFloor) {
+		WriteFloor(floor);
+	}
+
+	_statistics.Flushes++;
 }
 
-int UserDB::UserData::Compare(const uint8_t *key)
+void UserDB::SetClockSkew(int64_t skew)
 {
-	for (int i = 0; i < KEY_SIZE; i++) {
-		if (PublicKey[i] != key[i]) {
-			return (int)PublicKey[i] - (int)key[i];
+	WriteGuard guard(_lock);
+	_clockSkew = skew;
+}
+
+void UserDB::GetAccessTimeStatistics(AccessTimeStatistics &statistics)
+{
+	ReadGuard guard(_lock);
+
+	statistics = _statistics;
+}
+
+uint32_t UserDB::GetHash(const uint8_t *key)
+{
+	return KeyedHash(key, KEY_SIZE, _hashKey);
+}
+
+// Returns slot of the key or empty slot where the key belongs.
+// Keys are compared only in slots with matching hash.
+UserDB::Slot *UserDB::FindSlot(const uint8_t *key, uint32_t hash)
+{
+	uint64_t mask = _tableSize - 1;
+	uint64_t index = hash & mask;
+
+	while (true) {
+		Slot *slot = _table + index;
+
+		if (!slot->Keys) {
+			return slot;
 		}
+
+		bool found = slot->Hash == hash &&
+			!crypto_verify32(key, slot->Keys->PublicKey);
+
+		if (found) {
+			return slot;
+		}
+
+		index = (index + 1) & mask;
 	}
+}
 
-	return 0;
+UserDB::Slot *UserDB::FindUser(const uint8_t *key)
+{
+	Slot *slot = FindSlot(key, GetHash(key));
+	return slot->Keys ? slot : nullptr;
 }
 
-UserDB::UserTree::~UserTree()
+void UserDB::InsertSlot(uint32_t hash, uint32_t record, UserKeys *keys)
 {
-	if (Data) {
-		delete Data;
-	}
+	uint64_t mask = _tableSize - 1;
+	uint64_t index = hash & mask;
 
-	if (Left) {
-		delete Left;
+	while (_table[index].Keys) {
+		index = (index + 1) & mask;
 	}
 
-	if (Right) {
-		delete Right;
-	}
+	_table[index].Hash = hash;
+	_table[index].Record = record;
+	_table[index].Keys = keys;
 }
 
-UserDB::UserTree **UserDB::FindEntry(const uint8_t *key)
+// Following slots of the probe sequence are shifted back into the
+// hole, so lookups never stop early and no markers of removed slots
+// are needed.
+void UserDB::RemoveSlot(Slot *slot)
 {
-	UserTree **root = &_users;
+	uint64_t mask = _tableSize - 1;
+	uint64_t hole = slot - _table;
+	uint64_t index = hole;
 
-	while (*root) {
-		int cmp = (*root)->Data->Compare(key);
+	while (true) {
+		index = (index + 1) & mask;
 
-		if (!cmp) {
+		Slot *next = _table + index;
+
+		if (!next->Keys) {
 			break;
 		}
 
-		if (cmp < 0) {
-			root = &((*root)->Right);
-		} else {
-			root = &((*root)->Left);
+		// Slot can not move before its first probed slot.
+		uint64_t home = next->Hash & mask;
+
+		if (((index - home) & mask) >= ((index - hole) & mask)) {
+			_table[hole] = *next;
+			hole = index;
 		}
 	}
 
-	if (!*root) {
-		return nullptr;
+	_table[hole].Keys = nullptr;
+}
+
+void UserDB::ResizeTable(uint64_t size)
+{
+	Slot *table = _table;
+	uint64_t tableSize = _tableSize;
+
+	_table = new Slot[size];
+	_tableSize = size;
+
+	for (uint64_t i = 0; i < size; i++) {
+		_table[i].Keys = nullptr;
 	}
 
-	return root;
+	for (uint64_t i = 0; i < tableSize; i++) {
+		Slot &slot = table[i];
+
+		if (slot.Keys) {
+			InsertSlot(slot.Hash, slot.Record, slot.Keys);
+		}
+	}
+
+	delete[] table;
 }
 
-void UserDB::AddEntry(UserTree **root, UserTree *entry)
+UserDB::UserKeys *UserDB::AllocateKeys()
 {
-	const uint8_t *key = entry->Data->PublicKey;
+	if (!_keyChunks || _keyChunks->Used == _keyChunks->Size) {
+		AddKeyChunk(KeyChunkSize);
+	}
 
-	while (*root) {
-		int cmp = (*root)->Data->Compare(key);
+	UserKeys *keys = _keyChunks->Keys + _keyChunks->Used;
+	_keyChunks->Used++;
 
-		if (!cmp) {
-			THROW("Trying to add duplicate tree node.");
-		}
+	return keys;
+}
+
+void UserDB::AddKeyChunk(uint64_t size)
+{
+	KeyChunk *chunk = new KeyChunk;
+	chunk->Keys = new UserKeys[size];
+	chunk->Size = size;
+	chunk->Used = 0;
+	chunk->Next = _keyChunks;
 
-		if (cmp < 0) {
-			root = &((*root)->Right);
-		} else {
-			root = &((*root)->Left);
+	_keyChunks = chunk;
+}
+
+void UserDB::AddRecord(uint64_t index, UserKeys *keys, int64_t accessTime)
+{
+	if (index >= _recordCapacity) {
+		uint64_t capacity = _recordCapacity * 2;
+		UserKeys **records = new UserKeys*[capacity];
+		int64_t *accessTimes = new int64_t[capacity];
+		uint8_t *dirty = new uint8_t[capacity];
+
+		memcpy(records, _records, _recordCapacity * sizeof(UserKeys*));
+		memcpy(
+			accessTimes,
+			_accessTimes,
+			_recordCapacity * sizeof(int64_t));
+		memcpy(dirty, _dirty, _recordCapacity);
+
+		for (uint64_t i = _recordCapacity; i < capacity; i++) {
+			records[i] = nullptr;
+			dirty[i] = 0;
 		}
+
+		delete[] _records;
+		delete[] _accessTimes;
+		delete[] _dirty;
+
+		_records = records;
+		_accessTimes = accessTimes;
+		_dirty = dirty;
+		_recordCapacity = capacity;
 	}
 
-	*root = entry;
+	_records[index] = keys;
+	_accessTimes[index] = accessTime;
+	_dirty[index] = 0;
 }
 
-void UserDB::RemoveEntry(UserTree **entry)
+void UserDB::WriteAccessTime(uint64_t index)
 {
-	UserTree *root = *entry;
+	memcpy(
+		GetRecord(index) + _UserAccessTimeOffset,
+		_accessTimes + index,
+		sizeof(int64_t));
+}
 
-	if (!root->Left) {
-		*entry = root->Right;
-		root->Right = nullptr;
-		delete root;
-		return;
+// Records are written in file order, pages of the mapping are
+// written back by the system.
+void UserDB::WriteAccessTimes()
+{
+	for (uint64_t i = _dirtyBegin; i < _dirtyEnd; i++) {
+		if (_dirty[i]) {
+			WriteAccessTime(i);
+			_dirty[i] = 0;
+			_statistics.Written++;
+		}
 	}
 
-	if (!root->Right) {
-		*entry = root->Left;
-		root->Left = nullptr;
-		delete root;
+	_dirtyBegin = 0;
+	_dirtyEnd = 0;
+}
+
+void UserDB::WriteFloor(int64_t floor)
+{
+	_floorFile.Write(&floor, 1, 0);
+	_fileFloor = floor;
+}
+
+// Mapping is extended ahead of the file, so adding users rarely maps
+// it again. Pointers into the mapping are not kept outside the lock.
+void UserDB::MapRecords(uint64_t count)
+{
+	if (count <= _mappedRecords) {
 		return;
 	}
 
-	UserTree **leftMax = &(root->Left);
+	uint64_t mappedRecords = _mappedRecords * 2;
+
+	if (mappedRecords < count) {
+		mappedRecords = count;
+	}
 
-	while ((*leftMax)->Right) {
-		leftMax = &((*leftMax)->Right);
+	if (mappedRecords < MinMappedRecords) {
+		mappedRecords = MinMappedRecords;
 	}
 
-	root->Data = (*leftMax)->Data;
-	(*leftMax)->Data = nullptr;
+	BinaryFile::Unmap(_mapping, _mappedRecords * _EntrySize);
 
-	RemoveEntry(leftMax);
+	_mapping = _userFile.MapShared(mappedRecords * _EntrySize);
+	_mappedRecords = mappedRecords;
 }
 
+// Keys of all records are copied in one sequential pass. Table is
+// sized for all records, so it does not grow during the load.
 void UserDB::LoadUserData()
 {
-	uint64_t entryCount = _userFile.Size() / _EntrySize;
+	_recordCount = _userFile.Size() / _EntrySize;
+	MapRecords(_recordCount);
 
-	for (uint64_t entryIdx = 0; entryIdx < entryCount; entryIdx++) {
-		uint8_t valid;
+	_recordCapacity = _recordCount < MinMappedRecords ?
+		MinMappedRecords : _recordCount;
+	_records = new UserKeys*[_recordCapacity];
+	_accessTimes = new int64_t[_recordCapacity];
+	_dirty = new uint8_t[_recordCapacity];
 
-		_userFile.Read<uint8_t>(
-			&valid,
-			1,
-			entryIdx * _EntrySize + _ValidOffset);
+	_tableSize = MinTableSize;
 
-		if (!valid) {
-			FreeIndex *idx = new FreeIndex;
-			idx->Index = entryIdx;
-			idx->Next = _freeIndices;
-			_freeIndices = idx;
-			continue;
-		}
+	while (_tableSize < _recordCount * 2) {
+		_tableSize *= 2;
+	}
 
-		UserData *newUser = new UserData;
-		newUser->IndexInFile = entryIdx;
+	_table = new Slot[_tableSize];
 
-		_userFile.Read<uint8_t>(
-			newUser->PublicKey,
-			KEY_SIZE,
-			entryIdx * _EntrySize + _UserKeyOffset);
+	for (uint64_t i = 0; i < _tableSize; i++) {
+		_table[i].Keys = nullptr;
+	}
 
-		_userFile.Read<uint8_t>(
-			newUser->SignaturePublicKey,
-			SIGNATURE_PUBLIC_KEY_SIZE,
-			entryIdx * _EntrySize + _UserSignatureOffset);
+	if (_recordCount) {
+		AddKeyChunk(_recordCount);
+	}
 
-		_userFile.Read<int64_t>(
-			&newUser->AccessTime,
-			1,
-			entryIdx * _EntrySize + _UserAccessTimeOffset);
+	for (uint64_t entryIdx = 0; entryIdx < _recordCapacity; entryIdx++) {
+		_records[entryIdx] = nullptr;
+		_dirty[entryIdx] = 0;
+	}
 
-		char *nameBuffer = new char[_MaxNameLength];
-		_userFile.Read<char>(
-			nameBuffer,
-			_MaxNameLength,
-			entryIdx * _EntrySize + _UserNameOffset);
+	// Slots of a group of records are prefetched before they are
+	// filled, so their cache misses overlap.
+	uint64_t mask = _tableSize - 1;
+	uint32_t hashes[LoadGroupSize];
 
-		newUser->Name = String(nameBuffer);
-		delete[] nameBuffer;
+	for (uint64_t first = 0; first < _recordCount; first += LoadGroupSize) {
+		uint64_t count = _recordCount - first < LoadGroupSize ?
+			_recordCount - first : LoadGroupSize;
 
-		UserTree *entry = new UserTree;
-		entry->Data = newUser;
-		entry->Left = nullptr;
-		entry->Right = nullptr;
+		for (uint64_t i = 0; i < count; i++) {
+			const uint8_t *record = GetRecord(first + i);
 
-		AddEntry(&_users, entry);
+			if (record[_ValidOffset]) {
+				hashes[i] = GetHash(record + _UserKeyOffset);
+
+				Slot *slot = _table + (hashes[i] & mask);
+				__builtin_prefetch(slot, 1);
+			}
+		}
+
+		for (uint64_t i = 0; i < count; i++) {
+			LoadRecord(first + i, hashes[i]);
+		}
 	}
 }
 
-void UserDB::FreeUserData()
+void UserDB::LoadRecord(uint64_t index, uint32_t hash)
 {
-	delete _deletedUsers;
-	delete _users;
+	const uint8_t *record = GetRecord(index);
 
-	while (_freeIndices) {
-		FreeIndex *index = _freeIndices;
-		_freeIndices = _freeIndices->Next;
-		delete index;
+	if (!record[_ValidOffset]) {
+		FreeIndex *idx = new FreeIndex;
+		idx->Index = index;
+		idx->Next = _freeIndices;
+		_freeIndices = idx;
+		return;
 	}
+
+	const uint8_t *key = record + _UserKeyOffset;
+	Slot *slot = FindSlot(key, hash);
+
+	if (slot->Keys) {
+		THROW("Duplicate user in user file.");
+	}
+
+	UserKeys *keys = AllocateKeys();
+	memcpy(keys->PublicKey, key, KEY_SIZE);
+	memcpy(
+		keys->SignaturePublicKey,
+		record + _UserSignatureOffset,
+		SIGNATURE_PUBLIC_KEY_SIZE);
+
+	_records[index] = keys;
+
+	memcpy(
+		_accessTimes + index,
+		record + _UserAccessTimeOffset,
+		sizeof(int64_t));
+
+	slot->Hash = hash;
+	slot->Record = index;
+	slot->Keys = keys;
+	_userCount++;
 }
 
-int32_t UserDB::GetEntryNumber(UserTree *entry)
+// Floor is left in the file until the first flush, so updates are not
+// buffered before it.
+void UserDB::LoadFloor()
 {
-	if (!entry) {
-		return 0;
+	_timeFloor = 0;
+
+	if (_floorFile.Size() == sizeof(_timeFloor)) {
+		_floorFile.Read(&_timeFloor, 1, 0);
 	}
 
-	return 1 + GetEntryNumber(entry->Left) + GetEntryNumber(entry->Right);
+	_fileFloor = _timeFloor;
 }
 
-void UserDB::FillUserList(UserTree *entry, const uint8_t **data, int *index)
+void UserDB::FreeUserData()
 {
-	if (!entry) {
-		return;
+	BinaryFile::Unmap(_mapping, _mappedRecords * _EntrySize);
+
+	delete[] _table;
+	delete[] _records;
+	delete[] _accessTimes;
+	delete[] _dirty;
+
+	while (_keyChunks) {
+		KeyChunk *chunk = _keyChunks;
+		_keyChunks = chunk->Next;
+
+		crypto_wipe(chunk->Keys, chunk->Size * sizeof(UserKeys));
+		delete[] chunk->Keys;
+		delete chunk;
 	}
 
-	FillUserList(entry->Left, data, index);
-	data[*index] = entry->Data->PublicKey;
-	*index += 1;
-	FillUserList(entry->Right, data, index);
+	while (_freeIndices) {
+		FreeIndex *index = _freeIndices;
+		_freeIndices = _freeIndices->Next;
+		delete index;
+	}
 }
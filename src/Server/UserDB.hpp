@@ -4,10 +4,35 @@
 #include "../Crypto/CryptoDefinitions.hpp"
 #include "../Common/BinaryFile.hpp"
 #include "../Common/CowBuffer.hpp"
-
+#include "../Common/RwLock.hpp"
+#include "../Crypto/Crypto.hpp"
+
+// Safe for concurrent use. Lookups share the lock, modifications
+// take it exclusively. Returned key pointers stay valid after user removal.
+//
+// User file is mapped into memory and indexed by open addressing hash
+// table built in one pass over the file at startup. Keys are copied
+// out of the file, so a lookup touches the table slot and the keys.
+//
+// Access times are kept in memory and written to the file in batches.
+// Time floor file holds a time up to which updates may be buffered.
+// After unclean shutdown no access time older than the floor is
+// accepted, so lost updates can not be replayed. Clean shutdown writes
+// all buffered updates and keeps the floor of the last unclean one.
 class UserDB
 {
 public:
+	struct AccessTimeStatistics
+	{
+		// Calls of UpdateUserAccessTime.
+		int64_t Updates;
+		// Updates later than the floor, written to the file at once.
+		int64_t Immediate;
+		// Records written by flushes.
+		int64_t Written;
+		int64_t Flushes;
+	};
+
 	UserDB();
 	~UserDB();
 
@@ -16,6 +41,10 @@ public:
 	const uint8_t *GetUserPublicKey(const uint8_t key[KEY_SIZE]);
 	const uint8_t *GetUserSignature(const uint8_t key[KEY_SIZE]);
 	int64_t GetUserAccessTime(const uint8_t key[KEY_SIZE]);
+
+	// Floor left by unclean shutdown, zero if there was none. Access
+	// times up to it are returned as the floor.
+	int64_t GetTimeFloor();
 	String GetUserName(const uint8_t key[KEY_SIZE]);
 
 	void UpdateUserAccessTime(
@@ -33,28 +62,47 @@ public:
 	int32_t GetUserCount();
 	CowBuffer<const uint8_t*> ListUsers();
 
+	// Writes buffered access times in record order and raises the
+	// floor to nextFlush, Unix time of the next call, plus allowed
+	// clock skew of clients.
+	void FlushAccessTimes(int64_t nextFlush);
+
+	// Seconds that client clocks may be ahead of the server while
+	// their access times are still buffered.
+	void SetClockSkew(int64_t skew);
+	void GetAccessTimeStatistics(AccessTimeStatistics &statistics);
+
 private:
-	struct UserData
+	enum
 	{
-		uint64_t IndexInFile;
+		KeyChunkSize = 1024,
+		MinTableSize = 64,
+		MinMappedRecords = 1024,
+		LoadGroupSize = 16
+	};
 
+	// Keys of removed users are kept until destruction.
+	struct UserKeys
+	{
 		uint8_t PublicKey[KEY_SIZE];
 		uint8_t SignaturePublicKey[SIGNATURE_PUBLIC_KEY_SIZE];
-		int64_t AccessTime;
-		String Name;
-
-		~UserData();
-		int Compare(const uint8_t *key);
 	};
 
-	struct UserTree
+	struct KeyChunk
 	{
-		UserTree *Left;
-		UserTree *Right;
-
-		UserData *Data;
+		KeyChunk *Next;
+		UserKeys *Keys;
+		uint64_t Size;
+		uint64_t Used;
+	};
 
-		~UserTree();
+	// Empty slot has no keys. Lower bits of the hash select the first
+	// slot to probe, the rest of them filter out other keys.
+	struct Slot
+	{
+		uint32_t Hash;
+		uint32_t Record;
+		UserKeys *Keys;
 	};
 
 	struct FreeIndex
@@ -63,20 +111,63 @@ private:
 		FreeIndex *Next;
 	};
 
-	UserTree *_users;
+	Slot *_table;
+	uint64_t _tableSize;
+	uint64_t _userCount;
+	uint8_t _hashKey[HASH_KEY_SIZE];
+
+	KeyChunk *_keyChunks;
+
+	// Keys of each record in the file, null for free records.
+	UserKeys **_records;
+	uint64_t _recordCount;
+	uint64_t _recordCapacity;
 	FreeIndex *_freeIndices;
-	UserTree *_deletedUsers;
 
-	UserTree **FindEntry(const uint8_t *key);
-	void AddEntry(UserTree **root, UserTree *entry);
-	void RemoveEntry(UserTree **entry);
+	// Access time of each record and flags of buffered ones. Dirty
+	// records lie in range from _dirtyBegin to _dirtyEnd.
+	int64_t *_accessTimes;
+	uint8_t *_dirty;
+	uint64_t _dirtyBegin;
+	uint64_t _dirtyEnd;
 
-	void LoadUserData();
-	void FreeUserData();
+	// Floor found after unclean shutdown and current floor in file.
+	int64_t _timeFloor;
+	int64_t _fileFloor;
+	int64_t _clockSkew;
+
+	AccessTimeStatistics _statistics;
 
-	int32_t GetEntryNumber(UserTree *entry);
+	uint8_t *_mapping;
+	uint64_t _mappedRecords;
 
-	void FillUserList(UserTree *entry, const uint8_t **data, int *index);
+	RwLock _lock;
+
+	uint32_t GetHash(const uint8_t *key);
+	Slot *FindSlot(const uint8_t *key, uint32_t hash);
+	Slot *FindUser(const uint8_t *key);
+	void InsertSlot(uint32_t hash, uint32_t record, UserKeys *keys);
+	void RemoveSlot(Slot *slot);
+	void ResizeTable(uint64_t size);
+
+	UserKeys *AllocateKeys();
+	void AddKeyChunk(uint64_t size);
+
+	uint8_t *GetRecord(uint64_t index)
+	{
+		return _mapping + index * _EntrySize;
+	}
+
+	void AddRecord(uint64_t index, UserKeys *keys, int64_t accessTime);
+	void WriteAccessTime(uint64_t index);
+	void WriteAccessTimes();
+	void WriteFloor(int64_t floor);
+	void MapRecords(uint64_t count);
+
+	void LoadUserData();
+	void LoadFloor();
+	void LoadRecord(uint64_t index, uint32_t hash);
+	void FreeUserData();
 
 	// User file structure.
 	// File consists of records with equal size.
@@ -103,6 +194,10 @@ private:
 		sizeof(int64_t);
 
 	BinaryFile _userFile;
+
+	// Time floor file contains one 64 bit signed integer, zero after
+	// clean shutdown.
+	BinaryFile _floorFile;
 };
 
 #endif
@@ -0,0 +1,641 @@
+#include "Worker.hpp"
+
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../Protocol/ServerSession.hpp"
+#include "../Protocol/ControlSession.hpp"
+#include "../ServerCtl/SocketName.hpp"
+#include "../Common/UnixTime.hpp"
+#include "../Common/Log.hpp"
+
+Worker::Worker(const WorkerShared *shared) : _timers(GetMonotonicTime())
+{
+	_shared = shared;
+	_backend = IOBackend::Create(shared->Backend);
+
+	_sessionFirst = nullptr;
+	_activeUsers = 0;
+	_now = GetMonotonicTime();
+
+	_memoryTimer.Handler = this;
+	_memoryPressure = false;
+	_timers.Add(&_memoryTimer, _now + MemoryIdleInterval);
+
+	_listeningSocket = -1;
+	_controlSocket = -1;
+
+	_running = false;
+	_work = false;
+
+	pthread_mutex_init(&_reopenMutex, nullptr);
+	_reopen = false;
+
+	_backend->AddSocket(_mailbox.GetFd(), &_mailbox);
+}
+
+Worker::~Worker()
+{
+	Stop();
+	Join();
+
+	CloseSessions();
+	CloseUserSocket();
+	CloseControlSocket();
+
+	_backend->RemoveSocket(_mailbox.GetFd());
+	pthread_mutex_destroy(&_reopenMutex);
+
+	delete _backend;
+}
+
+void Worker::OpenUserSocket(const struct sockaddr_in &address)
+{
+	_listeningSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+	if (_listeningSocket == -1) {
+		THROW("Failed to create listening socket.");
+	}
+
+	int enable = 1;
+	int res = setsockopt(
+		_listeningSocket,
+		SOL_SOCKET,
+		SO_REUSEPORT,
+		&enable,
+		sizeof(enable));
+
+	if (res == -1) {
+		CloseUserSocket();
+		THROW("Failed to set SO_REUSEPORT on listening socket.");
+	}
+
+	res = bind(
+		_listeningSocket,
+		(const struct sockaddr*)&address,
+		sizeof(address));
+
+	if (res == -1) {
+		CloseUserSocket();
+		THROW("Failed to bind listening socket.");
+	}
+
+	res = listen(
+		_listeningSocket,
+		__atomic_load_n(_shared->Backlog, __ATOMIC_RELAXED));
+
+	if (res == -1) {
+		CloseUserSocket();
+		THROW("Failed to move socket to listening state.");
+	}
+
+	_backend->AddSocket(_listeningSocket, &_listeningSocket);
+}
+
+void Worker::CloseUserSocket()
+{
+	if (_listeningSocket != -1) {
+		_backend->RemoveSocket(_listeningSocket);
+		close(_listeningSocket);
+		_listeningSocket = -1;
+	}
+}
+
+void Worker::OpenControlSocket()
+{
+	_controlSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (_controlSocket == -1) {
+		THROW("Failed to create control socket.");
+	}
+
+	struct sockaddr_un addr;
+	addr.sun_family = AF_UNIX;
+	strncpy(
+		addr.sun_path,
+		TALKD_SOCKET_NAME,
+		sizeof(addr.sun_path) - 1);
+
+	int res = bind(_controlSocket, (struct sockaddr*)&addr, sizeof(addr));
+
+	if (res == -1) {
+		CloseControlSocket();
+		THROW("Failed to bind control socket.");
+	}
+
+	res = listen(_controlSocket, 5);
+
+	if (res == -1) {
+		CloseControlSocket();
+		THROW("Failed to move control socket to listening state.");
+	}
+
+	_backend->AddSocket(_controlSocket, &_controlSocket);
+}
+
+void Worker::CloseControlSocket()
+{
+	if (_controlSocket != -1) {
+		_backend->RemoveSocket(_controlSocket);
+		close(_controlSocket);
+		unlink(TALKD_SOCKET_NAME);
+		_controlSocket = -1;
+	}
+}
+
+void Worker::ReopenUserSocket(const struct sockaddr_in &address)
+{
+	pthread_mutex_lock(&_reopenMutex);
+	_reopenAddress = address;
+	__atomic_store_n(&_reopen, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&_reopenMutex);
+
+	_mailbox.Wake();
+}
+
+void Worker::Start()
+{
+	_work = true;
+
+	int res = pthread_create(&_thread, nullptr, Thread, this);
+
+	if (res) {
+		THROW("Failed to start worker thread.");
+	}
+
+	_running = true;
+}
+
+void Worker::Stop()
+{
+	if (!_running) {
+		return;
+	}
+
+	__atomic_store_n(&_work, false, __ATOMIC_RELEASE);
+	_mailbox.Wake();
+}
+
+void Worker::Join()
+{
+	if (!_running) {
+		return;
+	}
+
+	pthread_join(_thread, nullptr);
+	_running = false;
+}
+
+void Worker::Wake()
+{
+	_mailbox.Wake();
+}
+
+void Worker::Process(int timeout)
+{
+	int timerTimeout = _timers.GetTimeout(GetMonotonicTime());
+
+	if (timerTimeout >= 0 && (timeout < 0 || timerTimeout < timeout)) {
+		timeout = timerTimeout;
+	}
+
+	int eventCount = _backend->Wait(timeout);
+	_now = GetMonotonicTime();
+
+	for (int i = 0; i < eventCount; i++) {
+		void *data = _backend->GetData(i);
+
+		if (data == &_listeningSocket) {
+			AcceptConnections();
+		} else if (data == &_controlSocket) {
+			AcceptControl();
+		} else if (data == &_mailbox) {
+			_mailbox.Clear();
+		} else {
+			ProcessSession(
+				(Session*)data,
+				_backend->IsReadable(i),
+				_backend->IsWritable(i));
+		}
+	}
+
+	ProcessMailbox();
+	ProcessReopen();
+	ProcessTimers();
+}
+
+void Worker::CloseSessions()
+{
+	while (_sessionFirst) {
+		RemoveSession(_sessionFirst);
+	}
+}
+
+void Worker::AddTimer(Timer *timer, int64_t expiry)
+{
+	_timers.Add(timer, expiry);
+}
+
+void Worker::RemoveTimer(Timer *timer)
+{
+	_timers.Remove(timer);
+}
+
+void Worker::TimerExpired(Timer *timer)
+{
+	if (timer == &_memoryTimer) {
+		CheckMemory();
+		return;
+	}
+
+	Session *session = (Session*)timer->Data;
+	int64_t expiry = session->Time + session->Timeout;
+
+	// Activity does not touch the timer, it is moved here instead.
+	if (expiry > _now) {
+		_timers.Add(timer, expiry);
+		return;
+	}
+
+	if (!session->TimePassed()) {
+		RemoveSession(session);
+		return;
+	}
+
+	session->Time = _now;
+	_timers.Add(timer, _now + session->Timeout);
+}
+
+void Worker::OutputQueued(Session *session)
+{
+	_backend->OutputQueued(session);
+	Account(session);
+}
+
+void Worker::InputChanged(Session *session)
+{
+	_backend->InputChanged(session);
+}
+
+void *Worker::Thread(void *worker)
+{
+	((Worker*)worker)->Run();
+	return nullptr;
+}
+
+void Worker::Run()
+{
+	_mailbox.SetOwner();
+
+	try {
+		while (__atomic_load_n(&_work, __ATOMIC_ACQUIRE)) {
+			Process(-1);
+		}
+	} catch (Exception &ex) {
+		Log("Worker stopped on error, stopping server.");
+		Log(ex.Message());
+		Abandon();
+	}
+}
+
+// Backend may be broken, so the listening socket is closed without
+// removing it from the backend first.
+void Worker::Abandon()
+{
+	if (_listeningSocket != -1) {
+		close(_listeningSocket);
+		_listeningSocket = -1;
+	}
+
+	try {
+		CloseSessions();
+	} catch (Exception &ex) {
+		Log("Failed to close sessions of stopped worker.");
+		Log(ex.Message());
+	}
+
+	__atomic_store_n(_shared->Work, false, __ATOMIC_RELEASE);
+	_shared->Control->Wake();
+}
+
+void Worker::AddSession(Session *session)
+{
+	++_activeUsers;
+
+	session->Prev = nullptr;
+	session->Next = _sessionFirst;
+
+	if (_sessionFirst) {
+		_sessionFirst->Prev = session;
+	}
+
+	_sessionFirst = session;
+
+	session->Time = _now;
+	session->IdleTimer.Handler = this;
+	session->IdleTimer.Data = session;
+	_timers.Add(&session->IdleTimer, _now + session->Timeout);
+
+	_backend->AddSession(session);
+	session->Observer = this;
+
+	if (_memoryPressure) {
+		session->SetMemoryPressure(true);
+	}
+}
+
+void Worker::RemoveSession(Session *session)
+{
+	--_activeUsers;
+
+	if (session->Prev) {
+		session->Prev->Next = session->Next;
+	} else {
+		_sessionFirst = session->Next;
+	}
+
+	if (session->Next) {
+		session->Next->Prev = session->Prev;
+	}
+
+	_timers.Remove(&session->IdleTimer);
+	_backend->RemoveSession(session);
+
+	_shared->Memory->Update(session->Memory, SessionMemory());
+	delete session;
+}
+
+void Worker::AcceptConnections()
+{
+	for (int i = 0; i < AcceptBatch; i++) {
+		struct sockaddr_in addr;
+		socklen_t addrSize = sizeof(addr);
+
+		int fd = accept4(
+			_listeningSocket,
+			(struct sockaddr*)&addr,
+			&addrSize,
+			SOCK_NONBLOCK);
+
+		if (fd == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return;
+		}
+
+		AcceptConnection(fd, addr);
+	}
+}
+
+void Worker::AcceptConnection(int fd, const struct sockaddr_in &addr)
+{
+	bool allowed = _shared->Ban->IsAllowed(addr.sin_addr.s_addr);
+
+	if (!allowed) {
+		shutdown(fd, SHUT_RDWR);
+		close(fd);
+		return;
+	}
+
+	if (!_shared->Limits->Admit(addr.sin_addr.s_addr)) {
+		Refuse(fd);
+		return;
+	}
+
+	ServerSession *session = new ServerSession;
+	session->Socket = fd;
+
+	session->Users = _shared->Users;
+	session->Pipe = _shared->Pipe;
+	session->Inbox = &_mailbox;
+	session->Ban = _shared->Ban;
+	session->StorageLock = _shared->StorageLock;
+	session->Journal = _shared->Journal;
+	session->Storage = _shared->Storage;
+	session->IPv4 = addr.sin_addr.s_addr;
+	session->Limits = _shared->Limits;
+	session->Timers = this;
+	session->RestrictedMode = _shared->RestrictedMode;
+	session->State = ServerSession::ServerStateWaitFirstSyn;
+	session->SignatureKey = nullptr;
+	session->PeerPublicKey = nullptr;
+	session->PublicKey = _shared->PublicKey;
+	session->PrivateKey = _shared->PrivateKey;
+	session->VoiceState = ServerSession::VoiceStateInactive;
+
+	// Large blocks are received into temporary files.
+	session->SpillThreshold = __atomic_load_n(
+		_shared->SpillThreshold,
+		__ATOMIC_RELAXED);
+
+	// Handshake must be completed in time regardless of activity.
+	session->Timeout = __atomic_load_n(
+		_shared->HandshakeTimeout,
+		__ATOMIC_RELAXED);
+	session->Deadline = true;
+
+	AddSession(session);
+}
+
+void Worker::AcceptControl()
+{
+	int fd = accept4(_controlSocket, nullptr, nullptr, SOCK_NONBLOCK);
+
+	if (fd == -1) {
+		return;
+	}
+
+	ControlSession *session = new ControlSession;
+	session->Socket = fd;
+
+	session->Users = _shared->Users;
+	session->Ban = _shared->Ban;
+	session->Work = _shared->Work;
+	session->Reload = _shared->Reload;
+	session->Budget = _shared->Memory;
+	session->PublicKey = _shared->PublicKey;
+
+	AddSession(session);
+}
+
+// Connection is reset without handshake, so that client sees refusal
+// right away instead of timing out.
+void Worker::Refuse(int fd)
+{
+	struct linger linger;
+	linger.l_onoff = 1;
+	linger.l_linger = 0;
+
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+	close(fd);
+}
+
+void Worker::ProcessSession(Session *session, bool readable, bool writable)
+{
+	bool endSession = false;
+
+	// Error in one session must not stop other sessions of the worker.
+	try {
+		if (writable) {
+			endSession = !session->Write();
+		}
+
+		// Backend can deliver several reads worth of data at once.
+		// Messages are processed as soon as they are complete,
+		// processing can change how following data is read.
+		bool input = readable;
+
+		while (!endSession && input) {
+			endSession = !session->Read();
+
+			while (!endSession && session->CanReceive()) {
+				endSession = !session->Process();
+			}
+
+			input = session->Input.HasInput();
+		}
+	} catch (Exception &ex) {
+		Log("Session closed on error.");
+		Log(ex.Message());
+		endSession = true;
+	}
+
+	if (endSession) {
+		RemoveSession(session);
+		return;
+	}
+
+	if (!session->Deadline) {
+		session->Time = _now;
+	}
+
+	_backend->UpdateSession(session);
+	Account(session);
+}
+
+void Worker::ProcessMailbox()
+{
+	PipeEvent *event = _mailbox.Take();
+
+	while (event) {
+		PipeEvent *next = event->Next;
+		_shared->Pipe->Deliver(event, &_mailbox);
+		event = next;
+	}
+}
+
+void Worker::ProcessReopen()
+{
+	if (!__atomic_load_n(&_reopen, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	pthread_mutex_lock(&_reopenMutex);
+	struct sockaddr_in address = _reopenAddress;
+	_reopen = false;
+	pthread_mutex_unlock(&_reopenMutex);
+
+	CloseUserSocket();
+
+	try {
+		OpenUserSocket(address);
+	} catch (Exception &ex) {
+		Log("Failed to reopen listening socket.");
+		Log(ex.Message());
+	}
+}
+
+void Worker::Account(Session *session)
+{
+	SessionMemory usage;
+	session->GetMemoryUsage(usage);
+
+	_shared->Memory->Update(session->Memory, usage);
+	session->Memory = usage;
+}
+
+// Sessions are told when pressure starts and ends. While it is
+// critical, one session is closed per check.
+void Worker::CheckMemory()
+{
+	MemoryBudget::Level level = _shared->Memory->GetLevel();
+	bool pressure = level != MemoryBudget::LevelNormal;
+
+	if (pressure != _memoryPressure) {
+		_memoryPressure = pressure;
+
+		Session *session = _sessionFirst;
+
+		while (session) {
+			session->SetMemoryPressure(pressure);
+			session = session->Next;
+		}
+	}
+
+	if (level == MemoryBudget::LevelCritical) {
+		DropSession();
+	}
+
+	int64_t interval = _shared->Memory->HasLimit() ?
+		MemoryCheckInterval :
+		MemoryIdleInterval;
+
+	_timers.Add(&_memoryTimer, _now + interval);
+}
+
+// Session with the lowest priority is closed, the one holding more
+// memory among sessions of the same priority.
+void Worker::DropSession()
+{
+	Session *victim = nullptr;
+	Session *session = _sessionFirst;
+
+	while (session) {
+		Session::Priority priority = session->GetPriority();
+		int64_t usage = session->Memory.Total();
+
+		bool candidate =
+			priority != Session::PriorityControl &&
+			usage > 0;
+
+		if (candidate && victim) {
+			Session::Priority victimPriority = victim->GetPriority();
+
+			candidate =
+				priority < victimPriority ||
+				(priority == victimPriority &&
+				usage > victim->Memory.Total());
+		}
+
+		if (candidate) {
+			victim = session;
+		}
+
+		session = session->Next;
+	}
+
+	if (!victim) {
+		return;
+	}
+
+	Log("Session closed to free memory.");
+	_shared->Memory->RecordDrop();
+	RemoveSession(victim);
+}
+
+void Worker::ProcessTimers()
+{
+	_timers.Advance(_now);
+
+	Timer *timer = _timers.GetExpired();
+
+	while (timer) {
+		timer->Handler->TimerExpired(timer);
+		timer = _timers.GetExpired();
+	}
+}
@@ -0,0 +1,165 @@
+#ifndef _WORKER_HPP
+#define _WORKER_HPP
+
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "UserDB.hpp"
+#include "MessagePipe.hpp"
+#include "Mailbox.hpp"
+#include "FailBan.hpp"
+#include "KeyLock.hpp"
+#include "MessageJournal.hpp"
+#include "ConnectionLimits.hpp"
+#include "MemoryBudget.hpp"
+#include "IOBackend.hpp"
+#include "../Message/StorageEngine.hpp"
+#include "../Protocol/Session.hpp"
+#include "../Common/TimerWheel.hpp"
+
+class Worker;
+
+// State shared by all workers. Owned by server.
+struct WorkerShared
+{
+	UserDB *Users;
+	MessagePipe *Pipe;
+	FailBan *Ban;
+	KeyLock *StorageLock;
+	MessageJournal *Journal;
+	ConnectionLimits *Limits;
+	MemoryBudget *Memory;
+
+	const bool *RestrictedMode;
+	const int64_t *HandshakeTimeout;
+	const int64_t *Backlog;
+	const int64_t *SpillThreshold;
+
+	IOBackend::Type Backend;
+	StorageEngine::Type Storage;
+
+	const uint8_t *PublicKey;
+	const uint8_t *PrivateKey;
+
+	bool *Work;
+	bool *Reload;
+
+	// Woken when a user worker stops on error and clears Work.
+	Worker *Control;
+};
+
+// Event loop with its own set of sessions.
+// User workers run in separate threads, each one accepts connections
+// from its own listening socket bound with SO_REUSEPORT.
+// Control socket is served by the worker running in the main thread.
+// Session timeouts and other timers are kept in the timer wheel,
+// event loop sleeps until the nearest expiry.
+// Memory held by sessions is reported to the memory budget after
+// processing and whenever output is queued. Load is shed when budget
+// is exceeded.
+// User worker that stops on error closes its listening socket and
+// sessions and stops the server, so no connections are passed to it.
+class Worker : public TimerHandler, public TimerQueue, public SessionObserver
+{
+public:
+	Worker(const WorkerShared *shared);
+	~Worker();
+
+	void OpenUserSocket(const struct sockaddr_in &address);
+	void CloseUserSocket();
+	void OpenControlSocket();
+	void CloseControlSocket();
+
+	// Can be called from any thread.
+	void ReopenUserSocket(const struct sockaddr_in &address);
+
+	void Start();
+	void Stop();
+	void Join();
+
+	// Interrupts waiting of the event loop. Can be called from any
+	// thread.
+	void Wake();
+
+	// Runs one event loop iteration in the calling thread.
+	// Negative timeout means waiting for the nearest timer.
+	void Process(int timeout);
+
+	void CloseSessions();
+
+	// Timers can be used only by the thread running the worker.
+	// Time is milliseconds of monotonic clock.
+	void AddTimer(Timer *timer, int64_t expiry) override;
+	void RemoveTimer(Timer *timer) override;
+
+	int64_t GetTime() override
+	{
+		return _now;
+	}
+
+	void TimerExpired(Timer *timer) override;
+
+	// Forward notifications to the backend.
+	void OutputQueued(Session *session) override;
+	void InputChanged(Session *session) override;
+
+private:
+	// Connections accepted per wakeup, established sessions are served
+	// between batches.
+	// Memory budget is checked often while limit is set.
+	enum
+	{
+		AcceptBatch = 128,
+		MemoryCheckInterval = 100,
+		MemoryIdleInterval = 1000
+	};
+
+	const WorkerShared *_shared;
+
+	IOBackend *_backend;
+	Mailbox _mailbox;
+	Session *_sessionFirst;
+
+	int _activeUsers;
+
+	TimerWheel _timers;
+	int64_t _now;
+
+	Timer _memoryTimer;
+	bool _memoryPressure;
+
+	int _listeningSocket;
+	int _controlSocket;
+
+	pthread_t _thread;
+	bool _running;
+	bool _work;
+
+	pthread_mutex_t _reopenMutex;
+	struct sockaddr_in _reopenAddress;
+	bool _reopen;
+
+	static void *Thread(void *worker);
+	void Run();
+	void Abandon();
+
+	void AddSession(Session *session);
+	void RemoveSession(Session *session);
+
+	void AcceptConnections();
+	void AcceptConnection(int fd, const struct sockaddr_in &addr);
+	void AcceptControl();
+
+	static void Refuse(int fd);
+
+	void ProcessSession(Session *session, bool readable, bool writable);
+	void ProcessMailbox();
+	void ProcessReopen();
+	void ProcessTimers();
+
+	void Account(Session *session);
+	void CheckMemory();
+	void DropSession();
+};
+
+#endif
@@ -11,6 +11,7 @@
 static const char *ShutdownCommand = "shutdown";
 static const char *ReloadCommand = "reload";
 static const char *GetKeyCommand = "getkey";
+static const char *MemoryCommand = "memory";
 
 static const char *UserSection = "user";
 static const char *AddUserCommand = "add";
@@ -27,6 +28,7 @@ void PrintHelp()
 	printf("Commands:\n");
 	printf("  %s\n", ShutdownCommand);
 	printf("  %s\n", GetKeyCommand);
+	printf("  %s\n", MemoryCommand);
 	printf("  %s\n\n", ReloadCommand);
 
 	printf("  %s\n", UserSection);
@@ -208,6 +210,14 @@ static CowBuffer<uint8_t> RequestReload()
 	return result;
 }
 
+static CowBuffer<uint8_t> RequestMemoryStatus()
+{
+	CowBuffer<uint8_t> result(sizeof(int32_t));
+	*result.SwitchType<int32_t>() = COMMAND_MEMORY_STATUS;
+
+	return result;
+}
+
 CowBuffer<uint8_t> CreateRequestUser(int argc, char **argv)
 {
 	if (argc < 3) {
@@ -257,6 +267,8 @@ CowBuffer<uint8_t> CreateRequest(int argc, char **argv)
 		return RequestGetKey();
 	} else if (!strcmp(argv[1], ReloadCommand)) {
 		return RequestReload();
+	} else if (!strcmp(argv[1], MemoryCommand)) {
+		return RequestMemoryStatus();
 	} else if (!strcmp(argv[1], UserSection)) {
 		return CreateRequestUser(argc, argv);
 	} else if (!strcmp(argv[1], IPSection)) {
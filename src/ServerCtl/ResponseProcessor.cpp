@@ -172,6 +172,63 @@ static int ProcessListBannedIP(CowBuffer<uint8_t> response)
 	return 0;
 }
 
+static int ProcessMemoryStatus(const CowBuffer<uint8_t> response)
+{
+	int32_t code;
+
+	if (response.Size() < sizeof(code)) {
+		printf("Response is too short.\n");
+		return 1;
+	}
+
+	code = *response.SwitchType<int32_t>();
+
+	if (code != OK) {
+		PrintError(code);
+		return 1;
+	}
+
+	if (response.Size() != sizeof(code) + sizeof(int64_t) * 9 +
+		sizeof(int32_t))
+	{
+		printf("Invalid response length.\n");
+		return 1;
+	}
+
+	const int64_t *values = response.SwitchType<int64_t>(sizeof(code));
+	int32_t level = *response.SwitchType<int32_t>(
+		sizeof(code) + sizeof(int64_t) * 9);
+
+	const char *levelNames[] = {"normal", "pressure", "critical"};
+
+	if (values[0]) {
+		printf("Budget: %ld bytes\n", values[0]);
+	} else {
+		printf("Budget: unlimited\n");
+	}
+
+	printf("Input: %ld bytes\n", values[1]);
+	printf("Output: %ld bytes\n", values[2]);
+	printf("Storage reads: %ld bytes\n", values[3]);
+	printf("Total: %ld bytes\n", values[1] + values[2] + values[3]);
+	printf("Dropped sessions: %ld\n", values[4]);
+
+	int64_t poolAllocations = values[5] + values[6] + values[7];
+
+	printf(
+		"Pool: %ld allocations, %.1f%% from cache, %ld large\n",
+		poolAllocations,
+		poolAllocations ? values[5] * 100.0 / poolAllocations : 0.0,
+		values[7]);
+	printf("Pool cache: %ld bytes\n", values[8]);
+
+	if (level >= 0 && level <= 2) {
+		printf("State: %s\n", levelNames[level]);
+	}
+
+	return 0;
+}
+
 int ProcessResponse(
 	int32_t commandId,
 	CowBuffer<uint8_t> response)
@@ -194,6 +251,8 @@ int ProcessResponse(
 		return ProcessResultCode(response);
 	} else if (commandId == COMMAND_RELOAD) {
 		return ProcessResultCode(response);
+	} else if (commandId == COMMAND_MEMORY_STATUS) {
+		return ProcessMemoryStatus(response);
 	}
 
 	printf("Unknown command.\n");
@@ -22,5 +22,6 @@
 #define COMMAND_BAN_IP 7
 #define COMMAND_UNBAN_IP 8
 #define COMMAND_RELOAD 9
+#define COMMAND_MEMORY_STATUS 10
 
 #endif
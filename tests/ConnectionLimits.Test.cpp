@@ -0,0 +1,312 @@
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+
+#include "../src/Protocol/ServerSession.hpp"
+#include "../src/Protocol/ClientSession.hpp"
+#include "../src/Server/ConnectionLimits.hpp"
+
+// Opens connections over the global, per address and unauthenticated
+// limits the way workers admit them, checks that they are refused and
+// that closed sessions release their counts.
+
+class NullProcessor : public MessageProcessor
+{
+public:
+	void NotifyDelivery(void *userPointer, int32_t status) override
+	{
+	}
+
+	void DeliverMessage(CowBuffer<uint8_t> message) override
+	{
+	}
+
+	void UpdateUserData(const uint8_t *key, String name) override
+	{
+	}
+
+	int64_t GetLatestReceiveTimestamp() override
+	{
+		return 0;
+	}
+
+	void VoiceRequest(const uint8_t *key, int64_t timestamp) override
+	{
+	}
+
+	void VoiceInitResponse(int32_t code) override
+	{
+	}
+
+	void VoiceEnd() override
+	{
+	}
+
+	void ReceiveVoiceFrame(CowBuffer<uint8_t> frame) override
+	{
+	}
+};
+
+struct Server
+{
+	UserDB Users;
+	MessagePipe Pipe;
+	Mailbox Inbox;
+	FailBan Ban;
+	KeyLock StorageLock;
+	ConnectionLimits Limits;
+	bool RestrictedMode;
+
+	uint8_t PublicKey[KEY_SIZE];
+	uint8_t PrivateKey[KEY_SIZE];
+};
+
+enum
+{
+	UserCount = 16
+};
+
+static void GetClientKeys(int index, ClientSession &client)
+{
+	uint8_t seed[KEY_SIZE];
+
+	// Low bits of the first byte are cleared by key clamping.
+	memset(client.PrivateKey, 1, KEY_SIZE);
+	memset(seed, 2, KEY_SIZE);
+	memcpy(client.PrivateKey + 1, &index, sizeof(index));
+	memcpy(seed + 1, &index, sizeof(index));
+
+	GeneratePublicKey(client.PrivateKey, client.PublicKey);
+	GenerateSignature(
+		seed,
+		client.SignaturePrivateKey,
+		client.SignaturePublicKey);
+}
+
+static bool Step(Session *session)
+{
+	if (session->CanWrite() && !session->Write()) {
+		return false;
+	}
+
+	if (!session->Read()) {
+		return false;
+	}
+
+	while (session->CanReceive()) {
+		if (!session->Process()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool Authenticate(Server *server, ServerSession *session, int index)
+{
+	int sockets[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets)) {
+		return false;
+	}
+
+	NullProcessor processor;
+	ClientSession client;
+	client.Processor = &processor;
+	client.Socket = sockets[0];
+	GetClientKeys(index, client);
+	memcpy(client.PeerPublicKey, server->PublicKey, KEY_SIZE);
+
+	session->Socket = sockets[1];
+
+	bool success = client.InitSession();
+
+	for (int i = 0; success && i < 100; i++) {
+		success = Step(&client) && Step(session);
+
+		if (client.ConnectedActive() &&
+			session->State == ServerSession::ServerStateActiveSession)
+		{
+			break;
+		}
+	}
+
+	success = success &&
+		session->State == ServerSession::ServerStateActiveSession;
+
+	client.Disconnect();
+	return success;
+}
+
+// Admits connection as worker does. Returns nullptr if it is refused.
+static ServerSession *Open(
+	Server *server,
+	uint32_t ipv4,
+	int index,
+	bool authenticate)
+{
+	if (!server->Limits.Admit(ipv4)) {
+		return nullptr;
+	}
+
+	ServerSession *session = new ServerSession;
+	session->Socket = -1;
+	session->Users = &server->Users;
+	session->Pipe = &server->Pipe;
+	session->Inbox = &server->Inbox;
+	session->Ban = &server->Ban;
+	session->StorageLock = &server->StorageLock;
+	session->Journal = nullptr;
+	session->IPv4 = ipv4;
+	session->Limits = &server->Limits;
+	session->RestrictedMode = &server->RestrictedMode;
+	session->State = ServerSession::ServerStateWaitFirstSyn;
+	session->SignatureKey = nullptr;
+	session->PeerPublicKey = nullptr;
+	session->PublicKey = server->PublicKey;
+	session->PrivateKey = server->PrivateKey;
+	session->VoiceState = ServerSession::VoiceStateInactive;
+
+	if (authenticate && !Authenticate(server, session, index)) {
+		printf("Failed to authenticate client %d.\n", index);
+	}
+
+	return session;
+}
+
+static void Report(bool success)
+{
+	if (success) {
+		printf("Success.\n");
+	} else {
+		printf("Failure.\n");
+	}
+}
+
+// Counts are released if the tightest limits admit a new connection.
+static bool Released(Server *server)
+{
+	server->Limits.SetLimits(1, 1, 1);
+
+	ServerSession *session = Open(server, 1, 0, false);
+	bool success = session;
+	delete session;
+
+	return success;
+}
+
+void TestConnections(Server *server)
+{
+	printf("Test connection limit.\n");
+
+	server->Limits.SetLimits(3, 0, 0);
+
+	ServerSession *sessions[3];
+	bool success = true;
+
+	for (int i = 0; i < 3; i++) {
+		sessions[i] = Open(server, i + 1, i, i % 2);
+		success = success && sessions[i];
+	}
+
+	success = success && !Open(server, 10, 3, true);
+
+	delete sessions[1];
+	sessions[1] = Open(server, 10, 3, true);
+	success = success && sessions[1];
+	success = success && !Open(server, 11, 4, false);
+
+	for (int i = 0; i < 3; i++) {
+		delete sessions[i];
+	}
+
+	Report(success && Released(server));
+}
+
+void TestConnectionsPerAddress(Server *server)
+{
+	printf("Test connection limit per address.\n");
+
+	server->Limits.SetLimits(0, 2, 0);
+
+	ServerSession *first = Open(server, 1, 5, true);
+	ServerSession *second = Open(server, 1, 6, false);
+	bool success = first && second;
+
+	success = success && !Open(server, 1, 7, true);
+
+	ServerSession *other = Open(server, 2, 7, true);
+	success = success && other;
+
+	delete second;
+	second = Open(server, 1, 8, true);
+	success = success && second && !Open(server, 1, 9, false);
+
+	delete first;
+	delete second;
+	delete other;
+
+	Report(success && Released(server));
+}
+
+void TestUnauthenticated(Server *server)
+{
+	printf("Test unauthenticated connection limit.\n");
+
+	server->Limits.SetLimits(0, 0, 2);
+
+	ServerSession *first = Open(server, 1, 10, false);
+	ServerSession *second = Open(server, 2, 11, false);
+	bool success = first && second;
+
+	success = success && !Open(server, 3, 12, false);
+
+	// Completed handshake frees its place.
+	success = success && Authenticate(server, first, 10);
+
+	ServerSession *third = Open(server, 3, 12, false);
+	success = success && third && !Open(server, 4, 13, false);
+
+	delete second;
+	ServerSession *fourth = Open(server, 4, 13, false);
+	success = success && fourth;
+
+	delete first;
+	delete third;
+	delete fourth;
+
+	Report(success && Released(server));
+}
+
+int main(int argc, char **argv)
+{
+	Server *server = new Server;
+	server->RestrictedMode = false;
+	server->Inbox.SetOwner();
+
+	memset(server->PrivateKey, 7, KEY_SIZE);
+	GeneratePublicKey(server->PrivateKey, server->PublicKey);
+
+	for (int i = 0; i < UserCount; i++) {
+		ClientSession client;
+		GetClientKeys(i, client);
+
+		server->Users.AddUser(
+			client.PublicKey,
+			client.SignaturePublicKey,
+			0,
+			"limited user");
+	}
+
+	TestConnections(server);
+	TestConnectionsPerAddress(server);
+	TestUnauthenticated(server);
+
+	delete server;
+
+	unlink("talkd.users");
+	unlink("talkd.users.floor");
+	unlink("talkd.banned.ip");
+	return 0;
+}
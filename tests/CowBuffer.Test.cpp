@@ -0,0 +1,238 @@
+#include <time.h>
+#include <pthread.h>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+#include "../src/Common/CowBuffer.hpp"
+#include "../src/Common/MyString.hpp"
+
+// Checks copy on write semantics and counts allocations of buffer
+// operations used on the message path.
+
+static int64_t GetAllocations()
+{
+	MemoryPool::Statistics statistics;
+	MemoryPool::GetStatistics(statistics);
+	return statistics.Hits + statistics.Misses + statistics.Large;
+}
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+void TestAllocations()
+{
+	printf("Test allocations.\n");
+
+	bool success = true;
+	int64_t start = GetAllocations();
+
+	CowBuffer<uint8_t> empty;
+	CowBuffer<uint8_t> emptyCopy = empty;
+
+	if (GetAllocations() != start || emptyCopy.Pointer()) {
+		success = false;
+	}
+
+	CowBuffer<uint8_t> buffer(256);
+
+	if (GetAllocations() != start + 1) {
+		success = false;
+	}
+
+	CowBuffer<uint8_t> copy = buffer;
+	CowBuffer<uint8_t> slice = buffer.Slice(16, 32);
+	CowBuffer<uint8_t> moved = std::move(copy);
+	const CowBuffer<uint8_t> &constBuffer = buffer;
+	constBuffer.Pointer();
+
+	if (GetAllocations() != start + 1 || copy.Size()) {
+		success = false;
+	}
+
+	// Exclusive buffer is written in place.
+	moved = CowBuffer<uint8_t>();
+	slice = CowBuffer<uint8_t>();
+	buffer[0] = 1;
+
+	if (GetAllocations() != start + 1) {
+		success = false;
+	}
+
+	Report(success);
+}
+
+void TestCopyOnWrite()
+{
+	printf("Test copy on write.\n");
+
+	bool success = true;
+
+	CowBuffer<uint8_t> buffer(64);
+
+	for (int i = 0; i < 64; i++) {
+		buffer[i] = i;
+	}
+
+	CowBuffer<uint8_t> slice = buffer.Slice(8, 8);
+	slice[0] = 100;
+
+	if (buffer[8] != 8 || slice[0] != 100 || slice[1] != 9) {
+		success = false;
+	}
+
+	CowBuffer<uint8_t> concat = buffer.Slice(0, 4).Concat(slice);
+
+	if (concat.Size() != 12 || concat[3] != 3 || concat[4] != 100) {
+		success = false;
+	}
+
+	buffer.Resize(128);
+
+	if (buffer.Size() != 128 || buffer[63] != 63) {
+		success = false;
+	}
+
+	CowBuffer<String> strings(2);
+	strings[0] = "first";
+	CowBuffer<String> stringsCopy = strings;
+	stringsCopy[1] = "second";
+
+	if (strings[1].Length() || !(stringsCopy[0] == "first")) {
+		success = false;
+	}
+
+	Report(success);
+}
+
+struct ShareTask
+{
+	CowBuffer<uint8_t> Buffer;
+	int64_t Sum;
+};
+
+static void *ShareThread(void *arg)
+{
+	ShareTask *task = (ShareTask*)arg;
+	task->Sum = 0;
+
+	for (int i = 0; i < 100000; i++) {
+		CowBuffer<uint8_t> copy = task->Buffer;
+		task->Sum += copy.Size();
+	}
+
+	return nullptr;
+}
+
+void TestPool()
+{
+	printf("Test pool.\n");
+
+	bool success = true;
+
+	MemoryPool::Statistics before;
+	MemoryPool::GetStatistics(before);
+
+	for (int i = 0; i < 1000; i++) {
+		CowBuffer<uint8_t> buffer(2048);
+		buffer[0] = i;
+	}
+
+	MemoryPool::Statistics after;
+	MemoryPool::GetStatistics(after);
+
+	// Only the first buffer comes from the heap.
+	if (after.Misses - before.Misses != 1 ||
+		after.Hits - before.Hits != 999)
+	{
+		success = false;
+	}
+
+	CowBuffer<uint8_t> large(1024 * 1024);
+	MemoryPool::GetStatistics(after);
+
+	if (after.Large - before.Large != 1) {
+		success = false;
+	}
+
+	Report(success);
+}
+
+void TestShare()
+{
+	printf("Test share.\n");
+
+	CowBuffer<uint8_t> buffer(16);
+	ShareTask tasks[4];
+
+	for (int i = 0; i < 4; i++) {
+		tasks[i].Buffer = buffer.Share();
+	}
+
+	pthread_t threads[4];
+
+	for (int i = 0; i < 4; i++) {
+		pthread_create(&threads[i], nullptr, ShareThread, &tasks[i]);
+	}
+
+	for (int i = 0; i < 100000; i++) {
+		CowBuffer<uint8_t> copy = buffer;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		pthread_join(threads[i], nullptr);
+		tasks[i].Buffer = CowBuffer<uint8_t>();
+	}
+
+	// Only the original reference remains, so write does not copy.
+	int64_t start = GetAllocations();
+	buffer[0] = 1;
+
+	Report(GetAllocations() == start);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void BenchmarkCopy(int64_t size, int64_t count)
+{
+	CowBuffer<uint8_t> source(size);
+	memset(source.Pointer(), 1, size);
+
+	int64_t start = GetTime();
+
+	for (int64_t i = 0; i < count; i++) {
+		CowBuffer<uint8_t> header(sizeof(int32_t));
+		CowBuffer<uint8_t> result = header.Concat(source);
+	}
+
+	int64_t time = GetTime() - start;
+
+	printf(
+		"Concat of %ld bytes: %.0f ns.\n",
+		size,
+		(double)time / count);
+}
+
+int main(int argc, char **argv)
+{
+	TestAllocations();
+	TestCopyOnWrite();
+	TestPool();
+	TestShare();
+
+	BenchmarkCopy(256, 1000000);
+	BenchmarkCopy(64 * 1024, 100000);
+
+	return 0;
+}
@@ -0,0 +1,242 @@
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+
+#include "../src/Protocol/Session.hpp"
+#include "../src/Crypto/Crypto.hpp"
+
+// Checks encryption of stream slices and messages and measures
+// encrypted transfer between two sessions.
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+static void InitKeys(EncryptedStream &out, EncryptedStream &in)
+{
+	uint8_t key[KEY_SIZE];
+	memset(key, 0x42, KEY_SIZE);
+
+	InitStream(out, key);
+	InitStream(in, key);
+	memset(in.Nonce, 0, NONCE_SIZE);
+}
+
+void TestStreamSlices()
+{
+	printf("Test stream slices.\n");
+
+	bool success = true;
+
+	EncryptedStream outES;
+	EncryptedStream inES;
+	InitKeys(outES, inES);
+
+	CryptoStreamWriter writer;
+	CryptoStreamReader reader;
+
+	writer.Init(&outES);
+
+	if (!reader.Init(&inES, outES.Nonce)) {
+		success = false;
+	}
+
+	uint8_t plaintext[1000];
+
+	for (int i = 0; i < 1000; i++) {
+		plaintext[i] = i * 13;
+	}
+
+	uint8_t add[4] = {1, 2, 3, 4};
+	uint8_t slice[1000 + STREAM_OVERHEAD];
+	uint8_t result[1000];
+
+	// Slices of one block share the context.
+	for (int size = 1; size <= 1000; size += 333) {
+		writer.Encrypt(plaintext, size, slice, add, sizeof(add));
+		memset(result, 0, sizeof(result));
+
+		bool decrypted = reader.Decrypt(
+			slice,
+			size + STREAM_OVERHEAD,
+			result,
+			add,
+			sizeof(add));
+
+		if (!decrypted || memcmp(result, plaintext, size)) {
+			success = false;
+		}
+	}
+
+	// Damaged slice leaves destination untouched.
+	writer.Encrypt(plaintext, 100, slice, add, sizeof(add));
+	slice[STREAM_OVERHEAD + 10] ^= 1;
+	memset(result, 7, sizeof(result));
+
+	bool decrypted = reader.Decrypt(
+		slice,
+		100 + STREAM_OVERHEAD,
+		result,
+		add,
+		sizeof(add));
+
+	if (decrypted || result[0] != 7 || result[99] != 7) {
+		success = false;
+	}
+
+	if (reader.Decrypt(slice, STREAM_OVERHEAD, result, add, 4)) {
+		success = false;
+	}
+
+	Report(success);
+}
+
+void TestMessages()
+{
+	printf("Test messages.\n");
+
+	bool success = true;
+
+	EncryptedStream outES;
+	EncryptedStream inES;
+	InitKeys(outES, inES);
+
+	CowBuffer<uint8_t> plaintext(300);
+
+	for (int i = 0; i < 300; i++) {
+		plaintext[i] = i;
+	}
+
+	CowBuffer<uint8_t> encrypted = Encrypt(plaintext, outES);
+	CowBuffer<uint8_t> copy = encrypted;
+	CowBuffer<uint8_t> decrypted = Decrypt(encrypted, inES);
+
+	// Shared input is not changed by decryption.
+	if (decrypted.Size() != 300 ||
+		memcmp(decrypted.Pointer(), plaintext.Pointer(), 300) ||
+		memcmp(copy.Pointer(), encrypted.Pointer(), copy.Size()))
+	{
+		success = false;
+	}
+
+	// Replayed message is rejected.
+	if (Decrypt(encrypted, inES).Size()) {
+		success = false;
+	}
+
+	Report(success);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static int64_t GetCPUTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static int64_t GetAllocations()
+{
+	MemoryPool::Statistics statistics;
+	MemoryPool::GetStatistics(statistics);
+	return statistics.Hits + statistics.Misses + statistics.Large;
+}
+
+void BenchmarkSessions(uint64_t blockSize, uint32_t sliceSize)
+{
+	int sockets[2];
+	socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets);
+
+	EncryptedStream outES;
+	EncryptedStream inES;
+	InitKeys(outES, inES);
+
+	Session sender;
+	Session receiver;
+
+	sender.Socket = sockets[0];
+	receiver.Socket = sockets[1];
+	receiver.InputSizeLimit = blockSize;
+	sender.RestrictStreams = false;
+	receiver.RestrictStreams = false;
+
+	sender.SetSliceSize(2, sliceSize);
+	receiver.SetSliceSize(2, sliceSize);
+	sender.OutputStreams[2].SetES(&outES);
+	receiver.InputStreams[2].SetES(&inES);
+
+	CowBuffer<uint8_t> block(blockSize);
+	memset(block.Pointer(), 1, blockSize);
+
+	int count = 256 * 1024 * 1024 / blockSize;
+	int received = 0;
+	bool success = true;
+
+	int64_t allocations = GetAllocations();
+	int64_t cpuTime = GetCPUTime();
+	int64_t time = GetTime();
+
+	for (int i = 0; i < count; i++) {
+		sender.Send(block, 2, true);
+	}
+
+	while (success && received < count) {
+		success = sender.Write() && receiver.Read();
+
+		while (success && receiver.CanReceive()) {
+			success = receiver.Receive().Size() == blockSize;
+			received++;
+		}
+	}
+
+	time = GetTime() - time;
+	cpuTime = GetCPUTime() - cpuTime;
+	allocations = GetAllocations() - allocations;
+
+	int64_t slices = count *
+		((blockSize + sliceSize - STREAM_OVERHEAD - 1) /
+		(sliceSize - STREAM_OVERHEAD));
+
+	if (!success) {
+		printf("Transfer failed.\n");
+	}
+
+	printf(
+		"%lu byte blocks, %u byte slices: %.0f MB/s, "
+		"%.0f ms CPU per GB, %.1f pool allocations per slice.\n",
+		blockSize,
+		sliceSize,
+		(double)count * blockSize / time * 1000,
+		(double)cpuTime / (count * blockSize) * 1000,
+		(double)allocations / slices);
+
+	sender.Socket = -1;
+	receiver.Socket = -1;
+
+	close(sockets[0]);
+	close(sockets[1]);
+}
+
+int main(int argc, char **argv)
+{
+	TestStreamSlices();
+	TestMessages();
+
+	BenchmarkSessions(1024 * 1024, 2048);
+	BenchmarkSessions(1024 * 1024, 65536);
+
+	return 0;
+}
@@ -24,7 +24,6 @@ void TestInvalidSize(UserDB *users)
 	session.PublicKey = nullptr;
 	session.PrivateKey = nullptr;
 	session.VoiceState = ServerSession::VoiceStateInactive;
-	session.VoicePeer = nullptr;
 
 	uint64_t size = 1025;
 	int wb = write(input[0], &size, sizeof(size));
@@ -66,7 +65,6 @@ void TestInvalidKey(UserDB *users)
 	session.PublicKey = nullptr;
 	session.PrivateKey = nullptr;
 	session.VoiceState = ServerSession::VoiceStateInactive;
-	session.VoicePeer = nullptr;
 
 	CowBuffer<uint8_t> inputBuffer(KEY_SIZE + sizeof(int64_t) +
 		SIGNATURE_SIZE);
@@ -129,7 +127,6 @@ void TestInvalidSignature(UserDB *users)
 	session.PublicKey = nullptr;
 	session.PrivateKey = nullptr;
 	session.VoiceState = ServerSession::VoiceStateInactive;
-	session.VoicePeer = nullptr;
 
 	CowBuffer<uint8_t> inputBuffer(KEY_SIZE + sizeof(int64_t) +
 		SIGNATURE_SIZE);
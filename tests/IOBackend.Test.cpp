@@ -0,0 +1,405 @@
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../src/Server/Poller.hpp"
+#include "../src/Server/Uring.hpp"
+#include "../src/Common/Exception.hpp"
+
+// Checks that paused input is not read. Relays messages between pairs
+// of TCP connections through event loop backend. Reports message rate,
+// CPU time of event loop thread, calls into the heap per relayed
+// message and hit rate of the memory pool.
+
+static int64_t Allocations = 0;
+
+// Heap calls are plain allocations and the ones the pool could not
+// serve from its caches.
+static void GetAllocations(int64_t &pool, int64_t &heap)
+{
+	MemoryPool::Statistics statistics;
+	MemoryPool::GetStatistics(statistics);
+
+	pool = statistics.Hits + statistics.Misses + statistics.Large;
+	heap = __atomic_load_n(&Allocations, __ATOMIC_RELAXED) +
+		statistics.Misses +
+		statistics.Large;
+}
+
+void *operator new(size_t size)
+{
+	__atomic_add_fetch(&Allocations, 1, __ATOMIC_RELAXED);
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, size_t size) noexcept
+{
+	free(pointer);
+}
+
+struct RelaySession : public Session
+{
+	RelaySession *Peer;
+
+	bool Process() override
+	{
+		Peer->Send(Receive(), 0, false);
+		return true;
+	}
+};
+
+struct Client
+{
+	int Writer;
+	int Reader;
+
+	CowBuffer<uint8_t> Frame;
+	int64_t MessageCount;
+
+	pthread_t WriterThread;
+	pthread_t ReaderThread;
+};
+
+enum
+{
+	PairCount = 4
+};
+
+static int FinishedReaders = 0;
+
+static CowBuffer<uint8_t> BuildFrame(int64_t size, uint32_t sliceSize)
+{
+	int64_t sliceCount = (size + sliceSize - 1) / sliceSize;
+	CowBuffer<uint8_t> frame(1 + 8 + sliceCount * 5 + size);
+	memset(frame.Pointer(), 0, frame.Size());
+
+	*frame.SwitchType<uint64_t>(1) = size;
+
+	int64_t offset = 9;
+	int64_t remaining = size;
+
+	while (remaining) {
+		uint32_t slice = remaining > sliceSize ? sliceSize : remaining;
+		*frame.SwitchType<uint32_t>(offset + 1) = slice;
+		offset += 5 + slice;
+		remaining -= slice;
+	}
+
+	return frame;
+}
+
+static void *WriterThread(void *arg)
+{
+	Client *client = (Client*)arg;
+
+	for (int64_t i = 0; i < client->MessageCount; i++) {
+		uint64_t done = 0;
+
+		while (done < client->Frame.Size()) {
+			int64_t wb = write(
+				client->Writer,
+				client->Frame.Pointer(done),
+				client->Frame.Size() - done);
+
+			if (wb <= 0) {
+				return nullptr;
+			}
+
+			done += wb;
+		}
+	}
+
+	return nullptr;
+}
+
+static void *ReaderThread(void *arg)
+{
+	Client *client = (Client*)arg;
+
+	int64_t expected = client->Frame.Size() * client->MessageCount;
+	uint8_t buffer[65536];
+
+	while (expected) {
+		int64_t rb = read(client->Reader, buffer, sizeof(buffer));
+
+		if (rb <= 0) {
+			break;
+		}
+
+		expected -= rb;
+	}
+
+	__atomic_add_fetch(&FinishedReaders, 1, __ATOMIC_RELEASE);
+	return nullptr;
+}
+
+static void Connect(int listener, int &client, int &server)
+{
+	struct sockaddr_in addr;
+	socklen_t size = sizeof(addr);
+	getsockname(listener, (struct sockaddr*)&addr, &size);
+
+	client = socket(AF_INET, SOCK_STREAM, 0);
+	connect(client, (struct sockaddr*)&addr, sizeof(addr));
+	server = accept(listener, nullptr, nullptr);
+
+	int enable = 1;
+	setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+}
+
+static int64_t GetTime(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void ProcessSession(
+	IOBackend *backend,
+	Session *session,
+	bool readable,
+	bool writable)
+{
+	bool endSession = false;
+
+	if (writable) {
+		endSession = !session->Write();
+	}
+
+	bool input = readable;
+
+	while (!endSession && input) {
+		endSession = !session->Read();
+
+		while (!endSession && session->CanReceive()) {
+			endSession = !session->Process();
+		}
+
+		input = session->Input.HasInput();
+	}
+
+	if (endSession) {
+		printf("Session closed.\n");
+		backend->RemoveSession(session);
+		session->Close();
+		return;
+	}
+
+	backend->UpdateSession(session);
+}
+
+void Benchmark(const char *name, IOBackend *backend, int64_t messageSize,
+	int64_t messageCount, uint32_t sliceSize)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+	listen(listener, PairCount * 2);
+
+	Client clients[PairCount];
+	RelaySession inbound[PairCount];
+	RelaySession outbound[PairCount];
+
+	CowBuffer<uint8_t> frame = BuildFrame(messageSize, sliceSize);
+
+	for (int i = 0; i < PairCount; i++) {
+		Connect(listener, clients[i].Writer, inbound[i].Socket);
+		Connect(listener, clients[i].Reader, outbound[i].Socket);
+
+		clients[i].Frame = frame;
+		clients[i].MessageCount = messageCount;
+
+		inbound[i].Peer = &outbound[i];
+		inbound[i].InputSizeLimit = messageSize;
+		inbound[i].SetSliceSize(0, sliceSize);
+		outbound[i].Peer = &inbound[i];
+		outbound[i].SetSliceSize(0, sliceSize);
+
+		backend->AddSession(&inbound[i]);
+		backend->AddSession(&outbound[i]);
+	}
+
+	close(listener);
+
+	int64_t wallStart = GetTime(CLOCK_MONOTONIC);
+	int64_t cpuStart = GetTime(CLOCK_THREAD_CPUTIME_ID);
+	int64_t poolStart;
+	int64_t heapStart;
+	GetAllocations(poolStart, heapStart);
+
+	for (int i = 0; i < PairCount; i++) {
+		pthread_create(
+			&clients[i].WriterThread,
+			nullptr,
+			WriterThread,
+			&clients[i]);
+		pthread_create(
+			&clients[i].ReaderThread,
+			nullptr,
+			ReaderThread,
+			&clients[i]);
+	}
+
+	// Event loop runs until all messages are relayed.
+	while (__atomic_load_n(&FinishedReaders, __ATOMIC_ACQUIRE) < PairCount) {
+		int eventCount = backend->Wait(100);
+
+		for (int i = 0; i < eventCount; i++) {
+			ProcessSession(
+				backend,
+				(Session*)backend->GetData(i),
+				backend->IsReadable(i),
+				backend->IsWritable(i));
+		}
+	}
+
+	int64_t cpu = GetTime(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+	int64_t wall = GetTime(CLOCK_MONOTONIC) - wallStart;
+	int64_t poolEnd;
+	int64_t heapEnd;
+	GetAllocations(poolEnd, heapEnd);
+
+	for (int i = 0; i < PairCount; i++) {
+		pthread_join(clients[i].WriterThread, nullptr);
+		pthread_join(clients[i].ReaderThread, nullptr);
+	}
+
+	FinishedReaders = 0;
+
+	for (int i = 0; i < PairCount; i++) {
+		backend->RemoveSession(&inbound[i]);
+		backend->RemoveSession(&outbound[i]);
+
+		close(clients[i].Writer);
+		close(clients[i].Reader);
+	}
+
+	double messages = (double)messageCount * PairCount;
+	double bytes = (double)frame.Size() * messages;
+
+	printf(
+		"%s, %ld byte messages, %u byte slices: %.0f messages/s, "
+		"%.0f ms CPU per GB relayed, %.1f pool allocations and "
+		"%.2f heap calls per message.\n",
+		name,
+		messageSize,
+		sliceSize,
+		messages * 1e9 / wall,
+		cpu / 1e6 / (bytes / 1e9),
+		(poolEnd - poolStart) / messages,
+		(heapEnd - heapStart) / messages);
+}
+
+static bool WaitReadable(IOBackend *backend, Session *session)
+{
+	for (int i = 0; i < 3; i++) {
+		int eventCount = backend->Wait(100);
+
+		for (int j = 0; j < eventCount; j++) {
+			if (backend->GetData(j) == session &&
+				backend->IsReadable(j))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Session without flow control is not read while its input is paused.
+void TestInputPause(const char *name, IOBackend *backend)
+{
+	printf("Test input pause, %s.\n", name);
+
+	int sockets[2];
+	socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets);
+
+	Session session;
+	session.Socket = sockets[1];
+	backend->AddSession(&session);
+
+	session.PauseInput(0);
+	backend->Wait(0);
+
+	uint8_t data[16];
+	memset(data, 0, sizeof(data));
+
+	bool success = write(sockets[0], data, sizeof(data)) == sizeof(data);
+	success = success && !WaitReadable(backend, &session);
+
+	session.ResumeInput(0);
+	success = success && WaitReadable(backend, &session);
+
+	backend->RemoveSession(&session);
+	session.Close();
+	close(sockets[0]);
+
+	if (success) {
+		printf("Success.\n");
+	} else {
+		printf("Failure.\n");
+	}
+}
+
+void RunTests()
+{
+	Poller poller;
+	TestInputPause("epoll", &poller);
+
+	try {
+		Uring uring;
+		TestInputPause("io_uring", &uring);
+	} catch (Exception &ex) {
+		printf("io_uring is not available: %s\n", ex.Message().CStr());
+	}
+}
+
+void RunBenchmarks(int64_t messageSize, int64_t messageCount,
+	uint32_t sliceSize = SLICE_SIZE_DEFAULT)
+{
+	Poller poller;
+	Benchmark("epoll", &poller, messageSize, messageCount, sliceSize);
+
+	try {
+		Uring uring;
+		Benchmark(
+			"io_uring",
+			&uring,
+			messageSize,
+			messageCount,
+			sliceSize);
+	} catch (Exception &ex) {
+		printf("io_uring is not available: %s\n", ex.Message().CStr());
+	}
+}
+
+int main(int argc, char **argv)
+{
+	RunTests();
+
+	RunBenchmarks(256, 20000);
+	RunBenchmarks(16 * 1024, 4000);
+	RunBenchmarks(1024 * 1024, 50);
+	RunBenchmarks(1024 * 1024, 50, 64 * 1024);
+
+	return 0;
+}
@@ -0,0 +1,258 @@
+#include <unistd.h>
+#include <malloc.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "../src/Protocol/ServerSession.hpp"
+#include "../src/Protocol/ClientSession.hpp"
+#include "../src/Common/UnixTime.hpp"
+
+// Authenticates clients over socket pairs and keeps their server
+// sessions idle after one keep-alive. Reports resident and heap bytes
+// held by the server side per idle connection.
+
+class IdleProcessor : public MessageProcessor
+{
+public:
+	void NotifyDelivery(void *userPointer, int32_t status) override
+	{
+	}
+
+	void DeliverMessage(CowBuffer<uint8_t> message) override
+	{
+	}
+
+	void UpdateUserData(const uint8_t *key, String name) override
+	{
+	}
+
+	int64_t GetLatestReceiveTimestamp() override
+	{
+		return 0;
+	}
+
+	void VoiceRequest(const uint8_t *key, int64_t timestamp) override
+	{
+	}
+
+	void VoiceInitResponse(int32_t code) override
+	{
+	}
+
+	void VoiceEnd() override
+	{
+	}
+
+	void ReceiveVoiceFrame(CowBuffer<uint8_t> frame) override
+	{
+	}
+};
+
+struct Server
+{
+	UserDB Users;
+	MessagePipe Pipe;
+	Mailbox Inbox;
+	FailBan Ban;
+	KeyLock StorageLock;
+	bool RestrictedMode;
+
+	uint8_t PublicKey[KEY_SIZE];
+	uint8_t PrivateKey[KEY_SIZE];
+};
+
+static void GetClientKeys(int index, ClientSession &client)
+{
+	uint8_t seed[KEY_SIZE];
+
+	// Low bits of the first byte are cleared by key clamping.
+	memset(client.PrivateKey, 1, KEY_SIZE);
+	memset(seed, 2, KEY_SIZE);
+	memcpy(client.PrivateKey + 1, &index, sizeof(index));
+	memcpy(seed + 1, &index, sizeof(index));
+
+	GeneratePublicKey(client.PrivateKey, client.PublicKey);
+	GenerateSignature(
+		seed,
+		client.SignaturePrivateKey,
+		client.SignaturePublicKey);
+}
+
+static bool Step(Session *session)
+{
+	if (session->CanWrite() && !session->Write()) {
+		return false;
+	}
+
+	if (!session->Read()) {
+		return false;
+	}
+
+	while (session->CanReceive()) {
+		if (!session->Process()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Exchanges data until the client is authenticated and its keep-alive
+// is answered.
+static bool Connect(Server *server, ServerSession *session, int index)
+{
+	int sockets[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets)) {
+		return false;
+	}
+
+	IdleProcessor processor;
+	ClientSession client;
+	client.Processor = &processor;
+	client.Socket = sockets[0];
+	GetClientKeys(index, client);
+	memcpy(client.PeerPublicKey, server->PublicKey, KEY_SIZE);
+
+	session->Socket = sockets[1];
+	session->Users = &server->Users;
+	session->Pipe = &server->Pipe;
+	session->Inbox = &server->Inbox;
+	session->Ban = &server->Ban;
+	session->StorageLock = &server->StorageLock;
+	session->IPv4 = 0;
+	session->RestrictedMode = &server->RestrictedMode;
+	session->State = ServerSession::ServerStateWaitFirstSyn;
+	session->SignatureKey = nullptr;
+	session->PeerPublicKey = nullptr;
+	session->PublicKey = server->PublicKey;
+	session->PrivateKey = server->PrivateKey;
+	session->VoiceState = ServerSession::VoiceStateInactive;
+
+	bool success = client.InitSession();
+	bool keepAliveSent = false;
+
+	for (int i = 0; success && i < 100; i++) {
+		success = Step(&client) && Step(session);
+
+		if (!client.ConnectedActive()) {
+			continue;
+		}
+
+		if (!keepAliveSent) {
+			client.TimeState = 0;
+			client.TimePassed();
+			keepAliveSent = true;
+		} else if (!client.TimeState && !session->CanWrite()) {
+			break;
+		}
+	}
+
+	success = success && !client.TimeState;
+
+	// Server session stays open, its peer is not read anymore.
+	client.Disconnect();
+	return success;
+}
+
+static int64_t GetResidentSize()
+{
+	FILE *file = fopen("/proc/self/statm", "r");
+
+	if (!file) {
+		return 0;
+	}
+
+	int64_t size = 0;
+	int64_t resident = 0;
+
+	if (fscanf(file, "%ld %ld", &size, &resident) != 2) {
+		resident = 0;
+	}
+
+	fclose(file);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int64_t GetHeapSize()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+int main(int argc, char **argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 10000;
+
+	// Each connection keeps one descriptor open.
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	if ((int64_t)limit.rlim_cur - 64 < count) {
+		count = limit.rlim_cur - 64;
+	}
+
+	Server *server = new Server;
+	server->RestrictedMode = false;
+	server->Inbox.SetOwner();
+
+	memset(server->PrivateKey, 7, KEY_SIZE);
+	GeneratePublicKey(server->PrivateKey, server->PublicKey);
+
+	for (int i = 0; i <= count; i++) {
+		ClientSession client;
+		GetClientKeys(i, client);
+
+		server->Users.AddUser(
+			client.PublicKey,
+			client.SignaturePublicKey,
+			0,
+			"idle user");
+	}
+
+	ServerSession **sessions = new ServerSession*[count + 1];
+
+	// First connection warms up caches and is not counted.
+	sessions[count] = new ServerSession;
+
+	if (!Connect(server, sessions[count], count)) {
+		printf("Failed to authenticate client.\n");
+		return 1;
+	}
+
+	int64_t resident = GetResidentSize();
+	int64_t heap = GetHeapSize();
+
+	for (int i = 0; i < count; i++) {
+		sessions[i] = new ServerSession;
+
+		if (!Connect(server, sessions[i], i)) {
+			printf("Failed to authenticate client %d.\n", i);
+			return 1;
+		}
+	}
+
+	resident = GetResidentSize() - resident;
+	heap = GetHeapSize() - heap;
+
+	printf("Server session object: %lu bytes.\n", sizeof(ServerSession));
+	printf("Idle connections: %d.\n", count);
+	printf("Resident per connection: %ld bytes.\n", resident / count);
+	printf("Heap per connection: %ld bytes.\n", heap / count);
+
+	for (int i = 0; i <= count; i++) {
+		delete sessions[i];
+	}
+
+	delete[] sessions;
+	delete server;
+
+	unlink("talkd.users");
+	unlink("talkd.banned.ip");
+	return 0;
+}
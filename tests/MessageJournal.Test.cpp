@@ -0,0 +1,465 @@
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../src/Server/MessageJournal.hpp"
+#include "../src/Message/MessageStorage.hpp"
+#include "../src/Message/Message.hpp"
+#include "../src/Common/File.hpp"
+
+// Checks that committed messages are acknowledged in order, stored for
+// both users and recovered from the journal, that the journal is kept
+// while messages can not be stored, that messages which keep failing
+// are moved to the file of failed messages in order without blocking
+// commits, and compares commit rate of single messages and batches.
+
+static const char *JournalPath = "test.journal";
+static const char *FailedPath = "test.journal.failed";
+
+static uint8_t SenderKey[KEY_SIZE];
+static uint8_t RecipientKey[KEY_SIZE];
+
+class AckHandler : public SendMessageHandler
+{
+public:
+	int64_t Messages;
+	int64_t Acks;
+	int64_t LastSequence;
+	bool Ordered;
+
+	AckHandler()
+	{
+		Messages = 0;
+		Acks = 0;
+		LastSequence = 0;
+		Ordered = true;
+	}
+
+	void SendMessage(const CowBuffer<uint8_t> &message) override
+	{
+		Messages++;
+	}
+
+	void MessageStored(int64_t sequence, bool stored) override
+	{
+		if (!stored || sequence <= LastSequence) {
+			Ordered = false;
+		}
+
+		LastSequence = sequence;
+		Acks++;
+	}
+
+	bool StartVoice(const uint8_t *peerKey, int64_t timestamp) override
+	{
+		return false;
+	}
+
+	void VoiceStarted(
+		const uint8_t *peerKey,
+		VoiceStartStatus status) override
+	{
+	}
+
+	void AcceptVoice(const uint8_t *peerKey) override
+	{
+	}
+
+	void DeclineVoice(const uint8_t *peerKey) override
+	{
+	}
+
+	void EndVoice(const uint8_t *peerKey) override
+	{
+	}
+
+	void SendVoiceFrame(
+		const uint8_t *peerKey,
+		const CowBuffer<uint8_t> &frame) override
+	{
+	}
+};
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+static void InitKeys()
+{
+	memset(SenderKey, 0x11, KEY_SIZE);
+	memset(RecipientKey, 0x22, KEY_SIZE);
+}
+
+static CowBuffer<uint8_t> BuildMessage(int64_t timestamp)
+{
+	Message::Header header;
+	header.Source = SenderKey;
+	header.Destination = RecipientKey;
+	header.Timestamp = timestamp;
+	header.Index = 0;
+
+	CowBuffer<uint8_t> text(200);
+	memset(text.Pointer(), 'a', text.Size());
+
+	return Message::BuildMessage(Message::BuildHeader(header), text);
+}
+
+// Delivers notifications until the handler has the given number of
+// them.
+static void WaitForAcks(
+	MessagePipe &pipe,
+	Mailbox &inbox,
+	AckHandler &handler,
+	int64_t count)
+{
+	while (handler.Acks < count) {
+		PipeEvent *event = inbox.Take();
+
+		if (!event) {
+			usleep(100);
+			continue;
+		}
+
+		while (event) {
+			PipeEvent *next = event->Next;
+			pipe.Deliver(event, &inbox);
+			event = next;
+		}
+	}
+}
+
+// Delivers events left after the journal is stopped.
+static void DeliverAll(MessagePipe &pipe, Mailbox &inbox)
+{
+	PipeEvent *event = inbox.Take();
+
+	while (event) {
+		while (event) {
+			PipeEvent *next = event->Next;
+			pipe.Deliver(event, &inbox);
+			event = next;
+		}
+
+		event = inbox.Take();
+	}
+}
+
+static int64_t CountMessages(const uint8_t *owner)
+{
+	MessageStorage storage(owner, StorageEngine::TypeSegments);
+	return storage.GetMessageRange(0, 1000000).Size();
+}
+
+void TestCommit()
+{
+	printf("Test commit.\n");
+
+	system("rm -rf storage");
+	RemoveFile(JournalPath);
+
+	bool success = true;
+	const int count = 1000;
+
+	Mailbox inbox;
+	inbox.SetOwner();
+
+	AckHandler sender;
+	AckHandler recipient;
+	int64_t backlog = 0;
+
+	MessagePipe pipe;
+	pipe.Register(SenderKey, &sender, &inbox, &backlog);
+	pipe.Register(RecipientKey, &recipient, &inbox, &backlog);
+
+	KeyLock storageLock;
+
+	{
+		MessageJournal journal(JournalPath, &pipe, &storageLock);
+		journal.SetStorage(StorageEngine::TypeSegments);
+		journal.SetCommitInterval(10000);
+		journal.SetBatchSize(100);
+		journal.SetApplyThreads(4);
+		journal.Start();
+
+		for (int i = 0; i < count; i++) {
+			journal.Append(BuildMessage(i));
+		}
+
+		// Resent message is acknowledged and not relayed again.
+		journal.Append(BuildMessage(0));
+
+		WaitForAcks(pipe, inbox, sender, count);
+
+		journal.Stop();
+		WaitForAcks(pipe, inbox, sender, count + 1);
+
+		// Messages are relayed after acknowledgement.
+		DeliverAll(pipe, inbox);
+
+		MessageJournal::CommitStatistics statistics;
+		journal.GetCommitStatistics(statistics);
+
+		if (statistics.Messages != count + 1 ||
+			statistics.Commits != count / 100 + 1)
+		{
+			success = false;
+		}
+	}
+
+	if (!sender.Ordered || recipient.Messages != count) {
+		success = false;
+	}
+
+	if (CountMessages(SenderKey) != count ||
+		CountMessages(RecipientKey) != count)
+	{
+		success = false;
+	}
+
+	pipe.Unregister(SenderKey, &sender);
+	pipe.Unregister(RecipientKey, &recipient);
+
+	// Storage is lost after the commit, last batch is written
+	// partially.
+	system("rm -rf storage");
+
+	uint64_t journalSize;
+
+	{
+		BinaryFile file(JournalPath, false);
+		journalSize = file.Size();
+
+		uint8_t garbage[100];
+		memset(garbage, 0x55, sizeof(garbage));
+		file.Write<uint8_t>(garbage, sizeof(garbage), journalSize);
+	}
+
+	// Storage can not be written, journal is kept without the partial
+	// batch.
+	system("touch storage");
+
+	{
+		MessageJournal journal(JournalPath, &pipe, &storageLock);
+		journal.SetStorage(StorageEngine::TypeSegments);
+
+		if (journal.Recover() != count + 1) {
+			success = false;
+		}
+	}
+
+	{
+		BinaryFile file(JournalPath, false);
+
+		if (file.Size() != journalSize) {
+			success = false;
+		}
+	}
+
+	system("rm -f storage");
+
+	{
+		MessageJournal journal(JournalPath, &pipe, &storageLock);
+		journal.SetStorage(StorageEngine::TypeSegments);
+
+		if (journal.Recover() != count + 1) {
+			success = false;
+		}
+
+		if (journal.Recover() != 0) {
+			success = false;
+		}
+	}
+
+	if (CountMessages(SenderKey) != count ||
+		CountMessages(RecipientKey) != count)
+	{
+		success = false;
+	}
+
+	system("rm -rf storage");
+	RemoveFile(JournalPath);
+
+	Report(success);
+}
+
+static uint64_t GetFileSize(const char *path)
+{
+	if (!FileExists(path)) {
+		return 0;
+	}
+
+	BinaryFile file(path, false);
+	return file.Size();
+}
+
+void TestFailed()
+{
+	printf("Test failed messages.\n");
+
+	system("rm -rf storage");
+	RemoveFile(JournalPath);
+	RemoveFile(FailedPath);
+
+	bool success = true;
+	const int count = 2;
+
+	CowBuffer<uint8_t> message = BuildMessage(0);
+	// Records have 24 byte headers.
+	uint64_t recordSize = 24 + message.Size();
+
+	Mailbox inbox;
+	inbox.SetOwner();
+
+	AckHandler sender;
+	AckHandler recipient;
+	int64_t backlog = 0;
+
+	MessagePipe pipe;
+	pipe.Register(SenderKey, &sender, &inbox, &backlog);
+	pipe.Register(RecipientKey, &recipient, &inbox, &backlog);
+
+	KeyLock storageLock;
+
+	// Storage can not be written.
+	system("touch storage");
+
+	{
+		MessageJournal journal(JournalPath, &pipe, &storageLock);
+		journal.SetStorage(StorageEngine::TypeSegments);
+		journal.SetCommitInterval(0);
+		journal.SetBatchSize(1);
+		journal.Start();
+
+		for (int i = 0; i < count; i++) {
+			journal.Append(BuildMessage(i));
+		}
+
+		// Commits are acknowledged while messages are retried.
+		WaitForAcks(pipe, inbox, sender, count);
+
+		for (int i = 0; i < 200; i++) {
+			if (GetFileSize(FailedPath) >= recordSize * count) {
+				break;
+			}
+
+			usleep(100000);
+		}
+
+		system("rm -f storage");
+
+		journal.Append(BuildMessage(count));
+		WaitForAcks(pipe, inbox, sender, count + 1);
+
+		journal.Stop();
+		DeliverAll(pipe, inbox);
+	}
+
+	if (!sender.Ordered || recipient.Messages != 1) {
+		success = false;
+	}
+
+	if (GetFileSize(FailedPath) != recordSize * count) {
+		success = false;
+	} else {
+		BinaryFile file(FailedPath, false);
+
+		for (int i = 0; i < count; i++) {
+			int64_t sequence;
+			file.Read<int64_t>(&sequence, 1, recordSize * i);
+
+			if (sequence != i + 1) {
+				success = false;
+			}
+		}
+	}
+
+	if (CountMessages(SenderKey) != 1) {
+		success = false;
+	}
+
+	pipe.Unregister(SenderKey, &sender);
+	pipe.Unregister(RecipientKey, &recipient);
+
+	system("rm -rf storage");
+	RemoveFile(JournalPath);
+	RemoveFile(FailedPath);
+
+	Report(success);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void Benchmark(int64_t batchSize, int count)
+{
+	system("rm -rf storage");
+	RemoveFile(JournalPath);
+
+	Mailbox inbox;
+	inbox.SetOwner();
+
+	AckHandler sender;
+	int64_t backlog = 0;
+
+	MessagePipe pipe;
+	pipe.Register(SenderKey, &sender, &inbox, &backlog);
+
+	KeyLock storageLock;
+	MessageJournal journal(JournalPath, &pipe, &storageLock);
+	journal.SetStorage(StorageEngine::TypeSegments);
+	journal.SetCommitInterval(0);
+	journal.SetBatchSize(batchSize);
+	journal.Start();
+
+	int64_t start = GetTime();
+
+	for (int i = 0; i < count; i++) {
+		journal.Append(BuildMessage(i));
+	}
+
+	WaitForAcks(pipe, inbox, sender, count);
+
+	int64_t time = GetTime() - start;
+
+	journal.Stop();
+
+	MessageJournal::CommitStatistics statistics;
+	journal.GetCommitStatistics(statistics);
+
+	printf(
+		"Batch size %ld, %d messages: %.0f messages/s, "
+		"%ld commits.\n",
+		batchSize,
+		count,
+		count / (time / 1e9),
+		statistics.Commits);
+
+	pipe.Unregister(SenderKey, &sender);
+
+	system("rm -rf storage");
+	RemoveFile(JournalPath);
+}
+
+int main(int argc, char **argv)
+{
+	InitKeys();
+
+	TestCommit();
+	TestFailed();
+
+	Benchmark(1, 2000);
+	Benchmark(256, 2000);
+
+	return 0;
+}
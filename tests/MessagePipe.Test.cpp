@@ -0,0 +1,245 @@
+#include <time.h>
+#include <cstdio>
+#include <cstring>
+
+#include "../src/Server/MessagePipe.hpp"
+#include "../src/Message/Message.hpp"
+
+// Checks registration of online users and measures cost of relaying
+// a message for different numbers of online users.
+
+class CountingHandler : public SendMessageHandler
+{
+public:
+	int64_t Messages;
+
+	CountingHandler()
+	{
+		Messages = 0;
+	}
+
+	void SendMessage(const CowBuffer<uint8_t> &message) override
+	{
+		Messages++;
+	}
+
+	void MessageStored(int64_t sequence, bool stored) override
+	{
+	}
+
+	bool StartVoice(const uint8_t *peerKey, int64_t timestamp) override
+	{
+		return false;
+	}
+
+	void VoiceStarted(
+		const uint8_t *peerKey,
+		VoiceStartStatus status) override
+	{
+	}
+
+	void AcceptVoice(const uint8_t *peerKey) override
+	{
+	}
+
+	void DeclineVoice(const uint8_t *peerKey) override
+	{
+	}
+
+	void EndVoice(const uint8_t *peerKey) override
+	{
+	}
+
+	void SendVoiceFrame(
+		const uint8_t *peerKey,
+		const CowBuffer<uint8_t> &frame) override
+	{
+	}
+};
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+static uint8_t *GenerateKeys(int count)
+{
+	uint8_t *keys = new uint8_t[count * KEY_SIZE];
+
+	for (int i = 0; i < count; i++) {
+		memset(keys + i * KEY_SIZE, 0x33, KEY_SIZE);
+		memcpy(keys + i * KEY_SIZE + 4, &i, sizeof(i));
+	}
+
+	return keys;
+}
+
+static CowBuffer<uint8_t> BuildMessage(
+	const uint8_t *source,
+	const uint8_t *destination)
+{
+	Message::Header header;
+	header.Source = source;
+	header.Destination = destination;
+	header.Timestamp = 1;
+	header.Index = 0;
+
+	CowBuffer<uint8_t> text(16);
+	memset(text.Pointer(), 'a', text.Size());
+
+	return Message::BuildMessage(Message::BuildHeader(header), text);
+}
+
+void TestRegistration()
+{
+	printf("Test registration.\n");
+
+	bool success = true;
+
+	const int count = 1000;
+	uint8_t *keys = GenerateKeys(count + 1);
+
+	Mailbox inbox;
+	inbox.SetOwner();
+
+	CountingHandler handler;
+	CountingHandler other;
+	int64_t backlog = 5;
+
+	MessagePipe pipe;
+
+	// Table grows several times.
+	for (int i = 0; i < count; i++) {
+		const uint8_t *key = keys + i * KEY_SIZE;
+
+		if (!pipe.Register(key, &handler, &inbox, &backlog)) {
+			success = false;
+		}
+	}
+
+	if (pipe.Register(keys, &other, &inbox, &backlog)) {
+		success = false;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!pipe.IsOnline(keys + i * KEY_SIZE)) {
+			success = false;
+		}
+	}
+
+	const uint8_t *offline = keys + count * KEY_SIZE;
+
+	if (pipe.IsOnline(offline) || pipe.GetBacklog(offline)) {
+		success = false;
+	}
+
+	if (pipe.SendMessage(BuildMessage(offline, keys)) != 5 ||
+		handler.Messages != 1)
+	{
+		success = false;
+	}
+
+	pipe.SendMessage(BuildMessage(keys, offline));
+
+	if (handler.Messages != 1) {
+		success = false;
+	}
+
+	// Only the registered handler removes the user.
+	pipe.Unregister(keys, &other);
+
+	if (!pipe.IsOnline(keys)) {
+		success = false;
+	}
+
+	for (int i = 0; i < count; i += 2) {
+		pipe.Unregister(keys + i * KEY_SIZE, &handler);
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (pipe.IsOnline(keys + i * KEY_SIZE) != (i % 2 == 1)) {
+			success = false;
+		}
+	}
+
+	if (!pipe.Register(keys, &other, &inbox, &backlog)) {
+		success = false;
+	}
+
+	delete[] keys;
+
+	Report(success);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void BenchmarkRelay(int count)
+{
+	uint8_t *keys = GenerateKeys(count);
+
+	Mailbox inbox;
+	inbox.SetOwner();
+
+	CountingHandler handler;
+	int64_t backlog = 0;
+
+	MessagePipe pipe;
+
+	for (int i = 0; i < count; i++) {
+		pipe.Register(keys + i * KEY_SIZE, &handler, &inbox, &backlog);
+	}
+
+	// Destinations are spread over all online users.
+	const int messageCount = 4096;
+	CowBuffer<uint8_t> *messages = new CowBuffer<uint8_t>[messageCount];
+	uint32_t random = 12345;
+
+	for (int i = 0; i < messageCount; i++) {
+		random = random * 1103515245 + 12345;
+
+		messages[i] = BuildMessage(
+			keys,
+			keys + (random >> 8) % count * KEY_SIZE);
+	}
+
+	const int64_t sendCount = 1000000;
+	int64_t start = GetTime();
+
+	for (int64_t i = 0; i < sendCount; i++) {
+		pipe.SendMessage(messages[i % messageCount]);
+	}
+
+	int64_t time = GetTime() - start;
+
+	printf(
+		"Relay with %d online users: %.0f ns per message.\n",
+		count,
+		(double)time / sendCount);
+
+	if (handler.Messages != sendCount) {
+		printf("Lost messages.\n");
+	}
+
+	delete[] messages;
+	delete[] keys;
+}
+
+int main(int argc, char **argv)
+{
+	TestRegistration();
+
+	BenchmarkRelay(10);
+	BenchmarkRelay(1000);
+	BenchmarkRelay(100000);
+
+	return 0;
+}
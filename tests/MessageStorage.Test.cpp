@@ -0,0 +1,678 @@
+#include <time.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../src/Message/MessageStorage.hpp"
+#include "../src/Message/StorageConverter.hpp"
+#include "../src/Common/File.hpp"
+
+// Checks that both storage engines and the converter keep the same
+// messages, that damaged storage is repaired when messages are stored
+// again, checks the timeline of the owner and compares insert rate
+// and range scan throughput.
+
+static uint8_t OwnerKey[KEY_SIZE];
+static uint8_t PeerKeys[2][KEY_SIZE];
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+static void InitKeys()
+{
+	memset(OwnerKey, 0x11, KEY_SIZE);
+	memset(PeerKeys[0], 0x22, KEY_SIZE);
+	memset(PeerKeys[1], 0x33, KEY_SIZE);
+}
+
+static CowBuffer<uint8_t> BuildMessage(
+	int peer,
+	bool incoming,
+	int64_t timestamp,
+	int32_t index,
+	uint64_t size)
+{
+	Message::Header header;
+	header.Source = incoming ? PeerKeys[peer] : OwnerKey;
+	header.Destination = incoming ? OwnerKey : PeerKeys[peer];
+	header.Timestamp = timestamp;
+	header.Index = index;
+
+	CowBuffer<uint8_t> text(size);
+
+	for (uint64_t i = 0; i < size; i++) {
+		text[i] = timestamp + i;
+	}
+
+	return Message::BuildMessage(Message::BuildHeader(header), text);
+}
+
+static bool Equal(
+	const CowBuffer<CowBuffer<uint8_t>> &first,
+	const CowBuffer<CowBuffer<uint8_t>> &second)
+{
+	if (first.Size() != second.Size()) {
+		return false;
+	}
+
+	for (uint64_t i = 0; i < first.Size(); i++) {
+		bool equal =
+			first[i].Size() == second[i].Size() &&
+			!memcmp(
+				first[i].Pointer(),
+				second[i].Pointer(),
+				first[i].Size());
+
+		if (!equal) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Timestamps go out of order, some messages share them and one
+// message is large enough to be mapped.
+static bool AddMessages(MessageStorage &storage)
+{
+	bool success = true;
+
+	for (int i = 0; i < 600; i++) {
+		int64_t timestamp = (i * 7919) % 500;
+		uint64_t size = i == 300 ? 2 * 1024 * 1024 : 100 + i % 50;
+
+		CowBuffer<uint8_t> message = BuildMessage(
+			i % 2,
+			i % 3 == 0,
+			timestamp,
+			i / 500,
+			size);
+
+		if (!storage.AddMessage(message)) {
+			success = false;
+		}
+
+		if (storage.AddMessage(message)) {
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+static bool Compare(MessageStorage &first, MessageStorage &second)
+{
+	bool success =
+		Equal(first.GetMessageRange(0, 1000),
+			second.GetMessageRange(0, 1000)) &&
+		Equal(first.GetMessageRange(PeerKeys[0], 100, 200),
+			second.GetMessageRange(PeerKeys[0], 100, 200)) &&
+		Equal(first.GetLatestNMessages(PeerKeys[1], 50),
+			second.GetLatestNMessages(PeerKeys[1], 50));
+
+	for (int i = 0; i < 20; i++) {
+		bool exists = first.MessageExists(PeerKeys[0], i, 0, false);
+
+		if (second.MessageExists(PeerKeys[0], i, 0, false) != exists) {
+			success = false;
+		}
+
+		int32_t firstIndex;
+		int32_t secondIndex;
+
+		first.GetFreeTimestampIndex(PeerKeys[1], i, firstIndex);
+		second.GetFreeTimestampIndex(PeerKeys[1], i, secondIndex);
+
+		if (firstIndex != secondIndex) {
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+void TestEngines()
+{
+	printf("Test engines.\n");
+
+	system("rm -rf storage");
+
+	MessageStorage files(OwnerKey, StorageEngine::TypeFiles);
+	MessageStorage segments(OwnerKey, StorageEngine::TypeSegments);
+
+	bool success = AddMessages(files) && AddMessages(segments);
+
+	if (!Compare(files, segments)) {
+		success = false;
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> all =
+		segments.GetMessageRange(PeerKeys[0], 0, 1000);
+
+	if (all.Size() != 300) {
+		success = false;
+	}
+
+	for (uint64_t i = 1; i < all.Size(); i++) {
+		Message::Header previous;
+		Message::Header current;
+		Message::GetHeader(all[i - 1], previous);
+		Message::GetHeader(all[i], current);
+
+		if (previous.Timestamp > current.Timestamp) {
+			success = false;
+		}
+	}
+
+	system("rm -rf storage");
+
+	Report(success);
+}
+
+void TestConverter()
+{
+	printf("Test converter.\n");
+
+	system("rm -rf storage");
+
+	MessageStorage files(OwnerKey, StorageEngine::TypeFiles);
+	bool success = AddMessages(files);
+
+	CowBuffer<CowBuffer<uint8_t>> before = files.GetMessageRange(0, 1000);
+
+	if (ConvertStorageToSegments() != 600) {
+		success = false;
+	}
+
+	MessageStorage segments(OwnerKey, StorageEngine::TypeSegments);
+
+	if (!Equal(before, segments.GetMessageRange(0, 1000))) {
+		success = false;
+	}
+
+	if (files.GetMessageRange(0, 1000).Size()) {
+		success = false;
+	}
+
+	// Nothing is left to convert.
+	if (ConvertStorageToSegments() != 0) {
+		success = false;
+	}
+
+	system("rm -rf storage");
+
+	Report(success);
+}
+
+// Message of the pair is added to both storages as on the server.
+static bool AddShared(
+	MessageStorage &owner,
+	MessageStorage &peer,
+	bool incoming,
+	int64_t timestamp)
+{
+	CowBuffer<uint8_t> message =
+		BuildMessage(0, incoming, timestamp, 0, 1000);
+
+	return owner.AddMessage(message) && peer.AddMessage(message);
+}
+
+static uint64_t DirectorySize(const String &path)
+{
+	if (!FileExists(path)) {
+		return 0;
+	}
+
+	CowBuffer<String> files = ListDirectory(path);
+	uint64_t size = 0;
+
+	for (uint32_t i = 0; i < files.Size(); i++) {
+		struct stat fileStat;
+		String filePath = path + "/" + files[i];
+
+		if (!stat(filePath.CStr(), &fileStat)) {
+			size += S_ISDIR(fileStat.st_mode) ?
+				DirectorySize(filePath) :
+				fileStat.st_size;
+		}
+	}
+
+	return size;
+}
+
+void TestSharedCopies(StorageEngine::Type type, const char *name)
+{
+	printf("Test shared copies, %s.\n", name);
+
+	system("rm -rf storage");
+
+	MessageStorage owner(OwnerKey, type);
+	MessageStorage peer(PeerKeys[0], type);
+
+	bool success = true;
+
+	for (int i = 0; i < 10; i++) {
+		if (!AddShared(owner, peer, i % 2, i)) {
+			success = false;
+		}
+	}
+
+	// Every message is kept once.
+	if (DirectorySize("storage") > 10 * 1100 + 64 * 1024) {
+		success = false;
+	}
+
+	if (type == StorageEngine::TypeFiles) {
+		StringBuilder path;
+		path.Append("storage/");
+		path.AppendHex(OwnerKey, KEY_SIZE);
+		path.Append("/storage/");
+		path.AppendHex(PeerKeys[0], KEY_SIZE);
+		path.Append("/out/");
+		path.AppendHex((int64_t)0);
+		path.Append('_');
+		path.AppendHex((int32_t)0);
+
+		struct stat fileStat;
+		String messagePath = path.Build();
+
+		if (stat(messagePath.CStr(), &fileStat)) {
+			success = false;
+		} else if (fileStat.st_nlink != 2) {
+			success = false;
+		}
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> ownerMessages =
+		owner.GetMessageRange(PeerKeys[0], 0, 100);
+
+	if (ownerMessages.Size() != 10) {
+		success = false;
+	}
+
+	if (!Equal(ownerMessages, peer.GetMessageRange(OwnerKey, 0, 100))) {
+		success = false;
+	}
+
+	// Message stays readable for the peer until the peer removes it.
+	if (!owner.RemoveMessage(PeerKeys[0], 0, 0, false)) {
+		success = false;
+	}
+
+	if (owner.RemoveMessage(PeerKeys[0], 0, 0, false)) {
+		success = false;
+	}
+
+	if (owner.GetMessageRange(PeerKeys[0], 0, 100).Size() != 9) {
+		success = false;
+	}
+
+	if (!Equal(ownerMessages, peer.GetMessageRange(OwnerKey, 0, 100))) {
+		success = false;
+	}
+
+	if (!peer.RemoveMessage(OwnerKey, 0, 0, true)) {
+		success = false;
+	}
+
+	if (peer.GetMessageRange(OwnerKey, 0, 0).Size()) {
+		success = false;
+	}
+
+	system("rm -rf storage");
+
+	Report(success);
+}
+
+static String GetIndexPath(StorageEngine::Type type)
+{
+	StringBuilder path;
+	path.Append("storage/");
+	path.AppendHex(OwnerKey, KEY_SIZE);
+	path.Append("/storage/");
+	path.AppendHex(PeerKeys[0], KEY_SIZE);
+	path.Append(type == StorageEngine::TypeFiles ? "/index" : "/log.index");
+	return path.Build();
+}
+
+// Storage files are not synced. Messages stored again after their data
+// or index pages are lost are readable.
+void TestRepair(StorageEngine::Type type, const char *name)
+{
+	printf("Test repair, %s.\n", name);
+
+	system("rm -rf storage");
+
+	MessageStorage owner(OwnerKey, type);
+	MessageStorage peer(PeerKeys[0], type);
+
+	bool success = true;
+
+	for (int i = 0; i < 10; i++) {
+		if (!AddShared(owner, peer, i % 2, i)) {
+			success = false;
+		}
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> before =
+		owner.GetMessageRange(PeerKeys[0], 0, 100);
+
+	system(
+		"find storage -type f \\( -name 'log_*' -o -path '*/in/*' "
+		"-o -path '*/out/*' \\) -exec truncate -s 0 {} +");
+
+	for (int i = 0; i < 10; i++) {
+		if (!AddShared(owner, peer, i % 2, i)) {
+			success = false;
+		}
+	}
+
+	if (!Equal(before, owner.GetMessageRange(PeerKeys[0], 0, 100))) {
+		success = false;
+	}
+
+	if (!Equal(before, peer.GetMessageRange(OwnerKey, 0, 100))) {
+		success = false;
+	}
+
+	// Index keeps its header page only.
+	String command = "truncate -s 4096 " + GetIndexPath(type);
+	system(command.CStr());
+
+	if (!AddShared(owner, peer, false, 10)) {
+		success = false;
+	}
+
+	CowBuffer<CowBuffer<uint8_t>> after =
+		owner.GetMessageRange(PeerKeys[0], 0, 100);
+
+	if (after.Size() != 11 || !Equal(before, after.Slice(0, 10))) {
+		success = false;
+	}
+
+	system("rm -rf storage");
+
+	Report(success);
+}
+
+static void MakePeerKey(int peer, uint8_t *peerKey)
+{
+	memset(peerKey, 0x44, KEY_SIZE);
+	memcpy(peerKey, &peer, sizeof(peer));
+}
+
+static CowBuffer<uint8_t> BuildPeerMessage(
+	int peer,
+	bool incoming,
+	int64_t timestamp)
+{
+	uint8_t peerKey[KEY_SIZE];
+	MakePeerKey(peer, peerKey);
+
+	Message::Header header;
+	header.Source = incoming ? peerKey : OwnerKey;
+	header.Destination = incoming ? OwnerKey : peerKey;
+	header.Timestamp = timestamp;
+	header.Index = 0;
+
+	CowBuffer<uint8_t> text(100);
+	memset(text.Pointer(), peer, text.Size());
+
+	return Message::BuildMessage(Message::BuildHeader(header), text);
+}
+
+// Range of all peers holds messages of each peer range, ordered by
+// timestamp.
+static bool CheckRange(
+	MessageStorage &storage,
+	int peerCount,
+	int64_t from,
+	int64_t to)
+{
+	CowBuffer<CowBuffer<uint8_t>> range = storage.GetMessageRange(from, to);
+	uint64_t expected = 0;
+
+	for (int peer = 0; peer < peerCount; peer++) {
+		uint8_t peerKey[KEY_SIZE];
+		MakePeerKey(peer, peerKey);
+		expected += storage.GetMessageRange(peerKey, from, to).Size();
+	}
+
+	if (range.Size() != expected) {
+		return false;
+	}
+
+	for (uint64_t i = 0; i < range.Size(); i++) {
+		Message::Header header;
+		Message::GetHeader(range[i], header);
+
+		bool valid =
+			header.Timestamp >= from &&
+			header.Timestamp <= to;
+
+		if (i > 0) {
+			Message::Header previous;
+			Message::GetHeader(range[i - 1], previous);
+
+			if (previous.Timestamp > header.Timestamp) {
+				valid = false;
+			}
+		}
+
+		if (!valid) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static String GetTimelinePath()
+{
+	StringBuilder path;
+	path.Append("storage/");
+	path.AppendHex(OwnerKey, KEY_SIZE);
+	path.Append("/timeline");
+	return path.Build();
+}
+
+void TestTimeline(StorageEngine::Type type, const char *name)
+{
+	printf("Test timeline, %s.\n", name);
+
+	system("rm -rf storage");
+
+	const int peerCount = 30;
+	bool success = true;
+
+	MessageStorage storage(OwnerKey, type);
+
+	// Messages stored before the timeline is built.
+	for (int i = 0; i < 600; i++) {
+		storage.AddMessage(
+			BuildPeerMessage(i % peerCount, i % 3, i / 7));
+	}
+
+	if (!CheckRange(storage, peerCount, 0, 1000) ||
+		!CheckRange(storage, peerCount, 20, 40))
+	{
+		success = false;
+	}
+
+	// Added messages are in the timeline, resent ones are added
+	// once.
+	for (int i = 0; i < 100; i++) {
+		CowBuffer<uint8_t> message = BuildPeerMessage(
+			i % peerCount,
+			i / peerCount % 2,
+			1000);
+
+		storage.AddMessage(message);
+		storage.AddMessage(message);
+	}
+
+	if (storage.GetMessageRange(1000, 1000).Size() != 2 * peerCount) {
+		success = false;
+	}
+
+	uint8_t peerKey[KEY_SIZE];
+	MakePeerKey(5, peerKey);
+
+	if (!storage.RemoveMessage(peerKey, 1000, 0, true)) {
+		success = false;
+	}
+
+	if (!CheckRange(storage, peerCount, 0, 2000)) {
+		success = false;
+	}
+
+	// Rebuilt timeline gives the same range.
+	CowBuffer<CowBuffer<uint8_t>> before = storage.GetMessageRange(0, 2000);
+	RemoveFile(GetTimelinePath());
+
+	if (!Equal(before, storage.GetMessageRange(0, 2000))) {
+		success = false;
+	}
+
+	system("rm -rf storage");
+
+	Report(success);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void Benchmark(StorageEngine::Type type, const char *name, int count)
+{
+	system("rm -rf storage");
+
+	MessageStorage storage(OwnerKey, type);
+
+	const uint64_t size = 256;
+	CowBuffer<uint8_t> *messages = new CowBuffer<uint8_t>[count];
+
+	for (int i = 0; i < count; i++) {
+		messages[i] = BuildMessage(0, i % 2, i, 0, size);
+	}
+
+	int64_t start = GetTime();
+
+	for (int i = 0; i < count; i++) {
+		storage.AddMessage(messages[i]);
+	}
+
+	int64_t insertTime = GetTime() - start;
+
+	start = GetTime();
+	CowBuffer<CowBuffer<uint8_t>> range =
+		storage.GetMessageRange(PeerKeys[0], 0, count);
+	int64_t scanTime = GetTime() - start;
+
+	start = GetTime();
+	const int latestCount = 100;
+
+	for (int i = 0; i < latestCount; i++) {
+		storage.GetLatestNMessages(PeerKeys[0], 50);
+	}
+
+	int64_t latestTime = (GetTime() - start) / latestCount;
+
+	printf(
+		"%s, %d messages: insert %.0f messages/s, "
+		"scan %.0f messages/s (%.1f MB/s), latest 50 in %.2f ms.\n",
+		name,
+		count,
+		count / (insertTime / 1e9),
+		range.Size() / (scanTime / 1e9),
+		range.Size() * size / (scanTime / 1e3),
+		latestTime / 1e6);
+
+	if ((int)range.Size() != count) {
+		printf("Lost messages.\n");
+	}
+
+	delete[] messages;
+	system("rm -rf storage");
+}
+
+// Reconnecting user with many conversations gets the few new
+// messages, timeline is compared with the scan of every peer.
+void BenchmarkTimeline(StorageEngine::Type type, const char *name, int count)
+{
+	system("rm -rf storage");
+
+	MessageStorage storage(OwnerKey, type);
+
+	for (int peer = 0; peer < count; peer++) {
+		for (int i = 0; i < 4; i++) {
+			storage.AddMessage(BuildPeerMessage(peer, i % 2, i));
+		}
+	}
+
+	storage.GetMessageRange(0, 0);
+
+	storage.AddMessage(BuildPeerMessage(7, true, 100));
+	storage.AddMessage(BuildPeerMessage(count / 2, false, 101));
+
+	int64_t start = GetTime();
+	uint64_t found = storage.GetMessageRange(100, 200).Size();
+	int64_t timelineTime = GetTime() - start;
+
+	start = GetTime();
+	uint64_t scanned = 0;
+
+	for (int peer = 0; peer < count; peer++) {
+		uint8_t peerKey[KEY_SIZE];
+		MakePeerKey(peer, peerKey);
+		scanned += storage.GetMessageRange(peerKey, 100, 200).Size();
+	}
+
+	int64_t scanTime = GetTime() - start;
+
+	printf(
+		"%s, %d peers, 2 new messages: timeline %.2f ms, "
+		"scan of peers %.2f ms.\n",
+		name,
+		count,
+		timelineTime / 1e6,
+		scanTime / 1e6);
+
+	if (found != 2 || scanned != 2) {
+		printf("Lost messages.\n");
+	}
+
+	system("rm -rf storage");
+}
+
+int main(int argc, char **argv)
+{
+	InitKeys();
+
+	TestEngines();
+	TestConverter();
+	TestSharedCopies(StorageEngine::TypeFiles, "files");
+	TestSharedCopies(StorageEngine::TypeSegments, "segments");
+	TestRepair(StorageEngine::TypeFiles, "files");
+	TestRepair(StorageEngine::TypeSegments, "segments");
+	TestTimeline(StorageEngine::TypeFiles, "files");
+	TestTimeline(StorageEngine::TypeSegments, "segments");
+
+	Benchmark(StorageEngine::TypeFiles, "Files", 20000);
+	Benchmark(StorageEngine::TypeSegments, "Segments", 20000);
+
+	BenchmarkTimeline(StorageEngine::TypeFiles, "Files", 5000);
+	BenchmarkTimeline(StorageEngine::TypeSegments, "Segments", 5000);
+
+	return 0;
+}
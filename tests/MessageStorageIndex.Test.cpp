@@ -0,0 +1,410 @@
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../src/Message/MessageStorageIndex.hpp"
+#include "../src/Common/File.hpp"
+
+// Checks the index against a plain table of keys and measures it on
+// large conversations. Entry count of the benchmark is the first
+// argument.
+
+static const char *IndexPath = "test.index";
+
+enum
+{
+	TimestampCount = 3000,
+	IndexCount = 3
+};
+
+struct Reference
+{
+	uint32_t Numbers[TimestampCount][IndexCount][2];
+};
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+static bool CheckEntries(MessageStorageIndex &index, Reference &reference)
+{
+	bool success = true;
+
+	for (int t = 0; t < TimestampCount; t++) {
+		for (int i = 0; i < IndexCount; i++) {
+			for (int d = 0; d < 2; d++) {
+				uint32_t number = index.FindEntry(t, i, d);
+
+				if (number != reference.Numbers[t][i][d]) {
+					success = false;
+				}
+			}
+		}
+	}
+
+	return success;
+}
+
+// Scans forward from every tenth timestamp and backward from the end.
+static bool CheckOrder(MessageStorageIndex &index, Reference &reference)
+{
+	bool success = true;
+
+	for (int from = 0; from < TimestampCount; from += 10) {
+		uint32_t position = index.FindSmallest(from);
+
+		for (int t = from; t < TimestampCount; t++) {
+			for (int i = 0; i < IndexCount; i++) {
+				for (int d = 0; d < 2; d++) {
+					if (!reference.Numbers[t][i][d]) {
+						continue;
+					}
+
+					int64_t timestamp;
+					int32_t entryIndex;
+					bool incoming;
+
+					if (!position) {
+						return false;
+					}
+
+					index.GetEntry(
+						position,
+						timestamp,
+						entryIndex,
+						incoming);
+
+					bool equal =
+						timestamp == t &&
+						entryIndex == i &&
+						incoming == (bool)d &&
+						index.GetNumber(position) ==
+						reference.Numbers[t][i][d];
+
+					if (!equal) {
+						success = false;
+					}
+
+					position = index.Next(position);
+				}
+			}
+		}
+
+		if (position) {
+			success = false;
+		}
+	}
+
+	uint32_t position = index.FindBiggest();
+
+	for (int t = TimestampCount - 1; t >= 0; t--) {
+		for (int i = IndexCount - 1; i >= 0; i--) {
+			for (int d = 1; d >= 0; d--) {
+				if (!reference.Numbers[t][i][d]) {
+					continue;
+				}
+
+				if (!position) {
+					return false;
+				}
+
+				if (index.GetNumber(position) !=
+					reference.Numbers[t][i][d])
+				{
+					success = false;
+				}
+
+				position = index.Previous(position);
+			}
+		}
+	}
+
+	if (position) {
+		success = false;
+	}
+
+	return success;
+}
+
+void TestIndex()
+{
+	printf("Test index.\n");
+
+	RemoveFile(IndexPath);
+
+	Reference *reference = new Reference;
+	memset(reference, 0, sizeof(*reference));
+
+	bool success = true;
+
+	{
+		MessageStorageIndex index(IndexPath);
+
+		if (index.FindSmallest(0) || index.FindBiggest()) {
+			success = false;
+		}
+
+		srand(1);
+
+		for (int n = 0; n < 15000; n++) {
+			int t = rand() % TimestampCount;
+			int i = rand() % IndexCount;
+			int d = rand() % 2;
+
+			uint32_t &number = reference->Numbers[t][i][d];
+
+			if (n % 4 == 3) {
+				index.RemoveEntry(t, i, d);
+				number = 0;
+				continue;
+			}
+
+			uint32_t added = index.AddEntry(t, i, d);
+
+			if (number && added != number) {
+				success = false;
+			}
+
+			number = added;
+		}
+
+		// Whole leaves become empty.
+		for (int t = 1000; t < 1500; t++) {
+			for (int i = 0; i < IndexCount; i++) {
+				for (int d = 0; d < 2; d++) {
+					index.RemoveEntry(t, i, d);
+					reference->Numbers[t][i][d] = 0;
+				}
+			}
+		}
+
+		if (!CheckEntries(index, *reference)) {
+			success = false;
+		}
+
+		if (!CheckOrder(index, *reference)) {
+			success = false;
+		}
+	}
+
+	{
+		MessageStorageIndex index(IndexPath);
+
+		if (!CheckEntries(index, *reference)) {
+			success = false;
+		}
+
+		if (!CheckOrder(index, *reference)) {
+			success = false;
+		}
+	}
+
+	delete reference;
+	RemoveFile(IndexPath);
+
+	Report(success);
+}
+
+// Node of the binary tree index of earlier versions.
+struct LegacyNode
+{
+	struct
+	{
+		int64_t Timestamp;
+		int32_t Index;
+		uint8_t Incoming;
+	} Value;
+
+	int8_t Valid;
+
+	uint32_t This;
+	uint32_t Left;
+	uint32_t Right;
+	uint32_t Parent;
+	uint32_t Depth;
+};
+
+void TestUpgrade()
+{
+	printf("Test upgrade.\n");
+
+	RemoveFile(IndexPath);
+
+	const uint32_t nodeCount = 1000;
+
+	{
+		BinaryFile file(IndexPath, true);
+		LegacyNode *nodes = new LegacyNode[nodeCount];
+		memset(nodes, 0, sizeof(LegacyNode) * nodeCount);
+
+		// Tree links are not used by the upgrade.
+		for (uint32_t i = 1; i < nodeCount; i++) {
+			nodes[i].Value.Timestamp = (i * 7919) % nodeCount;
+			nodes[i].Value.Index = 0;
+			nodes[i].Value.Incoming = i % 2;
+			nodes[i].Valid = i % 10 ? 1 : 0;
+			nodes[i].This = i;
+		}
+
+		file.Write<LegacyNode>(nodes, nodeCount, 0);
+		delete[] nodes;
+	}
+
+	bool success = true;
+
+	{
+		MessageStorageIndex index(IndexPath);
+
+		for (uint32_t i = 1; i < nodeCount; i++) {
+			uint32_t number = index.FindEntry(
+				(i * 7919) % nodeCount,
+				0,
+				i % 2);
+
+			if (number != (i % 10 ? i : 0)) {
+				success = false;
+			}
+		}
+
+		int64_t previous = -1;
+		uint32_t count = 0;
+
+		for (
+			uint32_t position = index.FindSmallest(0);
+			position;
+			position = index.Next(position))
+		{
+			int64_t timestamp;
+			int32_t entryIndex;
+			bool incoming;
+
+			index.GetEntry(position, timestamp, entryIndex, incoming);
+
+			if (timestamp <= previous) {
+				success = false;
+			}
+
+			previous = timestamp;
+			count++;
+		}
+
+		if (count != nodeCount - 1 - (nodeCount - 1) / 10) {
+			success = false;
+		}
+
+		if (index.AddEntry(nodeCount, 0, false) != nodeCount) {
+			success = false;
+		}
+	}
+
+	RemoveFile(IndexPath);
+
+	Report(success);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static uint64_t FileSize(const char *path)
+{
+	BinaryFile file(path, false);
+	return file.Size();
+}
+
+void Benchmark(int64_t count)
+{
+	RemoveFile(IndexPath);
+
+	int64_t start = GetTime();
+
+	{
+		MessageStorageIndex index(IndexPath);
+
+		for (int64_t i = 0; i < count; i++) {
+			index.AddEntry(i / 2, 0, i % 2);
+		}
+	}
+
+	int64_t insertTime = GetTime() - start;
+
+	const int lookupCount = 100000;
+	srand(2);
+	start = GetTime();
+
+	{
+		MessageStorageIndex index(IndexPath);
+
+		for (int i = 0; i < lookupCount; i++) {
+			int64_t i2 = ((int64_t)rand() * RAND_MAX + rand()) % count;
+			index.FindEntry(i2 / 2, 0, i2 % 2);
+		}
+	}
+
+	int64_t lookupTime = GetTime() - start;
+
+	int64_t scanned = 0;
+	start = GetTime();
+
+	{
+		MessageStorageIndex index(IndexPath);
+
+		for (
+			uint32_t position = index.FindSmallest(0);
+			position;
+			position = index.Next(position))
+		{
+			scanned++;
+		}
+	}
+
+	int64_t scanTime = GetTime() - start;
+
+	// Storage engines open the index for each message.
+	const int appendCount = 10000;
+	start = GetTime();
+
+	for (int i = 0; i < appendCount; i++) {
+		MessageStorageIndex index(IndexPath);
+		index.AddEntry(count + i, 0, false);
+		index.Flush();
+	}
+
+	int64_t appendTime = GetTime() - start;
+
+	printf(
+		"%lld entries, %.1f MB: insert %.0f entries/s, "
+		"lookup %.1f us, scan %.0f entries/s, "
+		"open and append %.1f us.\n",
+		(long long)count,
+		FileSize(IndexPath) / 1e6,
+		count / (insertTime / 1e9),
+		lookupTime / 1e3 / lookupCount,
+		scanned / (scanTime / 1e9),
+		appendTime / 1e3 / appendCount);
+
+	if (scanned != count) {
+		printf("Lost entries.\n");
+	}
+
+	RemoveFile(IndexPath);
+}
+
+int main(int argc, char **argv)
+{
+	TestIndex();
+	TestUpgrade();
+
+	Benchmark(argc > 1 ? atoll(argv[1]) : 1000000);
+
+	return 0;
+}
@@ -0,0 +1,283 @@
+#include <time.h>
+#include <cstdio>
+#include <cstring>
+
+#include "../src/Common/MyString.hpp"
+#include "../src/Common/Hex.hpp"
+
+// Checks local and shared string storage, formatting of numbers and
+// hex, and measures construction of the paths AddMessage uses.
+
+static void Report(bool success)
+{
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+void TestStorage()
+{
+	printf("Test storage.\n");
+
+	bool success = true;
+
+	char text[301];
+
+	for (int i = 0; i < 300; i++) {
+		text[i] = 'a' + i % 26;
+	}
+
+	text[300] = 0;
+
+	// Every length from local to shared storage, built by
+	// appending and by copying.
+	String appended;
+
+	for (int length = 1; length <= 300; length++) {
+		appended += text[length - 1];
+
+		String copy = appended;
+		String constructed(text, length);
+
+		if (copy.Length() != length ||
+			!(copy == constructed) ||
+			strncmp(copy.CStr(), text, length) ||
+			copy.CStr()[length])
+		{
+			success = false;
+		}
+	}
+
+	// Copy of shared string is not changed through the original.
+	String original(text);
+	String copy = original;
+	original += "tail";
+
+	if (copy.Length() != 300 || original.Length() != 304) {
+		success = false;
+	}
+
+	String replaced = copy.Replace('a', 'A');
+
+	if (copy.CStr()[0] != 'a' || replaced.CStr()[0] != 'A') {
+		success = false;
+	}
+
+	String self = "abc";
+	self += self;
+	self += self;
+
+	if (!(self == "abcabcabcabc")) {
+		success = false;
+	}
+
+	String moved = static_cast<String&&>(original);
+
+	if (moved.Length() != 304 || original.Length()) {
+		success = false;
+	}
+
+	CowBuffer<String> parts = String(" a,,b ").Trim().Split(',', true);
+
+	if (parts.Size() != 2 || !(parts[0] == "a") || !(parts[1] == "b")) {
+		success = false;
+	}
+
+	Report(success);
+}
+
+void TestFormatting()
+{
+	printf("Test formatting.\n");
+
+	bool success = true;
+
+	if (!(ToString(0) == "0") ||
+		!(ToString(7) == "7") ||
+		!(ToString(42) == "42") ||
+		!(ToString(-105) == "-105") ||
+		!(ToString(2147483647) == "2147483647") ||
+		!(ToString(-2147483647 - 1) == "-2147483648"))
+	{
+		success = false;
+	}
+
+	StringBuilder builder;
+	builder.AppendInt(-9223372036854775807ll - 1);
+
+	if (!(builder.Build() == "-9223372036854775808")) {
+		success = false;
+	}
+
+	uint8_t data[37];
+
+	for (int i = 0; i < 37; i++) {
+		data[i] = i * 7 + 3;
+	}
+
+	const char digits[] = "0123456789abcdef";
+
+	for (int size = 0; size <= 37; size++) {
+		String hex = DataToHex(data, size);
+
+		if (hex.Length() != size * 2) {
+			success = false;
+			continue;
+		}
+
+		for (int i = 0; i < size; i++) {
+			bool valid =
+				hex.CStr()[i * 2] == digits[data[i] >> 4] &&
+				hex.CStr()[i * 2 + 1] == digits[data[i] & 0xf];
+
+			if (!valid) {
+				success = false;
+			}
+		}
+
+		uint8_t decoded[37];
+		HexToData(hex, decoded);
+
+		if (memcmp(decoded, data, size)) {
+			success = false;
+		}
+	}
+
+	int64_t value = 0x0123456789abcdefll;
+
+	if (!(ToHex(value) == "0123456789abcdef") ||
+		HexToInt<int64_t>(ToHex(value)) != value ||
+		!(ToHex((int32_t)-2) == "fffffffe"))
+	{
+		success = false;
+	}
+
+	Report(success);
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static int64_t GetAllocations()
+{
+	MemoryPool::Statistics statistics;
+	MemoryPool::GetStatistics(statistics);
+	return statistics.Hits + statistics.Misses + statistics.Large;
+}
+
+// Directories, message file and index paths of one stored message,
+// built with concatenation.
+static int64_t BuildPathsConcat(
+	const uint8_t *ownerKey,
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index)
+{
+	String peerKeyHex = DataToHex(peerKey, 32);
+	String ownerKeyHex = DataToHex(ownerKey, 32);
+
+	String entryPath = "storage";
+	int64_t length = entryPath.Length();
+	entryPath += "/" + ownerKeyHex;
+	length += entryPath.Length();
+	entryPath += "/storage";
+	length += entryPath.Length();
+	entryPath += "/" + peerKeyHex;
+	length += entryPath.Length();
+	entryPath += "/out";
+	length += entryPath.Length();
+
+	entryPath += "/" + ToHex(timestamp) + "_" + ToHex(index);
+	length += entryPath.Length();
+
+	String indexPath = "storage/" + ownerKeyHex + "/storage/" +
+		peerKeyHex + "/index";
+
+	return length + indexPath.Length();
+}
+
+// Same paths built with reserved builders.
+static int64_t BuildPathsBuilder(
+	const uint8_t *ownerKey,
+	const uint8_t *peerKey,
+	int64_t timestamp,
+	int32_t index)
+{
+	StringBuilder path(176);
+	path.Append("storage");
+	int64_t length = path.GetString().Length();
+	path.Append('/');
+	path.AppendHex(ownerKey, 32);
+	length += path.GetString().Length();
+	path.Append("/storage");
+	length += path.GetString().Length();
+	path.Append('/');
+	path.AppendHex(peerKey, 32);
+	length += path.GetString().Length();
+	path.Append("/out");
+	length += path.GetString().Length();
+
+	path.Append('/');
+	path.AppendHex(timestamp);
+	path.Append('_');
+	path.AppendHex(index);
+	String entryPath = path.Build();
+	length += entryPath.Length();
+
+	StringBuilder indexPath(176);
+	indexPath.Append("storage/");
+	indexPath.AppendHex(ownerKey, 32);
+	indexPath.Append("/storage/");
+	indexPath.AppendHex(peerKey, 32);
+	indexPath.Append("/index");
+
+	return length + indexPath.Build().Length();
+}
+
+template <typename F>
+void BenchmarkPaths(const char *name, F build)
+{
+	uint8_t ownerKey[32];
+	uint8_t peerKey[32];
+
+	memset(ownerKey, 0x5a, 32);
+	memset(peerKey, 0xc3, 32);
+
+	const int64_t count = 200000;
+	int64_t length = 0;
+
+	int64_t allocations = GetAllocations();
+	int64_t start = GetTime();
+
+	for (int64_t i = 0; i < count; i++) {
+		length += build(ownerKey, peerKey, 1700000000 + i, i & 3);
+	}
+
+	int64_t time = GetTime() - start;
+	allocations = GetAllocations() - allocations;
+
+	printf(
+		"Paths of AddMessage, %s: %.0f ns, %.1f allocations "
+		"(%ld bytes built).\n",
+		name,
+		(double)time / count,
+		(double)allocations / count,
+		length / count);
+}
+
+int main(int argc, char **argv)
+{
+	TestStorage();
+	TestFormatting();
+
+	BenchmarkPaths("concatenation", BuildPathsConcat);
+	BenchmarkPaths("builder", BuildPathsBuilder);
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "../src/Common/TimerWheel.hpp"
+
+// Compares timer wheel against plain scan over all timers.
+void TestRandomTimers()
+{
+	printf("Test random timers.\n");
+
+	const int timerCount = 1000;
+	Timer timers[timerCount];
+	bool armed[timerCount];
+	bool fired[timerCount];
+
+	int64_t now = 123456789;
+	TimerWheel wheel(now);
+
+	for (int i = 0; i < timerCount; i++) {
+		timers[i].Data = &timers[i];
+		armed[i] = false;
+		fired[i] = false;
+	}
+
+	bool success = true;
+	srand(1);
+
+	for (int iter = 0; iter < 200000 && success; iter++) {
+		int index = rand() % timerCount;
+		int action = rand() % 4;
+
+		if (action == 0) {
+			int64_t range = (int64_t)1 << (rand() % 34);
+			int64_t expiry = now + rand() % range;
+			wheel.Add(&timers[index], expiry);
+			armed[index] = true;
+		} else if (action == 1) {
+			wheel.Remove(&timers[index]);
+			armed[index] = false;
+		} else {
+			int64_t timeout = wheel.GetTimeout(now);
+
+			if (timeout < 0) {
+				timeout = 1000;
+			}
+
+			now += timeout + rand() % 3;
+			wheel.Advance(now);
+
+			Timer *timer = wheel.GetExpired();
+
+			while (timer) {
+				fired[(Timer*)timer->Data - timers] = true;
+				timer = wheel.GetExpired();
+			}
+
+			for (int i = 0; i < timerCount; i++) {
+				bool due = armed[i] && timers[i].Expiry <= now;
+
+				if (due != fired[i]) {
+					success = false;
+				}
+
+				if (armed[i] && timers[i].Armed() == due) {
+					success = false;
+				}
+
+				if (due) {
+					armed[i] = false;
+				}
+
+				fired[i] = false;
+			}
+		}
+	}
+
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+// Next timeout must not skip the nearest expiry.
+void TestTimeout()
+{
+	printf("Test timeout.\n");
+
+	int64_t now = 1000;
+	TimerWheel wheel(now);
+
+	bool success = wheel.GetTimeout(now) == -1;
+
+	Timer timer;
+	wheel.Add(&timer, now + 5000);
+
+	while (timer.Armed() && success) {
+		int timeout = wheel.GetTimeout(now);
+
+		if (timeout < 0 || now + timeout > 6000) {
+			success = false;
+		}
+
+		now += timeout;
+		wheel.Advance(now);
+
+		if (wheel.GetExpired() == &timer && now != 6000) {
+			success = false;
+		}
+	}
+
+	if (!success || now != 6000) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	TestRandomTimers();
+	TestTimeout();
+
+	return 0;
+}
@@ -1,4 +1,8 @@
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <cstdio>
 #include <cstring>
 
@@ -84,10 +88,303 @@ void TimingTest()
 		averageNotExistingTime / iterationsNotExist);
 
 	unlink("talkd.users");
+	unlink("talkd.users.floor");
+}
+
+// Size of user record and offset of name in it.
+static const int EntrySize =
+	1 + KEY_SIZE + SIGNATURE_PUBLIC_KEY_SIZE + sizeof(int64_t) + 55;
+static const int NameOffset =
+	1 + KEY_SIZE + SIGNATURE_PUBLIC_KEY_SIZE + sizeof(int64_t);
+
+static void GetKey(int index, uint8_t *key)
+{
+	memset(key, 0x21, KEY_SIZE);
+	memcpy(key + 3, &index, sizeof(index));
+}
+
+void PersistenceTest()
+{
+	printf("Persistence test.\n");
+
+	bool success = true;
+	const int count = 3000;
+
+	uint8_t key[KEY_SIZE];
+	const uint8_t *removedKey = nullptr;
+
+	{
+		UserDB db;
+
+		for (int i = 0; i < count; i++) {
+			GetKey(i, key);
+			db.AddUser(key, key, i, "user " + ToString(i));
+		}
+
+		// Key pointer outlives the user and its reused record.
+		GetKey(7, key);
+		removedKey = db.GetUserPublicKey(key);
+
+		for (int i = 0; i < count; i += 3) {
+			GetKey(i, key);
+			db.RemoveUser(key);
+		}
+
+		GetKey(count, key);
+		db.AddUser(key, key, 5, "new user");
+		db.UpdateUserAccessTime(key, 100);
+
+		GetKey(7, key);
+
+		if (memcmp(removedKey, key, KEY_SIZE)) {
+			success = false;
+		}
+	}
+
+	UserDB db;
+
+	if (db.GetUserCount() != count - count / 3 + 1) {
+		success = false;
+	}
+
+	for (int i = 0; i <= count; i++) {
+		GetKey(i, key);
+
+		bool expected = i % 3 != 0 || i == count;
+
+		if (db.HasUser(key) != expected) {
+			success = false;
+			continue;
+		}
+
+		if (!expected || i == count) {
+			continue;
+		}
+
+		bool valid =
+			!memcmp(db.GetUserSignature(key), key, KEY_SIZE) &&
+			db.GetUserAccessTime(key) == i &&
+			db.GetUserName(key) == "user " + ToString(i);
+
+		if (!valid) {
+			success = false;
+		}
+	}
+
+	// New user took a free record.
+	CowBuffer<const uint8_t*> users = db.ListUsers();
+	GetKey(count, key);
+
+	struct stat info;
+	stat("talkd.users", &info);
+
+	if ((int32_t)users.Size() != db.GetUserCount() ||
+		info.st_size != count * EntrySize ||
+		db.GetUserAccessTime(key) != 100)
+	{
+		success = false;
+	}
+
+	unlink("talkd.users");
+	unlink("talkd.users.floor");
+
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+static int64_t GetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static int64_t ReadAccessTime(int index)
+{
+	int64_t accessTime = 0;
+	int fd = open("talkd.users", O_RDONLY);
+
+	pread(
+		fd,
+		&accessTime,
+		sizeof(accessTime),
+		index * EntrySize + NameOffset - sizeof(accessTime));
+	close(fd);
+
+	return accessTime;
+}
+
+// Repeated logins are written once per flush, times later than the
+// floor are written at once and buffered times survive a crash.
+void AccessTimeTest()
+{
+	printf("Access time test.\n");
+
+	bool success = true;
+	const int count = 1000;
+	int64_t now = GetUnixTime();
+
+	uint8_t key[KEY_SIZE];
+
+	{
+		UserDB db;
+
+		for (int i = 0; i < count; i++) {
+			GetKey(i, key);
+			db.AddUser(key, key, i, "user");
+		}
+
+		db.FlushAccessTimes(now);
+
+		for (int round = 1; round <= 3; round++) {
+			for (int i = 0; i < count; i++) {
+				GetKey(i, key);
+				db.UpdateUserAccessTime(key, now - 100 + round);
+			}
+		}
+
+		GetKey(10, key);
+
+		if (db.GetUserAccessTime(key) != now - 97 ||
+			ReadAccessTime(10) != 10)
+		{
+			success = false;
+		}
+
+		db.FlushAccessTimes(now);
+
+		UserDB::AccessTimeStatistics statistics;
+		db.GetAccessTimeStatistics(statistics);
+
+		if (statistics.Updates != count * 3 ||
+			statistics.Immediate != 0 ||
+			statistics.Written != count ||
+			ReadAccessTime(10) != now - 97)
+		{
+			success = false;
+		}
+
+		db.UpdateUserAccessTime(key, now + 100000);
+
+		if (ReadAccessTime(10) != now + 100000) {
+			success = false;
+		}
+	}
+
+	// Child dies with buffered update.
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		UserDB db;
+		db.FlushAccessTimes(now);
+
+		GetKey(20, key);
+		db.UpdateUserAccessTime(key, now - 10);
+
+		_exit(0);
+	}
+
+	waitpid(pid, nullptr, 0);
+
+	{
+		UserDB db;
+
+		GetKey(20, key);
+
+		if (ReadAccessTime(20) != now - 97 ||
+			db.GetUserAccessTime(key) < now - 10)
+		{
+			success = false;
+		}
+
+		// Floor applies to all users.
+		GetKey(30, key);
+
+		if (db.GetUserAccessTime(key) < now) {
+			success = false;
+		}
+	}
+
+	unlink("talkd.users");
+	unlink("talkd.users.floor");
+
+	if (!success) {
+		printf("Failure.\n");
+	} else {
+		printf("Success.\n");
+	}
+}
+
+// User file is written directly, then loaded and queried.
+void StartupBenchmark(int count)
+{
+	const int batch = 4096;
+
+	uint8_t *records = new uint8_t[EntrySize * batch];
+	memset(records, 0, EntrySize * batch);
+
+	int fd = open("talkd.users", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	for (int i = 0; i < count; i += batch) {
+		int size = count - i < batch ? count - i : batch;
+
+		for (int j = 0; j < size; j++) {
+			uint8_t *record = records + j * EntrySize;
+			record[0] = 1;
+			GetKey(i + j, record + 1);
+			memcpy(record + NameOffset, "user", 5);
+		}
+
+		if (write(fd, records, EntrySize * size) != EntrySize * size) {
+			printf("Failed to write user file.\n");
+		}
+	}
+
+	close(fd);
+	delete[] records;
+
+	int64_t start = GetTime();
+	UserDB *db = new UserDB;
+	int64_t loadTime = GetTime() - start;
+
+	const int lookupCount = 1000000;
+	uint8_t key[KEY_SIZE];
+	uint32_t random = 1;
+	int found = 0;
+
+	start = GetTime();
+
+	for (int i = 0; i < lookupCount; i++) {
+		random = random * 1103515245 + 12345;
+		GetKey((random >> 4) % (count * 2), key);
+		found += db->HasUser(key);
+	}
+
+	int64_t lookupTime = GetTime() - start;
+
+	printf(
+		"%d users: load %.1f ms, lookup %.0f ns (%d%% found).\n",
+		count,
+		loadTime / 1000000.0,
+		(double)lookupTime / lookupCount,
+		found * 100 / lookupCount);
+
+	delete db;
+	unlink("talkd.users");
+	unlink("talkd.users.floor");
 }
 
 int main(int argc, char **argv)
 {
 	TimingTest();
+	PersistenceTest();
+	AccessTimeTest();
+
+	StartupBenchmark(10000);
+	StartupBenchmark(1000000);
+
 	return 0;
 }